@@ -312,6 +312,40 @@ static int parse_settings(void *log_ctx, AVTAddress *addr,
                 addr->opts.tx_buf = res;
             else if (!strcmp(key, "rx_buf"))
                 addr->opts.rx_buf = res;
+        } else if (!strcmp(key, "gso") || !strcmp(key, "gro") ||
+                   !strcmp(key, "zerocopy")) {
+            long res = strtol(val, &end, 10);
+            if ((end == val) || (res < 0) || (res > 1)) {
+                avt_log(log_ctx, AVT_LOG_ERROR, "Invalid option %s value: %s\n", key, val);
+                return AVT_ERROR(EINVAL);
+            }
+
+            if (!strcmp(key, "gso"))
+                addr->opts.gso = res;
+            else if (!strcmp(key, "gro"))
+                addr->opts.gro = res;
+            else if (!strcmp(key, "zerocopy"))
+                addr->opts.zerocopy = res;
+        } else if (!strcmp(key, "pacing")) {
+            if (!strcmp(val, "none")) {
+                addr->opts.pacing = AVT_ADDRESS_PACING_NONE;
+            } else if (!strcmp(val, "txtime")) {
+                addr->opts.pacing = AVT_ADDRESS_PACING_TXTIME;
+            } else if (!strcmp(val, "user")) {
+                addr->opts.pacing = AVT_ADDRESS_PACING_USER;
+            } else {
+                avt_log(log_ctx, AVT_LOG_ERROR, "Invalid option %s value: %s\n", key, val);
+                return AVT_ERROR(EINVAL);
+            }
+        } else if (!strcmp(key, "pacing_clock")) {
+            if (!strcmp(val, "monotonic")) {
+                addr->opts.pacing_clock = AVT_ADDRESS_CLOCK_MONOTONIC;
+            } else if (!strcmp(val, "tai")) {
+                addr->opts.pacing_clock = AVT_ADDRESS_CLOCK_TAI;
+            } else {
+                avt_log(log_ctx, AVT_LOG_ERROR, "Invalid option %s value: %s\n", key, val);
+                return AVT_ERROR(EINVAL);
+            }
         } else if (!strcmp(key, "certfile") || !strcmp(key, "keyfile")) {
             char *dupd = strdup(val);
             if (!dupd)
@@ -337,6 +371,22 @@ static int parse_settings(void *log_ctx, AVTAddress *addr,
     if (addr->opts.tx_buf)
         snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
                  "      tx_buf: %i\n", addr->opts.tx_buf);
+    if (addr->opts.gso)
+        snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
+                 "      gso: enabled\n");
+    if (addr->opts.gro)
+        snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
+                 "      gro: enabled\n");
+    if (addr->opts.zerocopy)
+        snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
+                 "      zerocopy: enabled\n");
+    if (addr->opts.pacing)
+        snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
+                 "      pacing: %s\n",
+                 addr->opts.pacing == AVT_ADDRESS_PACING_TXTIME ? "txtime" : "user");
+    if (addr->opts.pacing_clock)
+        snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
+                 "      pacing clock: tai\n");
     if (addr->opts.nb_default_sid) {
         snprintf(&opts_buf[strlen(opts_buf)], opts_buf_size - strlen(opts_buf),
                  "      default streams: ");
@@ -642,6 +692,12 @@ int avt_addr_from_info(void *log_ctx, AVTAddress *addr, AVTConnectionInfo *info)
         break;
     };
 
+    addr->opts.coalesce = info->output_opts.coalesce;
+    addr->opts.coalesce_latency = info->output_opts.coalesce_latency;
+    addr->opts.direct_io = info->output_opts.direct_io;
+    addr->opts.sync_bytes = info->output_opts.sync_bytes;
+    addr->opts.sync_period = info->output_opts.sync_period;
+
     return 0;
 }
 
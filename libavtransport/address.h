@@ -47,6 +47,17 @@ enum AVTAddressConnection {
     AVT_ADDRESS_CALLBACK,
 };
 
+enum AVTAddressPacing {
+    AVT_ADDRESS_PACING_NONE,
+    AVT_ADDRESS_PACING_TXTIME, /* Kernel, via launch times */
+    AVT_ADDRESS_PACING_USER,   /* Sleep before sending */
+};
+
+enum AVTAddressClock {
+    AVT_ADDRESS_CLOCK_MONOTONIC, /* As used by the fq qdisc */
+    AVT_ADDRESS_CLOCK_TAI,       /* As required by the etf qdisc */
+};
+
 typedef struct AVTCallbacksPacket {
     void *opaque;
     int (*out)(void *opaque, union AVTPacketData pkt, AVTBuffer *buf);
@@ -92,6 +103,30 @@ typedef struct AVTAddress {
         int rx_buf;
         int tx_buf;
 
+        /* Use UDP segmentation offload */
+        bool gso;
+
+        /* Use UDP receive offload */
+        bool gro;
+
+        /* Send large messages without copying their data */
+        bool zerocopy;
+
+        /* Space out packets on the wire, with launch times on a clock */
+        enum AVTAddressPacing pacing;
+        enum AVTAddressClock pacing_clock;
+
+        /* Write coalescing staging buffer size and latency cap (1ns timebase) */
+        size_t coalesce;
+        int64_t coalesce_latency;
+
+        /* Bypass the page cache for files */
+        bool direct_io;
+
+        /* File durability policy (1ns timebase) */
+        size_t sync_bytes;
+        int64_t sync_period;
+
         /* Default stream IDs */
         uint16_t *default_sid;
         int nb_default_sid;
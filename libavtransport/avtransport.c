@@ -32,16 +32,20 @@
 #include <avtransport/version.h>
 
 #include "common.h"
+#include "cpu.h"
 
 int avt_init(AVTContext **ctx, AVTContextOptions *opts)
 {
-    AVTContext *tmp = malloc(sizeof(*tmp));
+    AVTContext *tmp = calloc(1, sizeof(*tmp));
     if (!tmp)
         return AVT_ERROR(ENOMEM);
 
     if (opts)
         tmp->opts = *opts;
 
+    /* Select kernels upfront */
+    avt_cpu_get_flags();
+
     *ctx = tmp;
     return 0;
 }
@@ -31,6 +31,34 @@
 #include "buffer.h"
 #include "utils_internal.h"
 
+uint8_t *avt_buffer_quick_alloc_aligned(AVTBuffer *buf, size_t len,
+                                        size_t align, size_t headroom)
+{
+    if (align & (align - 1))
+        return NULL;
+
+    size_t size;
+    if (ckd_add(&size, sizeof(AVTBufferCtrl), headroom) ||
+        ckd_add(&size, size, len) ||
+        (align && ckd_add(&size, size, align - 1)))
+        return NULL;
+
+    AVTBufferCtrl *ctrl = malloc(size);
+    if (!ctrl)
+        return NULL;
+
+    uint8_t *data = (uint8_t *)(ctrl + 1) + headroom;
+    if (align)
+        data = (uint8_t *)(((uintptr_t)data + align - 1) & ~(uintptr_t)(align - 1));
+
+    avt_buffer_init_ctrl(buf, ctrl, data - headroom, headroom + len,
+                         NULL, NULL, 0);
+    buf->data = data;
+    buf->len = len;
+
+    return data;
+}
+
 AVT_API AVTBuffer *avt_buffer_create(uint8_t *data, size_t len,
                                      void *opaque, avt_free_cb free_cb)
 {
@@ -67,7 +95,6 @@ int avt_buffer_resize(AVTBuffer *buf, size_t len)
 
     /* Sanity checking */
     avt_assert0(avt_buffer_get_refcount(buf) == 1);
-    avt_assert0(buf->free == avt_buffer_default_free);
 
     /* Account for data before the current ref's slice */
     size_t tmp;
@@ -75,9 +102,38 @@ int avt_buffer_resize(AVTBuffer *buf, size_t len)
     if (ckd_add(&tmp, len, pre_data))
         return AVT_ERROR(EINVAL);
 
-    uint8_t *newdata = realloc(buf->base_data, tmp);
-    if (!newdata)
-        return AVT_ERROR(ENOMEM);
+    AVTBufferCtrl *ctrl = buf->ctrl;
+    size_t old_size = buf->end_data - buf->base_data;
+    uint8_t *newdata;
+
+    if (ctrl->free == avt_buffer_default_free) {
+        newdata = realloc(buf->base_data, tmp);
+        if (!newdata)
+            return AVT_ERROR(ENOMEM);
+    } else if (ctrl->flags & AVT_BUFFER_CTRL_INLINE) {
+        /* The control block goes away with the memory, so move both */
+        AVTBuffer new = { };
+        newdata = avt_buffer_quick_alloc(&new, tmp);
+        if (!newdata)
+            return AVT_ERROR(ENOMEM);
+
+        memcpy(newdata, buf->base_data, AVT_MIN(old_size, tmp));
+        new.flags = buf->flags;
+        avt_buffer_quick_unref(buf);
+        *buf = new;
+    } else {
+        /* Memory we do not own, or which was allocated along with the
+         * control block. Move it out. */
+        newdata = malloc(tmp);
+        if (!newdata)
+            return AVT_ERROR(ENOMEM);
+
+        memcpy(newdata, buf->base_data, AVT_MIN(old_size, tmp));
+        if (ctrl->free)
+            ctrl->free(ctrl->opaque, buf->base_data, old_size);
+        ctrl->free = avt_buffer_default_free;
+        ctrl->opaque = NULL;
+    }
 
     buf->base_data = newdata;
     buf->data      = newdata + pre_data;
@@ -94,13 +150,18 @@ void avt_buffer_default_free(void *opaque, void *base_data, size_t len)
 
 AVTBuffer *avt_buffer_alloc(size_t len)
 {
-    void *alloc = malloc(len);
-    if (!alloc)
+    return avt_buffer_alloc_aligned(len, 0, 0);
+}
+
+AVTBuffer *avt_buffer_alloc_aligned(size_t len, size_t align,
+                                    size_t headroom)
+{
+    AVTBuffer *buf = malloc(sizeof(*buf));
+    if (!buf)
         return NULL;
 
-    AVTBuffer *buf = avt_buffer_create(alloc, len, NULL, avt_buffer_default_free);
-    if (!buf) {
-        free(alloc);
+    if (!avt_buffer_quick_alloc_aligned(buf, len, align, headroom)) {
+        free(buf);
         return NULL;
     }
 
@@ -109,7 +170,7 @@ AVTBuffer *avt_buffer_alloc(size_t len)
 
 AVTBuffer *avt_buffer_ref(AVTBuffer *buf, ptrdiff_t offset, size_t len)
 {
-    if (!buf || !buf->refcnt)
+    if (!buf || !buf->ctrl)
         return NULL;
 
     if (!len)
@@ -123,7 +184,7 @@ AVTBuffer *avt_buffer_ref(AVTBuffer *buf, ptrdiff_t offset, size_t len)
     if (!ret)
         return NULL;
 
-    atomic_fetch_add_explicit(buf->refcnt, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&buf->ctrl->refcnt, 1, memory_order_relaxed);
 
     memcpy(ret, buf, sizeof(*ret));
 
@@ -135,25 +196,28 @@ AVTBuffer *avt_buffer_ref(AVTBuffer *buf, ptrdiff_t offset, size_t len)
 
 int avt_buffer_offset(AVTBuffer *buf, ptrdiff_t offset)
 {
-    if (buf->base_data + offset > buf->end_data)
+    if ((buf->data + offset < buf->base_data) ||
+        (buf->data + offset > buf->end_data))
         return AVT_ERROR(EINVAL);
 
+    /* Keep the end of the view */
     buf->data += offset;
+    buf->len = offset > (ptrdiff_t)buf->len ? 0 : buf->len - offset;
 
     return 0;
 }
 
 int avt_buffer_get_refcount(AVTBuffer *buf)
 {
-    if (!buf || !buf->refcnt)
+    if (!buf || !buf->ctrl)
         return 0;
 
-    return atomic_load_explicit(buf->refcnt, memory_order_relaxed);
+    return atomic_load_explicit(&buf->ctrl->refcnt, memory_order_relaxed);
 }
 
 void *avt_buffer_get_data(AVTBuffer *buf, size_t *len)
 {
-    if (!buf || !buf->refcnt) {
+    if (!buf || !buf->ctrl) {
         if (len)
             *len = 0;
         return NULL;
@@ -166,7 +230,7 @@ void *avt_buffer_get_data(AVTBuffer *buf, size_t *len)
 
 size_t avt_buffer_get_data_len(const AVTBuffer *buf)
 {
-    if (!buf || !buf->refcnt)
+    if (!buf || !buf->ctrl)
         return 0;
 
     return buf->len;
@@ -180,7 +244,7 @@ bool avt_buffer_read_only(AVTBuffer *buffer)
 void avt_buffer_unref(AVTBuffer **_buf)
 {
     AVTBuffer *buf = *_buf;
-    if (!buf || !buf->refcnt)
+    if (!buf || !buf->ctrl)
         return;
 
     avt_buffer_quick_unref(buf);
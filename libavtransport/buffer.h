@@ -28,6 +28,8 @@
 #define LIBAVTRANSPORT_BUFFER
 
 #include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -38,6 +40,21 @@ enum AVTBufferFlags {
     AVT_BUFFER_FLAG_READ_ONLY = 1 << 0,
 };
 
+enum AVTBufferCtrlFlags {
+    /* The control block lives in the memory released by the free callback */
+    AVT_BUFFER_CTRL_INLINE = 1 << 0,
+};
+
+/* State shared by all references to a buffer.
+ * If free is NULL, the data was allocated along with the control block,
+ * and is freed with it. */
+typedef struct AVTBufferCtrl {
+    alignas(max_align_t) atomic_int refcnt;
+    enum AVTBufferCtrlFlags flags;
+    avt_free_cb free;
+    void *opaque;
+} AVTBufferCtrl;
+
 struct AVTBuffer {
     uint8_t *data;      /* Current ref's view of the buffer */
     size_t len;         /* Current ref's size of the view of the buffer */
@@ -45,63 +62,89 @@ struct AVTBuffer {
     uint8_t *base_data; /* Buffer's actual start data */
     uint8_t *end_data;  /* Buffer's end of data */
 
-    avt_free_cb free;
-    void *opaque;
+    AVTBufferCtrl *ctrl;
     enum AVTBufferFlags flags;
-    atomic_int *refcnt;
 };
 
 void avt_buffer_update(AVTBuffer *buf, void *data, size_t len);
+
+/* Resize a buffer with a single reference.
+ * Alignment and headroom are not kept if the buffer has to grow. */
 int avt_buffer_resize(AVTBuffer *buf, size_t len);
 
+static inline void avt_buffer_init_ctrl(AVTBuffer *buf, AVTBufferCtrl *ctrl,
+                                        uint8_t *data, size_t len,
+                                        void *opaque, avt_free_cb free_cb,
+                                        enum AVTBufferCtrlFlags ctrl_flags)
+{
+    atomic_init(&ctrl->refcnt, 1);
+    ctrl->flags = ctrl_flags;
+    ctrl->free = free_cb;
+    ctrl->opaque = opaque;
+
+    buf->base_data = data;
+    buf->end_data = data + len;
+    buf->data = data;
+    buf->len = len;
+    buf->ctrl = ctrl;
+    buf->flags = 0;
+}
+
 static inline int avt_buffer_quick_create(AVTBuffer *buf, uint8_t *data,
                                           size_t len, void *opaque,
                                           avt_free_cb free_cb,
                                           enum AVTBufferFlags flags)
 {
-    buf->refcnt = malloc(sizeof(*buf->refcnt));
-    if (!buf->refcnt)
+    AVTBufferCtrl *ctrl = malloc(sizeof(*ctrl));
+    if (!ctrl)
         return AVT_ERROR(ENOMEM);
 
-    atomic_init(buf->refcnt, 1);
-
-    buf->base_data = data;
-    buf->end_data = data + len;
-    buf->data = data;
-    buf->len = len;
-    buf->opaque = opaque;
-    if (!free_cb)
-        buf->free = avt_buffer_default_free;
-    else
-        buf->free = free_cb;
+    avt_buffer_init_ctrl(buf, ctrl, data, len, opaque,
+                         free_cb ? free_cb : avt_buffer_default_free, 0);
+    buf->flags = flags;
 
     return 0;
 }
 
+/* Allocate a buffer, with the data following the control block */
 static inline uint8_t *avt_buffer_quick_alloc(AVTBuffer *buf, size_t len)
 {
-    void *alloc = malloc(len);
-    if (!alloc)
+    if (len > (SIZE_MAX - sizeof(AVTBufferCtrl)))
         return NULL;
 
-    int err = avt_buffer_quick_create(buf, alloc, len, NULL,
-                                      avt_buffer_default_free , 0);
-    if (err < 0) {
-        free(alloc);
+    AVTBufferCtrl *ctrl = malloc(sizeof(*ctrl) + len);
+    if (!ctrl)
         return NULL;
-    }
 
-    return alloc;
+    avt_buffer_init_ctrl(buf, ctrl, (uint8_t *)(ctrl + 1), len,
+                         NULL, NULL, 0);
+
+    return buf->data;
 }
 
+/* Same as avt_buffer_quick_alloc, but with the data aligned to align
+ * (a power of two, or 0 for the default), and headroom bytes of space
+ * before it, reachable via avt_buffer_offset(). */
+uint8_t *avt_buffer_quick_alloc_aligned(AVTBuffer *buf, size_t len,
+                                        size_t align, size_t headroom);
+
 static inline void avt_buffer_quick_unref(AVTBuffer *buf)
 {
-    if (!buf || !buf->refcnt)
+    if (!buf || !buf->ctrl)
         return;
 
-    if (atomic_fetch_sub_explicit(buf->refcnt, 1, memory_order_acq_rel) <= 1) {
-        buf->free(buf->opaque, buf->data, buf->end_data - buf->base_data);
-        free(buf->refcnt);
+    AVTBufferCtrl *ctrl = buf->ctrl;
+    if (atomic_fetch_sub_explicit(&ctrl->refcnt, 1, memory_order_acq_rel) <= 1) {
+        if (!ctrl->free) {
+            free(ctrl);
+        } else {
+            /* The callback may release the control block */
+            const bool inline_ctrl = ctrl->flags & AVT_BUFFER_CTRL_INLINE;
+            ctrl->free(ctrl->opaque, buf->base_data,
+                       buf->end_data - buf->base_data);
+            if (!inline_ctrl)
+                free(ctrl);
+        }
     }
 
     /* Zero out to avoid leaks */
@@ -113,12 +156,12 @@ static inline void avt_buffer_quick_ref(AVTBuffer *dst, AVTBuffer *buf,
 {
     avt_buffer_quick_unref(dst);
 
-    if (!buf || !buf->refcnt)
+    if (!buf || !buf->ctrl)
         return;
 
     avt_assert0(buf->base_data + offset < buf->end_data);
 
-    atomic_fetch_add_explicit(buf->refcnt, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&buf->ctrl->refcnt, 1, memory_order_relaxed);
     memcpy(dst, buf, sizeof(*dst));
 
     dst->data += offset;
@@ -127,4 +170,9 @@ static inline void avt_buffer_quick_ref(AVTBuffer *dst, AVTBuffer *buf,
 
 int avt_buffer_offset(AVTBuffer *buf, ptrdiff_t offset);
 
+/* Allocate a buffer from a pool, in place. Allocations too large for the
+ * pool are allocated normally. Returns the data, or NULL on error. */
+uint8_t *avt_buffer_pool_quick_alloc(AVTBufferPool *pool, AVTBuffer *buf,
+                                     size_t len);
+
 #endif
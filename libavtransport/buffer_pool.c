@@ -0,0 +1,343 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbit.h>
+#include <threads.h>
+
+#include "buffer.h"
+#include "utils_internal.h"
+
+/* Smallest size class, 64 bytes */
+#define POOL_MIN_BITS 6
+
+/* Number of size classes, up to 2GiB */
+#define POOL_NB_CLASSES 26
+
+/* Largest pooled allocation, unless specified */
+#define POOL_DEFAULT_MAX (16*1024*1024)
+
+/* Number of pools each thread can cache memory for at once */
+#define POOL_NB_CACHES 4
+
+/* Number of entries per size class in each cache */
+#define POOL_CACHE_NB 8
+
+/* Size classes cached per thread, up to 64KiB. Larger memory always
+ * goes back to the pool, so idle threads cannot hold on to much. */
+#define POOL_CACHE_CLASSES 11
+
+/* Unused memory is kept in lists, linked through the memory itself */
+typedef struct PoolEntry {
+    struct PoolEntry *next;
+} PoolEntry;
+
+/* Memory cached by a thread for a single pool, used without locking */
+typedef struct PoolCache {
+    uint64_t pool_id; /* 0 if unused */
+    PoolEntry *list[POOL_CACHE_CLASSES];
+    uint32_t nb[POOL_CACHE_CLASSES];
+} PoolCache;
+
+struct AVTBufferPool {
+    int nb_classes;
+    uint64_t id;
+
+    /* One reference for the user, and one per buffer given out */
+    atomic_int refcnt;
+    atomic_bool closed;
+
+    atomic_uint_least64_t hits;
+    atomic_uint_least64_t misses;
+    atomic_uint_least64_t oversized;
+
+    /* Memory which did not fit in a cache */
+    mtx_t lock;
+    PoolEntry *list[POOL_NB_CLASSES];
+};
+
+/* Pools are told apart by ID, as a new pool may reuse a freed one's address */
+static atomic_uint_least64_t pool_counter;
+
+/* Caches of the thread, released by thread_caches_free() when it exits */
+static thread_local PoolCache *thread_caches;
+static tss_t thread_caches_key;
+static once_flag thread_caches_once = ONCE_FLAG_INIT;
+static bool thread_caches_ok;
+
+static void free_lists(PoolEntry **list, int nb)
+{
+    for (int i = 0; i < nb; i++) {
+        while (list[i]) {
+            PoolEntry *e = list[i];
+            list[i] = e->next;
+            free(e);
+        }
+    }
+}
+
+static void cache_flush(PoolCache *cache)
+{
+    free_lists(cache->list, POOL_CACHE_CLASSES);
+    memset(cache, 0, sizeof(*cache));
+}
+
+static void thread_caches_free(void *opaque)
+{
+    PoolCache *caches = opaque;
+    for (int i = 0; i < POOL_NB_CACHES; i++)
+        cache_flush(&caches[i]);
+    free(caches);
+}
+
+static void thread_caches_init(void)
+{
+    thread_caches_ok = tss_create(&thread_caches_key,
+                                  thread_caches_free) == thrd_success;
+}
+
+/* The calling thread's cache for a pool, or NULL if it has none */
+static PoolCache *get_cache(AVTBufferPool *pool)
+{
+    if (!thread_caches) {
+        call_once(&thread_caches_once, thread_caches_init);
+        if (!thread_caches_ok)
+            return NULL;
+
+        PoolCache *caches = calloc(POOL_NB_CACHES, sizeof(*caches));
+        if (!caches)
+            return NULL;
+        if (tss_set(thread_caches_key, caches) != thrd_success) {
+            free(caches);
+            return NULL;
+        }
+        thread_caches = caches;
+    }
+
+    /* Memory cached for another pool goes back to the system, as that
+     * pool may be gone already */
+    PoolCache *cache = &thread_caches[pool->id % POOL_NB_CACHES];
+    if (cache->pool_id != pool->id) {
+        cache_flush(cache);
+        cache->pool_id = pool->id;
+    }
+
+    return cache;
+}
+
+static inline int size_class(size_t len)
+{
+    if (len <= (1 << POOL_MIN_BITS))
+        return 0;
+    return stdc_bit_width(len - 1) - POOL_MIN_BITS;
+}
+
+static void pool_unref(AVTBufferPool *pool)
+{
+    if (atomic_fetch_sub_explicit(&pool->refcnt, 1, memory_order_acq_rel) > 1)
+        return;
+
+    free_lists(pool->list, POOL_NB_CLASSES);
+    mtx_destroy(&pool->lock);
+    free(pool);
+}
+
+AVT_API void avt_buffer_pool_release(void *opaque, void *base_data,
+                                     size_t len)
+{
+    AVTBufferPool *pool = opaque;
+    PoolEntry *e = (PoolEntry *)((AVTBufferCtrl *)base_data - 1);
+    const int c = size_class(len);
+
+    /* Nothing left to reuse the memory, or it was never pooled */
+    if (atomic_load_explicit(&pool->closed, memory_order_acquire) ||
+        (c >= pool->nb_classes)) {
+        free(e);
+        goto end;
+    }
+
+    PoolCache *cache = c < POOL_CACHE_CLASSES ? get_cache(pool) : NULL;
+    if (cache && (cache->nb[c] < POOL_CACHE_NB)) {
+        e->next = cache->list[c];
+        cache->list[c] = e;
+        cache->nb[c]++;
+        goto end;
+    }
+
+    mtx_lock(&pool->lock);
+    e->next = pool->list[c];
+    pool->list[c] = e;
+    mtx_unlock(&pool->lock);
+
+end:
+    pool_unref(pool);
+}
+
+/* Memory for a size class fitting *size bytes, which gets updated,
+ * preceded by space for a control block */
+static PoolEntry *pool_get(AVTBufferPool *pool, size_t *size)
+{
+    const int c = size_class(*size);
+    if (c >= pool->nb_classes) {
+        atomic_fetch_add_explicit(&pool->oversized, 1, memory_order_relaxed);
+        if (*size > (SIZE_MAX - sizeof(AVTBufferCtrl)))
+            return NULL;
+        return malloc(sizeof(AVTBufferCtrl) + *size);
+    }
+
+    *size = (size_t)1 << (c + POOL_MIN_BITS);
+
+    PoolCache *cache = c < POOL_CACHE_CLASSES ? get_cache(pool) : NULL;
+    PoolEntry *e;
+    if (cache && cache->list[c]) {
+        e = cache->list[c];
+        cache->list[c] = e->next;
+        cache->nb[c]--;
+    } else {
+        mtx_lock(&pool->lock);
+        e = pool->list[c];
+        if (e)
+            pool->list[c] = e->next;
+        mtx_unlock(&pool->lock);
+    }
+
+    if (e) {
+        atomic_fetch_add_explicit(&pool->hits, 1, memory_order_relaxed);
+        return e;
+    }
+
+    atomic_fetch_add_explicit(&pool->misses, 1, memory_order_relaxed);
+    return malloc(sizeof(AVTBufferCtrl) + *size);
+}
+
+AVT_API void *avt_buffer_pool_get(AVTBufferPool *pool, size_t len)
+{
+    PoolEntry *e = pool_get(pool, &len);
+    if (!e)
+        return NULL;
+
+    atomic_fetch_add_explicit(&pool->refcnt, 1, memory_order_relaxed);
+    return (AVTBufferCtrl *)e + 1;
+}
+
+uint8_t *avt_buffer_pool_quick_alloc(AVTBufferPool *pool, AVTBuffer *buf,
+                                     size_t len)
+{
+    size_t size = len;
+    PoolEntry *e = pool_get(pool, &size);
+    if (!e)
+        return NULL;
+
+    atomic_fetch_add_explicit(&pool->refcnt, 1, memory_order_relaxed);
+
+    /* Same as avt_buffer_quick_create() with avt_buffer_pool_release(),
+     * but with the control block in the space kept for it */
+    AVTBufferCtrl *ctrl = (AVTBufferCtrl *)e;
+    avt_buffer_init_ctrl(buf, ctrl, (uint8_t *)(ctrl + 1), size, pool,
+                         avt_buffer_pool_release, AVT_BUFFER_CTRL_INLINE);
+    buf->len = len;
+
+    return buf->data;
+}
+
+AVT_API AVTBuffer *avt_buffer_pool_alloc(AVTBufferPool *pool, size_t len)
+{
+    AVTBuffer *buf = malloc(sizeof(*buf));
+    if (!buf)
+        return NULL;
+
+    if (!avt_buffer_pool_quick_alloc(pool, buf, len)) {
+        free(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+AVT_API int avt_buffer_pool_init(AVTBufferPool **_pool, size_t max_size)
+{
+    AVTBufferPool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return AVT_ERROR(ENOMEM);
+
+    if (!max_size)
+        max_size = POOL_DEFAULT_MAX;
+
+    pool->nb_classes = AVT_MIN(size_class(max_size) + 1, POOL_NB_CLASSES);
+    pool->id = atomic_fetch_add_explicit(&pool_counter, 1,
+                                         memory_order_relaxed) + 1;
+    atomic_init(&pool->refcnt, 1);
+    atomic_init(&pool->closed, false);
+    atomic_init(&pool->hits, 0);
+    atomic_init(&pool->misses, 0);
+    atomic_init(&pool->oversized, 0);
+
+    if (mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+        free(pool);
+        return AVT_ERROR(ENOMEM);
+    }
+
+    *_pool = pool;
+
+    return 0;
+}
+
+AVT_API void avt_buffer_pool_get_stats(AVTBufferPool *pool,
+                                       AVTBufferPoolStats *stats)
+{
+    *stats = (AVTBufferPoolStats) {
+        .hits = atomic_load_explicit(&pool->hits, memory_order_relaxed),
+        .misses = atomic_load_explicit(&pool->misses, memory_order_relaxed),
+        .oversized = atomic_load_explicit(&pool->oversized,
+                                          memory_order_relaxed),
+    };
+}
+
+AVT_API void avt_buffer_pool_free(AVTBufferPool **_pool)
+{
+    AVTBufferPool *pool = *_pool;
+    if (!pool)
+        return;
+
+    atomic_store_explicit(&pool->closed, true, memory_order_release);
+
+    /* Release unused memory now, rather than once all buffers are returned.
+     * Other threads release what they cache once they exit, or use
+     * another pool. */
+    if (thread_caches) {
+        PoolCache *cache = &thread_caches[pool->id % POOL_NB_CACHES];
+        if (cache->pool_id == pool->id)
+            cache_flush(cache);
+    }
+
+    mtx_lock(&pool->lock);
+    free_lists(pool->list, POOL_NB_CLASSES);
+    mtx_unlock(&pool->lock);
+
+    pool_unref(pool);
+    *_pool = NULL;
+}
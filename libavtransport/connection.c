@@ -25,6 +25,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <avtransport/version.h>
 
 #include "connection_internal.h"
@@ -208,6 +209,24 @@ int avt_connection_flush(AVTConnection *conn, int64_t timeout)
     return conn->p->flush(conn->p_ctx, timeout);
 }
 
+int avt_connection_get_status(AVTConnection *conn, AVTConnectionStatus *s)
+{
+    memset(s, 0, sizeof(*s));
+
+    if (conn->io->get_stats) {
+        AVTIOStats stats;
+        conn->io->get_stats(conn->io_ctx, &stats);
+        s->io.copied = stats.nb_copied;
+        s->io.zerocopy = stats.nb_zerocopy;
+        s->io.syncs = stats.nb_syncs;
+        s->io.sync_bytes = stats.sync_bytes;
+        s->io.sync_time = stats.sync_time;
+        s->io.sync_time_max = stats.sync_time_max;
+    }
+
+    return 0;
+}
+
 int avt_connection_mirror_open(AVTContext *ctx, AVTConnection *conn,
                                AVTConnectionInfo *info)
 {
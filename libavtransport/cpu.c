@@ -0,0 +1,204 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#include "cpu.h"
+#include "ldpc.h"
+#include "utils_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CPU_AARCH64
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+
+#ifdef CPU_X86
+static void cpu_cpuid(unsigned leaf, unsigned sub, unsigned r[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex((int *)r, leaf, sub);
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static uint64_t cpu_xgetbv(void)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static unsigned cpu_detect_x86(void)
+{
+    unsigned flags = 0;
+    unsigned r[4];
+
+    cpu_cpuid(0, 0, r);
+    unsigned max_leaf = r[0];
+    if (max_leaf < 1)
+        return 0;
+
+    cpu_cpuid(1, 0, r);
+    if (r[2] & (1 << 19))
+        flags |= AVT_CPU_FLAG_SSE4;
+
+    /* The OS must save the vector state too */
+    if (!(r[2] & (1 << 27)) || max_leaf < 7)
+        return flags;
+
+    uint64_t xcr0 = cpu_xgetbv();
+
+    cpu_cpuid(7, 0, r);
+    if ((xcr0 & 0x06) == 0x06 && (r[1] & (1 << 5)))
+        flags |= AVT_CPU_FLAG_AVX2;
+
+    /* F, DQ, CD, BW, VL */
+    const unsigned avx512 = (1 << 16) | (1 << 17) | (1 << 28) | (1u << 30) | (1u << 31);
+    if ((flags & AVT_CPU_FLAG_AVX2) && (xcr0 & 0xE6) == 0xE6 &&
+        (r[1] & avx512) == avx512)
+        flags |= AVT_CPU_FLAG_AVX512;
+
+    return flags;
+}
+#endif
+
+unsigned avt_cpu_detect(void)
+{
+#if defined(CPU_X86)
+    return cpu_detect_x86();
+#elif defined(CPU_AARCH64) && defined(__linux__) && defined(HWCAP_ASIMD)
+    return (getauxval(AT_HWCAP) & HWCAP_ASIMD) ? AVT_CPU_FLAG_NEON : 0;
+#elif defined(CPU_AARCH64)
+    return AVT_CPU_FLAG_NEON; /* Mandatory */
+#else
+    return 0;
+#endif
+}
+
+unsigned avt_cpu_level_flags(enum AVTCPULevel level)
+{
+    switch (level) {
+    case AVT_CPU_LEVEL_AUTO:   return ~0u;
+    case AVT_CPU_LEVEL_C:      return 0;
+    case AVT_CPU_LEVEL_SSE4:   return AVT_CPU_FLAG_SSE4;
+    case AVT_CPU_LEVEL_AVX2:   return AVT_CPU_FLAG_SSE4 | AVT_CPU_FLAG_AVX2;
+    case AVT_CPU_LEVEL_AVX512: return AVT_CPU_FLAG_SSE4 | AVT_CPU_FLAG_AVX2 |
+                                      AVT_CPU_FLAG_AVX512;
+    case AVT_CPU_LEVEL_NEON:   return AVT_CPU_FLAG_NEON;
+    }
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    enum AVTCPULevel level;
+} cpu_level_names[] = {
+    { "auto",   AVT_CPU_LEVEL_AUTO   },
+    { "c",      AVT_CPU_LEVEL_C      },
+    { "sse4",   AVT_CPU_LEVEL_SSE4   },
+    { "avx2",   AVT_CPU_LEVEL_AVX2   },
+    { "avx512", AVT_CPU_LEVEL_AVX512 },
+    { "neon",   AVT_CPU_LEVEL_NEON   },
+};
+
+static unsigned cpu_flags;
+static once_flag cpu_init_once = ONCE_FLAG_INIT;
+
+/* Level requested via avt_set_cpu_level(), and the one kernels were
+ * selected with */
+static atomic_int cpu_level = AVT_CPU_LEVEL_AUTO;
+static enum AVTCPULevel cpu_level_used;
+
+static void cpu_select(unsigned flags)
+{
+    cpu_flags = flags;
+    avt_ldpc_dsp_select(flags);
+}
+
+static void cpu_init(void)
+{
+    unsigned flags = avt_cpu_detect();
+
+    /* The environment only applies without a level set */
+    cpu_level_used = atomic_load(&cpu_level);
+    const char *env = getenv("AVT_CPU");
+    if (cpu_level_used != AVT_CPU_LEVEL_AUTO) {
+        flags &= avt_cpu_level_flags(cpu_level_used);
+    } else if (env && env[0]) {
+        int i;
+        for (i = 0; i < AVT_ARRAY_ELEMS(cpu_level_names); i++) {
+            if (!strcmp(env, cpu_level_names[i].name)) {
+                flags &= avt_cpu_level_flags(cpu_level_names[i].level);
+                break;
+            }
+        }
+        if (i == AVT_ARRAY_ELEMS(cpu_level_names))
+            avt_log(NULL, AVT_LOG_WARN, "Unknown AVT_CPU level \"%s\", ignoring\n", env);
+    }
+
+    cpu_select(flags);
+}
+
+unsigned avt_cpu_get_flags(void)
+{
+    call_once(&cpu_init_once, cpu_init);
+    return cpu_flags;
+}
+
+unsigned avt_cpu_set_flags(unsigned flags)
+{
+    call_once(&cpu_init_once, cpu_init);
+    cpu_select(flags & avt_cpu_detect());
+    return cpu_flags;
+}
+
+int avt_set_cpu_level(enum AVTCPULevel level)
+{
+    if (level < AVT_CPU_LEVEL_AUTO || level > AVT_CPU_LEVEL_NEON)
+        return AVT_ERROR(EINVAL);
+
+    atomic_store(&cpu_level, level);
+    call_once(&cpu_init_once, cpu_init);
+
+    return cpu_level_used == level ? 0 : AVT_ERROR(EBUSY);
+}
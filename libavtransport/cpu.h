@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AVTRANSPORT_CPU_H
+#define AVTRANSPORT_CPU_H
+
+#include <avtransport/avtransport.h>
+
+/* Features kernels can be selected on */
+enum AVTCPUFlags {
+    AVT_CPU_FLAG_SSE4   = 1 << 0, /* SSE4.1 */
+    AVT_CPU_FLAG_AVX2   = 1 << 1,
+    AVT_CPU_FLAG_AVX512 = 1 << 2, /* F, CD, BW, DQ and VL */
+
+    AVT_CPU_FLAG_NEON   = 1 << 16,
+};
+
+/* Features of the running CPU, and of the OS supporting it */
+unsigned avt_cpu_detect(void);
+
+/* Features allowed at a given level */
+unsigned avt_cpu_level_flags(enum AVTCPULevel level);
+
+/* Features in use. On first call, selects kernels using the detected
+ * features, limited by the AVT_CPU environment variable if set. */
+unsigned avt_cpu_get_flags(void);
+
+/* Reselects kernels for all features in flags which are supported.
+ * Dispatch is process-wide, so this must not race with other users. */
+unsigned avt_cpu_set_flags(unsigned flags);
+
+#endif /* AVTRANSPORT_CPU_H */
@@ -43,6 +43,16 @@ enum AVTLogLevel {
     AVT_LOG_TRACE    = +(1 << 5),
 };
 
+/* Highest instruction set level to use for optimized functions */
+enum AVTCPULevel {
+    AVT_CPU_LEVEL_AUTO = 0, /* Best supported, unless limited by AVT_CPU in the environment */
+    AVT_CPU_LEVEL_C,        /* No SIMD */
+    AVT_CPU_LEVEL_SSE4,
+    AVT_CPU_LEVEL_AVX2,
+    AVT_CPU_LEVEL_AVX512,
+    AVT_CPU_LEVEL_NEON,
+};
+
 /* Library context-level options */
 typedef struct AVTContextOptions {
     /* Logging context */
@@ -56,9 +66,19 @@ typedef struct AVTContextOptions {
     uint16_t producer_ver[3]; /* Major, minor, micro version */
 
     /* Padding to allow for future options. Must always be set to 0. */
-    uint8_t padding[1024 - 16*1 - 3*2 - 0*4 - 2*8];
+    uint8_t padding[1024 - 16*1 - 3*2 - 2*8];
 } AVTContextOptions;
 
+/* Option sizes are part of the ABI. Pointers are counted as 8 bytes. */
+#if SIZE_MAX == UINT64_MAX
+static_assert(sizeof(AVTContextOptions) == 1024);
+#endif
+
+/* Limits the optimized functions used. Kernels are shared by the whole
+ * process, and selected once, so this must be called before any other
+ * function of the library. Returns AVT_ERROR(EBUSY) if too late. */
+AVT_API int avt_set_cpu_level(enum AVTCPULevel level);
+
 /* Allocate an AVTransport context with the given context options. */
 AVT_API int avt_init(AVTContext **ctx, AVTContextOptions *opts);
 
@@ -27,6 +27,8 @@
 #ifndef AVTRANSPORT_CONNECTION_H
 #define AVTRANSPORT_CONNECTION_H
 
+#include <assert.h>
+
 #include <avtransport/packet_enums.h>
 #include <avtransport/packet_data.h>
 #include <avtransport/utils.h>
@@ -165,7 +167,9 @@ typedef struct AVTConnectionInfo {
         struct {
             /* Called by libavtransport in strictly sequential order,
              * with no holes, to write data. Returns the offset after
-             * writing, or a negative error. */
+             * writing, or a negative error.
+             * With output_opts.coalesce set, several packets may be
+             * given at once in the payload, with a hdr_len of 0. */
             int64_t (*write)(void *opaque,
                              uint8_t hdr[AVT_MAX_HEADER_LEN], size_t hdr_len,
                              AVTBuffer *payload);
@@ -252,8 +256,47 @@ typedef struct AVTConnectionInfo {
          */
         unsigned int session_start_freq;
 
-        /* Padding to allow for future options. Must always be set to 0. */
-        uint8_t padding[1024 - 0*1 - 0*2 - 1*4 - 2*8];
+        /* Write coalescing, for outputs without vectored I/O, such as
+         * AVT_CONNECTION_DATA callbacks.
+         * Headers and small payloads are copied into a staging buffer
+         * of this many bytes, which is written out in one go.
+         * Payloads of a quarter of this size or larger are passed through
+         * without copying.
+         * If left at zero, coalescing is disabled.
+         */
+        size_t coalesce;
+
+        /* Maximum time staged data may be held for before being written
+         * out, in nanoseconds. Checked on every write. Flushing the
+         * connection always writes out all staged data.
+         * If left at zero, defaults to 10 milliseconds.
+         */
+        int64_t coalesce_latency;
+
+        /* Durability policy for file outputs. Written data is synced to
+         * storage once this many bytes have been written since the last
+         * sync, or once the oldest unsynced data is sync_period nanoseconds
+         * old, whichever comes first. Between syncs, written data is
+         * handed off to the kernel for writeback early, where supported.
+         * A single sync covers all packets written since the last one.
+         * The period is only checked on writes. Once writing stops, data
+         * stays unsynced until the next write, or a flush.
+         * If both are left at zero, data is only synced on flushes.
+         * Sync statistics are given by avt_connection_get_status().
+         */
+        size_t sync_bytes;
+        int64_t sync_period;
+
+        /* For file outputs, write with direct I/O, bypassing the page cache.
+         * Data is gathered into large aligned blocks and written out
+         * asynchronously. Ignored if unsupported by the filesystem,
+         * or if a durability policy is set.
+         */
+        bool direct_io;
+
+        /* Padding to allow for future options. Must always be set to 0.
+         * The last term is the alignment hole after session_start_freq. */
+        uint8_t padding[1024 - 1*1 - 0*2 - 1*4 - 6*8 - 4];
     } output_opts;
 
     /* When greater than 0, enables asynchronous mode.
@@ -264,6 +307,13 @@ typedef struct AVTConnectionInfo {
     uint8_t padding[1024 - 0*1 - 0*2 - 1*4 - 0*8];
 } AVTConnectionInfo;
 
+/* Option sizes are part of the ABI. Pointers and size_t are counted
+ * as 8 bytes. */
+#if SIZE_MAX == UINT64_MAX
+static_assert(sizeof(((AVTConnectionInfo *)0)->input_opts) == 1024);
+static_assert(sizeof(((AVTConnectionInfo *)0)->output_opts) == 1024);
+#endif
+
 /**
  * Initialize a connection. Returns 0 or greater on success, otherwise
  * returns an error code.
@@ -372,10 +422,33 @@ typedef struct AVTConnectionStatus {
         int64_t buffer_duration;
     } tx;
 
+    /* I/O statistics */
+    struct {
+        /* Messages whose data was copied into the kernel, and messages
+         * sent from their buffers directly */
+        uint64_t copied;
+        uint64_t zerocopy;
+
+        /* Syncs of written data to storage, and the total number of bytes
+         * they made durable */
+        uint64_t syncs;
+        uint64_t sync_bytes;
+
+        /* Total, and longest time spent syncing, in nanoseconds */
+        int64_t sync_time;
+        int64_t sync_time_max;
+    } io;
+
     /* Padding to allow for future options. Must always be set to 0. */
-    uint8_t padding[4096 - 0*1 - 0*2 - 3*4 - 10*8];
+    uint8_t padding[4096 - 0*1 - 0*2 - 3*4 - 16*8];
 } AVTConnectionStatus;
 
+/**
+ * Get the current status of a connection.
+ */
+AVT_API int avt_connection_get_status(AVTConnection *conn,
+                                      AVTConnectionStatus *s);
+
 /**
  * Subscribe to receive status notifications.
  * Special error codes like AVTERROR_EOS will be returned from status_cb on
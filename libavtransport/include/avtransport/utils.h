@@ -35,6 +35,7 @@
 typedef struct AVTContext AVTContext;
 typedef struct AVTMetadata AVTMetadata;
 typedef struct AVTBuffer AVTBuffer;
+typedef struct AVTBufferPool AVTBufferPool;
 
 /* All functions return negative values for errors.
  * This is a wrapper that's used to convert standard stderr values into
@@ -89,6 +90,11 @@ AVT_API bool avt_buffer_read_only(AVTBuffer *buffer);
 /* Create and allocate a reference counted buffer. */
 AVT_API AVTBuffer *avt_buffer_alloc(size_t len);
 
+/* Same as avt_buffer_alloc, with the data aligned to align (a power of two,
+ * or 0 for the default), and headroom bytes of space before it. */
+AVT_API AVTBuffer *avt_buffer_alloc_aligned(size_t len, size_t align,
+                                            size_t headroom);
+
 /* References the buffer. Returns a new reference at the offset and length requested.
  * If offset AND length are 0, references the whole buffer. */
 AVT_API AVTBuffer *avt_buffer_ref(AVTBuffer *buffer, ptrdiff_t offset, size_t len);
@@ -105,4 +111,37 @@ AVT_API size_t avt_buffer_get_data_len(const AVTBuffer *buffer);
 /* Unreference a reference counted buffer. */
 AVT_API void avt_buffer_unref(AVTBuffer **buffer);
 
+/* Allocation statistics of a buffer pool */
+typedef struct AVTBufferPoolStats {
+    uint64_t hits;      /* Allocations which reused returned memory */
+    uint64_t misses;    /* Allocations which needed new memory */
+    uint64_t oversized; /* Allocations too large to be pooled */
+} AVTBufferPoolStats;
+
+/* Create a pool of buffers. Allocation sizes are rounded up to a power of
+ * two, and memory is returned to the pool once its last reference is gone.
+ * Allocations larger than max_size are not pooled. 0 means the default.
+ * Pools are thread-safe, and each thread keeps a small cache of the memory
+ * it returns, for its own allocations. */
+AVT_API int avt_buffer_pool_init(AVTBufferPool **pool, size_t max_size);
+
+/* Allocate a buffer from a pool. Free with avt_buffer_unref(). */
+AVT_API AVTBuffer *avt_buffer_pool_alloc(AVTBufferPool *pool, size_t len);
+
+/* Get len bytes of memory from a pool, to wrap into a buffer, e.g.
+ * avt_buffer_create(data, len, pool, avt_buffer_pool_release). */
+AVT_API void *avt_buffer_pool_get(AVTBufferPool *pool, size_t len);
+
+/* Free callback returning memory from avt_buffer_pool_get() to the pool
+ * given as opaque. len must be the length requested, or smaller. */
+AVT_API void avt_buffer_pool_release(void *opaque, void *base_data,
+                                     size_t len);
+
+/* Get the allocation statistics of a pool. */
+AVT_API void avt_buffer_pool_get_stats(AVTBufferPool *pool,
+                                       AVTBufferPoolStats *stats);
+
+/* Free a pool. Buffers allocated from it remain valid. */
+AVT_API void avt_buffer_pool_free(AVTBufferPool **pool);
+
 #endif /* AVTRANSPORT_UTILS_H */
@@ -0,0 +1,134 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AVTRANSPORT_IO_COALESCE_H
+#define AVTRANSPORT_IO_COALESCE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "utils_internal.h"
+
+/* Default latency cap for staged data, in nanoseconds */
+#define AVT_IO_COALESCE_LATENCY (10 * 1000 * 1000)
+
+/* Staging buffer alignment */
+#define AVT_IO_COALESCE_ALIGN 4096
+
+/* Write-coalescing staging buffer.
+ * Small headers and payloads are copied here and written out in one go,
+ * large payloads flush the staged data and are written as-is. */
+typedef struct AVTIOCoalesce {
+    AVTBuffer buf;
+    size_t size;      /* Flush once this many bytes are staged */
+    size_t threshold; /* Payloads of at least this size are not copied */
+    size_t len;       /* Bytes currently staged */
+    int64_t latency;  /* Flush once the oldest staged data is this old */
+    int64_t first;    /* Time at which the oldest staged data came in */
+} AVTIOCoalesce;
+
+/* A size of 0 disables coalescing, and a latency of 0 picks a default */
+static inline int avt_io_coalesce_init(AVTIOCoalesce *c, size_t size,
+                                       int64_t latency)
+{
+    memset(c, 0, sizeof(*c));
+    if (!size)
+        return 0;
+
+    /* Must always fit a header next to the largest staged payload */
+    size = AVT_MAX(size, AVT_IO_COALESCE_ALIGN);
+
+    if (!avt_buffer_quick_alloc_aligned(&c->buf, size,
+                                        AVT_IO_COALESCE_ALIGN, 0))
+        return AVT_ERROR(ENOMEM);
+
+    c->size = size;
+    c->threshold = AVT_MAX(size >> 2, 1);
+    c->latency = latency > 0 ? latency : AVT_IO_COALESCE_LATENCY;
+
+    return 0;
+}
+
+static inline bool avt_io_coalesce_enabled(const AVTIOCoalesce *c)
+{
+    return !!c->size;
+}
+
+/* Whether a payload should be staged, rather than written directly */
+static inline bool avt_io_coalesce_small(const AVTIOCoalesce *c, size_t len)
+{
+    return len < c->threshold;
+}
+
+/* Returns true if len bytes will not fit in the staging buffer */
+static inline bool avt_io_coalesce_full(const AVTIOCoalesce *c, size_t len)
+{
+    return len > (c->size - c->len);
+}
+
+static inline void avt_io_coalesce_copy(AVTIOCoalesce *c, const void *src,
+                                        size_t len, int64_t now)
+{
+    if (!len)
+        return;
+    if (!c->len)
+        c->first = now;
+    memcpy(c->buf.data + c->len, src, len);
+    c->len += len;
+}
+
+/* Whether the staged data is due to be written out */
+static inline bool avt_io_coalesce_due(const AVTIOCoalesce *c, int64_t now)
+{
+    return c->len && ((c->len >= c->size) || ((now - c->first) >= c->latency));
+}
+
+/* Empties the staging buffer. If the staged data was referenced
+ * while being written out, a new buffer is allocated. */
+static inline int avt_io_coalesce_reset(AVTIOCoalesce *c)
+{
+    c->len = 0;
+    if (avt_buffer_get_refcount(&c->buf) <= 1)
+        return 0;
+
+    avt_buffer_quick_unref(&c->buf);
+    if (!avt_buffer_quick_alloc_aligned(&c->buf, c->size,
+                                        AVT_IO_COALESCE_ALIGN, 0)) {
+        c->size = 0;
+        return AVT_ERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static inline void avt_io_coalesce_free(AVTIOCoalesce *c)
+{
+    avt_buffer_quick_unref(&c->buf);
+    c->size = c->len = 0;
+}
+
+#endif /* AVTRANSPORT_IO_COALESCE_H */
@@ -37,13 +37,19 @@ extern const AVTIO avt_io_fd;
 extern const AVTIO avt_io_fd_path;
 extern const AVTIO avt_io_mmap;
 extern const AVTIO avt_io_mmap_path;
+extern const AVTIO avt_io_direct_path;
+#endif
+#ifdef CONFIG_HAVE_LIBURING
+extern const AVTIO avt_io_uring;
+extern const AVTIO avt_io_uring_path;
+extern const AVTIO avt_io_udp_uring;
 #endif
 
 extern const AVTIO avt_io_udp;
 
 extern const AVTIO avt_io_unix;
 
-#define MAX_NB_BACKENDS 4
+#define MAX_NB_BACKENDS 5
 
 /* In order of preference */
 static const AVTIO *avt_io_list[AVT_IO_INVALID][MAX_NB_BACKENDS + 1] = {
@@ -54,6 +60,12 @@ static const AVTIO *avt_io_list[AVT_IO_INVALID][MAX_NB_BACKENDS + 1] = {
         &avt_io_dcb,
     },
     [AVT_IO_FILE] = {
+#ifndef _WIN32
+        &avt_io_direct_path, /* Only if requested */
+#endif
+#ifdef CONFIG_HAVE_LIBURING
+        &avt_io_uring_path,
+#endif
 #ifndef _WIN32
         &avt_io_mmap_path,
         &avt_io_fd_path,
@@ -61,12 +73,18 @@ static const AVTIO *avt_io_list[AVT_IO_INVALID][MAX_NB_BACKENDS + 1] = {
         &avt_io_file,
     },
     [AVT_IO_FD] = {
+#ifdef CONFIG_HAVE_LIBURING
+        &avt_io_uring,
+#endif
 #ifndef _WIN32
         &avt_io_mmap,
         &avt_io_fd,
 #endif
     },
     [AVT_IO_UDP] = {
+#ifdef CONFIG_HAVE_LIBURING
+        &avt_io_udp_uring,
+#endif
         &avt_io_udp,
     },
     [AVT_IO_UNIX] = {
@@ -108,7 +126,7 @@ COLD int avt_io_init(AVTContext *ctx, const AVTIO **_io, AVTIOCtx **io_ctx,
 
     int err;
     const AVTIO *io, **io_list = avt_io_list[io_type];
-    while ((io = *io_list)) {
+    while ((io = *io_list++)) {
         err = io->init(ctx, io_ctx, addr);
         if (err == AVT_ERROR(ENOMEM)) {
             return err;
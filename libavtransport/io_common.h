@@ -64,6 +64,35 @@ enum AVTIOReadFlags {
     AVT_IO_READ_MUTABLE = 1 << 0,
 };
 
+/* A received datagram */
+typedef struct AVTIODatagram {
+    AVTBuffer buf;
+
+    /* Kernel receive time in nanoseconds, or INT64_MIN if unknown */
+    int64_t ts;
+
+    /* Total number of datagrams dropped by the kernel so far */
+    uint32_t nb_dropped;
+} AVTIODatagram;
+
+/* Statistics. Counters which an IO does not track stay at 0. */
+typedef struct AVTIOStats {
+    /* Messages whose data was copied into the kernel */
+    uint64_t nb_copied;
+
+    /* Messages sent from their buffers directly */
+    uint64_t nb_zerocopy;
+
+    /* Syncs to storage, and the number of bytes written since the
+     * previous sync which each made durable */
+    uint64_t nb_syncs;
+    uint64_t sync_bytes;
+
+    /* Total, and longest time spent syncing, in nanoseconds */
+    int64_t sync_time;
+    int64_t sync_time_max;
+} AVTIOStats;
+
 /* Low level interface */
 typedef struct AVTIOCtx AVTIOCtx;
 typedef struct AVTIO {
@@ -102,14 +131,25 @@ typedef struct AVTIO {
      *
      * The amount of bytes read may not match len.
      *
-     * Returns positive current offset after reading on success,
-     * otherwise negative error. */
+     * Returns the offset the data was read from on success, which was the
+     * current offset before reading, otherwise negative error. */
     avt_pos (*read_input)(AVTIOCtx *io, AVTBuffer *buf, size_t len,
                           int64_t timeout, enum AVTIOReadFlags flags);
 
+    /* Read multiple datagrams at once, into buffers allocated by the IO.
+     * dgram must have space for nb_dgram datagrams.
+     *
+     * Returns the number of datagrams read, otherwise negative error.
+     * May be NULL if unsupported. */
+    int (*read_vec)(AVTIOCtx *io, AVTIODatagram *dgram, uint32_t nb_dgram,
+                    int64_t timeout);
+
     /* Set the read position */
     avt_pos (*seek)(AVTIOCtx *io, avt_pos off);
 
+    /* Get statistics, NULL if unsupported */
+    void (*get_stats)(AVTIOCtx *io, AVTIOStats *stats);
+
     /* Flush data written */
     int (*flush)(AVTIOCtx *io, int64_t timeout);
 
@@ -27,19 +27,38 @@
 #include <stdlib.h>
 
 #include "io_common.h"
+#include "io_coalesce.h"
 #include "attributes.h"
 
 struct AVTIOCtx {
     AVTCallbacksData cb;
     int64_t rpos;
+    AVTIOCoalesce co;
 };
 
+/* Hands all staged data to the callback as a single payload */
+static int64_t dcb_coalesce_flush(AVTIOCtx *io)
+{
+    if (!io->co.len)
+        return 0;
+
+    AVTBuffer tmp = { };
+    avt_buffer_quick_ref(&tmp, &io->co.buf, 0, io->co.len);
+    int64_t ret = io->cb.write(io->cb.opaque, tmp.data, 0, &tmp);
+    avt_buffer_quick_unref(&tmp);
+
+    int err = avt_io_coalesce_reset(&io->co);
+    return ret < 0 ? ret : err;
+}
+
 static int dcb_close(AVTIOCtx **_io)
 {
     AVTIOCtx *io = *_io;
+    int64_t ret = dcb_coalesce_flush(io);
+    avt_io_coalesce_free(&io->co);
     free(io);
     *_io = NULL;
-    return 0;
+    return ret < 0 ? ret : 0;
 }
 
 static COLD int dcb_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
@@ -51,6 +70,13 @@ static COLD int dcb_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
     io->cb = addr->dcb;
     io->rpos = 0;
 
+    int err = avt_io_coalesce_init(&io->co, addr->opts.coalesce,
+                                   addr->opts.coalesce_latency);
+    if (err < 0) {
+        free(io);
+        return err;
+    }
+
     *_io = io;
     return 0;
 }
@@ -81,6 +107,7 @@ static int64_t dcb_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
         uint8_t *src_data = avt_buffer_get_data(tmp, &src_len);
 
         memcpy(dst_data, src_data, AVT_MIN(len, src_len));
+        avt_buffer_resize(buf, AVT_MIN(len, src_len));
     } else {
         avt_buffer_quick_ref(buf, tmp, 0, AVT_BUFFER_REF_ALL);
     }
@@ -88,23 +115,71 @@ static int64_t dcb_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
     return (io->rpos = ret);
 }
 
-static int64_t dcb_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
-{
-    return io->cb.write(io->cb.opaque, p->hdr, p->hdr_len, &p->pl);
-}
-
 static int64_t dcb_write_vec(AVTIOCtx *io, AVTPktd *iov, uint32_t nb_iov,
                              int64_t timeout)
 {
     int64_t ret;
+
+    if (!avt_io_coalesce_enabled(&io->co)) {
+        for (int i = 0; i < nb_iov; i++) {
+            ret = io->cb.write(io->cb.opaque, iov[i].hdr.data, iov[i].hdr_len, &iov[i].pl);
+            if (ret < 0)
+                return ret;
+        }
+        return 0;
+    }
+
+    int64_t now = avt_get_time_ns();
     for (int i = 0; i < nb_iov; i++) {
-        ret = io->cb.write(io->cb.opaque, iov[i].hdr, iov[i].hdr_len, &iov[i].pl);
+        AVTPktd *p = &iov[i];
+        size_t pl_len;
+        uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+
+        /* Large payloads are passed through along with their header */
+        if (!avt_io_coalesce_small(&io->co, pl_len)) {
+            ret = dcb_coalesce_flush(io);
+            if (ret < 0)
+                return ret;
+
+            ret = io->cb.write(io->cb.opaque, p->hdr.data, p->hdr_len, &p->pl);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+
+        if (avt_io_coalesce_full(&io->co, p->hdr_len + pl_len)) {
+            ret = dcb_coalesce_flush(io);
+            if (ret < 0)
+                return ret;
+        }
+
+        avt_io_coalesce_copy(&io->co, p->hdr.data, p->hdr_len, now);
+        avt_io_coalesce_copy(&io->co, pl_data, pl_len, now);
+    }
+
+    if (avt_io_coalesce_due(&io->co, now)) {
+        ret = dcb_coalesce_flush(io);
         if (ret < 0)
             return ret;
     }
+
     return 0;
 }
 
+static int64_t dcb_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
+{
+    if (avt_io_coalesce_enabled(&io->co))
+        return dcb_write_vec(io, p, 1, timeout);
+
+    return io->cb.write(io->cb.opaque, p->hdr.data, p->hdr_len, &p->pl);
+}
+
+static int dcb_flush(AVTIOCtx *io, int64_t timeout)
+{
+    int64_t ret = dcb_coalesce_flush(io);
+    return ret < 0 ? ret : 0;
+}
+
 const AVTIO avt_io_dcb = {
     .name = "dcb",
     .type = AVT_IO_CALLBACK,
@@ -115,5 +190,6 @@ const AVTIO avt_io_dcb = {
     .write_pkt = dcb_write_pkt,
     .rewrite = NULL,
     .seek = dcb_seek,
+    .flush = dcb_flush,
     .close = dcb_close,
 };
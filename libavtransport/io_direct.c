@@ -0,0 +1,477 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE // O_DIRECT
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <threads.h>
+
+#include "io_common.h"
+#include "io_utils.h"
+#include "utils_internal.h"
+
+/* Alignment of buffers, offsets and sizes for direct I/O */
+#define DIRECT_ALIGN 4096
+
+/* Size and number of blocks packets are gathered in */
+#define DIRECT_BLOCK (1024*1024)
+#define DIRECT_NB_BLOCKS 8
+
+#define ALIGN_UP(x) (((x) + DIRECT_ALIGN - 1) & ~((avt_pos)DIRECT_ALIGN - 1))
+
+struct AVTIOCtx {
+    int fd;  /* Opened with O_DIRECT, for writing */
+    int rfd; /* Regular descriptor, for reading */
+
+    /* All blocks, in a single allocation */
+    AVTBuffer mem;
+
+    /* Block being filled, and its file offset */
+    int cur;
+    avt_pos cur_off;
+
+    /* Blocks which are full, and waiting to be written, in order,
+     * starting at the block after the last written one */
+    int nb_pending;
+    int next;
+
+    thrd_t thread;
+    mtx_t lock;
+    cnd_t cond_work;
+    cnd_t cond_done;
+    bool quit;
+    int err;
+
+    avt_pos rpos;
+    avt_pos wpos;
+};
+
+static inline uint8_t *direct_block(AVTIOCtx *io, int idx)
+{
+    return io->mem.data + (size_t)idx*DIRECT_BLOCK;
+}
+
+static int direct_pwrite(AVTIOCtx *io, uint8_t *data, size_t len, avt_pos off)
+{
+    while (len) {
+        ssize_t ret = pwrite(io->fd, data, len, off);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        else if (ret < 0)
+            return avt_handle_errno(io, "Error writing: %i %s\n");
+        else if (!ret)
+            return AVT_ERROR(EIO);
+        data += ret;
+        off += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static int direct_thread(void *arg)
+{
+    AVTIOCtx *io = arg;
+
+    mtx_lock(&io->lock);
+    while (1) {
+        while (!io->nb_pending && !io->quit)
+            cnd_wait(&io->cond_work, &io->lock);
+        if (!io->nb_pending)
+            break;
+
+        /* The oldest pending block sits right after the last written one */
+        int idx = (io->cur - io->nb_pending + DIRECT_NB_BLOCKS) % DIRECT_NB_BLOCKS;
+        avt_pos off = io->next;
+        mtx_unlock(&io->lock);
+
+        int err = direct_pwrite(io, direct_block(io, idx), DIRECT_BLOCK,
+                                off*(avt_pos)DIRECT_BLOCK);
+
+        mtx_lock(&io->lock);
+        if (err < 0 && !io->err)
+            io->err = err;
+        io->next++;
+        io->nb_pending--;
+        cnd_broadcast(&io->cond_done);
+    }
+    mtx_unlock(&io->lock);
+
+    return 0;
+}
+
+/* Waits until no more than nb blocks are pending */
+static int direct_wait(AVTIOCtx *io, int nb)
+{
+    mtx_lock(&io->lock);
+    while (io->nb_pending > nb)
+        cnd_wait(&io->cond_done, &io->lock);
+    int err = io->err;
+    io->err = 0;
+    mtx_unlock(&io->lock);
+    return err;
+}
+
+/* Hands the current block to the writer, and starts a new one */
+static int direct_submit(AVTIOCtx *io)
+{
+    int err = direct_wait(io, DIRECT_NB_BLOCKS - 2);
+    if (err < 0)
+        return err;
+
+    mtx_lock(&io->lock);
+    io->nb_pending++;
+    io->cur = (io->cur + 1) % DIRECT_NB_BLOCKS;
+    io->cur_off += DIRECT_BLOCK;
+    cnd_signal(&io->cond_work);
+    mtx_unlock(&io->lock);
+
+    return 0;
+}
+
+/* Writes out the partially filled block, padded, and trims the file.
+ * The block stays current. */
+static int direct_write_tail(AVTIOCtx *io)
+{
+    int err = direct_wait(io, 0);
+    if (err < 0)
+        return err;
+
+    size_t len = io->wpos - io->cur_off;
+    if (!len)
+        return 0;
+
+    uint8_t *data = direct_block(io, io->cur);
+    memset(data + len, 0, ALIGN_UP(len) - len);
+
+    err = direct_pwrite(io, data, ALIGN_UP(len), io->cur_off);
+    if (err < 0)
+        return err;
+
+    if (ftruncate(io->fd, io->wpos))
+        return avt_handle_errno(io, "Error in ftruncate(): %i %s\n");
+
+    return 0;
+}
+
+static COLD int direct_close(AVTIOCtx **_io)
+{
+    AVTIOCtx *io = *_io;
+    int err = direct_write_tail(io);
+
+    mtx_lock(&io->lock);
+    io->quit = true;
+    cnd_signal(&io->cond_work);
+    mtx_unlock(&io->lock);
+    thrd_join(io->thread, NULL);
+
+    cnd_destroy(&io->cond_done);
+    cnd_destroy(&io->cond_work);
+    mtx_destroy(&io->lock);
+
+    avt_buffer_quick_unref(&io->mem);
+    close(io->rfd);
+    close(io->fd);
+    free(io);
+    *_io = NULL;
+
+    return err;
+}
+
+static COLD int direct_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
+{
+    int ret;
+
+    /* Only used when asked for */
+    if (!addr->opts.direct_io)
+        return AVT_ERROR(ENOTSUP);
+
+    /* Blocks are written out asynchronously, with no durability policy */
+    if (addr->opts.sync_bytes || addr->opts.sync_period) {
+        avt_log(ctx, AVT_LOG_WARN, "Direct I/O does not support sync "
+                "options, not using it\n");
+        return AVT_ERROR(ENOTSUP);
+    }
+#ifndef O_DIRECT
+    return AVT_ERROR(ENOTSUP);
+#else
+    AVTIOCtx *io = calloc(1, sizeof(*io));
+    if (!io)
+        return AVT_ERROR(ENOMEM);
+
+    if (!avt_buffer_quick_alloc_aligned(&io->mem,
+                                        (size_t)DIRECT_BLOCK*DIRECT_NB_BLOCKS,
+                                        DIRECT_ALIGN, 0)) {
+        free(io);
+        return AVT_ERROR(ENOMEM);
+    }
+
+    /* Not all filesystems support O_DIRECT */
+    io->fd = open(addr->path, O_CREAT | O_RDWR | O_DIRECT | O_CLOEXEC, 0666);
+    if (io->fd < 0) {
+        ret = avt_handle_errno(io, "Error opening: %i %s\n");
+        goto fail_mem;
+    }
+
+    io->rfd = open(addr->path, O_RDONLY | O_CLOEXEC);
+    if (io->rfd < 0) {
+        ret = avt_handle_errno(io, "Error opening: %i %s\n");
+        goto fail_fd;
+    }
+
+    if (mtx_init(&io->lock, mtx_plain) != thrd_success) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail_rfd;
+    }
+    if (cnd_init(&io->cond_work) != thrd_success) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail_lock;
+    }
+    if (cnd_init(&io->cond_done) != thrd_success) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail_work;
+    }
+    if (thrd_create(&io->thread, direct_thread, io) != thrd_success) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail_done;
+    }
+
+    *_io = io;
+
+    return 0;
+
+fail_done:
+    cnd_destroy(&io->cond_done);
+fail_work:
+    cnd_destroy(&io->cond_work);
+fail_lock:
+    mtx_destroy(&io->lock);
+fail_rfd:
+    close(io->rfd);
+fail_fd:
+    close(io->fd);
+fail_mem:
+    avt_buffer_quick_unref(&io->mem);
+    free(io);
+    return ret;
+#endif
+}
+
+static int direct_max_pkt_len(AVTIOCtx *io, size_t *mtu)
+{
+    *mtu = SIZE_MAX;
+    return 0;
+}
+
+static avt_pos direct_seek(AVTIOCtx *io, avt_pos off)
+{
+    return (io->rpos = off);
+}
+
+/* Copies data into blocks, submitting them as they fill up */
+static int direct_copy(AVTIOCtx *io, const uint8_t *src, size_t len)
+{
+    while (len) {
+        size_t pos = io->wpos - io->cur_off;
+        size_t cpy = AVT_MIN(len, DIRECT_BLOCK - pos);
+        memcpy(direct_block(io, io->cur) + pos, src, cpy);
+        src += cpy;
+        len -= cpy;
+        io->wpos += cpy;
+
+        if ((pos + cpy) == DIRECT_BLOCK) {
+            int err = direct_submit(io);
+            if (err < 0)
+                return err;
+        }
+    }
+    return 0;
+}
+
+static avt_pos direct_write_vec(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                                int64_t timeout)
+{
+    int err;
+    avt_pos start = io->wpos;
+
+    for (int i = 0; i < nb_pkt; i++) {
+        size_t pl_len;
+        uint8_t *pl_data = avt_buffer_get_data(&pkt[i].pl, &pl_len);
+
+        err = direct_copy(io, pkt[i].hdr.data, pkt[i].hdr_len);
+        if (err < 0)
+            return err;
+
+        err = direct_copy(io, pl_data, pl_len);
+        if (err < 0)
+            return err;
+    }
+
+    return start;
+}
+
+static avt_pos direct_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
+{
+    return direct_write_vec(io, p, 1, timeout);
+}
+
+/* Read-modify-write of data which has already been written out */
+static int direct_rmw(AVTIOCtx *io, const uint8_t *src, size_t len,
+                      avt_pos off)
+{
+    avt_pos start = off & ~((avt_pos)DIRECT_ALIGN - 1);
+    size_t size = ALIGN_UP(off + len) - start;
+
+    AVTBuffer tmp = { };
+    if (!avt_buffer_quick_alloc_aligned(&tmp, size, DIRECT_ALIGN, 0))
+        return AVT_ERROR(ENOMEM);
+
+    int err = 0;
+    for (size_t done = 0; done < size;) {
+        ssize_t ret = pread(io->fd, tmp.data + done, size - done, start + done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            err = ret < 0 ? avt_handle_errno(io, "Error reading: %i %s\n") :
+                            AVT_ERROR(EIO);
+            break;
+        }
+        done += ret;
+    }
+
+    if (err >= 0) {
+        memcpy(tmp.data + (off - start), src, len);
+        err = direct_pwrite(io, tmp.data, size, start);
+    }
+
+    avt_buffer_quick_unref(&tmp);
+    return err;
+}
+
+static int direct_rewrite_data(AVTIOCtx *io, const uint8_t *src, size_t len,
+                               avt_pos off)
+{
+    /* Part still in memory */
+    if ((off + len) > io->cur_off) {
+        size_t skip = off < io->cur_off ? io->cur_off - off : 0;
+        memcpy(direct_block(io, io->cur) + (off + skip - io->cur_off),
+               src + skip, len - skip);
+        len = skip;
+    }
+
+    if (!len)
+        return 0;
+
+    /* Pending blocks must be written before being modified on disk */
+    int err = direct_wait(io, 0);
+    if (err < 0)
+        return err;
+
+    return direct_rmw(io, src, len, off);
+}
+
+static avt_pos direct_rewrite(AVTIOCtx *io, AVTPktd *p, avt_pos off,
+                              int64_t timeout)
+{
+    size_t pl_len;
+    uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+
+    if ((off + p->hdr_len + pl_len) > io->wpos)
+        return AVT_ERROR(ERANGE);
+
+    int err = direct_rewrite_data(io, p->hdr.data, p->hdr_len, off);
+    if (err >= 0 && pl_len)
+        err = direct_rewrite_data(io, pl_data, pl_len, off + p->hdr_len);
+    if (err < 0)
+        return err;
+
+    return off;
+}
+
+static avt_pos direct_read_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
+                                 int64_t timeout, enum AVTIOReadFlags flags)
+{
+    uint8_t *dst = avt_buffer_get_data(buf, NULL);
+    len = io->rpos < io->wpos ? AVT_MIN(len, io->wpos - io->rpos) : 0;
+
+    /* Anything before the current block is, or will soon be, on disk */
+    size_t disk = io->rpos < io->cur_off ? AVT_MIN(len, io->cur_off - io->rpos) : 0;
+    if (disk) {
+        int err = direct_wait(io, 0);
+        if (err < 0)
+            return err;
+
+        for (size_t done = 0; done < disk;) {
+            ssize_t ret = pread(io->rfd, dst + done, disk - done, io->rpos + done);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            else if (ret < 0)
+                return avt_handle_errno(io, "Error reading: %i %s\n");
+            else if (!ret)
+                return AVT_ERROR(EIO);
+            done += ret;
+        }
+    }
+
+    if (len > disk)
+        memcpy(dst + disk,
+               direct_block(io, io->cur) + (io->rpos + disk - io->cur_off),
+               len - disk);
+
+    avt_buffer_resize(buf, len);
+
+    avt_pos ret = io->rpos + len;
+    AVT_SWAP(io->rpos, ret);
+    return ret;
+}
+
+static int direct_flush(AVTIOCtx *io, int64_t timeout)
+{
+    int err = direct_write_tail(io);
+    if (err < 0)
+        return err;
+
+    if (fdatasync(io->fd))
+        return avt_handle_errno(io, "Error flushing: %i %s\n");
+
+    return 0;
+}
+
+const AVTIO avt_io_direct_path = {
+    .name = "direct_path",
+    .type = AVT_IO_FILE,
+    .init = direct_init,
+    .get_max_pkt_len = direct_max_pkt_len,
+    .read_input = direct_read_input,
+    .write_vec = direct_write_vec,
+    .write_pkt = direct_write_pkt,
+    .rewrite = direct_rewrite,
+    .seek = direct_seek,
+    .flush = direct_flush,
+    .close = direct_close,
+};
@@ -24,6 +24,12 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "config.h"
+
+#ifdef CONFIG_HAVE_SYNC_FILE_RANGE
+#define _GNU_SOURCE // sync_file_range
+#endif
+#define _DEFAULT_SOURCE // preadv, pwritev
 #define _XOPEN_SOURCE 700 // pwrite, IOV_MAX
 
 #include "os_compat.h"
@@ -38,6 +44,7 @@
 
 #include "io_common.h"
 #include "io_utils.h"
+#include "io_sync.h"
 #include "utils_internal.h"
 
 #ifndef IOV_MAX
@@ -49,9 +56,14 @@ struct AVTIOCtx {
     int fd;
     struct iovec *iov;
 
+    /* Pipes and sockets have no offsets */
+    bool seekable;
+
     off_t rpos;
     off_t wpos;
     bool is_write;
+
+    AVTIOSync sync;
 };
 
 static COLD int fd_close(AVTIOCtx **_io)
@@ -96,6 +108,13 @@ static COLD int fd_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
         return ret;
     }
 
+    /* Continue from wherever the fd is */
+    off_t pos = lseek(io->fd, 0, SEEK_CUR);
+    io->seekable = pos >= 0;
+    io->rpos = io->wpos = io->seekable ? pos : 0;
+
+    avt_io_sync_init(&io->sync, addr->opts.sync_bytes, addr->opts.sync_period);
+
     *_io = io;
 
     return 0;
@@ -108,25 +127,48 @@ static int fd_init_path(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
     if (!io)
         return AVT_ERROR(ENOMEM);
 
-    io->iov = calloc(IOV_MAX, sizeof(*io->iov));
-    if (io->iov < 0) {
+    io->iov = calloc(IOV_MAX + 1, sizeof(*io->iov));
+    if (!io->iov) {
         free(io);
         return AVT_ERROR(ENOMEM);
     }
 
     io->fd = open(addr->path, O_CREAT | O_RDWR | O_CLOEXEC, 0666);
-    if (!io->fd) {
+    if (io->fd < 0) {
         ret = avt_handle_errno(io, "Error opening: %i %s\n");
         free(io->iov);
         free(io);
         return ret;
     }
 
+    io->seekable = true;
+
+    avt_io_sync_init(&io->sync, addr->opts.sync_bytes, addr->opts.sync_period);
+
     *_io = io;
 
     return 0;
 }
 
+#if IOV_MAX > 4
+#define IO_VECTORED
+
+static inline ssize_t fd_pwritev(AVTIOCtx *io, const struct iovec *iov,
+                                 int nb_iov, avt_pos off, int64_t timeout)
+{
+    if (!io->seekable)
+        return writev(io->fd, iov, nb_iov);
+    return pwritev(io->fd, iov, nb_iov, off);
+}
+
+static inline ssize_t fd_preadv(AVTIOCtx *io, const struct iovec *iov,
+                                int nb_iov, avt_pos off, int64_t timeout)
+{
+    if (!io->seekable)
+        return readv(io->fd, iov, nb_iov);
+    return preadv(io->fd, iov, nb_iov, off);
+}
+#else
 static inline int fd_seek_to(AVTIOCtx *io, int64_t pos)
 {
     return lseek(io->fd, pos, SEEK_SET);
@@ -148,90 +190,63 @@ static inline int64_t fd_offset(AVTIOCtx *io)
 {
     return lseek(io->fd, 0, SEEK_CUR);
 }
+#endif
 
 static int fd_flush(AVTIOCtx *io, int64_t timeout)
 {
+    /* Pipes and sockets cannot be synced */
+    if (!io->seekable)
+        return 0;
+
+    int64_t t = avt_get_time_ns();
     int ret = fsync(io->fd);
     if (ret)
-        ret = avt_handle_errno(io, "Error flushing: %i %s\n");
+        return avt_handle_errno(io, "Error flushing: %i %s\n");
 
-    return ret;
+    avt_io_sync_done(&io->sync, t, avt_get_time_ns());
+
+    return 0;
 }
 
-#if IOV_MAX > 4
-static int64_t fd_write_vec_native(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
-                                   int64_t timeout)
+static inline int fd_sync_check(AVTIOCtx *io, avt_pos off, size_t len)
 {
-    int64_t ret;
-    int nb_iov = 0;
-
-    while (nb_pkt) {
-        nb_iov = 0;
-        do {
-            io->iov[nb_iov + 0].iov_base = pkt->hdr;
-            io->iov[nb_iov + 0].iov_len  = pkt->hdr_len;
-            io->iov[nb_iov + 1].iov_base = avt_buffer_get_data(&pkt->pl,
-                                                               &io->iov[nb_iov + 1].iov_len);
-            nb_iov += 1 + !!io->iov[nb_iov + 1].iov_base;
-
-            pkt++;
-            nb_pkt--;
-        } while (nb_pkt && ((nb_iov + 2) > IOV_MAX));
-        ret = writev(io->fd, io->iov, nb_iov);
-        if (ret < 0) {
-            ret = avt_handle_errno(io, "Error flushing: %i %s\n");
-            io->wpos = fd_offset(io);
-            return ret;
-        }
-    }
-
-    off_t offset = fd_offset(io);
-    AVT_SWAP(io->wpos, offset);
-    return offset;
+    /* Pipes and sockets cannot be synced */
+    if (!io->seekable)
+        return 0;
+    return avt_io_sync_fd(&io->sync, io->fd, io, off, len);
 }
-#endif
 
-static int64_t fd_rewrite_native(AVTIOCtx *io, AVTPktd *p, int64_t off,
-                                 int64_t timeout)
+static void fd_get_stats(AVTIOCtx *io, AVTIOStats *stats)
 {
-    int64_t ret;
-    ret = pwrite(io->fd, p->hdr, p->hdr_len, off);
-    if (ret < 0) {
-        ret = avt_handle_errno(io, "Error writing: %i %s\n");
-        return ret;
-    }
-
-    size_t pl_len;
-    uint8_t *data = avt_buffer_get_data(&p->pl, &pl_len);
-    if (data) {
-        ret = pwrite(io->fd, data, pl_len, off + p->hdr_len);
-        if (ret < 0) {
-            ret = avt_handle_errno(io, "Error writing: %i %s\n");
-            return ret;
-        }
-    }
-
-    return off;
+    memset(stats, 0, sizeof(*stats));
+    avt_io_sync_stats(&io->sync, stats);
 }
 
 #define RENAME(x) fd_ ## x
 
+#define IO_SYNC
 #include "io_template.c"
 
+/* Writes to pipes and sockets can only append */
+static avt_pos fd_rewrite_seekable(AVTIOCtx *io, AVTPktd *p, avt_pos off,
+                                   int64_t timeout)
+{
+    if (!io->seekable)
+        return AVT_ERROR(ESPIPE);
+    return fd_rewrite(io, p, off, timeout);
+}
+
 const AVTIO avt_io_fd = {
     .name = "fd",
     .type = AVT_IO_FD,
     .init = fd_init,
     .get_max_pkt_len = fd_max_pkt_len,
     .read_input = fd_read_input,
-#if IOV_MAX > 4
-    .write_vec = fd_write_vec_native,
-#else
     .write_vec = fd_write_vec,
-#endif
     .write_pkt = fd_write_pkt,
-    .rewrite = fd_rewrite,
+    .rewrite = fd_rewrite_seekable,
     .seek = fd_seek,
+    .get_stats = fd_get_stats,
     .flush = fd_flush,
     .close = fd_close,
 };
@@ -242,14 +257,11 @@ const AVTIO avt_io_fd_path = {
     .init = fd_init_path,
     .get_max_pkt_len = fd_max_pkt_len,
     .read_input = fd_read_input,
-#if IOV_MAX > 4
-    .write_vec = fd_write_vec_native,
-#else
     .write_vec = fd_write_vec,
-#endif
     .write_pkt = fd_write_pkt,
-    .rewrite = fd_rewrite_native,
+    .rewrite = fd_rewrite_seekable,
     .seek = fd_seek,
+    .get_stats = fd_get_stats,
     .flush = fd_flush,
     .close = fd_close,
 };
@@ -29,9 +29,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <uchar.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "io_common.h"
 #include "io_utils.h"
+#include "io_coalesce.h"
+#include "io_sync.h"
 #include "utils_internal.h"
 
 struct AVTIOCtx {
@@ -39,6 +46,8 @@ struct AVTIOCtx {
     avt_pos rpos;
     avt_pos wpos;
     bool is_write;
+    AVTIOCoalesce co;
+    AVTIOSync sync;
 };
 
 static int file_handle_error(AVTIOCtx *io, const char *msg)
@@ -49,19 +58,6 @@ static int file_handle_error(AVTIOCtx *io, const char *msg)
     return AVT_ERROR(errno);
 }
 
-static COLD int file_close(AVTIOCtx **_io)
-{
-    AVTIOCtx *io = *_io;
-    int ret = fclose(io->f);
-    if (ret)
-        ret = file_handle_error(io, "Error closing: %s\n");
-
-    free(io);
-    *_io = NULL;
-
-    return ret;
-}
-
 static COLD int file_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
 {
     int ret;
@@ -69,9 +65,19 @@ static COLD int file_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
     if (!io)
         return AVT_ERROR(ENOMEM);
 
+    ret = avt_io_coalesce_init(&io->co, addr->opts.coalesce,
+                               addr->opts.coalesce_latency);
+    if (ret < 0) {
+        free(io);
+        return ret;
+    }
+
+    avt_io_sync_init(&io->sync, addr->opts.sync_bytes, addr->opts.sync_period);
+
     io->f = fopen(addr->path, "w+");
     if (!io->f) {
         ret = file_handle_error(io, "Error opening: %s\n");
+        avt_io_coalesce_free(&io->co);
         free(io);
         return ret;
     }
@@ -103,18 +109,76 @@ static inline avt_pos file_offset(AVTIOCtx *io)
     return ftello(io->f);
 }
 
-static int file_flush(AVTIOCtx *io, int64_t timeout)
+static int file_sync_check(AVTIOCtx *io, avt_pos off, size_t len);
+
+#define RENAME(x) file_ ## x
+
+#define IO_COALESCE
+#define IO_SYNC
+#include "io_template.c"
+
+/* Writes out all buffered data, and syncs it to storage if requested */
+static int file_sync(AVTIOCtx *io, bool sync, int64_t timeout)
 {
-    int ret = fflush(io->f);
+    int64_t t = avt_get_time_ns();
+    int ret = file_write_end(io, timeout);
+    if (ret < 0)
+        return ret;
+
+    ret = fflush(io->f);
     if (ret)
-        ret = file_handle_error(io, "Error flushing: %s\n");
+        return file_handle_error(io, "Error flushing: %s\n");
+
+    if (!sync)
+        return 0;
 
-    return ret;
+#ifdef _WIN32
+    ret = _commit(_fileno(io->f));
+#else
+    ret = fdatasync(fileno(io->f));
+#endif
+    if (ret)
+        return file_handle_error(io, "Error syncing: %s\n");
+
+    avt_io_sync_done(&io->sync, t, avt_get_time_ns());
+
+    return 0;
 }
 
-#define RENAME(x) file_ ## x
+/* Data sits in the stdio buffer until synced, so there is no writeback */
+static int file_sync_check(AVTIOCtx *io, avt_pos off, size_t len)
+{
+    if (!avt_io_sync_mark(&io->sync, off, len, avt_get_time_ns()))
+        return 0;
+    return file_sync(io, true, INT64_MAX);
+}
 
-#include "io_template.c"
+static int file_flush(AVTIOCtx *io, int64_t timeout)
+{
+    return file_sync(io, avt_io_sync_enabled(&io->sync), timeout);
+}
+
+static void file_get_stats(AVTIOCtx *io, AVTIOStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    avt_io_sync_stats(&io->sync, stats);
+}
+
+static COLD int file_close(AVTIOCtx **_io)
+{
+    AVTIOCtx *io = *_io;
+    int err = file_write_end(io, 0);
+
+    int ret = fclose(io->f);
+    if (ret)
+        ret = file_handle_error(io, "Error closing: %s\n");
+
+    avt_io_coalesce_free(&io->co);
+    free(io);
+    *_io = NULL;
+
+    return err < 0 ? err : ret;
+}
 
 const AVTIO avt_io_file = {
     .name = "file",
@@ -126,6 +190,7 @@ const AVTIO avt_io_file = {
     .write_pkt = file_write_pkt,
     .rewrite = file_rewrite,
     .seek = file_seek,
+    .get_stats = file_get_stats,
     .flush = file_flush,
     .close = file_close,
 };
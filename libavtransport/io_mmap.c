@@ -26,7 +26,8 @@
 
 #include "config.h"
 
-#if defined(CONFIG_HAVE_MREMAP) || defined(CONFIG_HAVE_FALLOCATE)
+#if defined(CONFIG_HAVE_MREMAP) || defined(CONFIG_HAVE_FALLOCATE) || \
+    defined(CONFIG_HAVE_SYNC_FILE_RANGE)
 #define _GNU_SOURCE
 #endif
 
@@ -37,114 +38,156 @@
 #include <fcntl.h>
 #include <sys/uio.h>
 #include <limits.h>
-
-#ifdef CONFIG_HAVE_MREMAP
 #include <sys/mman.h>
-#endif
 
 #include "io_common.h"
 #include "io_utils.h"
+#include "io_sync.h"
 #include "utils_internal.h"
 
 /* A reasonable default */
 #define MIN_ALLOC 1024*1024
 
+/* Files grow geometrically, by at most this much at a time */
+#define MAX_GROW (1024*1024*1024)
+
+/* Files larger than this are mapped in windows */
+#define MAX_MAP ((avt_pos)1024*1024*1024)
+
+/* Size of the mapping around the write position in windowed mode,
+ * and of mappings made for reads outside of it */
+#define WINDOW_SIZE 256*1024*1024
+#define READ_WINDOW 64*1024*1024
+
+/* How far ahead of reads to ask the kernel to page data in */
+#define READ_AHEAD 4*1024*1024
+
 struct AVTIOCtx {
     int fd;
+
+    /* Mapping starting at map_off. Covers the entire file,
+     * unless windowed, in which case it follows the write position. */
     AVTBuffer map;
+    avt_pos map_off;
+    bool windowed;
+
+    /* In windowed mode, mapping for reads outside of the window */
+    AVTBuffer rmap;
+    avt_pos rmap_off;
 
     avt_pos rpos;
     avt_pos wpos;
 
+    /* End of the data in the file. Anything after is padding. */
+    avt_pos end;
+
+    /* Allocated size of the file */
+    avt_pos size;
+
+    /* End of the region which read-ahead was requested for */
+    avt_pos advised;
+    size_t page_size;
+
     bool file_grew;
+
+    /* Durability policy, and the range written to since the last sync */
+    AVTIOSync sync;
 };
 
 static void mmap_buffer_free(void *opaque, void *base_data, size_t size)
 {
     munmap(base_data, size);
-    close((int)((intptr_t)opaque));
 }
 
 static COLD int mmap_close(AVTIOCtx **_io)
 {
     AVTIOCtx *io = *_io;
     avt_buffer_quick_unref(&io->map);
+    avt_buffer_quick_unref(&io->rmap);
     if (io->file_grew)
-        ftruncate(io->fd, io->wpos);
+        ftruncate(io->fd, io->end);
     close(io->fd);
     free(io);
     *_io = NULL;
     return 0;
 }
 
-static int fd_fallocate(AVTIOCtx *io, size_t len)
+static int fd_fallocate(AVTIOCtx *io, avt_pos off, size_t len)
 {
     int ret;
 #ifdef CONFIG_HAVE_FALLOCATE
-    if (fallocate(io->fd, 0, 0, len)) {
+    if (fallocate(io->fd, 0, off, len)) {
         ret = avt_handle_errno(io, "Error in fallocate(): %i %s\n");
         return ret;
     }
 #elif defined(CONFIG_HAVE_POSIX_FALLOCATE)
-    if ((errno = posix_fallocate(io->fd, 0, len))) {
+    if ((errno = posix_fallocate(io->fd, off, len))) {
         ret = avt_handle_errno(io, "Error in posix_fallocate(): %i %s\n");
         return ret;
     }
 #else /* OSX-code */
-    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, len};
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, len };
     ret = fcntl(io->fd, F_PREALLOCATE, &store);
     if (ret == -1) {
         store.fst_flags = F_ALLOCATEALL;
-        ret = fcntl(fd, F_PREALLOCATE, &store);
+        ret = fcntl(io->fd, F_PREALLOCATE, &store);
         if (ret == -1) {
             ret = avt_handle_errno(io, "Error in fnctl(): %i %s\n");
             return ret;
         }
     }
+    /* Preallocation does not change the file size */
+    if (ftruncate(io->fd, off + len))
+        return avt_handle_errno(io, "Error in ftruncate(): %i %s\n");
 #endif
     return 0;
 }
 
+/* Maps len bytes of the file at off, which must be page-aligned */
+static int mmap_map(AVTIOCtx *io, AVTBuffer *dst, avt_pos off, size_t len,
+                    int flags)
+{
+    void *data = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | flags, io->fd, off);
+    if (data == MAP_FAILED)
+        return avt_handle_errno(io, "Error in mmap(): %i %s\n");
+
+    /* Reads are mostly sequential */
+    posix_madvise(data, len, POSIX_MADV_SEQUENTIAL);
+
+    int ret = avt_buffer_quick_create(dst, data, len, NULL,
+                                      mmap_buffer_free,
+                                      AVT_BUFFER_FLAG_READ_ONLY);
+    if (ret < 0)
+        munmap(data, len);
+
+    return ret;
+}
+
 static COLD int mmap_init_common(AVTContext *ctx, AVTIOCtx *io)
 {
     int ret;
 
-    size_t len = lseek(io->fd, SEEK_END, 0);
-    if (!len) {
-        len = MIN_ALLOC;
-        ret = fd_fallocate(io, len);
+    off_t size = lseek(io->fd, 0, SEEK_END);
+    if (size < 0)
+        return avt_handle_errno(io, "Error in lseek(): %i %s\n");
+
+    io->end = io->size = size;
+    io->page_size = sysconf(_SC_PAGESIZE);
+
+    if (!size) {
+        ret = fd_fallocate(io, 0, MIN_ALLOC);
         if (ret < 0)
             return ret;
+        io->size = MIN_ALLOC;
         io->file_grew = 1;
     }
 
-    int fd_dup = dup(io->fd);
-    if (fd_dup < 0)
-        return avt_handle_errno(io, "Error in dup(): %i %s\n");
+    /* Writing starts at the beginning of the file */
+    io->windowed = io->size > MAX_MAP;
+    size_t len = io->windowed ? WINDOW_SIZE : io->size;
 
-    void *data = mmap(NULL, len, PROT_READ | PROT_WRITE,
-                      MAP_SHARED |
-                      MAP_POPULATE |
-                      MAP_NONBLOCK,
-                      fd_dup, 0);
-
-    if (!data) {
-        ret = avt_handle_errno(io, "Error in mmap(): %i %s\n");
-        close(fd_dup);
-        return ret;
-    }
-
-    ret = avt_buffer_quick_create(&io->map, data, len,
-                                  (void *)((intptr_t)fd_dup),
-                                  mmap_buffer_free,
-                                  AVT_BUFFER_FLAG_READ_ONLY);
-    if (ret < 0) {
-        munmap(data, len);
-        close(fd_dup);
-        return ret;
-    }
-
-    return 0;
+    return mmap_map(io, &io->map, 0, len, MAP_POPULATE | MAP_NONBLOCK);
 }
 
 static COLD int mmap_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
@@ -154,6 +197,8 @@ static COLD int mmap_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
     if (!io)
         return AVT_ERROR(ENOMEM);
 
+    avt_io_sync_init(&io->sync, addr->opts.sync_bytes, addr->opts.sync_period);
+
     io->fd = dup(addr->fd);
     if (io->fd < 0) {
         ret = avt_handle_errno(io, "Error duplicating fd: %i %s\n");
@@ -180,6 +225,8 @@ static COLD int mmap_init_path(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr
     if (!io)
         return AVT_ERROR(ENOMEM);
 
+    avt_io_sync_init(&io->sync, addr->opts.sync_bytes, addr->opts.sync_period);
+
     io->fd = open(addr->path, O_CREAT | O_RDWR | O_CLOEXEC, 0666);
     if (io->fd < 0) {
         ret = avt_handle_errno(io, "Error opening: %i %s\n");
@@ -199,77 +246,148 @@ static COLD int mmap_init_path(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr
     return 0;
 }
 
-static int mmap_grow(AVTIOCtx *io, size_t amount)
+/* Grows the file to at least new_end, geometrically */
+static int mmap_grow(AVTIOCtx *io, avt_pos new_end)
 {
-    int ret;
-    size_t old_map_size;
-    uint8_t *old_map = avt_buffer_get_data(&io->map, &old_map_size);
-    void *new_map = MAP_FAILED;
-
-    amount = AVT_MAX(amount, MIN_ALLOC);
-    size_t new_map_size = old_map_size + amount;
+    avt_pos amount = AVT_MIN(AVT_MAX(io->size, MIN_ALLOC), MAX_GROW);
+    amount = AVT_MAX(amount, new_end - io->size);
 
-    /* Grow file */
-    ret = fd_fallocate(io, new_map_size);
+    int ret = fd_fallocate(io, io->size, amount);
     if (ret < 0)
         return ret;
 
+    io->size += amount;
+
     /* Trim the file at the end, stripping it of padding, if it was grown */
     io->file_grew = true;
 
-#if CONFIG_HAVE_MREMAP
-    /* First, attempt to remap the old mapping, and retaining its address.
-     * If there's only a single reference to the map (ours), allow it to be
-     * moved. */
-    new_map = mremap(old_map, old_map_size, new_map_size,
-                     avt_buffer_get_refcount(&io->map) == 1 ? MREMAP_MAYMOVE :
-                                                              0);
-
-    /* Success */
-    if (new_map != MAP_FAILED) {
-        /* Update the existing buffer */
-        avt_buffer_update(&io->map, new_map, new_map_size);
-        return 0;
-    } else if (new_map == MAP_FAILED && errno != ENOMEM) {
-        ret = avt_handle_errno(io, "Error in mremap(): %i %s\n");
-        return ret;
+    return 0;
+}
+
+/* Remaps the entire file after it grew */
+static int mmap_remap(AVTIOCtx *io)
+{
+#ifdef CONFIG_HAVE_MREMAP
+    /* If there's only a single reference to the map (ours), remap it.
+     * Otherwise, readers still reference the old mapping. */
+    if (avt_buffer_get_refcount(&io->map) == 1) {
+        size_t old_map_size;
+        uint8_t *old_map = avt_buffer_get_data(&io->map, &old_map_size);
+        void *new_map = mremap(old_map, old_map_size, io->size,
+                               MREMAP_MAYMOVE);
+
+        /* Success */
+        if (new_map != MAP_FAILED) {
+            /* Update the existing buffer */
+            avt_buffer_update(&io->map, new_map, io->size);
+            return 0;
+        } else if (errno != ENOMEM) {
+            return avt_handle_errno(io, "Error in mremap(): %i %s\n");
+        }
     }
 #endif
 
-    /* Recreate the mapping */
-    int fd_dup = dup(io->fd);
-    if (fd_dup < 0)
-        return avt_handle_errno(io, "Error in dup(): %i %s\n");
-
-    if (fcntl(fd_dup, F_SETFD, FD_CLOEXEC) == -1) {
-        ret = avt_handle_errno(io, "Error in fcntl(F_SETFD, FD_CLOEXEC): %i %s\n");
-        close(fd_dup);
+    /* Recreate the mapping. Only what's new needs to be paged in. */
+    AVTBuffer new_buf;
+    int ret = mmap_map(io, &new_buf, 0, io->size, 0);
+    if (ret < 0)
         return ret;
+
+    size_t old_len = avt_buffer_get_data_len(&io->map);
+    posix_madvise(new_buf.data + old_len, io->size - old_len,
+                  POSIX_MADV_WILLNEED);
+
+    avt_buffer_quick_unref(&io->map);
+    io->map = new_buf;
+
+    return 0;
+}
+
+/* Returns whether a range is contained in a mapping */
+static inline bool mmap_has(const AVTBuffer *map, avt_pos map_off,
+                            avt_pos off, size_t len)
+{
+    return map->ctrl && (off >= map_off) &&
+           ((off + len) <= (map_off + map->len));
+}
+
+/* Returns a pointer to len bytes at the write position */
+static uint8_t *mmap_reserve(AVTIOCtx *io, size_t len, int *err)
+{
+    avt_pos off = io->wpos;
+    if (mmap_has(&io->map, io->map_off, off, len))
+        return io->map.data + (off - io->map_off);
+
+    if ((off + len) > io->size) {
+        *err = mmap_grow(io, off + len);
+        if (*err < 0)
+            return NULL;
     }
 
-    void *data = mmap(NULL, new_map_size, PROT_READ | PROT_WRITE,
-                      MAP_SHARED |
-                      MAP_POPULATE,
-                      fd_dup, 0);
-    if (data == MAP_FAILED) {
-        ret = avt_handle_errno(io, "Error in mmap(): %i %s\n");
-        close(fd_dup);
-        return ret;
+    /* Switch to a window once the file gets too large to map entirely */
+    if (!io->windowed && io->size > MAX_MAP)
+        io->windowed = true;
+
+    if (!io->windowed) {
+        *err = mmap_remap(io);
+        if (*err < 0)
+            return NULL;
+        return io->map.data + off;
     }
 
+    /* Slide the window. Readers keep any data they reference mapped. */
+    avt_pos start = off & ~((avt_pos)io->page_size - 1);
+    size_t win = AVT_MIN(AVT_MAX(WINDOW_SIZE, off + len - start),
+                         io->size - start);
+
     AVTBuffer new_buf;
-    ret = avt_buffer_quick_create(&new_buf, data, new_map_size,
-                                  (void *)((intptr_t)fd_dup),
-                                  mmap_buffer_free,
-                                  AVT_BUFFER_FLAG_READ_ONLY);
-    if (ret < 0) {
-        munmap(data, new_map_size);
-        close(fd_dup);
-        return ret;
-    }
+    *err = mmap_map(io, &new_buf, start, win, 0);
+    if (*err < 0)
+        return NULL;
 
     avt_buffer_quick_unref(&io->map);
     io->map = new_buf;
+    io->map_off = start;
+
+    return io->map.data + (off - io->map_off);
+}
+
+/* Syncs the range written to since the last sync. Only the dirty part
+ * of the mapping is synced, unless it was partly written through
+ * an earlier window, in which case the whole file is. */
+static int mmap_sync(AVTIOCtx *io, int flags)
+{
+    AVTIOSync *s = &io->sync;
+    if (!s->pending)
+        return 0;
+
+    int64_t t = avt_get_time_ns();
+    avt_pos start = s->start & ~((avt_pos)io->page_size - 1);
+    if (mmap_has(&io->map, io->map_off, start, s->end - start)) {
+        if (msync(io->map.data + (start - io->map_off), s->end - start, flags) < 0)
+            return avt_handle_errno(io, "Error syncing: %i %s\n");
+    } else if ((flags & MS_SYNC) && fdatasync(io->fd) < 0) {
+        return avt_handle_errno(io, "Error syncing: %i %s\n");
+    }
+
+    if (flags & MS_SYNC)
+        avt_io_sync_done(s, t, avt_get_time_ns());
+
+    return 0;
+}
+
+static int mmap_sync_check(AVTIOCtx *io, avt_pos off, size_t len)
+{
+    if (avt_io_sync_mark(&io->sync, off, len, avt_get_time_ns()))
+        return mmap_sync(io, MS_SYNC);
+
+#ifdef CONFIG_HAVE_SYNC_FILE_RANGE
+    /* Dirty pages in shared mappings are written back just the same */
+    avt_pos wb_off;
+    size_t wb_len;
+    if (avt_io_sync_writeback(&io->sync, &wb_off, &wb_len))
+        sync_file_range(io->fd, wb_off, wb_len, SYNC_FILE_RANGE_WRITE);
+#endif
 
     return 0;
 }
@@ -282,61 +400,66 @@ static int mmap_max_pkt_len(AVTIOCtx *io, size_t *mtu)
 
 static inline avt_pos mmap_seek(AVTIOCtx *io, avt_pos pos)
 {
-    if (pos > avt_buffer_get_data_len(&io->map))
+    if (pos > io->end)
         return AVT_ERROR(ERANGE);
+    io->advised = pos;
     return (io->rpos = pos);
 }
 
 static avt_pos mmap_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
 {
+    int ret;
     size_t pl_len;
     uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
 
-    size_t map_size;
-    uint8_t *map_data = avt_buffer_get_data(&io->map, &map_size);
-
-    if ((io->wpos + p->hdr_len + pl_len) > map_size) {
-        int ret = mmap_grow(io, p->hdr_len + pl_len);
-        if (ret < 0)
-            return ret;
-    }
+    uint8_t *dst = mmap_reserve(io, p->hdr_len + pl_len, &ret);
+    if (!dst)
+        return ret;
 
-    map_data = avt_buffer_get_data(&io->map, &map_size);
-    memcpy(&map_data[io->wpos], p->hdr, p->hdr_len);
-    memcpy(&map_data[io->wpos + p->hdr_len], pl_data, pl_len);
+    memcpy(dst, p->hdr.data, p->hdr_len);
+    if (pl_len)
+        memcpy(dst + p->hdr_len, pl_data, pl_len);
 
     avt_pos offset = io->wpos + p->hdr_len + pl_len;
     AVT_SWAP(io->wpos, offset);
+    io->end = AVT_MAX(io->end, io->wpos);
+
+    ret = mmap_sync_check(io, offset, io->wpos - offset);
+    if (ret < 0)
+        return ret;
+
     return offset;
 }
 
 static avt_pos mmap_write_vec(AVTIOCtx *io, AVTPktd *iov, uint32_t nb_iov,
                               int64_t timeout)
 {
+    int ret;
     uint8_t *pl_data;
     size_t pl_len, sum = 0;
     for (int i = 0; i < nb_iov; i++)
         sum += iov[i].hdr_len + avt_buffer_get_data_len(&iov[i].pl);
 
-    size_t map_size;
-    uint8_t *map_data = avt_buffer_get_data(&io->map, &map_size);
-
-    if ((io->wpos + sum) > map_size) {
-        int ret = mmap_grow(io, sum);
-        if (ret < 0)
-            return ret;
-    }
+    uint8_t *dst = mmap_reserve(io, sum, &ret);
+    if (!dst)
+        return ret;
 
-    avt_pos offset = io->wpos;
-    map_data = avt_buffer_get_data(&io->map, &map_size);
     for (int i = 0; i < nb_iov; i++) {
         pl_data = avt_buffer_get_data(&iov[i].pl, &pl_len);
-        memcpy(&map_data[offset], iov[i].hdr, iov[i].hdr_len);
-        memcpy(&map_data[offset + iov[i].hdr_len], pl_data, pl_len);
-        offset += iov[i].hdr_len + pl_len;
+        memcpy(dst, iov[i].hdr.data, iov[i].hdr_len);
+        if (pl_len)
+            memcpy(dst + iov[i].hdr_len, pl_data, pl_len);
+        dst += iov[i].hdr_len + pl_len;
     }
 
+    avt_pos offset = io->wpos + sum;
     AVT_SWAP(io->wpos, offset);
+    io->end = AVT_MAX(io->end, io->wpos);
+
+    ret = mmap_sync_check(io, offset, sum);
+    if (ret < 0)
+        return ret;
+
     return offset;
 }
 
@@ -345,15 +468,33 @@ static avt_pos mmap_rewrite(AVTIOCtx *io, AVTPktd *p, avt_pos off,
 {
     size_t pl_len;
     uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+    size_t len = p->hdr_len + pl_len;
 
-    size_t map_size;
-    uint8_t *map_data = avt_buffer_get_data(&io->map, &map_size);
-
-    if ((off + p->hdr_len + pl_len) > map_size)
+    if ((off + len) > io->size)
         return AVT_ERROR(ERANGE);
 
-    memcpy(&map_data[off], p->hdr, p->hdr_len);
-    memcpy(&map_data[off + p->hdr_len], pl_data, pl_len);
+    /* Outside of the window, map just what's needed */
+    AVTBuffer tmp = { };
+    uint8_t *dst;
+    if (mmap_has(&io->map, io->map_off, off, len)) {
+        dst = io->map.data + (off - io->map_off);
+    } else {
+        avt_pos start = off & ~((avt_pos)io->page_size - 1);
+        int ret = mmap_map(io, &tmp, start, off + len - start, 0);
+        if (ret < 0)
+            return ret;
+        dst = tmp.data + (off - start);
+    }
+
+    memcpy(dst, p->hdr.data, p->hdr_len);
+    if (pl_len)
+        memcpy(dst + p->hdr_len, pl_data, pl_len);
+
+    avt_buffer_quick_unref(&tmp);
+
+    int ret = mmap_sync_check(io, off, len);
+    if (ret < 0)
+        return ret;
 
     return off;
 }
@@ -362,18 +503,50 @@ static inline int64_t mmap_read(AVTIOCtx *io, AVTBuffer *dst,
                                 size_t len, int64_t timeout,
                                 enum AVTIOReadFlags flags)
 {
-    size_t map_size;
-    uint8_t *map_data = avt_buffer_get_data(&io->map, &map_size);
+    /* Never hand out padding past the end of the data */
+    len = io->rpos < io->end ? AVT_MIN(io->end - io->rpos, len) : 0;
+
+    /* Find a mapping with the data, or map it */
+    AVTBuffer *src = &io->map;
+    avt_pos src_off = io->map_off;
+    if (len && !mmap_has(src, src_off, io->rpos, len)) {
+        src = &io->rmap;
+        if (!mmap_has(&io->rmap, io->rmap_off, io->rpos, len)) {
+            avt_pos start = io->rpos & ~((avt_pos)io->page_size - 1);
+            size_t win = AVT_MIN(AVT_MAX(READ_WINDOW, io->rpos + len - start),
+                                 io->size - start);
+
+            avt_buffer_quick_unref(&io->rmap);
+            int ret = mmap_map(io, &io->rmap, start, win, 0);
+            if (ret < 0)
+                return ret;
+            io->rmap_off = start;
+        }
+        src_off = io->rmap_off;
+    }
 
-    /* TODO: cap map_size at wpos? */
-    len = AVT_MIN(map_size - io->rpos, len);
+    size_t src_pos = io->rpos - src_off;
+
+    /* Ask for the data after this read to be paged in */
+    avt_pos next = io->rpos + len;
+    if ((next + READ_AHEAD/2) > io->advised && io->end > next) {
+        avt_pos start = AVT_MAX(io->advised, next) & ~((avt_pos)io->page_size - 1);
+        avt_pos stop = AVT_MIN(AVT_MIN(next + READ_AHEAD, io->end),
+                               src_off + src->len);
+        if (stop > start && start >= src_off)
+            posix_madvise(src->data + (start - src_off), stop - start,
+                          POSIX_MADV_WILLNEED);
+        io->advised = stop;
+    }
 
     if (flags & AVT_IO_READ_MUTABLE) {
-        dst = avt_buffer_get_data(dst, NULL);
-        memcpy(dst, &map_data[io->rpos], len);
+        if (len)
+            memcpy(avt_buffer_get_data(dst, NULL), src->data + src_pos, len);
+        avt_buffer_resize(dst, len);
     } else {
         avt_buffer_quick_unref(dst);
-        avt_buffer_quick_ref(dst, &io->map, io->rpos, len);
+        if (len)
+            avt_buffer_quick_ref(dst, src, src_pos, len);
     }
 
     len = io->rpos + len;
@@ -383,14 +556,13 @@ static inline int64_t mmap_read(AVTIOCtx *io, AVTBuffer *dst,
 
 static int mmap_flush(AVTIOCtx *io, int64_t timeout)
 {
-    size_t map_size;
-    uint8_t *map_data = avt_buffer_get_data(&io->map, &map_size);
-
-    int ret = msync(map_data, map_size, timeout == 0 ? MS_ASYNC : MS_SYNC);
-    if (ret < 0)
-        ret = avt_handle_errno(io, "Error flushing: %i %s\n");
+    return mmap_sync(io, timeout == 0 ? MS_ASYNC : MS_SYNC);
+}
 
-    return ret;
+static void mmap_get_stats(AVTIOCtx *io, AVTIOStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    avt_io_sync_stats(&io->sync, stats);
 }
 
 const AVTIO avt_io_mmap = {
@@ -403,6 +575,7 @@ const AVTIO avt_io_mmap = {
     .write_pkt = mmap_write_pkt,
     .rewrite = mmap_rewrite,
     .seek = mmap_seek,
+    .get_stats = mmap_get_stats,
     .flush = mmap_flush,
     .close = mmap_close,
 };
@@ -417,6 +590,7 @@ const AVTIO avt_io_mmap_path = {
     .write_pkt = mmap_write_pkt,
     .rewrite = mmap_rewrite,
     .seek = mmap_seek,
+    .get_stats = mmap_get_stats,
     .flush = mmap_flush,
     .close = mmap_close,
 };
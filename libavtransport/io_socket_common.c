@@ -163,10 +163,13 @@ static int setup_ip_socket(void *log_ctx, AVTSocketCommon *sc, AVTAddress *addr,
 
 #ifdef SO_RXQ_OVFL
     /* Turn on dropped packet counter */
-    SET_SOCKET_OPT(log_ctx, sc->socket, SOL_SOCKET, SO_RXQ_OVFL, (int)0);
+    SET_SOCKET_OPT(log_ctx, sc->socket, SOL_SOCKET, SO_RXQ_OVFL, (int)1);
 #endif
 
-    /* Turn CORK, SEGMENT and GRO very very off */
+    /* Turn CORK and SEGMENT very very off.
+     * Segmentation offload, if enabled, is requested per message.
+     * Receive offload is only enabled on request, as it coalesces datagrams,
+     * which the reader has to split back up. */
 #ifdef UDP_CORK
     SET_SOCKET_OPT(log_ctx, sc->socket, proto, UDP_CORK, (int)0);
 #endif
@@ -174,7 +177,7 @@ static int setup_ip_socket(void *log_ctx, AVTSocketCommon *sc, AVTAddress *addr,
     SET_SOCKET_OPT(log_ctx, sc->socket, proto, UDP_SEGMENT, (int)0);
 #endif
 #ifdef UDP_GRO
-    SET_SOCKET_OPT(log_ctx, sc->socket, proto, UDP_GRO, (int)0);
+    SET_SOCKET_OPT(log_ctx, sc->socket, proto, UDP_GRO, (int)addr->opts.gro);
 #endif
 
     /* Disable IPv6 only */
@@ -0,0 +1,166 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AVTRANSPORT_IO_SYNC_H
+#define AVTRANSPORT_IO_SYNC_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "io_common.h"
+#include "io_utils.h"
+#include "utils_internal.h"
+
+/* Data is handed to the kernel for write-behind in chunks of this size */
+#define AVT_IO_SYNC_WRITEBACK (1024*1024)
+
+/* Group-commit durability policy.
+ * Writes are accounted for, and once enough bytes have been written,
+ * or the oldest unsynced write is old enough, a sync is due.
+ * Both are only checked on writes, there is no timer.
+ * Between syncs, written data may be handed off for writeback early,
+ * so that the sync itself has less to do. */
+typedef struct AVTIOSync {
+    size_t bytes;    /* Sync once this many bytes are unsynced */
+    int64_t period;  /* Sync once the oldest unsynced data is this old */
+
+    avt_pos start;   /* Range written to since the last sync */
+    avt_pos end;
+    size_t pending;  /* Bytes written since the last sync */
+    int64_t first;   /* Time of the oldest unsynced write */
+    avt_pos wb;      /* Writeback has been started up to here */
+
+    /* Counters */
+    uint64_t nb_syncs;
+    uint64_t synced;
+    int64_t sync_time;
+    int64_t sync_time_max;
+} AVTIOSync;
+
+/* Both limits at 0 disable the policy. Syncs are still counted. */
+static inline void avt_io_sync_init(AVTIOSync *s, size_t bytes, int64_t period)
+{
+    memset(s, 0, sizeof(*s));
+    s->bytes = bytes;
+    s->period = period;
+}
+
+static inline bool avt_io_sync_enabled(const AVTIOSync *s)
+{
+    return s->bytes || s->period;
+}
+
+/* Accounts for len bytes written at off. Written ranges are tracked
+ * even with the policy disabled, so that flushes can be limited to them.
+ * Returns true if a sync is due. */
+static inline bool avt_io_sync_mark(AVTIOSync *s, avt_pos off, size_t len,
+                                    int64_t now)
+{
+    if (!len)
+        return false;
+
+    if (!s->pending) {
+        s->first = now;
+        s->start = off;
+        s->end = off + len;
+        s->wb = AVT_MAX(s->wb, off);
+    } else {
+        s->start = AVT_MIN(s->start, off);
+        s->end = AVT_MAX(s->end, off + len);
+    }
+    s->pending += len;
+
+    return avt_io_sync_enabled(s) &&
+           ((s->bytes && (s->pending >= s->bytes)) ||
+            (s->period && ((now - s->first) >= s->period)));
+}
+
+/* Returns true, and the range to start writeback on, if enough
+ * contiguous data past the last such range has been written */
+static inline bool avt_io_sync_writeback(AVTIOSync *s, avt_pos *off,
+                                         size_t *len)
+{
+    if (!avt_io_sync_enabled(s) || !s->pending || s->wb < s->start ||
+        (s->end - s->wb) < AVT_IO_SYNC_WRITEBACK)
+        return false;
+
+    *off = s->wb;
+    *len = s->end - s->wb;
+    s->wb = s->end;
+    return true;
+}
+
+/* Records a sync which took from t_start to t_end, and empties the range */
+static inline void avt_io_sync_done(AVTIOSync *s, int64_t t_start,
+                                    int64_t t_end)
+{
+    int64_t t = t_end - t_start;
+    s->nb_syncs++;
+    s->synced += s->pending;
+    s->sync_time += t;
+    s->sync_time_max = AVT_MAX(s->sync_time_max, t);
+    s->pending = 0;
+}
+
+#ifndef _WIN32
+/* Starts writeback of new data, or syncs the file if due.
+ * Writeback needs _GNU_SOURCE for sync_file_range. */
+static inline int avt_io_sync_fd(AVTIOSync *s, int fd, void *log_ctx,
+                                 avt_pos off, size_t len)
+{
+    int64_t now = avt_get_time_ns();
+    if (!avt_io_sync_mark(s, off, len, now)) {
+#if defined(CONFIG_HAVE_SYNC_FILE_RANGE) && defined(SYNC_FILE_RANGE_WRITE)
+        avt_pos wb_off;
+        size_t wb_len;
+        if (avt_io_sync_writeback(s, &wb_off, &wb_len))
+            sync_file_range(fd, wb_off, wb_len, SYNC_FILE_RANGE_WRITE);
+#endif
+        return 0;
+    }
+
+    if (fdatasync(fd))
+        return avt_handle_errno(log_ctx, "Error syncing: %i %s\n");
+
+    avt_io_sync_done(s, now, avt_get_time_ns());
+    return 0;
+}
+#endif
+
+static inline void avt_io_sync_stats(const AVTIOSync *s, AVTIOStats *stats)
+{
+    stats->nb_syncs = s->nb_syncs;
+    stats->sync_bytes = s->synced;
+    stats->sync_time = s->sync_time;
+    stats->sync_time_max = s->sync_time_max;
+}
+
+#endif /* AVTRANSPORT_IO_SYNC_H */
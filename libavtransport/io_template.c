@@ -24,21 +24,273 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <errno.h>
 #include <stdckdint.h>
 #include <inttypes.h>
 #include <string.h>
 
 #include "utils_internal.h"
 
+#ifdef IO_COALESCE
+#include "io_coalesce.h"
+#endif
+
+/* With IO_SYNC, the backend must implement RENAME(sync_check), which is
+ * called with the range of each write, and syncs according to its policy */
+#ifdef IO_SYNC
+#include "io_sync.h"
+#endif
+
 static int RENAME(max_pkt_len)(AVTIOCtx *io, size_t *mtu)
 {
     *mtu = SIZE_MAX;
     return 0;
 }
 
+#ifdef IO_VECTORED
+
+/* Positional, vectored I/O. RENAME(pwritev) and RENAME(preadv) must not
+ * change the file offset, so no seeking is needed between reads and writes. */
+
 [[maybe_unused]] static avt_pos RENAME(seek)(AVTIOCtx *io, avt_pos off)
 {
-    avt_pos ret = RENAME(seek_to)(io, off);
+    return (io->rpos = off);
+}
+
+static avt_pos RENAME(read_input)(AVTIOCtx *io, AVTBuffer *buf, size_t len,
+                                  int64_t timeout, enum AVTIOReadFlags flags)
+{
+    int64_t ret;
+    struct iovec iov = {
+        .iov_base = avt_buffer_get_data(buf, NULL),
+        .iov_len = len,
+    };
+
+    do {
+        ret = RENAME(preadv)(io, &iov, 1, io->rpos, timeout);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return avt_handle_errno(io, "Error reading: %i %s\n");
+
+    /* Adjust new size in case of underreads */
+    [[maybe_unused]] int tmp = avt_buffer_resize(buf, ret);
+    avt_assert2(tmp >= 0);
+
+    ret = io->rpos + ret;
+    AVT_SWAP(io->rpos, ret);
+    return ret;
+}
+
+/* Write out iovecs, resuming after short writes */
+static int RENAME(pwritev_all)(AVTIOCtx *io, struct iovec *iov, int nb_iov,
+                               avt_pos *off, int64_t timeout)
+{
+    while (nb_iov) {
+        ssize_t ret = RENAME(pwritev)(io, iov, nb_iov, *off, timeout);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        else if (ret < 0)
+            return avt_handle_errno(io, "Error writing: %i %s\n");
+        else if (!ret)
+            return AVT_ERROR(EIO);
+
+        *off += ret;
+
+        /* Skip what was written */
+        while (nb_iov && ((size_t)ret >= iov->iov_len)) {
+            ret -= iov->iov_len;
+            iov++;
+            nb_iov--;
+        }
+        if (nb_iov) {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+/* Gather the headers and payloads of as many packets as IOV_MAX allows
+ * into each call */
+static avt_pos RENAME(write_vec)(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                                 int64_t timeout)
+{
+    int ret;
+    avt_pos off = io->wpos;
+
+    while (nb_pkt) {
+        int nb_iov = 0;
+        do {
+            io->iov[nb_iov].iov_base = pkt->hdr.data;
+            io->iov[nb_iov].iov_len  = pkt->hdr_len;
+            io->iov[nb_iov + 1].iov_base = avt_buffer_get_data(&pkt->pl,
+                                                               &io->iov[nb_iov + 1].iov_len);
+            nb_iov += 1 + !!io->iov[nb_iov + 1].iov_len;
+
+            pkt++;
+            nb_pkt--;
+        } while (nb_pkt && ((nb_iov + 2) <= IOV_MAX));
+
+        ret = RENAME(pwritev_all)(io, io->iov, nb_iov, &off, timeout);
+        if (ret < 0) {
+            io->wpos = off;
+            return ret;
+        }
+    }
+
+    AVT_SWAP(io->wpos, off);
+
+#ifdef IO_SYNC
+    ret = RENAME(sync_check)(io, off, io->wpos - off);
+    if (ret < 0)
+        return ret;
+#endif
+
+    return off;
+}
+
+static avt_pos RENAME(write_pkt)(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
+{
+    return RENAME(write_vec)(io, p, 1, timeout);
+}
+
+[[maybe_unused]] static avt_pos RENAME(rewrite)(AVTIOCtx *io, AVTPktd *p,
+                                                avt_pos off, int64_t timeout)
+{
+    if (off > io->wpos) {
+        avt_log(io, AVT_LOG_ERROR, "Error rewriting: out of range: "
+                "%" PRIu64 " req vs %" PRIu64 " max\n",
+                off, io->wpos);
+        return AVT_ERROR(EOF);
+    }
+
+    struct iovec iov[2] = { { p->hdr.data, p->hdr_len } };
+    iov[1].iov_base = avt_buffer_get_data(&p->pl, &iov[1].iov_len);
+
+    avt_pos end = off;
+    int ret = RENAME(pwritev_all)(io, iov, 1 + !!iov[1].iov_len, &end, timeout);
+    if (ret < 0)
+        return ret;
+
+#ifdef IO_SYNC
+    ret = RENAME(sync_check)(io, off, end - off);
+    if (ret < 0)
+        return ret;
+#endif
+
+    return off;
+}
+
+#else
+
+#ifdef IO_COALESCE
+
+/* Optional write coalescing. The context must contain an AVTIOCoalesce co.
+ * Staged data only exists while io->is_write is set, and io->wpos always
+ * includes it. */
+
+static int RENAME(coalesce_flush)(AVTIOCtx *io, int64_t timeout)
+{
+    if (!io->co.len)
+        return 0;
+
+    size_t out = RENAME(write)(io, io->co.buf.data, io->co.len, timeout);
+    if (out != io->co.len) {
+        int ret = avt_handle_errno(io, "Error writing: %i %s\n");
+        io->co.len = 0;
+        io->wpos = RENAME(offset)(io);
+        return ret;
+    }
+
+    io->co.len = 0;
+    return 0;
+}
+
+#endif
+
+/* Writes a single packet at the current position, and advances io->wpos */
+static int RENAME(write_data)(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
+{
+    int ret;
+    size_t out;
+    size_t pl_len;
+    uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+
+#ifdef IO_COALESCE
+    if (avt_io_coalesce_enabled(&io->co)) {
+        int64_t now = avt_get_time_ns();
+        bool small = avt_io_coalesce_small(&io->co, pl_len);
+        size_t len = p->hdr_len + (small ? pl_len : 0);
+
+        if (avt_io_coalesce_full(&io->co, len)) {
+            ret = RENAME(coalesce_flush)(io, timeout);
+            if (ret < 0)
+                return ret;
+        }
+
+        /* Large payloads go out right after their header, without a copy */
+        avt_io_coalesce_copy(&io->co, p->hdr.data, p->hdr_len, now);
+        if (small)
+            avt_io_coalesce_copy(&io->co, pl_data, pl_len, now);
+        io->wpos += len;
+
+        if (!small || avt_io_coalesce_due(&io->co, now)) {
+            ret = RENAME(coalesce_flush)(io, timeout);
+            if (ret < 0)
+                return ret;
+        }
+
+        if (small || !pl_data)
+            return 0;
+
+        goto payload;
+    }
+#endif
+
+    /* Header */
+    out = RENAME(write)(io, p->hdr.data, p->hdr_len, timeout);
+    if (out != p->hdr_len) {
+        ret = avt_handle_errno(io, "Error writing: %i %s\n");
+        io->wpos = RENAME(offset)(io);
+        return ret;
+    }
+    io->wpos += p->hdr_len;
+
+    if (!pl_data)
+        return 0;
+
+#ifdef IO_COALESCE
+payload:
+#endif
+    out = RENAME(write)(io, pl_data, pl_len, timeout);
+    if (out != pl_len) {
+        ret = avt_handle_errno(io, "Error writing: %i %s\n");
+        io->wpos = RENAME(offset)(io);
+        return ret;
+    }
+    io->wpos += pl_len;
+
+    return 0;
+}
+
+/* Must be called before anything moves the position away from io->wpos */
+static inline int RENAME(write_end)(AVTIOCtx *io, int64_t timeout)
+{
+#ifdef IO_COALESCE
+    if (io->is_write)
+        return RENAME(coalesce_flush)(io, timeout);
+#endif
+    return 0;
+}
+
+[[maybe_unused]] static avt_pos RENAME(seek)(AVTIOCtx *io, avt_pos off)
+{
+    avt_pos ret = RENAME(write_end)(io, 0);
+    if (ret < 0)
+        return ret;
+
+    ret = RENAME(seek_to)(io, off);
     if (ret < 0)
         return avt_handle_errno(io, "Error seeking: %i %s\n");
 
@@ -53,6 +305,10 @@ static avt_pos RENAME(read_input)(AVTIOCtx *io, AVTBuffer *buf, size_t len,
     int64_t ret;
 
     if (io->is_write) {
+        ret = RENAME(write_end)(io, timeout);
+        if (ret < 0)
+            return ret;
+
         ret = RENAME(seek_to)(io, io->rpos);
         if (ret < 0)
             return avt_handle_errno(io, "Error seeking: %i %s\n");
@@ -87,29 +343,18 @@ static avt_pos RENAME(write_pkt)(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
         io->is_write = true;
     }
 
-    /* Write header */
-    size_t out = RENAME(write)(io, p->hdr, p->hdr_len, timeout);
-    if (out != p->hdr_len) {
-        ret = avt_handle_errno(io, "Error writing: %i %s\n");
-        io->wpos = RENAME(offset)(io);
+    avt_pos start = io->wpos;
+    ret = RENAME(write_data)(io, p, timeout);
+    if (ret < 0)
         return ret;
-    }
 
-    /* Write payload */
-    size_t pl_len;
-    uint8_t *data = avt_buffer_get_data(&p->pl, &pl_len);
-    if (data) {
-        out = RENAME(write)(io, data, pl_len, timeout);
-        if (out != pl_len) {
-            ret = avt_handle_errno(io, "Error writing: %i %s\n");
-            io->wpos = RENAME(offset)(io);
-            return ret;
-        }
-    }
+#ifdef IO_SYNC
+    ret = RENAME(sync_check)(io, start, io->wpos - start);
+    if (ret < 0)
+        return ret;
+#endif
 
-    ret = io->wpos + p->hdr_len + pl_len;
-    AVT_SWAP(io->wpos, ret);
-    return ret;
+    return start;
 }
 
 [[maybe_unused]] static avt_pos RENAME(write_vec)(AVTIOCtx *io, AVTPktd *pkt,
@@ -124,43 +369,29 @@ static avt_pos RENAME(write_pkt)(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
         io->is_write = true;
     }
 
-    avt_pos out;
-    size_t pl_len;
-    uint8_t *pl_data;
-    AVTPktd *v;
-
+    avt_pos start = io->wpos;
     for (auto i = 0; i < nb_pkt; i++) {
-        v = &pkt[i];
-
-        /* Header */
-        out = RENAME(write)(io, v->hdr, v->hdr_len, timeout);
-        if (out != v->hdr_len) {
-            ret = avt_handle_errno(io, "Error writing: %i %s\n");
-            io->wpos = RENAME(offset)(io);
+        ret = RENAME(write_data)(io, &pkt[i], timeout);
+        if (ret < 0)
             return ret;
-        }
-
-        /* Payload */
-        pl_data = avt_buffer_get_data(&v->pl, &pl_len);
-        if (pl_data) {
-            out = RENAME(write)(io, pl_data, pl_len, timeout);
-            if (out != pl_len) {
-                ret = avt_handle_errno(io, "Error writing: %i %s\n");
-                io->wpos = RENAME(offset)(io);
-                return ret;
-            }
-        }
     }
 
-    out = RENAME(offset)(io);
-    AVT_SWAP(io->wpos, out);
-    return out;
+#ifdef IO_SYNC
+    ret = RENAME(sync_check)(io, start, io->wpos - start);
+    if (ret < 0)
+        return ret;
+#endif
+
+    return start;
 }
 
 [[maybe_unused]] static avt_pos RENAME(rewrite)(AVTIOCtx *io, AVTPktd *p,
                                                 avt_pos off, int64_t timeout)
 {
-    int ret;
+    int ret = RENAME(write_end)(io, timeout);
+    if (ret < 0)
+        return ret;
+
     const avt_pos backup_pos = io->is_write ? io->wpos : io->rpos;
 
     if (off > io->wpos) {
@@ -178,10 +409,13 @@ static avt_pos RENAME(write_pkt)(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
         }
     }
 
-    avt_pos out = RENAME(write)(io, p->hdr, p->hdr_len, timeout);
+    const avt_pos start = off;
+    int err = 0;
+
+    avt_pos out = RENAME(write)(io, p->hdr.data, p->hdr_len, timeout);
     off += out;
     if (out != p->hdr_len) {
-        ret = avt_handle_errno(io, "Error writing: %i %s\n");
+        err = avt_handle_errno(io, "Error writing: %i %s\n");
         goto restore;
     }
 
@@ -191,7 +425,7 @@ static avt_pos RENAME(write_pkt)(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
         out = RENAME(write)(io, data, pl_len, timeout);
         off += out;
         if (out != pl_len) {
-            ret = avt_handle_errno(io, "Error writing: %i %s\n");
+            err = avt_handle_errno(io, "Error writing: %i %s\n");
             goto restore;
         }
     }
@@ -204,8 +438,19 @@ restore:
         ret = avt_handle_errno(io, "Error seeking: %i %s\n");
         io->is_write = true;
         io->wpos = off; /* Stuck with this */
-        return ret;
+        return err < 0 ? err : ret;
     }
 
+    if (err < 0)
+        return err;
+
+#ifdef IO_SYNC
+    ret = RENAME(sync_check)(io, start, off - start);
+    if (ret < 0)
+        return ret;
+#endif
+
     return off;
 }
+
+#endif
@@ -25,7 +25,7 @@
  */
 
 #define _GNU_SOURCE // ipv6_mtuinfo
-#define _XOPEN_SOURCE 700 // pwrite, IOV_MAX
+#define _XOPEN_SOURCE 700 // pwrite
 
 #include <stdlib.h>
 #include <string.h>
@@ -36,38 +36,221 @@
 #include <sys/uio.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <netinet/udp.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <poll.h>
+#include <time.h>
 
 #include "io_common.h"
 #include "io_utils.h"
 #include "io_socket_common.h"
 #include "attributes.h"
 #include "utils_internal.h"
+#include "mem.h"
 
 #if __has_include(<linux/errqueue.h>)
 #include <linux/errqueue.h>
 #endif
+#if __has_include(<linux/net_tstamp.h>)
+#include <linux/net_tstamp.h>
+#endif
+
+#ifdef CONFIG_HAVE_LIBURING
+#include "io_uring_common.h"
+#endif
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+#define UDP_HAVE_ZEROCOPY
+#endif
+
+/* Maximum number of messages sent per syscall */
+#define UDP_MAX_MMSG 64
+
+/* Maximum number of iovecs for all messages in a syscall */
+#define UDP_MAX_IOV 1024
+
+/* Kernel limits for segmentation offload */
+#define UDP_GSO_MAX_SEGS 64
+#define UDP_GSO_MAX_LEN 65507
+
+/* Messages smaller than this are always copied. Pinning pages and handling
+ * the completion costs more than copying a small amount of data. */
+#define UDP_ZEROCOPY_MIN_LEN 8192
+
+/* Each buffer becomes at least one fragment of a zero-copy message, of which
+ * the kernel only allows a few. Coalesced messages get limited to this many
+ * datagrams, reduced further if the kernel refuses. */
+#define UDP_ZEROCOPY_MAX_SEGS 8
+
+/* Time to wait for outstanding zero-copy completions when closing */
+#define UDP_ZEROCOPY_CLOSE_WAIT INT64_C(100000000)
+
+/* Paced packets closer together than this may be sent at once */
+#define UDP_PACING_QUANTUM INT64_C(50000)
 
-#ifndef IOV_MAX
-#warning "IOV_MAX not defined!"
-#define IOV_MAX 0
+/* Packets are never scheduled further ahead than this */
+#define UDP_PACING_HORIZON INT64_C(1000000000)
+
+/* Receive buffer size. Enough for any datagram, or a coalesced run of them. */
+#define UDP_RX_BUF_LEN 65536
+
+/* Datagrams smaller than this get copied out of their receive buffer,
+ * so that they do not pin down a whole buffer each */
+#define UDP_RX_COPY_LEN (UDP_RX_BUF_LEN >> 2)
+
+/* Messages in flight when sending via io_uring */
+#define UDP_URING_NB_REQ 256
+
+#if !defined(CONFIG_HAVE_SENDMMSG) || !defined(CONFIG_HAVE_RECVMMSG)
+#define mmsghdr avt_mmsghdr
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+#ifndef CONFIG_HAVE_SENDMMSG
+#define sendmmsg avt_sendmmsg
 #endif
+#ifndef CONFIG_HAVE_RECVMMSG
+#define recvmmsg avt_recvmmsg
+#endif
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0
+#endif
+
+/* Space for the segment size and launch time */
+typedef union UDPControl {
+    struct cmsghdr hdr;
+    uint8_t buf[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t))];
+} UDPControl;
+
+/* Space for timestamps, the drop counter, GRO segment size and MTU updates */
+typedef union UDPRecvControl {
+    struct cmsghdr hdr;
+    uint8_t buf[256];
+} UDPRecvControl;
+
+/* A buffer referenced by a zero-copy message, held until the kernel is done */
+typedef struct UDPZerocopyRef {
+    uint32_t id;
+    bool done;
+    AVTBuffer buf;
+} UDPZerocopyRef;
+
+/* A received message, possibly made up of multiple datagrams */
+typedef struct UDPRecvMsg {
+    AVTIODatagram d;
+    size_t seg; /* Size of each datagram, 0 if not coalesced */
+} UDPRecvMsg;
 
 struct AVTIOCtx {
     AVTSocketCommon sc;
+
+    /* Send a run of packets of equal size as a single message */
+    bool gso;
+
+    /* The kernel may coalesce received datagrams */
+    bool gro;
+
+    /* Send large messages directly from their buffers */
+    bool zerocopy;
+    uint32_t zc_max_segs;
+    uint32_t zc_id; /* ID of the next zero-copy message */
+    UDPZerocopyRef *zc_ref;
+    uint32_t zc_head;
+    uint32_t zc_nb;
+    uint32_t zc_alloc;
+
+    AVTIOStats stats;
+
+    /* Space out packets according to their tx_time */
+    enum AVTAddressPacing pacing;
+    clockid_t pace_clock;
+    bool pace_init;
+    int64_t pace_base; /* Clock time of tx_time 0 */
+
+    /* Packets not yet due, when not allowed to wait for them */
+    AVTPacketFifo deferred;
+
+    /* Messages, with 2 iovecs per packet */
+    struct mmsghdr *msg;
+    UDPControl *ctrl;
+    uint32_t *msg_pkts;
+    int64_t *msg_time;
     struct iovec *iov;
 
+    /* Receiving */
+    AVTBufferPool *pool;
+    struct mmsghdr *rx_msg;
+    struct iovec *rx_iov;
+    UDPRecvControl *rx_ctrl;
+    AVTBuffer *rx_buf;
+    uint32_t nb_dropped;
+
+    /* Messages received, but not yet returned */
+    UDPRecvMsg *rx_queue;
+    uint32_t rx_queue_idx;
+    uint32_t rx_queue_nb;
+
+#ifdef CONFIG_HAVE_LIBURING
+    /* Sending without waiting for the socket */
+    AVTUring *ring;
+#endif
+
     avt_pos wpos;
     avt_pos rpos;
 };
 
+static COLD void udp_free(AVTIOCtx *io)
+{
+#ifdef CONFIG_HAVE_LIBURING
+    if (io->ring) {
+        avt_uring_free(io->ring);
+        free(io->ring);
+    }
+#endif
+
+    if (io->rx_buf) {
+        for (int i = 0; i < UDP_MAX_MMSG; i++)
+            avt_buffer_quick_unref(&io->rx_buf[i]);
+    }
+    for (uint32_t i = io->rx_queue_idx; i < io->rx_queue_nb; i++)
+        avt_buffer_quick_unref(&io->rx_queue[i].d.buf);
+    avt_buffer_pool_free(&io->pool);
+
+    for (uint32_t i = 0; i < io->zc_nb; i++)
+        avt_buffer_quick_unref(&io->zc_ref[(io->zc_head + i) & (io->zc_alloc - 1)].buf);
+    free(io->zc_ref);
+
+    avt_pkt_fifo_free(&io->deferred);
+
+    free(io->msg);
+    free(io->ctrl);
+    free(io->msg_pkts);
+    free(io->msg_time);
+    free(io->iov);
+    free(io->rx_msg);
+    free(io->rx_iov);
+    free(io->rx_ctrl);
+    free(io->rx_buf);
+    free(io->rx_queue);
+    free(io);
+}
+
+static int udp_zc_wait(AVTIOCtx *io, int64_t timeout);
+
 static COLD int udp_close(AVTIOCtx **_io)
 {
     AVTIOCtx *io = *_io;
+
+    /* Give the kernel a chance to finish with the buffers */
+    if (io->zc_nb)
+        udp_zc_wait(io, UDP_ZEROCOPY_CLOSE_WAIT);
+
     int ret = avt_socket_close(io, &io->sc);
-    free(io->iov);
-    free(io);
+    udp_free(io);
     *_io = NULL;
     return ret;
 }
@@ -79,22 +262,96 @@ static COLD int udp_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
     if (!io)
         return AVT_ERROR(ENOMEM);
 
-    io->iov = calloc(IOV_MAX + 1, sizeof(*io->iov));
-    if (!io->iov) {
-        free(io);
-        return AVT_ERROR(ENOMEM);
+    io->msg = calloc(UDP_MAX_MMSG, sizeof(*io->msg));
+    io->ctrl = calloc(UDP_MAX_MMSG, sizeof(*io->ctrl));
+    io->msg_pkts = calloc(UDP_MAX_MMSG, sizeof(*io->msg_pkts));
+    io->msg_time = calloc(UDP_MAX_MMSG, sizeof(*io->msg_time));
+    io->iov = calloc(UDP_MAX_IOV, sizeof(*io->iov));
+    io->rx_msg = calloc(UDP_MAX_MMSG, sizeof(*io->rx_msg));
+    io->rx_iov = calloc(UDP_MAX_MMSG, sizeof(*io->rx_iov));
+    io->rx_ctrl = calloc(UDP_MAX_MMSG, sizeof(*io->rx_ctrl));
+    io->rx_buf = calloc(UDP_MAX_MMSG, sizeof(*io->rx_buf));
+    io->rx_queue = calloc(UDP_MAX_MMSG, sizeof(*io->rx_queue));
+    if (!io->msg || !io->ctrl || !io->msg_pkts || !io->msg_time || !io->iov ||
+        !io->rx_msg || !io->rx_iov || !io->rx_ctrl || !io->rx_buf ||
+        !io->rx_queue) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail;
     }
 
+    ret = avt_buffer_pool_init(&io->pool, 0);
+    if (ret < 0)
+        goto fail;
+
     ret = avt_socket_open(io, &io->sc, addr);
-    if (ret < 0) {
-        free(io->iov);
-        free(io);
-        return ret;
+    if (ret < 0)
+        goto fail;
+
+#ifdef UDP_SEGMENT
+    io->gso = addr->opts.gso;
+#else
+    if (addr->opts.gso)
+        avt_log(io, AVT_LOG_WARN, "UDP segmentation offload not supported\n");
+#endif
+#ifdef UDP_HAVE_ZEROCOPY
+    if (addr->opts.zerocopy) {
+        int val = 1;
+        if (setsockopt(io->sc.socket, SOL_SOCKET, SO_ZEROCOPY,
+                       &val, sizeof(val)) < 0)
+            avt_log(io, AVT_LOG_WARN, "Zero-copy sending not supported: %s\n",
+                    strerror(errno));
+        else
+            io->zerocopy = true;
+        io->zc_max_segs = UDP_ZEROCOPY_MAX_SEGS;
+    }
+#else
+    if (addr->opts.zerocopy)
+        avt_log(io, AVT_LOG_WARN, "Zero-copy sending not supported\n");
+#endif
+
+    io->pacing = addr->opts.pacing;
+    io->pace_clock = CLOCK_MONOTONIC;
+    if (addr->opts.pacing_clock == AVT_ADDRESS_CLOCK_TAI) {
+#ifdef CLOCK_TAI
+        io->pace_clock = CLOCK_TAI;
+#else
+        avt_log(io, AVT_LOG_WARN, "TAI clock not supported, pacing "
+                "with the monotonic clock\n");
+#endif
     }
 
+    if (io->pacing == AVT_ADDRESS_PACING_TXTIME) {
+#ifdef SO_TXTIME
+        /* Launch times are only honoured by some qdiscs. fq needs the
+         * monotonic clock, and etf the TAI clock, dropping anything else. */
+        struct sock_txtime txtime = { .clockid = io->pace_clock };
+        if (setsockopt(io->sc.socket, SOL_SOCKET, SO_TXTIME,
+                       &txtime, sizeof(txtime)) < 0) {
+            avt_log(io, AVT_LOG_WARN, "Unable to set launch times: %s, "
+                    "pacing in userspace\n", strerror(errno));
+            io->pacing = AVT_ADDRESS_PACING_USER;
+        }
+#else
+        avt_log(io, AVT_LOG_WARN, "Launch times not supported, "
+                "pacing in userspace\n");
+        io->pacing = AVT_ADDRESS_PACING_USER;
+#endif
+    }
+
+#ifdef UDP_GRO
+    io->gro = addr->opts.gro;
+#else
+    if (addr->opts.gro)
+        avt_log(io, AVT_LOG_WARN, "UDP receive offload not supported\n");
+#endif
+
     *_io = io;
 
     return 0;
+
+fail:
+    udp_free(io);
+    return ret;
 }
 
 static int udp_max_pkt_len(AVTIOCtx *io, size_t *mtu)
@@ -102,15 +359,222 @@ static int udp_max_pkt_len(AVTIOCtx *io, size_t *mtu)
     return avt_socket_get_mtu(io, &io->sc, mtu);
 }
 
+static inline size_t pkt_size(AVTPktd *p)
+{
+    return p->hdr_len + avt_buffer_get_data_len(&p->pl);
+}
+
+static int udp_zc_ref(AVTIOCtx *io, AVTBuffer *buf)
+{
+    if (io->zc_nb == io->zc_alloc) {
+        uint32_t alloc = AVT_MAX(io->zc_alloc << 1, 256);
+        UDPZerocopyRef *ref = avt_reallocarray(NULL, alloc, sizeof(*ref));
+        if (!ref)
+            return AVT_ERROR(ENOMEM);
+
+        /* Unwrap the ring */
+        for (uint32_t i = 0; i < io->zc_nb; i++)
+            ref[i] = io->zc_ref[(io->zc_head + i) & (io->zc_alloc - 1)];
+
+        free(io->zc_ref);
+        io->zc_ref = ref;
+        io->zc_head = 0;
+        io->zc_alloc = alloc;
+    }
+
+    UDPZerocopyRef *r = &io->zc_ref[(io->zc_head + io->zc_nb) & (io->zc_alloc - 1)];
+    *r = (UDPZerocopyRef) { .id = io->zc_id };
+    avt_buffer_quick_ref(&r->buf, buf, 0, AVT_BUFFER_REF_ALL);
+    io->zc_nb++;
+
+    return 0;
+}
+
+/* Hold on to all buffers of a zero-copy message, until it completes */
+static int udp_zc_hold(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt)
+{
+    for (uint32_t i = 0; i < nb_pkt; i++) {
+        int err = udp_zc_ref(io, &pkt[i].hdr);
+        if (err >= 0 && avt_buffer_get_data_len(&pkt[i].pl))
+            err = udp_zc_ref(io, &pkt[i].pl);
+        if (err < 0)
+            return err;
+    }
+
+    /* IDs are assigned by the kernel to each message sent */
+    io->zc_id++;
+    return 0;
+}
+
+static void udp_zc_complete(AVTIOCtx *io, uint32_t lo, uint32_t hi, bool copied)
+{
+    if (copied)
+        io->stats.nb_copied += hi - lo + 1;
+    else
+        io->stats.nb_zerocopy += hi - lo + 1;
+
+    /* IDs wrap around */
+    for (uint32_t i = 0; i < io->zc_nb; i++) {
+        UDPZerocopyRef *r = &io->zc_ref[(io->zc_head + i) & (io->zc_alloc - 1)];
+        if ((int32_t)(r->id - hi) > 0)
+            break;
+        if ((int32_t)(r->id - lo) >= 0)
+            r->done = true;
+    }
+
+    /* Completions may arrive out of order */
+    while (io->zc_nb && io->zc_ref[io->zc_head].done) {
+        avt_buffer_quick_unref(&io->zc_ref[io->zc_head].buf);
+        io->zc_head = (io->zc_head + 1) & (io->zc_alloc - 1);
+        io->zc_nb--;
+    }
+
+    if (copied && io->zerocopy) {
+        /* Happens on loopback, or with devices which cannot gather data */
+        avt_log(io, AVT_LOG_VERBOSE, "Kernel copies zero-copy messages on "
+                "this route, disabling\n");
+        io->zerocopy = false;
+    }
+}
+
+/* Reap all zero-copy completions on the error queue */
+static void udp_zc_reap(AVTIOCtx *io)
+{
+#ifdef UDP_HAVE_ZEROCOPY
+    UDPRecvControl ctrl;
+
+    while (io->zc_nb) {
+        struct msghdr msg = {
+            .msg_control = ctrl.buf,
+            .msg_controllen = sizeof(ctrl.buf),
+        };
+
+        if (recvmsg(io->sc.socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        struct cmsghdr *cmsg;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_RECVERR) &&
+                !(cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR))
+                continue;
+
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+            if (ee.ee_errno || ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            udp_zc_complete(io, ee.ee_info, ee.ee_data,
+                            ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+        }
+    }
+#endif
+}
+
+/* Wait until all zero-copy messages have completed */
+static int udp_zc_wait(AVTIOCtx *io, int64_t timeout)
+{
+    int64_t end;
+    if (ckd_add(&end, avt_get_time_ns(), timeout))
+        end = INT64_MAX;
+
+    udp_zc_reap(io);
+    while (io->zc_nb) {
+        int64_t left = end - avt_get_time_ns();
+        if (left <= 0)
+            return AVT_ERROR(ETIMEDOUT);
+
+        /* Completions are signalled as errors */
+        struct pollfd pfd = { .fd = io->sc.socket };
+        int ret = poll(&pfd, 1, (left + 999999) / 1000000);
+        if (ret < 0 && errno != EINTR)
+            return avt_handle_errno(io, "Error polling socket: %i %s\n");
+
+        udp_zc_reap(io);
+    }
+
+    return 0;
+}
+
+static inline int64_t udp_clock_ns(AVTIOCtx *io)
+{
+    struct timespec ts;
+    clock_gettime(io->pace_clock, &ts);
+    return ts.tv_sec*INT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void udp_sleep_until(AVTIOCtx *io, int64_t t)
+{
+    struct timespec ts = {
+        .tv_sec = t / 1000000000,
+        .tv_nsec = t % 1000000000,
+    };
+    while (clock_nanosleep(io->pace_clock, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+/* Map a packet's time on the scheduler's timeline to the clock */
+static int64_t udp_launch_time(AVTIOCtx *io, int64_t tx_time, int64_t now)
+{
+    int64_t t = io->pace_base + tx_time;
+
+    /* Restart the timeline if we fell behind, as after the source went idle,
+     * rather than catching up in a burst */
+    if (!io->pace_init || (t < now) || ((t - now) > UDP_PACING_HORIZON)) {
+        io->pace_base = now - tx_time;
+        io->pace_init = true;
+        t = now;
+    }
+
+    return t;
+}
+
+/* Append a control message, with storage from ctrl */
+static void *msg_add_cmsg(struct msghdr *mh, UDPControl *ctrl,
+                          int level, int type, size_t len)
+{
+    if (!mh->msg_control) {
+        mh->msg_control = ctrl->buf;
+        mh->msg_controllen = 0;
+    }
+
+    struct cmsghdr *cm = (struct cmsghdr *)(ctrl->buf + mh->msg_controllen);
+    cm->cmsg_level = level;
+    cm->cmsg_type = type;
+    cm->cmsg_len = CMSG_LEN(len);
+    mh->msg_controllen += CMSG_SPACE(len);
+
+    return CMSG_DATA(cm);
+}
+
+/* Give a message its launch time, stored in msg_time */
+static void udp_pace_msg(AVTIOCtx *io, struct msghdr *mh, UDPControl *ctrl,
+                         int64_t *msg_time, int64_t tx_time, int64_t now)
+{
+    *msg_time = udp_launch_time(io, tx_time, now);
+#ifdef SO_TXTIME
+    if (io->pacing == AVT_ADDRESS_PACING_TXTIME) {
+        uint64_t t = *msg_time;
+        memcpy(msg_add_cmsg(mh, ctrl, SOL_SOCKET, SCM_TXTIME, sizeof(t)),
+               &t, sizeof(t));
+    }
+#endif
+}
+
+static avt_pos udp_write_vec(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                             int64_t timeout);
+
 static avt_pos udp_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
 {
     int64_t ret;
 
+    /* Packets may have to wait their turn */
+    if (io->pacing == AVT_ADDRESS_PACING_USER)
+        return udp_write_vec(io, p, 1, timeout);
+
     size_t pl_len;
     uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
 
     struct iovec vdata[2] = {
-        { .iov_base = p->hdr, .iov_len = p->hdr_len },
+        { .iov_base = p->hdr.data, .iov_len = p->hdr_len },
         { .iov_base = pl_data, .iov_len = pl_len },
     };
 
@@ -123,54 +587,473 @@ static avt_pos udp_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
         .msg_flags = 0,
     };
 
-    ret = sendmsg(io->sc.socket, &pm, !timeout ? MSG_DONTWAIT : 0);
+    const int flags = !timeout ? MSG_DONTWAIT : 0;
+    bool zc = false;
+
+    UDPControl ctrl;
+    if (io->pacing) {
+        int64_t launch;
+        udp_pace_msg(io, &pm, &ctrl, &launch, p->tx_time, udp_clock_ns(io));
+    }
+
+#ifdef UDP_HAVE_ZEROCOPY
+    udp_zc_reap(io);
+    zc = io->zerocopy && (pkt_size(p) >= UDP_ZEROCOPY_MIN_LEN);
+
+    ret = sendmsg(io->sc.socket, &pm, flags | (zc ? MSG_ZEROCOPY : 0));
+    if (ret < 0 && (errno == ENOBUFS || errno == EMSGSIZE) && zc) {
+        /* Out of memory to pin pages with, or too many fragments */
+        zc = false;
+        ret = sendmsg(io->sc.socket, &pm, flags);
+    }
+#else
+    ret = sendmsg(io->sc.socket, &pm, flags);
+#endif
     if (ret < 0)
         return avt_handle_errno(io, "Unable to send message: %i %s");
 
+    if (zc) {
+        int err = udp_zc_hold(io, p, 1);
+        if (err < 0)
+            return err;
+    } else {
+        io->stats.nb_copied++;
+    }
+
     ret = io->wpos + ret;
     AVT_SWAP(io->wpos, ret);
     return ret;
 }
 
-static avt_pos udp_write_vec(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
-                             int64_t timeout)
+#ifndef CONFIG_HAVE_SENDMMSG
+static int sendmmsg(int fd, struct mmsghdr *msg, unsigned int nb, int flags)
 {
-    int64_t ret;
-    avt_pos off = 0;
-    int nb_iov = 0;
+    for (unsigned int i = 0; i < nb; i++) {
+        ssize_t ret = sendmsg(fd, &msg[i].msg_hdr, flags);
+        if (ret < 0)
+            return i ? i : -1;
+        msg[i].msg_len = ret;
+    }
+    return nb;
+}
+#endif
 
-    while (nb_pkt) {
-        nb_iov = 0;
-        do {
-            io->iov[nb_iov + 0].iov_base = pkt->hdr;
-            io->iov[nb_iov + 0].iov_len  = pkt->hdr_len;
-            io->iov[nb_iov + 1].iov_base = avt_buffer_get_data(&pkt->pl,
-                                                               &io->iov[nb_iov + 1].iov_len);
-            nb_iov += 1 + !!io->iov[nb_iov + 1].iov_base;
+/* Build up to UDP_MAX_MMSG messages. Each packet is a datagram of its own,
+ * but with GSO, a run of packets of equal size is sent as a single message,
+ * which the kernel splits back up. Returns the number of packets used. */
+static uint32_t udp_build_batch(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                                uint32_t *nb_msg, int64_t now)
+{
+    uint32_t nb_iov = 0;
+    uint32_t i = 0;
+    uint32_t m = 0;
+
+    while ((i < nb_pkt) && (m < UDP_MAX_MMSG) &&
+           ((nb_iov + 2) <= UDP_MAX_IOV)) {
+        const size_t seg = pkt_size(&pkt[i]);
+        struct iovec *iov = &io->iov[nb_iov];
+        uint32_t nb_seg = 0;
 
-            pkt++;
-            nb_pkt--;
-        } while (nb_pkt && ((nb_iov + 2) > IOV_MAX));
+        do {
+            AVTPktd *p = &pkt[i + nb_seg];
+            iov[0].iov_base = p->hdr.data;
+            iov[0].iov_len  = p->hdr_len;
+            iov[1].iov_base = avt_buffer_get_data(&p->pl, &iov[1].iov_len);
+            iov += 1 + !!iov[1].iov_len;
+            nb_seg++;
+        } while (io->gso &&
+                 ((i + nb_seg) < nb_pkt) &&
+                 (nb_seg < UDP_GSO_MAX_SEGS) &&
+                 (!io->zerocopy || (nb_seg < io->zc_max_segs)) &&
+                 (!io->pacing ||
+                  ((pkt[i + nb_seg].tx_time - pkt[i].tx_time) < UDP_PACING_QUANTUM)) &&
+                 ((nb_seg + 1)*seg <= UDP_GSO_MAX_LEN) &&
+                 ((iov - io->iov) + 2 <= UDP_MAX_IOV) &&
+                 (pkt_size(&pkt[i + nb_seg]) == seg));
 
-        struct msghdr pm = {
+        io->msg[m].msg_hdr = (struct msghdr) {
             .msg_name = io->sc.remote_addr,
             .msg_namelen = io->sc.addr_size,
-            .msg_iov = io->iov,
-            .msg_iovlen = nb_iov,
-            .msg_control = NULL,
-            .msg_flags = 0,
+            .msg_iov = &io->iov[nb_iov],
+            .msg_iovlen = (iov - io->iov) - nb_iov,
         };
 
-        ret = sendmsg(io->sc.socket, &pm, !timeout ? MSG_DONTWAIT : 0);
+#ifdef UDP_SEGMENT
+        if (nb_seg > 1) {
+            uint16_t gso_size = seg;
+            memcpy(msg_add_cmsg(&io->msg[m].msg_hdr, &io->ctrl[m], IPPROTO_UDP,
+                                UDP_SEGMENT, sizeof(gso_size)),
+                   &gso_size, sizeof(gso_size));
+        }
+#endif
+
+        if (io->pacing)
+            udp_pace_msg(io, &io->msg[m].msg_hdr, &io->ctrl[m],
+                         &io->msg_time[m], pkt[i].tx_time, now);
+
+        io->msg_pkts[m++] = nb_seg;
+        nb_iov = iov - io->iov;
+        i += nb_seg;
+    }
+
+    *nb_msg = m;
+    return i;
+}
+
+static inline bool msg_zerocopy(const struct msghdr *mh)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < mh->msg_iovlen; i++)
+        len += mh->msg_iov[i].iov_len;
+    return len >= UDP_ZEROCOPY_MIN_LEN;
+}
+
+/* Send packets. If not allowed to wait, stops at the first message which
+ * is not due yet. The number of packets done with is returned in nb_done. */
+static int udp_send(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                    int64_t timeout, uint32_t *nb_done)
+{
+    int ret;
+    avt_pos off = 0;
+    const int flags = !timeout ? MSG_DONTWAIT : 0;
+    const uint32_t nb_total = nb_pkt;
+
+    *nb_done = nb_pkt;
+    udp_zc_reap(io);
+
+    while (nb_pkt) {
+        uint32_t nb_msg;
+        uint32_t nb = udp_build_batch(io, pkt, nb_pkt, &nb_msg,
+                                      io->pacing ? udp_clock_ns(io) : 0);
+        uint32_t nb_sent = 0;
+
+        /* The kernel may send fewer messages than asked for */
+        for (uint32_t sent = 0; sent < nb_msg; sent += ret) {
+            uint32_t nb_run = nb_msg - sent;
+            bool zc = false;
+
+            /* Wait until the first message is due, then send all that are.
+             * When not allowed to wait, leave the rest for later. */
+            if (io->pacing == AVT_ADDRESS_PACING_USER) {
+                int64_t now = udp_clock_ns(io);
+                if (!timeout && (io->msg_time[sent] > (now + UDP_PACING_QUANTUM))) {
+                    *nb_done = nb_total - nb_pkt + nb_sent;
+                    io->wpos += off;
+                    return 0;
+                } else if (timeout && (io->msg_time[sent] > now)) {
+                    udp_sleep_until(io, io->msg_time[sent]);
+                    now = io->msg_time[sent];
+                }
+                for (nb_run = 1; (sent + nb_run) < nb_msg; nb_run++)
+                    if (io->msg_time[sent + nb_run] > (now + UDP_PACING_QUANTUM))
+                        break;
+            }
+
+#ifdef UDP_HAVE_ZEROCOPY
+            /* Flags are per call, so large and small messages are sent
+             * in separate runs */
+            if (io->zerocopy) {
+                zc = msg_zerocopy(&io->msg[sent].msg_hdr);
+                for (uint32_t i = 1; i < nb_run; i++) {
+                    if (msg_zerocopy(&io->msg[sent + i].msg_hdr) != zc) {
+                        nb_run = i;
+                        break;
+                    }
+                }
+            }
+
+            ret = sendmmsg(io->sc.socket, &io->msg[sent], nb_run,
+                           flags | (zc ? MSG_ZEROCOPY : 0));
+            if (ret < 0 && (errno == ENOBUFS || errno == EMSGSIZE) && zc) {
+                /* Out of memory to pin pages with, or too many fragments.
+                 * Send this run with copying. */
+                if (errno == EMSGSIZE && io->zc_max_segs > 1) {
+                    io->zc_max_segs >>= 1;
+                    avt_log(io, AVT_LOG_DEBUG, "Zero-copy message too "
+                            "fragmented, limiting to %u datagrams\n",
+                            io->zc_max_segs);
+                }
+                udp_zc_reap(io);
+                zc = false;
+                ret = sendmmsg(io->sc.socket, &io->msg[sent], nb_run, flags);
+            }
+#else
+            ret = sendmmsg(io->sc.socket, &io->msg[sent], nb_run, flags);
+#endif
+
+            if (ret < 0 && errno == EINTR) {
+                ret = 0;
+                continue;
+            } else if (ret < 0 && errno == EIO && io->gso) {
+                /* Segmentation is not supported for this route.
+                 * Resend everything from the failed message on. */
+                avt_log(io, AVT_LOG_WARN, "UDP segmentation offload failed, "
+                        "disabling\n");
+                io->gso = false;
+                nb = nb_sent;
+                break;
+            } else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                /* Whatever was not sent is lost, as with any datagram */
+                avt_log(io, AVT_LOG_DEBUG, "Socket full, %u datagrams "
+                        "not sent\n", nb_pkt - nb_sent);
+                io->wpos += off;
+                return AVT_ERROR(EAGAIN);
+            } else if (ret < 0) {
+                io->wpos += off;
+                return avt_handle_errno(io, "Unable to send messages: %i %s\n");
+            }
+
+            for (int i = 0; i < ret; i++) {
+                if (zc) {
+                    int err = udp_zc_hold(io, &pkt[nb_sent],
+                                          io->msg_pkts[sent + i]);
+                    if (err < 0) {
+                        io->wpos += off;
+                        return err;
+                    }
+                } else {
+                    io->stats.nb_copied++;
+                }
+
+                off += io->msg[sent + i].msg_len;
+                nb_sent += io->msg_pkts[sent + i];
+            }
+        }
+
+        pkt += nb;
+        nb_pkt -= nb;
+    }
+
+    io->wpos += off;
+    return 0;
+}
+
+/* Send packets deferred earlier, oldest first */
+static int udp_send_deferred(AVTIOCtx *io, int64_t timeout)
+{
+    while (io->deferred.nb) {
+        AVTPktd *p;
+        uint32_t nb_done;
+        uint32_t nb = avt_pkt_fifo_span(&io->deferred, 0, &p);
+
+        int err = udp_send(io, p, nb, timeout, &nb_done);
+        for (uint32_t i = 0; i < nb_done; i++)
+            avt_pkt_fifo_pop_d(&io->deferred, NULL);
+        if (err < 0)
+            return err;
+        else if (nb_done < nb)
+            break;
+    }
+
+    return 0;
+}
+
+static avt_pos udp_write_vec(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                             int64_t timeout)
+{
+    int err;
+    uint32_t nb_done = 0;
+    avt_pos start = io->wpos;
+
+    err = udp_send_deferred(io, timeout);
+    if (err < 0)
+        return err;
+
+    /* Packets go out in order, so nothing can overtake deferred ones */
+    if (!io->deferred.nb) {
+        err = udp_send(io, pkt, nb_pkt, timeout, &nb_done);
+        if (err < 0)
+            return err;
+    }
+
+    for (uint32_t i = nb_done; i < nb_pkt; i++) {
+        err = avt_pkt_fifo_push_d(&io->deferred, &pkt[i]);
+        if (err < 0)
+            return err;
+    }
+
+    return start;
+}
+
+/* Parse the ancillary data of a received message */
+static void udp_parse_cmsg(AVTIOCtx *io, struct msghdr *msg,
+                           AVTIODatagram *d, size_t *seg)
+{
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+#ifdef SCM_TIMESTAMPING
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping t;
+            memcpy(&t, CMSG_DATA(cmsg), sizeof(t));
+            if (t.ts[0].tv_sec || t.ts[0].tv_nsec)
+                d->ts = t.ts[0].tv_sec*INT64_C(1000000000) + t.ts[0].tv_nsec;
+        }
+#endif
+#ifdef SO_RXQ_OVFL
+        /* Only sent when non-zero */
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+            memcpy(&io->nb_dropped, CMSG_DATA(cmsg), sizeof(uint32_t));
+#endif
+#ifdef UDP_GRO
+        if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            *seg = gso_size;
+        }
+#endif
+#ifdef IPV6_RECVPATHMTU
+        if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PATHMTU &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(struct ip6_mtuinfo))) {
+            struct ip6_mtuinfo mtu;
+            memcpy(&mtu, CMSG_DATA(cmsg), sizeof(mtu));
+            avt_log(io, AVT_LOG_VERBOSE, "MTU changed to %i\n", mtu.ip6m_mtu);
+        }
+#endif
+    }
+
+    d->nb_dropped = io->nb_dropped;
+}
+
+#ifndef CONFIG_HAVE_RECVMMSG
+static int recvmmsg(int fd, struct mmsghdr *msg, unsigned int nb, int flags,
+                    struct timespec *timeout)
+{
+    for (unsigned int i = 0; i < nb; i++) {
+        ssize_t ret = recvmsg(fd, &msg[i].msg_hdr, flags & ~MSG_WAITFORONE);
         if (ret < 0)
-            return avt_handle_errno(io, "Unable to send message: %i %s");
+            return i ? i : -1;
+        msg[i].msg_len = ret;
+        flags |= MSG_DONTWAIT;
+    }
+    return nb;
+}
+#endif
 
-        off += ret;
+/* Return queued datagrams, splitting up coalesced messages.
+ * Returns the number of datagrams output. */
+static uint32_t udp_drain_queue(AVTIOCtx *io, AVTIODatagram *dgram,
+                                uint32_t nb_dgram)
+{
+    uint32_t nb = 0;
+
+    while ((io->rx_queue_idx < io->rx_queue_nb) && (nb < nb_dgram)) {
+        UDPRecvMsg *m = &io->rx_queue[io->rx_queue_idx];
+        if (!m->seg || (m->d.buf.len <= m->seg)) {
+            dgram[nb++] = m->d;
+            m->d.buf = (AVTBuffer){ };
+            io->rx_queue_idx++;
+            continue;
+        }
+
+        /* All segments share the message's buffer */
+        while (m->d.buf.len && (nb < nb_dgram)) {
+            size_t len = AVT_MIN(m->seg, m->d.buf.len);
+            dgram[nb] = m->d;
+            dgram[nb].buf = (AVTBuffer){ };
+            avt_buffer_quick_ref(&dgram[nb].buf, &m->d.buf, 0, len);
+            avt_buffer_offset(&m->d.buf, len);
+            nb++;
+        }
+
+        if (m->d.buf.len)
+            break;
+
+        avt_buffer_quick_unref(&m->d.buf);
+        io->rx_queue_idx++;
     }
 
-    off = io->wpos + off;
-    AVT_SWAP(io->wpos, off);
-    return off;
+    return nb;
+}
+
+/* Receive up to nb_msg messages into the queue */
+static int udp_recv_batch(AVTIOCtx *io, uint32_t nb_msg, int flags)
+{
+    int ret;
+
+    for (uint32_t i = 0; i < nb_msg; i++) {
+        if (!io->rx_buf[i].ctrl &&
+            !avt_buffer_pool_quick_alloc(io->pool, &io->rx_buf[i],
+                                         UDP_RX_BUF_LEN))
+            return AVT_ERROR(ENOMEM);
+
+        io->rx_iov[i] = (struct iovec) {
+            .iov_base = io->rx_buf[i].data,
+            .iov_len = UDP_RX_BUF_LEN,
+        };
+        io->rx_msg[i].msg_hdr = (struct msghdr) {
+            .msg_iov = &io->rx_iov[i],
+            .msg_iovlen = 1,
+            .msg_control = io->rx_ctrl[i].buf,
+            .msg_controllen = sizeof(io->rx_ctrl[i].buf),
+        };
+    }
+
+    do {
+        ret = recvmmsg(io->sc.socket, io->rx_msg, nb_msg, flags, NULL);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return AVT_ERROR(EAGAIN);
+    else if (ret < 0)
+        return avt_handle_errno(io, "Unable to receive messages: %i %s\n");
+
+    io->rx_queue_idx = 0;
+    io->rx_queue_nb = 0;
+
+    for (int i = 0; i < ret; i++) {
+        struct msghdr *mh = &io->rx_msg[i].msg_hdr;
+        const size_t len = io->rx_msg[i].msg_len;
+        UDPRecvMsg *m = &io->rx_queue[io->rx_queue_nb];
+
+        *m = (UDPRecvMsg) { .d.ts = INT64_MIN };
+        udp_parse_cmsg(io, mh, &m->d, &m->seg);
+
+        io->rpos += len;
+
+        /* Ancillary message only */
+        if (!len)
+            continue;
+
+        if (mh->msg_flags & MSG_TRUNC) {
+            avt_log(io, AVT_LOG_ERROR, "Datagram truncated, dropping\n");
+            continue;
+        }
+
+        if (len < UDP_RX_COPY_LEN) {
+            /* Copy, and keep the receive buffer */
+            uint8_t *data = avt_buffer_pool_quick_alloc(io->pool, &m->d.buf,
+                                                        len);
+            if (!data)
+                return AVT_ERROR(ENOMEM);
+            memcpy(data, io->rx_buf[i].data, len);
+        } else {
+            /* Give the receive buffer away */
+            m->d.buf = io->rx_buf[i];
+            m->d.buf.len = len;
+            io->rx_buf[i] = (AVTBuffer){ };
+        }
+
+        io->rx_queue_nb++;
+    }
+
+    return io->rx_queue_nb;
+}
+
+static int udp_read_vec(AVTIOCtx *io, AVTIODatagram *dgram, uint32_t nb_dgram,
+                        int64_t timeout)
+{
+    uint32_t nb = udp_drain_queue(io, dgram, nb_dgram);
+    if ((nb == nb_dgram) || (io->rx_queue_idx < io->rx_queue_nb))
+        return nb;
+
+    /* Only wait if there is nothing to return yet */
+    int flags = (!timeout || nb) ? MSG_DONTWAIT : MSG_WAITFORONE;
+
+    int ret = udp_recv_batch(io, AVT_MIN(nb_dgram - nb, UDP_MAX_MMSG), flags);
+    if (ret < 0)
+        return nb ? nb : ret;
+
+    return nb + udp_drain_queue(io, &dgram[nb], nb_dgram - nb);
 }
 
 static avt_pos udp_read_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
@@ -181,76 +1064,52 @@ static avt_pos udp_read_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
 
     size_t buf_len;
     uint8_t *data = avt_buffer_get_data(buf, &buf_len);
+
+    /* Coalesced datagrams have to be split up first */
+    if (io->gro) {
+        AVTIODatagram d;
+        ret = io->rpos;
+        err = udp_read_vec(io, &d, 1, timeout);
+        if (err <= 0)
+            return err;
+
+        size_t dgram_len = AVT_MIN(d.buf.len, buf_len);
+        memcpy(data, d.buf.data, dgram_len);
+        avt_buffer_quick_unref(&d.buf);
+
+        err = avt_buffer_resize(buf, dgram_len);
+        avt_assert2(err >= 0);
+        return ret;
+    }
     struct iovec iov = {
         .iov_base = data,
         .iov_len = buf_len,
     };
 
     struct sockaddr_in6 remote_addr = { };
+    UDPRecvControl cmsgbuf;
 
     struct msghdr msg = {
         .msg_name = &remote_addr,
         .msg_namelen = sizeof(remote_addr),
         .msg_iov = &iov,
         .msg_iovlen = 1,
-        .msg_control = NULL,
-        .msg_controllen = 0,
+        .msg_control = cmsgbuf.buf,
+        .msg_controllen = sizeof(cmsgbuf.buf),
         .msg_flags = 0x0,
     };
 
-#ifdef IPV6_RECVPATHMTU
-    union {
-        struct cmsghdr hdr;
-        uint8_t buf[CMSG_SPACE(
-#ifdef IPV6_RECVPATHMTU
-                               sizeof(struct ip6_mtuinfo) +
-#endif
-#ifdef SO_RXQ_OVFL
-                               32 +
-#endif
-#ifdef SCM_TIMESTAMPING
-                               sizeof(struct scm_timestamping) +
-#endif
-                               0)];
-    } cmsgbuf;
-    msg.msg_control = &cmsgbuf.buf;
-    msg.msg_controllen = sizeof(cmsgbuf.buf);
-#endif
-
     ret = recvmsg(io->sc.socket, &msg, 0x0);
-    if (ret < 0) {
+    if (ret < 0)
         return avt_handle_errno(io, "Unable to receive message: %s");
-    } else if (ret == 0) { /* Ancillary message only */
-        struct cmsghdr *cmsg;
 
-        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-#ifdef SO_RXQ_OVFL
-            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
-                const uint32_t *t = (uint32_t *)CMSG_DATA(cmsg);
-//                avt_log(io, AVT_LOG_VERBOSE, "New ts = %li %li\n", t->ts[0].tv_sec, t->ts[0].tv_nsec);
-            }
-#endif
-#ifdef IPV6_RECVPATHMTU
-            if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PATHMTU &&
-                cmsg->cmsg_len == CMSG_LEN(sizeof(struct ip6_mtuinfo))) {
-                const struct ip6_mtuinfo *mtu = (struct ip6_mtuinfo *)CMSG_DATA(cmsg);
-                avt_log(io, AVT_LOG_VERBOSE, "MTU changed to %i\n", mtu->ip6m_mtu);
-            }
-#endif
-        }
+    AVTIODatagram d = { .ts = INT64_MIN };
+    size_t seg = 0;
+    udp_parse_cmsg(io, &msg, &d, &seg);
 
+    /* Ancillary message only */
+    if (ret == 0)
         return 0;
-    } else if (ret > 0) { /* Ancillary message with the data */
-        struct cmsghdr *cmsg;
-        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-#ifdef SCM_TIMESTAMPING
-            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
-                const struct scm_timestamping *t = (struct scm_timestamping *)CMSG_DATA(cmsg);
-//                avt_log(io, AVT_LOG_VERBOSE, "New ts = %li %li\n", t->ts[0].tv_sec, t->ts[0].tv_nsec);
-            }
-#endif
-        }
-    }
 
     if (msg.msg_flags & MSG_TRUNC) {
         avt_log(io, AVT_LOG_ERROR, "Packet truncated! MTU changed?\n");
@@ -266,16 +1125,135 @@ static avt_pos udp_read_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
     return ret;
 }
 
+static void udp_get_stats(AVTIOCtx *io, AVTIOStats *stats)
+{
+    udp_zc_reap(io);
+    *stats = io->stats;
+}
+
+static int udp_flush(AVTIOCtx *io, int64_t timeout)
+{
+    /* Packets not yet due can only all go out if allowed to wait */
+    int err = udp_send_deferred(io, timeout);
+    if (err < 0)
+        return err;
+    else if (io->deferred.nb)
+        return AVT_ERROR(EAGAIN);
+
+    return udp_zc_wait(io, timeout);
+}
+
+#ifdef CONFIG_HAVE_LIBURING
+static COLD int udp_uring_init(AVTContext *ctx, AVTIOCtx **_io,
+                               AVTAddress *addr)
+{
+    /* Offloads and pacing need control over each call */
+    if (addr->opts.gso || addr->opts.zerocopy || addr->opts.pacing)
+        return AVT_ERROR(ENOTSUP);
+
+    int ret = udp_init(ctx, _io, addr);
+    if (ret < 0)
+        return ret;
+
+    AVTIOCtx *io = *_io;
+    io->ring = calloc(1, sizeof(*io->ring));
+    if (!io->ring) {
+        udp_close(_io);
+        return AVT_ERROR(ENOMEM);
+    }
+
+    ret = avt_uring_init(io, io->ring, io->sc.socket, UDP_URING_NB_REQ, 0, 0);
+    if (ret < 0) {
+        free(io->ring);
+        io->ring = NULL;
+        udp_close(_io);
+        return ret;
+    }
+
+    return 0;
+}
+
+static avt_pos udp_uring_write_vec(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                                   int64_t timeout)
+{
+    avt_pos off = 0;
+
+    /* Errors of previous messages are reported here */
+    int err = avt_uring_wait(io->ring, UINT32_MAX, 0);
+    if (err < 0)
+        return err;
+
+    for (uint32_t i = 0; i < nb_pkt; i++) {
+        AVTUringReq *r = avt_uring_get_req(io->ring, false, timeout);
+        if (!r) {
+            /* Whatever was not sent is lost, as with any datagram */
+            avt_log(io, AVT_LOG_DEBUG, "Ring full, %u datagrams "
+                    "not sent\n", nb_pkt - i);
+            avt_uring_submit(io->ring);
+            io->wpos += off;
+            return AVT_ERROR(EAGAIN);
+        }
+
+        size_t pl_len = avt_buffer_get_data_len(&pkt[i].pl);
+        avt_uring_add_ref(r, &pkt[i].hdr, pkt[i].hdr_len);
+        if (pl_len)
+            avt_uring_add_ref(r, &pkt[i].pl, pl_len);
+
+        avt_uring_sendmsg(io->ring, r, io->sc.remote_addr, io->sc.addr_size, 0);
+        io->stats.nb_copied++;
+        off += pkt_size(&pkt[i]);
+    }
+
+    err = avt_uring_submit(io->ring);
+    if (err < 0) {
+        io->wpos += off;
+        return err;
+    }
+
+    off = io->wpos + off;
+    AVT_SWAP(io->wpos, off);
+    return off;
+}
+
+static avt_pos udp_uring_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
+{
+    return udp_uring_write_vec(io, p, 1, timeout);
+}
+
+static int udp_uring_flush(AVTIOCtx *io, int64_t timeout)
+{
+    return avt_uring_wait(io->ring, 0, timeout);
+}
+
+const AVTIO avt_io_udp_uring = {
+    .name = "udp_uring",
+    .type = AVT_IO_UDP,
+    .init = udp_uring_init,
+    .get_max_pkt_len = udp_max_pkt_len,
+    .read_input = udp_read_input,
+    .read_vec = udp_read_vec,
+    .write_vec = udp_uring_write_vec,
+    .write_pkt = udp_uring_write_pkt,
+    .rewrite = NULL,
+    .seek = NULL,
+    .get_stats = udp_get_stats,
+    .flush = udp_uring_flush,
+    .close = udp_close,
+};
+#endif
+
 const AVTIO avt_io_udp = {
     .name = "udp",
     .type = AVT_IO_UDP,
     .init = udp_init,
     .get_max_pkt_len = udp_max_pkt_len,
     .read_input = udp_read_input,
+    .read_vec = udp_read_vec,
     .write_vec = udp_write_vec,
     .write_pkt = udp_write_pkt,
     .rewrite = NULL,
     .seek = NULL,
-    .flush = NULL,
+    .get_stats = udp_get_stats,
+    .flush = udp_flush,
     .close = udp_close,
 };
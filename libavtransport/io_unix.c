@@ -116,16 +116,6 @@ static int unix_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
     return 0;
 }
 
-static int unix_seek_to(AVTIOCtx *ctx, int64_t pos) { return 0; } /* unused */
-
-static inline avt_pos unix_offset(AVTIOCtx *io)
-{
-    if (io->is_write)
-        return io->wpos;
-    else
-        return io->rpos;
-}
-
 static inline avt_pos server_state_check(AVTIOCtx *io, bool *emulate)
 {
     if (!io->listen)
@@ -155,6 +145,57 @@ static inline avt_pos server_state_check(AVTIOCtx *io, bool *emulate)
     return 0;
 }
 
+#if IOV_MAX > 4
+#define IO_VECTORED
+
+/* Streams have no offsets, so off is only tracked */
+static inline ssize_t unix_pwritev(AVTIOCtx *io, const struct iovec *iov,
+                                   int nb_iov, avt_pos off, int64_t timeout)
+{
+    bool emulate = false;
+    avt_pos ret = server_state_check(io, &emulate);
+    if (ret) {
+        errno = ret;
+        return -1;
+    }
+
+    /* No client yet, pretend everything got written */
+    if (emulate) {
+        size_t len = 0;
+        for (int i = 0; i < nb_iov; i++)
+            len += iov[i].iov_len;
+        return len;
+    }
+
+    return writev(io->fd, iov, nb_iov);
+}
+
+static inline ssize_t unix_preadv(AVTIOCtx *io, const struct iovec *iov,
+                                  int nb_iov, avt_pos off, int64_t timeout)
+{
+    bool emulate = false;
+    avt_pos ret = server_state_check(io, &emulate);
+    if (ret) {
+        errno = ret;
+        return -1;
+    } else if (emulate) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return readv(io->fd, iov, nb_iov);
+}
+#else
+static int unix_seek_to(AVTIOCtx *ctx, int64_t pos) { return 0; } /* unused */
+
+static inline avt_pos unix_offset(AVTIOCtx *io)
+{
+    if (io->is_write)
+        return io->wpos;
+    else
+        return io->rpos;
+}
+
 static inline avt_pos unix_read(AVTIOCtx *io, uint8_t *dst, size_t len,
                                 int64_t timeout)
 {
@@ -186,51 +227,6 @@ static inline avt_pos unix_write(AVTIOCtx *io, uint8_t *src, size_t len,
 
     return ret;
 }
-
-#if IOV_MAX > 4
-static avt_pos unix_write_vec_native(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
-                                     int64_t timeout)
-{
-    avt_pos ret;
-    avt_pos off = io->wpos;
-    int nb_iov = 0;
-
-    bool emulate = false;
-    ret = server_state_check(io, &emulate);
-    if (ret < 0)
-        return ret;
-
-    if (emulate) {
-        for (auto i = 0; i < nb_pkt; i++)
-            off += pkt[i].hdr_len + avt_buffer_get_data_len(&pkt[i].pl);
-
-        AVT_SWAP(io->wpos, off);
-        return off;
-    }
-
-    while (nb_pkt) {
-        nb_iov = 0;
-        do {
-            io->iov[nb_iov + 0].iov_base = pkt->hdr;
-            io->iov[nb_iov + 0].iov_len  = pkt->hdr_len;
-            io->iov[nb_iov + 1].iov_base = avt_buffer_get_data(&pkt->pl,
-                                                               &io->iov[nb_iov + 1].iov_len);
-            nb_iov += 1 + !!io->iov[nb_iov + 1].iov_base;
-
-            pkt++;
-            nb_pkt--;
-        } while (nb_pkt && ((nb_iov + 2) > IOV_MAX));
-
-        ret = writev(io->fd, io->iov, nb_iov);
-        if (ret < 0)
-            return avt_handle_errno(io, "Error flushing: %i %s\n");
-
-        off += ret;
-    }
-
-    AVT_SWAP(io->wpos, off);
-    return off;
-}
 #endif
 
 #define RENAME(x) unix_ ## x
@@ -243,11 +239,7 @@ const AVTIO avt_io_unix = {
     .init = unix_init,
     .get_max_pkt_len = unix_max_pkt_len,
     .read_input = unix_read_input,
-#if IOV_MAX > 4
-    .write_vec = unix_write_vec_native,
-#else
     .write_vec = unix_write_vec,
-#endif
     .write_pkt = unix_write_pkt,
     .rewrite = NULL,
     .seek = NULL,
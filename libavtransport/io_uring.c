@@ -0,0 +1,449 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE // liburing
+#define _XOPEN_SOURCE 700 // pread, pwrite
+
+#include <stdio.h>
+#include <string.h>
+#include <uchar.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "io_common.h"
+#include "io_utils.h"
+#include "io_uring_common.h"
+#include "utils_internal.h"
+
+/* Number of operations in flight */
+#define URING_NB_REQ 128
+
+/* Packets and small payloads are copied into staging buffers, and
+ * written out in one go */
+#define URING_NB_STAGE 32
+#define URING_STAGE_SIZE (1 << 16)
+
+/* Payloads this large are written directly from their buffers */
+#define URING_COPY_MAX (URING_STAGE_SIZE >> 2)
+
+/* Reads are handed out from a mapping of the file of this size */
+#define URING_READ_WINDOW 64*1024*1024
+
+struct AVTIOCtx {
+    int fd;
+    AVTUring u;
+
+    /* Mapping for reads, starting at rmap_off */
+    AVTBuffer rmap;
+    avt_pos rmap_off;
+    bool no_map;
+    size_t page_size;
+
+    /* Size of the file, as last seen */
+    avt_pos size;
+
+    avt_pos rpos;
+    avt_pos wpos;
+};
+
+static COLD int uring_close(AVTIOCtx **_io)
+{
+    AVTIOCtx *io = *_io;
+
+    int ret = avt_uring_wait(&io->u, 0, INT64_MAX);
+    avt_uring_free(&io->u);
+    avt_buffer_quick_unref(&io->rmap);
+
+    if (close(io->fd) && !ret)
+        ret = avt_handle_errno(io, "Error closing: %i %s\n");
+
+    free(io);
+    *_io = NULL;
+
+    return ret;
+}
+
+static COLD int uring_init_common(AVTIOCtx *io)
+{
+    /* Writes are done at explicit offsets, continuing from wherever
+     * the fd is */
+    off_t pos = lseek(io->fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        int ret = avt_handle_errno(io, "Unable to seek: %i %s\n");
+        close(io->fd);
+        free(io);
+        return ret;
+    }
+    io->rpos = io->wpos = pos;
+    io->page_size = sysconf(_SC_PAGESIZE);
+
+    int ret = avt_uring_init(io, &io->u, io->fd, URING_NB_REQ,
+                             URING_NB_STAGE, URING_STAGE_SIZE);
+    if (ret < 0) {
+        close(io->fd);
+        free(io);
+        return ret;
+    }
+
+    return 0;
+}
+
+static COLD int uring_init(AVTContext *ctx, AVTIOCtx **_io, AVTAddress *addr)
+{
+    int ret;
+
+    /* No durability policy, leave those to other backends */
+    if (addr->opts.sync_bytes || addr->opts.sync_period)
+        return AVT_ERROR(ENOTSUP);
+
+    AVTIOCtx *io = calloc(1, sizeof(*io));
+    if (!io)
+        return AVT_ERROR(ENOMEM);
+
+    io->fd = fcntl(addr->fd, F_DUPFD_CLOEXEC, 0);
+    if (io->fd < 0) {
+        ret = avt_handle_errno(io, "Error duplicating fd: %i %s\n");
+        free(io);
+        return ret;
+    }
+
+    ret = uring_init_common(io);
+    if (ret < 0)
+        return ret;
+
+    *_io = io;
+
+    return 0;
+}
+
+static COLD int uring_init_path(AVTContext *ctx, AVTIOCtx **_io,
+                                AVTAddress *addr)
+{
+    int ret;
+
+    /* No durability policy, leave those to other backends */
+    if (addr->opts.sync_bytes || addr->opts.sync_period)
+        return AVT_ERROR(ENOTSUP);
+
+    AVTIOCtx *io = calloc(1, sizeof(*io));
+    if (!io)
+        return AVT_ERROR(ENOMEM);
+
+    io->fd = open(addr->path, O_CREAT | O_RDWR | O_CLOEXEC, 0666);
+    if (io->fd < 0) {
+        ret = avt_handle_errno(io, "Error opening: %i %s\n");
+        free(io);
+        return ret;
+    }
+
+    ret = uring_init_common(io);
+    if (ret < 0)
+        return ret;
+
+    *_io = io;
+
+    return 0;
+}
+
+static int uring_max_pkt_len(AVTIOCtx *io, size_t *mtu)
+{
+    *mtu = SIZE_MAX;
+    return 0;
+}
+
+/* Write directly, bypassing the ring */
+static int uring_pwrite(AVTIOCtx *io, const uint8_t *data, size_t len,
+                        avt_pos off)
+{
+    while (len) {
+        ssize_t ret = pwrite(io->fd, data, len, off);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        else if (ret < 0)
+            return avt_handle_errno(io, "Error writing: %i %s\n");
+        data += ret;
+        len -= ret;
+        off += ret;
+    }
+
+    return 0;
+}
+
+/* Queues packets whole. If the ring is out of room, and either not allowed
+ * to wait, or waiting does not free any, the remaining packets are written
+ * directly, so none get lost. */
+static avt_pos uring_write_vec(AVTIOCtx *io, AVTPktd *pkt, uint32_t nb_pkt,
+                               int64_t timeout)
+{
+    int err;
+    uint32_t i;
+    avt_pos off = io->wpos;
+
+    /* Errors of previous writes are reported here */
+    err = avt_uring_wait(&io->u, UINT32_MAX, 0);
+    if (err < 0)
+        return err;
+
+    AVTUringReq *r = NULL;
+    avt_pos r_off = off;
+
+    for (i = 0; i < nb_pkt; i++) {
+        AVTPktd *p = &pkt[i];
+        size_t pl_len;
+        uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+        const bool copy_pl = pl_len < URING_COPY_MAX;
+
+        if (r && (avt_uring_stage_left(&io->u, r) <
+                  (p->hdr_len + (copy_pl ? pl_len : 0)))) {
+            avt_uring_write(&io->u, r, r_off);
+            r = NULL;
+        }
+
+        if (!r) {
+            r = avt_uring_get_req(&io->u, true, timeout);
+            if (!r)
+                break;
+            r_off = off;
+        }
+
+        /* Large payloads are written from their own buffer, right after
+         * the staged data, so both operations are needed */
+        AVTUringReq *pr = NULL;
+        if (!copy_pl) {
+            pr = avt_uring_get_req(&io->u, false, timeout);
+            if (!pr)
+                break;
+        }
+
+        avt_uring_stage_copy(r, p->hdr.data, p->hdr_len);
+        off += p->hdr_len;
+
+        if (copy_pl && pl_len) {
+            avt_uring_stage_copy(r, pl_data, pl_len);
+        } else if (pr) {
+            avt_uring_write(&io->u, r, r_off);
+            r = NULL;
+            avt_uring_add_ref(pr, &p->pl, pl_len);
+            avt_uring_write(&io->u, pr, off);
+        }
+        off += pl_len;
+    }
+
+    /* Only whole packets were staged */
+    if (r && r->iov[0].iov_len)
+        avt_uring_write(&io->u, r, r_off);
+    else if (r)
+        avt_uring_put_req(&io->u, r);
+
+    err = avt_uring_submit(&io->u);
+
+    /* The ring is out of room, write the rest directly */
+    for (; (err >= 0) && (i < nb_pkt); i++) {
+        AVTPktd *p = &pkt[i];
+        size_t pl_len;
+        uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+
+        err = uring_pwrite(io, p->hdr.data, p->hdr_len, off);
+        if (err >= 0 && pl_len)
+            err = uring_pwrite(io, pl_data, pl_len, off + p->hdr_len);
+        if (err >= 0)
+            off += p->hdr_len + pl_len;
+    }
+
+    AVT_SWAP(io->wpos, off);
+    return err < 0 ? err : off;
+}
+
+static avt_pos uring_write_pkt(AVTIOCtx *io, AVTPktd *p, int64_t timeout)
+{
+    return uring_write_vec(io, p, 1, timeout);
+}
+
+static avt_pos uring_rewrite(AVTIOCtx *io, AVTPktd *p, avt_pos off,
+                             int64_t timeout)
+{
+    /* Do not race with any pending write of the same range */
+    int err = avt_uring_wait(&io->u, 0, timeout);
+    if (err < 0)
+        return err;
+
+    err = uring_pwrite(io, p->hdr.data, p->hdr_len, off);
+    if (err < 0)
+        return err;
+
+    size_t pl_len;
+    uint8_t *data = avt_buffer_get_data(&p->pl, &pl_len);
+    if (data) {
+        err = uring_pwrite(io, data, pl_len, off + p->hdr_len);
+        if (err < 0)
+            return err;
+    }
+
+    return off;
+}
+
+static avt_pos uring_seek(AVTIOCtx *io, avt_pos off)
+{
+    return (io->rpos = off);
+}
+
+static void uring_unmap(void *opaque, void *base_data, size_t size)
+{
+    munmap(base_data, size);
+}
+
+/* Make sure the mapping covers up to len bytes at the read position,
+ * clipping len to the end of the file */
+static int uring_map(AVTIOCtx *io, size_t *len)
+{
+    /* The file may have grown since */
+    if ((io->rpos + *len) > io->size) {
+        struct stat st;
+        if (fstat(io->fd, &st))
+            return avt_handle_errno(io, "Error in fstat(): %i %s\n");
+        io->size = st.st_size;
+    }
+
+    *len = io->rpos < io->size ? AVT_MIN(io->size - io->rpos, *len) : 0;
+    if (!*len || ((io->rpos >= io->rmap_off) &&
+                  ((io->rpos + *len) <= (io->rmap_off + io->rmap.len))))
+        return 0;
+
+    avt_pos start = io->rpos & ~((avt_pos)io->page_size - 1);
+    size_t win = AVT_MIN(AVT_MAX(URING_READ_WINDOW, io->rpos + *len - start),
+                         io->size - start);
+
+    void *data = mmap(NULL, win, PROT_READ, MAP_SHARED, io->fd, start);
+    if (data == MAP_FAILED)
+        return AVT_ERROR(errno);
+
+    /* Reads are mostly sequential */
+    posix_madvise(data, win, POSIX_MADV_SEQUENTIAL);
+
+    avt_buffer_quick_unref(&io->rmap);
+    int ret = avt_buffer_quick_create(&io->rmap, data, win, NULL,
+                                      uring_unmap, AVT_BUFFER_FLAG_READ_ONLY);
+    if (ret < 0) {
+        munmap(data, win);
+        return ret;
+    }
+    io->rmap_off = start;
+
+    return 0;
+}
+
+static avt_pos uring_read_input(AVTIOCtx *io, AVTBuffer *buf, size_t len,
+                                int64_t timeout, enum AVTIOReadFlags flags)
+{
+    int64_t ret;
+
+    /* Data may still be on its way to the file */
+    if (io->u.nb_inflight) {
+        ret = avt_uring_wait(&io->u, 0, timeout);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* Hand out the data without copying, if the file can be mapped */
+    if (!(flags & AVT_IO_READ_MUTABLE) && !io->no_map) {
+        ret = uring_map(io, &len);
+        if (ret == AVT_ERROR(ENOMEM)) {
+            return ret;
+        } else if (ret < 0) {
+            avt_log(io, AVT_LOG_DEBUG, "Unable to map file for reading: %i, "
+                    "copying instead\n", (int)ret);
+            io->no_map = true;
+        } else {
+            avt_buffer_quick_unref(buf);
+            if (len)
+                avt_buffer_quick_ref(buf, &io->rmap, io->rpos - io->rmap_off, len);
+
+            ret = io->rpos + len;
+            AVT_SWAP(io->rpos, ret);
+            return ret;
+        }
+    }
+
+    size_t buf_len;
+    uint8_t *data = avt_buffer_get_data(buf, &buf_len);
+
+    do {
+        ret = pread(io->fd, data, len, io->rpos);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return avt_handle_errno(io, "Error reading: %i %s\n");
+
+    /* Adjust new size in case of underreads */
+    [[maybe_unused]] int tmp = avt_buffer_resize(buf, ret);
+    avt_assert2(tmp >= 0);
+
+    ret = io->rpos + ret;
+    AVT_SWAP(io->rpos, ret);
+    return ret;
+}
+
+static int uring_flush(AVTIOCtx *io, int64_t timeout)
+{
+    int ret = avt_uring_wait(&io->u, 0, timeout);
+    if (ret < 0)
+        return ret;
+
+    ret = fsync(io->fd);
+    if (ret)
+        ret = avt_handle_errno(io, "Error flushing: %i %s\n");
+
+    return ret;
+}
+
+const AVTIO avt_io_uring = {
+    .name = "io_uring",
+    .type = AVT_IO_FD,
+    .init = uring_init,
+    .get_max_pkt_len = uring_max_pkt_len,
+    .read_input = uring_read_input,
+    .write_vec = uring_write_vec,
+    .write_pkt = uring_write_pkt,
+    .rewrite = uring_rewrite,
+    .seek = uring_seek,
+    .flush = uring_flush,
+    .close = uring_close,
+};
+
+const AVTIO avt_io_uring_path = {
+    .name = "io_uring_path",
+    .type = AVT_IO_FILE,
+    .init = uring_init_path,
+    .get_max_pkt_len = uring_max_pkt_len,
+    .read_input = uring_read_input,
+    .write_vec = uring_write_vec,
+    .write_pkt = uring_write_pkt,
+    .rewrite = uring_rewrite,
+    .seek = uring_seek,
+    .flush = uring_flush,
+    .close = uring_close,
+};
@@ -0,0 +1,328 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE // liburing
+
+#include <stdlib.h>
+#include <errno.h>
+#include <stdckdint.h>
+
+#include <avtransport/avtransport.h>
+#include "io_uring_common.h"
+#include "utils_internal.h"
+
+void avt_uring_put_req(AVTUring *u, AVTUringReq *r)
+{
+    for (int i = 0; i < r->nb_ref; i++)
+        avt_buffer_quick_unref(&r->ref[i]);
+    if (r->stage >= 0)
+        u->stage_free[u->nb_stage_free++] = r->stage;
+    u->req_free[u->nb_req_free++] = r - u->req;
+}
+
+static void uring_prep(AVTUring *u, AVTUringReq *r)
+{
+    /* Never NULL, as there are as many entries as operations */
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+
+    if (r->op == AVT_URING_SENDMSG)
+        io_uring_prep_sendmsg(sqe, u->fd, &r->mh, r->flags);
+    else if (r->nb_iov > 1)
+        io_uring_prep_writev(sqe, u->fd, r->iov, r->nb_iov, r->off);
+    else if (u->fixed && (r->stage >= 0) && !r->nb_ref)
+        io_uring_prep_write_fixed(sqe, u->fd, r->iov[0].iov_base,
+                                  r->iov[0].iov_len, r->off, r->stage);
+    else
+        io_uring_prep_write(sqe, u->fd, r->iov[0].iov_base,
+                            r->iov[0].iov_len, r->off);
+
+    io_uring_sqe_set_data(sqe, r);
+    u->nb_queued++;
+    u->nb_inflight++;
+}
+
+static void uring_complete(AVTUring *u, AVTUringReq *r, int res)
+{
+    u->nb_inflight--;
+
+    if ((res > 0) && (r->op == AVT_URING_WRITE) && ((size_t)res < r->len)) {
+        /* Short write, queue the rest */
+        size_t done = res;
+        r->len -= done;
+        r->off += done;
+
+        int i = 0;
+        while (done >= r->iov[i].iov_len)
+            done -= r->iov[i++].iov_len;
+        memmove(&r->iov[0], &r->iov[i], (r->nb_iov - i)*sizeof(*r->iov));
+        r->nb_iov -= i;
+        r->iov[0].iov_base = (uint8_t *)r->iov[0].iov_base + done;
+        r->iov[0].iov_len -= done;
+
+        uring_prep(u, r);
+        return;
+    } else if (!res && r->len) {
+        res = AVT_ERROR(EIO);
+    }
+
+    if ((res < 0) && !u->err)
+        u->err = res;
+
+    avt_uring_put_req(u, r);
+}
+
+static void uring_reap(AVTUring *u)
+{
+    unsigned head, nb = 0;
+    struct io_uring_cqe *cqe;
+
+    io_uring_for_each_cqe(&u->ring, head, cqe) {
+        uring_complete(u, io_uring_cqe_get_data(cqe), cqe->res);
+        nb++;
+    }
+    io_uring_cq_advance(&u->ring, nb);
+}
+
+/* Submit and wait for a completion until end */
+static int uring_wait_one(AVTUring *u, int64_t end)
+{
+    int ret = avt_uring_submit(u);
+    if (ret < 0)
+        return ret;
+
+    struct __kernel_timespec ts, *tsp = NULL;
+    if (end != INT64_MAX) {
+        int64_t left = end - avt_get_time_ns();
+        if (left <= 0)
+            return AVT_ERROR(ETIMEDOUT);
+        ts.tv_sec = left / 1000000000;
+        ts.tv_nsec = left % 1000000000;
+        tsp = &ts;
+    }
+
+    struct io_uring_cqe *cqe;
+    ret = io_uring_wait_cqe_timeout(&u->ring, &cqe, tsp);
+    if (ret == -ETIME)
+        return AVT_ERROR(ETIMEDOUT);
+    else if (ret < 0 && ret != -EINTR)
+        return ret;
+
+    uring_reap(u);
+    return 0;
+}
+
+static inline int64_t uring_deadline(int64_t timeout)
+{
+    int64_t end;
+    if ((timeout == INT64_MAX) || ckd_add(&end, avt_get_time_ns(), timeout))
+        return INT64_MAX;
+    return end;
+}
+
+COLD int avt_uring_init(void *log_ctx, AVTUring *u, int fd, uint32_t nb_req,
+                        uint32_t nb_stage, size_t stage_size)
+{
+    int ret;
+    *u = (AVTUring) { .fd = fd };
+
+    ret = io_uring_queue_init(nb_req, &u->ring, 0);
+    if (ret < 0) {
+        avt_log(log_ctx, AVT_LOG_VERBOSE, "Unable to setup io_uring: %s\n",
+                strerror(-ret));
+        return ret;
+    }
+
+    u->req = calloc(nb_req, sizeof(*u->req));
+    u->req_free = calloc(nb_req, sizeof(*u->req_free));
+    u->stage_free = calloc(nb_stage + 1, sizeof(*u->stage_free));
+    if (!u->req || !u->req_free || !u->stage_free) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail;
+    }
+
+    u->nb_req = nb_req;
+    for (uint32_t i = 0; i < nb_req; i++)
+        u->req_free[u->nb_req_free++] = nb_req - i - 1;
+
+    if (!nb_stage)
+        return 0;
+
+    uint8_t *stage = avt_buffer_quick_alloc_aligned(&u->stage,
+                                                    nb_stage*stage_size,
+                                                    4096, 0);
+    if (!stage) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail;
+    }
+
+    u->stage_size = stage_size;
+    u->nb_stage = nb_stage;
+    for (uint32_t i = 0; i < nb_stage; i++)
+        u->stage_free[u->nb_stage_free++] = nb_stage - i - 1;
+
+    /* Registering lets the kernel skip mapping the pages on each write.
+     * It counts against the locked memory limit, so it may fail. */
+    struct iovec *iov = calloc(nb_stage, sizeof(*iov));
+    if (!iov) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail;
+    }
+
+    for (uint32_t i = 0; i < nb_stage; i++)
+        iov[i] = (struct iovec) { stage + i*stage_size, stage_size };
+
+    ret = io_uring_register_buffers(&u->ring, iov, nb_stage);
+    free(iov);
+    if (ret < 0)
+        avt_log(log_ctx, AVT_LOG_VERBOSE, "Unable to register io_uring "
+                "buffers: %s\n", strerror(-ret));
+    u->fixed = ret >= 0;
+
+    return 0;
+
+fail:
+    avt_uring_free(u);
+    return ret;
+}
+
+COLD void avt_uring_free(AVTUring *u)
+{
+    if (!u->req)
+        goto end;
+
+    /* The kernel may still be using the memory */
+    while (u->nb_inflight && (uring_wait_one(u, INT64_MAX) >= 0))
+        ;
+
+    for (uint32_t i = 0; i < u->nb_req; i++)
+        for (int j = 0; j < u->req[i].nb_ref; j++)
+            avt_buffer_quick_unref(&u->req[i].ref[j]);
+
+end:
+    io_uring_queue_exit(&u->ring);
+    avt_buffer_quick_unref(&u->stage);
+    free(u->req);
+    free(u->req_free);
+    free(u->stage_free);
+    u->req = NULL;
+    u->req_free = NULL;
+    u->stage_free = NULL;
+}
+
+AVTUringReq *avt_uring_get_req(AVTUring *u, bool stage, int64_t timeout)
+{
+    const int64_t end = uring_deadline(timeout);
+
+    uring_reap(u);
+    while (!u->nb_req_free || (stage && !u->nb_stage_free)) {
+        if (!timeout || !u->nb_inflight || (uring_wait_one(u, end) < 0))
+            return NULL;
+    }
+
+    AVTUringReq *r = &u->req[u->req_free[--u->nb_req_free]];
+    *r = (AVTUringReq) { .stage = -1 };
+
+    if (stage) {
+        r->stage = u->stage_free[--u->nb_stage_free];
+        r->iov[0].iov_base = u->stage.data + r->stage*u->stage_size;
+        r->nb_iov = 1;
+    }
+
+    return r;
+}
+
+void avt_uring_add_ref(AVTUringReq *r, AVTBuffer *buf, size_t len)
+{
+    avt_buffer_quick_ref(&r->ref[r->nb_ref++], buf, 0, AVT_BUFFER_REF_ALL);
+    r->iov[r->nb_iov++] = (struct iovec) { buf->data, len };
+}
+
+static inline size_t uring_req_len(AVTUringReq *r)
+{
+    size_t len = 0;
+    for (int i = 0; i < r->nb_iov; i++)
+        len += r->iov[i].iov_len;
+    return len;
+}
+
+void avt_uring_write(AVTUring *u, AVTUringReq *r, int64_t off)
+{
+    r->op = AVT_URING_WRITE;
+    r->len = uring_req_len(r);
+    r->off = off;
+    uring_prep(u, r);
+}
+
+void avt_uring_sendmsg(AVTUring *u, AVTUringReq *r,
+                       struct sockaddr *addr, socklen_t addr_len, int flags)
+{
+    r->op = AVT_URING_SENDMSG;
+    r->flags = flags;
+    r->len = uring_req_len(r);
+    r->mh = (struct msghdr) {
+        .msg_name = addr,
+        .msg_namelen = addr_len,
+        .msg_iov = r->iov,
+        .msg_iovlen = r->nb_iov,
+    };
+    uring_prep(u, r);
+}
+
+int avt_uring_submit(AVTUring *u)
+{
+    if (!u->nb_queued)
+        return 0;
+
+    int ret = io_uring_submit(&u->ring);
+    if (ret < 0)
+        return ret;
+
+    u->nb_queued -= AVT_MIN((uint32_t)ret, u->nb_queued);
+    return 0;
+}
+
+int avt_uring_wait(AVTUring *u, uint32_t nb_left, int64_t timeout)
+{
+    const int64_t end = uring_deadline(timeout);
+
+    int ret = avt_uring_submit(u);
+    if (ret < 0)
+        return ret;
+
+    uring_reap(u);
+    while (u->nb_inflight > nb_left) {
+        ret = uring_wait_one(u, end);
+        if (ret < 0)
+            break;
+    }
+
+    if (u->err) {
+        ret = u->err;
+        u->err = 0;
+    }
+
+    return ret;
+}
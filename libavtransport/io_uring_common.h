@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AVTRANSPORT_IO_URING_COMMON_H
+#define AVTRANSPORT_IO_URING_COMMON_H
+
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <liburing.h>
+
+#include "buffer.h"
+
+enum AVTUringOp {
+    AVT_URING_WRITE,
+    AVT_URING_SENDMSG,
+};
+
+/* A single operation. Everything the kernel may look at until
+ * the completion arrives lives here. */
+typedef struct AVTUringReq {
+    enum AVTUringOp op;
+    int flags;
+
+    struct iovec iov[2];
+    int nb_iov;
+    struct msghdr mh;
+
+    /* References held until completion */
+    AVTBuffer ref[2];
+    int nb_ref;
+
+    /* Staging buffer index, or -1. If set, iov[0] points into it. */
+    int stage;
+
+    /* Bytes left, and their file offset, to resume short writes */
+    size_t len;
+    int64_t off;
+} AVTUringReq;
+
+typedef struct AVTUring {
+    struct io_uring ring;
+    int fd;
+
+    AVTUringReq *req;
+    uint32_t *req_free;
+    uint32_t nb_req;
+    uint32_t nb_req_free;
+
+    /* Staging buffers, registered with the ring if possible */
+    AVTBuffer stage;
+    size_t stage_size;
+    uint32_t *stage_free;
+    uint32_t nb_stage;
+    uint32_t nb_stage_free;
+    bool fixed;
+
+    /* Prepared but not yet submitted, and not yet completed */
+    uint32_t nb_queued;
+    uint32_t nb_inflight;
+
+    /* First error any completion returned */
+    int err;
+} AVTUring;
+
+/* Setup a ring for operations on fd, with up to nb_req operations, and
+ * nb_stage staging buffers of stage_size bytes each */
+int avt_uring_init(void *log_ctx, AVTUring *u, int fd, uint32_t nb_req,
+                   uint32_t nb_stage, size_t stage_size);
+
+/* Wait for all operations to complete and free everything */
+void avt_uring_free(AVTUring *u);
+
+/* Get an operation, with an empty staging buffer if stage is set.
+ * Reaps completions, waiting for up to timeout nanoseconds for one
+ * if needed. Returns NULL if nothing freed up in time. */
+AVTUringReq *avt_uring_get_req(AVTUring *u, bool stage, int64_t timeout);
+
+/* Return an operation which was not queued */
+void avt_uring_put_req(AVTUring *u, AVTUringReq *r);
+
+/* Space left in the staging buffer of an operation */
+static inline size_t avt_uring_stage_left(AVTUring *u, AVTUringReq *r)
+{
+    return u->stage_size - r->iov[0].iov_len;
+}
+
+/* Append data to the staging buffer of an operation */
+static inline void avt_uring_stage_copy(AVTUringReq *r,
+                                        const void *src, size_t len)
+{
+    memcpy((uint8_t *)r->iov[0].iov_base + r->iov[0].iov_len, src, len);
+    r->iov[0].iov_len += len;
+}
+
+/* Reference a buffer and append it to the operation's data */
+void avt_uring_add_ref(AVTUringReq *r, AVTBuffer *buf, size_t len);
+
+/* Queue writing the data of an operation at off */
+void avt_uring_write(AVTUring *u, AVTUringReq *r, int64_t off);
+
+/* Queue sending the data of an operation as a single message */
+void avt_uring_sendmsg(AVTUring *u, AVTUringReq *r,
+                       struct sockaddr *addr, socklen_t addr_len, int flags);
+
+/* Submit everything queued, without waiting */
+int avt_uring_submit(AVTUring *u);
+
+/* Submit, and wait for up to timeout nanoseconds until at most nb_left
+ * operations are incomplete. Returns the first error a completion
+ * returned since the last call, or ETIMEDOUT. */
+int avt_uring_wait(AVTUring *u, uint32_t nb_left, int64_t timeout);
+
+#endif /* AVTRANSPORT_IO_URING_COMMON_H */
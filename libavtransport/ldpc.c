@@ -25,3 +25,75 @@
  */
 
 #include "ldpc.h"
+#include "ldpc_tables.h"
+#include "bytestream.h"
+#include "cpu.h"
+#include "x86/ldpc.h"
+
+static void ldpc_encode_c(uint8_t *pkt, const uint64_t *H,
+                          int message_bytes, int nb_blocks)
+{
+    ldpc_encode(pkt, H, message_bytes*8, nb_blocks*64);
+}
+
+/* Computes the syndrome for each block of 64 checks.
+ * The H-matrix is in the format the encoder expects, with the identity
+ * columns included. Returns non-zero if any check failed. */
+static int ldpc_syndrome_c(uint64_t *syn, const uint8_t *pkt,
+                           const uint64_t *H, int message_bytes,
+                           int nb_blocks)
+{
+    uint64_t err = 0;
+    const uint8_t *par = pkt + message_bytes;
+
+    for (int i = 0; i < nb_blocks; i++) {
+        uint64_t s = AVT_RB64(&par[i*8]);
+        for (int j = 0; j < message_bytes; j++) {
+            uint8_t d = pkt[j];
+            for (int k = 0; k < 8; k++)
+                s ^= (((d >> (7 - k)) & 1) * UINT64_MAX) & (*H++);
+        }
+        syn[i] = s;
+        err |= s;
+
+        /* Skip identity elements */
+        H += nb_blocks*64;
+    }
+
+    return !!err;
+}
+
+void avt_ldpc_dsp_init(AVTLDPCDSP *dsp, unsigned cpu_flags)
+{
+    dsp->encode = ldpc_encode_c;
+    dsp->encode_x4 = NULL;
+    dsp->syndrome = ldpc_syndrome_c;
+
+#ifdef LDPC_X86
+    if (cpu_flags & AVT_CPU_FLAG_SSE4) {
+        dsp->encode = avt_ldpc_encode_sse4;
+        dsp->syndrome = avt_ldpc_syndrome_sse4;
+    }
+    if (cpu_flags & AVT_CPU_FLAG_AVX2) {
+        dsp->encode = avt_ldpc_encode_avx2;
+        dsp->syndrome = avt_ldpc_syndrome_avx2;
+    }
+    if (cpu_flags & AVT_CPU_FLAG_AVX512) {
+        dsp->encode = avt_ldpc_encode_avx512;
+        dsp->encode_x4 = avt_ldpc_encode_x4_avx512;
+    }
+#endif
+}
+
+static AVTLDPCDSP ldpc_dsp;
+
+void avt_ldpc_dsp_select(unsigned cpu_flags)
+{
+    avt_ldpc_dsp_init(&ldpc_dsp, cpu_flags);
+}
+
+const AVTLDPCDSP *avt_ldpc_get_dsp(void)
+{
+    avt_cpu_get_flags();
+    return &ldpc_dsp;
+}
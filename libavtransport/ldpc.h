@@ -27,4 +27,33 @@
 #ifndef LIBAVTRANSPORT_LDPC
 #define LIBAVTRANSPORT_LDPC
 
+#include <stdint.h>
+
+/* LDPC kernels, which take an H-matrix in the format of the tables.
+ * Sizes are in bytes of message, and in blocks of 64 parity bits. */
+typedef struct AVTLDPCDSP {
+    /* Computes and writes the parity after the message */
+    void (*encode)(uint8_t *pkt, const uint64_t *H,
+                   int message_bytes, int nb_blocks);
+
+    /* Same as encode, for 4 messages sharing the H-matrix.
+     * Optional, only set when faster than 4 calls to encode. */
+    void (*encode_x4)(uint8_t *const *pkt, const uint64_t *H,
+                      int message_bytes, int nb_blocks);
+
+    /* Computes the syndrome of each block of 64 checks.
+     * Returns non-zero if any check failed. */
+    int (*syndrome)(uint64_t *syn, const uint8_t *pkt,
+                    const uint64_t *H, int message_bytes, int nb_blocks);
+} AVTLDPCDSP;
+
+/* Sets all kernels to the best ones among the given CPU flags */
+void avt_ldpc_dsp_init(AVTLDPCDSP *dsp, unsigned cpu_flags);
+
+/* Kernels in use, selected on first use or by avt_cpu_set_flags() */
+const AVTLDPCDSP *avt_ldpc_get_dsp(void);
+
+/* Reselects the kernels in use. Called by avt_cpu_set_flags(). */
+void avt_ldpc_dsp_select(unsigned cpu_flags);
+
 #endif
@@ -24,12 +24,294 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "ldpc.h"
 #include "ldpc_decode.h"
+#include "ldpc_tables.h"
+#include "bytestream.h"
+#include "utils_internal.h"
+
+/* Iterations of each decoding stage, unless set */
+#define LDPC_ITERATIONS 16
+
+/* Largest code supported */
+#define LDPC_MAX_BITS 2784
+#define LDPC_MAX_BLOCKS (768 / 64)
+
+/* Most connections between checks and bits of a code, for min-sum decoding */
+#define LDPC_MAX_EDGES 16384
+
+/* Bit flipping results with more corrections than this are checked
+ * against min-sum decoding */
+#define LDPC_BF_MAX_FLIPS 2
+
+/* Min-sum: magnitude of the hard-decision input, the normalization
+ * factor (in quarters), and the limit of accumulated values */
+#define LDPC_LLR 8
+#define LDPC_SCALE 3
+#define LDPC_LLR_MAX (1 << 15)
+
+static inline bool ldpc_failed(const uint64_t *syn, int nb_blocks)
+{
+    uint64_t err = 0;
+    for (int i = 0; i < nb_blocks; i++)
+        err |= syn[i];
+    return !!err;
+}
+
+/* Hard-decision bit flipping. Each iteration flips the message bits
+ * involved in the most failed checks. Once no message bit is in more
+ * than a single failed check, the parity is taken to be wrong instead.
+ * Returns the number of bits flipped, or a negative error if the
+ * flips did not settle within the given iterations. */
+static int ldpc_bit_flip(uint8_t *pkt, uint64_t *syn, const uint64_t *H,
+                         int message_bits, int nb_blocks, int iterations)
+{
+    int flipped = 0;
+    const int n = message_bits + nb_blocks*64;
+    uint16_t cnt[LDPC_MAX_BITS];
+
+    for (int it = 0; it < iterations; it++) {
+        int max = 0;
+        for (int c = 0; c < message_bits; c++) {
+            int u = 0;
+            for (int i = 0; i < nb_blocks; i++)
+                u += stdc_count_ones(H[i*n + c] & syn[i]);
+            cnt[c] = u;
+            max = AVT_MAX(max, u);
+        }
+
+        if (max < 2) {
+            uint8_t *par = pkt + (message_bits >> 3);
+            for (int i = 0; i < nb_blocks; i++) {
+                flipped += stdc_count_ones(syn[i]);
+                for (int k = 0; k < 8; k++)
+                    par[i*8 + k] ^= syn[i] >> (56 - k*8);
+                syn[i] = 0;
+            }
+            return flipped;
+        }
+
+        for (int c = 0; c < message_bits; c++) {
+            if (cnt[c] != max)
+                continue;
+            pkt[c >> 3] ^= 0x80 >> (c & 7);
+            for (int i = 0; i < nb_blocks; i++)
+                syn[i] ^= H[i*n + c];
+            flipped++;
+        }
+
+        if (!ldpc_failed(syn, nb_blocks))
+            return flipped;
+    }
+
+    return AVT_ERROR(EINVAL);
+}
+
+/* Connections of each check of a code, taken from its H-matrix */
+typedef struct LDPCGraph {
+    int nb_edges;
+    uint16_t row_start[LDPC_MAX_BLOCKS*64 + 1];
+    uint16_t *col;
+} LDPCGraph;
+
+static int ldpc_graph_init(LDPCGraph *g, const uint64_t *H,
+                           int message_bits, int nb_blocks)
+{
+    const int n = message_bits + nb_blocks*64;
+    const int rows = nb_blocks*64;
+
+    g->col = NULL;
+
+    int cnt[LDPC_MAX_BLOCKS*64] = { };
+    for (int i = 0; i < nb_blocks; i++)
+        for (int c = 0; c < n; c++)
+            for (uint64_t m = H[i*n + c]; m; m &= m - 1)
+                cnt[i*64 + 63 - stdc_trailing_zeros(m)]++;
+
+    int nb_edges = 0;
+    for (int r = 0; r < rows; r++) {
+        g->row_start[r] = nb_edges;
+        nb_edges += cnt[r];
+        if (nb_edges > LDPC_MAX_EDGES)
+            return AVT_ERROR(ENOTSUP);
+    }
+    g->row_start[rows] = nb_edges;
+    g->nb_edges = nb_edges;
+    if (!nb_edges)
+        return AVT_ERROR(EINVAL);
+
+    g->col = malloc(nb_edges*sizeof(*g->col));
+    if (!g->col)
+        return AVT_ERROR(ENOMEM);
+
+    uint16_t fill[LDPC_MAX_BLOCKS*64];
+    memcpy(fill, g->row_start, rows*sizeof(*fill));
+    for (int i = 0; i < nb_blocks; i++)
+        for (int c = 0; c < n; c++)
+            for (uint64_t m = H[i*n + c]; m; m &= m - 1)
+                g->col[fill[i*64 + 63 - stdc_trailing_zeros(m)]++] = c;
+
+    return 0;
+}
+
+/* Graphs of the codes from the specification, built once */
+static LDPCGraph graph_288_224;
+static LDPCGraph graph_2784_2016;
+static once_flag graph_init_once = ONCE_FLAG_INIT;
+
+/* Without a graph, only bit flipping is done */
+static void ldpc_graphs_init(void)
+{
+    ldpc_graph_init(&graph_288_224, ldpc_h_matrix_288_224, 224, 1);
+    ldpc_graph_init(&graph_2784_2016, ldpc_h_matrix_2784_2016, 2016, 12);
+}
+
+/* Layered, normalized min-sum decoding, on the hard-decision input.
+ * Slower, but recovers from errors bit flipping gets stuck on. */
+static int ldpc_min_sum(const AVTLDPCDSP *dsp, uint8_t *pkt, uint64_t *syn,
+                        const uint64_t *H, const LDPCGraph *g,
+                        int message_bits, int nb_blocks, int iterations)
+{
+    const int n = message_bits + nb_blocks*64;
+    const int rows = nb_blocks*64;
+    const uint16_t *col = g->col;
+
+    /* Check to bit messages. Bounded by LDPC_LLR_MAX*LDPC_SCALE/4. */
+    int16_t R[LDPC_MAX_EDGES];
+    memset(R, 0, g->nb_edges*sizeof(*R));
+
+    int32_t L[LDPC_MAX_BITS];
+    for (int c = 0; c < n; c++)
+        L[c] = (pkt[c >> 3] & (0x80 >> (c & 7))) ? -LDPC_LLR : LDPC_LLR;
+
+    uint8_t out[LDPC_MAX_BITS / 8];
+    const int len = n >> 3;
+
+    for (int it = 0; it < iterations; it++) {
+        for (int r = 0; r < rows; r++) {
+            int s = g->row_start[r], e = g->row_start[r + 1];
+            int32_t min1 = LDPC_LLR_MAX, min2 = LDPC_LLR_MAX;
+            int min_idx = -1, sign = 0;
+
+            for (int j = s; j < e; j++) {
+                int32_t q = L[col[j]] - R[j];
+                int32_t a = q < 0 ? -q : q;
+                sign ^= q < 0;
+                if (a < min1) {
+                    min2 = min1;
+                    min1 = a;
+                    min_idx = j;
+                } else if (a < min2) {
+                    min2 = a;
+                }
+            }
+
+            /* Each bit appears once in a check, so q is still the same */
+            for (int j = s; j < e; j++) {
+                int32_t q = L[col[j]] - R[j];
+                int32_t mag = ((j == min_idx ? min2 : min1)*LDPC_SCALE) >> 2;
+                R[j] = (sign ^ (q < 0)) ? -mag : mag;
+                q += R[j];
+                L[col[j]] = AVT_MIN(AVT_MAX(q, -LDPC_LLR_MAX), LDPC_LLR_MAX);
+            }
+        }
+
+        memset(out, 0, len);
+        for (int c = 0; c < n; c++)
+            out[c >> 3] |= (L[c] < 0) << (7 - (c & 7));
+
+        if (!dsp->syndrome(syn, out, H, message_bits >> 3, nb_blocks)) {
+            int ret = 0;
+            for (int j = 0; j < len; j++)
+                ret += stdc_count_ones((uint8_t)(out[j] ^ pkt[j]));
+            memcpy(pkt, out, len);
+            return ret;
+        }
+    }
+
+    return AVT_ERROR(EINVAL);
+}
+
+/* If g is NULL, the graph is built only if min-sum decoding is needed.
+ * If it has no connections, only bit flipping is done. */
+static int ldpc_decode(uint8_t *pkt, const uint64_t *H, const LDPCGraph *g,
+                       int message_bits, int parity_bits, int iterations)
+{
+    uint64_t syn[LDPC_MAX_BLOCKS];
+    const int nb_blocks = parity_bits >> 6;
+    const int len = (message_bits + parity_bits) >> 3;
+
+    if (iterations < 0)
+        return 0;
+    else if (!iterations)
+        iterations = LDPC_ITERATIONS;
+
+    const AVTLDPCDSP *dsp = avt_ldpc_get_dsp();
+
+    /* Clean data */
+    if (!dsp->syndrome(syn, pkt, H, message_bits >> 3, nb_blocks))
+        return 0;
+
+    uint8_t orig[LDPC_MAX_BITS / 8];
+    memcpy(orig, pkt, len);
+
+    /* Bit flipping reliably corrects isolated errors */
+    int ret = ldpc_bit_flip(pkt, syn, H, message_bits, nb_blocks, iterations);
+    if (ret >= 0 && ret <= LDPC_BF_MAX_FLIPS)
+        return ret;
+
+    LDPCGraph tmp = { };
+    if (!g) {
+        int err = ldpc_graph_init(&tmp, H, message_bits, nb_blocks);
+        if (err == AVT_ERROR(ENOMEM)) {
+            memcpy(pkt, orig, len);
+            return err;
+        }
+        g = &tmp;
+    }
+
+    int ret_ms = AVT_ERROR(EINVAL);
+    uint8_t bf[LDPC_MAX_BITS / 8];
+    if (g->col) {
+        memcpy(bf, pkt, len);
+        memcpy(pkt, orig, len);
+        ret_ms = ldpc_min_sum(dsp, pkt, syn, H, g, message_bits, nb_blocks,
+                              iterations);
+        if (ret_ms < 0)
+            memcpy(pkt, bf, len);
+    }
+    free(tmp.col);
+
+    if (ret_ms >= 0)
+        return ret_ms;
+    else if (ret >= 0) /* Take whatever bit flipping came up with */
+        return ret;
+
+    /* Leave the data untouched */
+    memcpy(pkt, orig, len);
+    return ret;
+}
+
+int avt_ldpc_decode(uint8_t *pkt, const uint64_t *H, int message_bits,
+                    int parity_bits, int iterations)
+{
+    return ldpc_decode(pkt, H, NULL, message_bits, parity_bits, iterations);
+}
 
-void avt_ldpc_decode_288_224(uint8_t *dst, int iterations)
+int avt_ldpc_decode_288_224(uint8_t *dst, int iterations)
 {
+    call_once(&graph_init_once, ldpc_graphs_init);
+    return ldpc_decode(dst, ldpc_h_matrix_288_224, &graph_288_224,
+                       224, 64, iterations);
 }
 
-void avt_ldpc_decode_2784_2016(uint8_t *dst, int iterations)
+int avt_ldpc_decode_2784_2016(uint8_t *dst, int iterations)
 {
+    call_once(&graph_init_once, ldpc_graphs_init);
+    return ldpc_decode(dst, ldpc_h_matrix_2784_2016, &graph_2784_2016,
+                       2016, 768, iterations);
 }
@@ -29,10 +29,20 @@
 
 #include <stdint.h>
 
-/* Decodes systematic LDPC codes. dst must point to the start of the message. */
+/* Decodes systematic LDPC codes, correcting the data in place.
+ * dst must point to the start of the message.
+ * iterations limits the work done on corrupted data. Zero picks a default,
+ * negative values disable decoding.
+ *
+ * Returns the number of bits corrected, or a negative error if the data
+ * could not be corrected, in which case it is left untouched. */
+
+int avt_ldpc_decode_288_224(uint8_t *dst, int iterations);
 
-void avt_ldpc_decode_288_224(uint8_t *dst, int iterations);
+int avt_ldpc_decode_2784_2016(uint8_t *dst, int iterations);
 
-void avt_ldpc_decode_2784_2016(uint8_t *dst, int iterations);
+/* Decodes with any H-matrix, in the format ldpc_encode() takes */
+int avt_ldpc_decode(uint8_t *pkt, const uint64_t *H, int message_bits,
+                    int parity_bits, int iterations);
 
 #endif /* AVTRANSPORT_LDPC_DECODE */
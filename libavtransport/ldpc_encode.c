@@ -24,16 +24,48 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "ldpc.h"
 #include "ldpc_encode.h"
 #include "ldpc_tables.h"
-#include "bytestream.h"
 
 void avt_ldpc_encode_288_224(uint8_t *src)
 {
-    ldpc_encode(src, ldpc_h_matrix_288_224, 224, 64);
+    avt_ldpc_get_dsp()->encode(src, ldpc_h_matrix_288_224, 224/8, 64/64);
 }
 
 void avt_ldpc_encode_2784_2016(uint8_t *src)
 {
-    ldpc_encode(src, ldpc_h_matrix_2784_2016, 2016, 768);
+    avt_ldpc_get_dsp()->encode(src, ldpc_h_matrix_2784_2016, 2016/8, 768/64);
+}
+
+static void ldpc_encode_batch(uint8_t *const *dst, int nb, const uint64_t *H,
+                              int message_bytes, int nb_blocks)
+{
+    const AVTLDPCDSP *dsp = avt_ldpc_get_dsp();
+
+    int i = 0;
+    if (dsp->encode_x4) {
+        for (; i < (nb & ~3); i += 4)
+            dsp->encode_x4(&dst[i], H, message_bytes, nb_blocks);
+    }
+    for (; i < nb; i++)
+        dsp->encode(dst[i], H, message_bytes, nb_blocks);
+}
+
+void avt_ldpc_encode_288_224_batch(uint8_t *const *dst, int nb)
+{
+    ldpc_encode_batch(dst, nb, ldpc_h_matrix_288_224, 224/8, 64/64);
+}
+
+void avt_ldpc_encode_2784_2016_batch(uint8_t *const *dst, int nb)
+{
+    ldpc_encode_batch(dst, nb, ldpc_h_matrix_2784_2016, 2016/8, 768/64);
+}
+
+void avt_ldpc_encode_batch(AVTLDPCBatch *b)
+{
+    avt_ldpc_encode_288_224_batch(b->dst_288_224, b->nb_288_224);
+    avt_ldpc_encode_2784_2016_batch(b->dst_2784_2016, b->nb_2784_2016);
+    b->nb_288_224 = 0;
+    b->nb_2784_2016 = 0;
 }
@@ -36,4 +36,48 @@ void avt_ldpc_encode_288_224(uint8_t *dst);
 
 void avt_ldpc_encode_2784_2016(uint8_t *dst);
 
+/* Same as above, for nb sequences at once */
+void avt_ldpc_encode_288_224_batch(uint8_t *const *dst, int nb);
+
+void avt_ldpc_encode_2784_2016_batch(uint8_t *const *dst, int nb);
+
+#define AVT_LDPC_BATCH_MAX 256
+
+/* Sequences queued for encoding, one array per code */
+typedef struct AVTLDPCBatch {
+    uint8_t *dst_288_224[AVT_LDPC_BATCH_MAX];
+    uint8_t *dst_2784_2016[AVT_LDPC_BATCH_MAX];
+    int nb_288_224;
+    int nb_2784_2016;
+} AVTLDPCBatch;
+
+/* Encodes all queued sequences, and empties the batch */
+void avt_ldpc_encode_batch(AVTLDPCBatch *b);
+
+/* Queue a sequence for encoding. Without a batch, encodes immediately.
+ * The sequence must not be moved until the batch is encoded. */
+static inline void avt_ldpc_queue_288_224(AVTLDPCBatch *b, uint8_t *dst)
+{
+    if (!b) {
+        avt_ldpc_encode_288_224(dst);
+        return;
+    }
+
+    b->dst_288_224[b->nb_288_224++] = dst;
+    if (b->nb_288_224 == AVT_LDPC_BATCH_MAX)
+        avt_ldpc_encode_batch(b);
+}
+
+static inline void avt_ldpc_queue_2784_2016(AVTLDPCBatch *b, uint8_t *dst)
+{
+    if (!b) {
+        avt_ldpc_encode_2784_2016(dst);
+        return;
+    }
+
+    b->dst_2784_2016[b->nb_2784_2016++] = dst;
+    if (b->nb_2784_2016 == AVT_LDPC_BATCH_MAX)
+        avt_ldpc_encode_batch(b);
+}
+
 #endif /* AVTRANSPORT_LDPC_ENCODE */
@@ -27,6 +27,7 @@
 #ifndef AVTRANSPORT_MEM_H
 #define AVTRANSPORT_MEM_H
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdckdint.h>
 
@@ -68,4 +69,55 @@ avt_alloc_attrib(2, 3) static inline void *avt_reallocarray(void *ptr,
         return sctx;                                                          \
     }
 
+/* Two-level radix table, for sparse 16-bit IDs.
+ * Pages of entry pointers, and the entries themselves, are allocated
+ * on first use, so an unused ID costs at most a NULL pointer. */
+#define AVT_SPARSE_PAGE_BITS 8
+#define AVT_SPARSE_PAGE_SIZE (1 << AVT_SPARSE_PAGE_BITS)
+#define AVT_SPARSE_NB_PAGES  ((UINT16_MAX + 1) >> AVT_SPARSE_PAGE_BITS)
+
+/* Generic macro for creating lookup, allocation and freeing functions for
+ * a `type **table[AVT_SPARSE_NB_PAGES]` field. Entries are zeroed on
+ * allocation, and keep their addresses until the table is freed. */
+#define FN_SPARSE_TABLE(prefix, ctx, type, shortname, table)                  \
+    static inline type *prefix##_##get_##shortname(const ctx *dctx,           \
+                                                   uint16_t id)               \
+    {                                                                         \
+        type **page = dctx->table[id >> AVT_SPARSE_PAGE_BITS];                \
+        return page ? page[id & (AVT_SPARSE_PAGE_SIZE - 1)] : NULL;           \
+    }                                                                         \
+                                                                              \
+    static inline type *prefix##_##alloc_##shortname(ctx *dctx, uint16_t id)  \
+    {                                                                         \
+        type ***page = &dctx->table[id >> AVT_SPARSE_PAGE_BITS];              \
+        if (!(*page)) {                                                       \
+            *page = calloc(AVT_SPARSE_PAGE_SIZE, sizeof(type *));             \
+            if (!(*page))                                                     \
+                return NULL;                                                  \
+        }                                                                     \
+                                                                              \
+        type **entry = &(*page)[id & (AVT_SPARSE_PAGE_SIZE - 1)];             \
+        if (!(*entry))                                                        \
+            *entry = calloc(1, sizeof(type));                                 \
+                                                                              \
+        return *entry;                                                        \
+    }                                                                         \
+                                                                              \
+    static inline void prefix##_##free_##table(ctx *dctx,                     \
+                                               void (*uninit)(type *))        \
+    {                                                                         \
+        for (int i = 0; i < AVT_SPARSE_NB_PAGES; i++) {                       \
+            type **page = dctx->table[i];                                     \
+            if (!page)                                                        \
+                continue;                                                     \
+            for (int j = 0; j < AVT_SPARSE_PAGE_SIZE; j++) {                  \
+                if (page[j] && uninit)                                        \
+                    uninit(page[j]);                                          \
+                free(page[j]);                                                \
+            }                                                                 \
+            free(page);                                                       \
+            dctx->table[i] = NULL;                                            \
+        }                                                                     \
+    }
+
 #endif /* AVTRANSPORT_MEM_H */
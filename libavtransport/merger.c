@@ -135,9 +135,9 @@ static inline int fill_phantom_header(void *log_ctx, AVTMerger *m,
     int hdr_part = p->pkt.seq % 7;
 
     if (!is_parity)
-        memcpy(&m->p.hdr[4*hdr_part], p->pkt.generic_segment.header_7, 4);
+        memcpy(&m->hdr[4*hdr_part], p->pkt.generic_segment.header_7, 4);
     else
-        memcpy(&m->p.hdr[4*hdr_part], p->pkt.generic_parity.header_7, 4);
+        memcpy(&m->hdr[4*hdr_part], p->pkt.generic_parity.header_7, 4);
 
     m->hdr_mask |= 1 << (6 - hdr_part);
 
@@ -145,13 +145,13 @@ static inline int fill_phantom_header(void *log_ctx, AVTMerger *m,
     if (!(m->hdr_mask == 0x7F))
         return 0;
 
-    uint16_t tgt_desc = AVT_RB16(&m->p.hdr[0]);
+    uint16_t tgt_desc = AVT_RB16(&m->hdr[0]);
 
     if ((tgt_desc == (AVT_PKT_TIME_SYNC & 0xFF00)) ||
         (tgt_desc == (AVT_PKT_STREAM_DATA & 0xFF00)))
         tgt_desc &= 0xFF00;
 
-    AVTBytestream bs = avt_bs_init(m->p.hdr, sizeof(m->p.hdr));
+    AVTBytestream bs = avt_bs_init(m->hdr, sizeof(m->hdr));
 
     // TODO more sanity checking
 
@@ -208,7 +208,7 @@ static int validate_packet(void *log_ctx, AVTMerger *m, AVTPktd *p, int series,
     /* Check for phantom header mismatch */;
     const uint32_t hdr_part = p->pkt.seq % 7;
     if (m->hdr_mask & (1 << (6 - hdr_part))) {
-        const uint8_t *hdr_part_data = &m->p.hdr[4*hdr_part];
+        const uint8_t *hdr_part_data = &m->hdr[4*hdr_part];
         for (auto i = 0; i < 4; i++)
             if (hdr_part_data[i] != p->pkt.generic_segment.header_7[i])
                 return AVT_ERROR(EINVAL);
@@ -267,7 +267,7 @@ int avt_pkt_merge_seg(void *log_ctx, AVTMerger *m, AVTPktd *p)
              * as 7 is guaranteed to be a mismatch */
             for (int i = 1; i < 7; i++) {
                 if (((m->hdr_mask >> i) & 1) &&
-                    memcmp(&m->p.hdr[4*i], p->hdr, 4))
+                    (!p->hdr.data || memcmp(&m->hdr[4*i], p->hdr.data, 4)))
                     hdr_match++;
             }
 
@@ -284,6 +284,8 @@ int avt_pkt_merge_seg(void *log_ctx, AVTMerger *m, AVTPktd *p)
         {
             /* Direct output - just copy the input */
             memcpy(&m->p, p, sizeof(*p));
+            m->p.hdr = (AVTBuffer){ };
+            avt_buffer_quick_ref(&m->p.hdr, &p->hdr, 0, p->hdr_len);
             m->hdr_mask = 0x7F;
             m->active = 1;
             m->p_avail = 1;
@@ -324,19 +326,24 @@ int avt_pkt_merge_seg(void *log_ctx, AVTMerger *m, AVTPktd *p)
         if (series > 0) {
             /* Starting with a segment, not the actual start */
             m->p = *p;
+            m->p.hdr = (AVTBuffer){ };
+            if (p->hdr.data) {
+                memcpy(m->hdr, p->hdr.data, p->hdr_len);
+                avt_buffer_quick_ref(&m->p.hdr, &p->hdr, 0, p->hdr_len);
+            }
             m->p_avail = true;
             m->hdr_mask = 0x7F;
             m->target = p->pkt.seq;
         } else if (!is_parity) {
             /* Starting with a segment */
             const uint32_t hdr_part = p->pkt.seq % 7;
-            memcpy(&m->p.hdr[4*hdr_part], p->pkt.generic_segment.header_7, 4);
+            memcpy(&m->hdr[4*hdr_part], p->pkt.generic_segment.header_7, 4);
             m->hdr_mask = 1 << (6 - hdr_part);
             m->target = p->pkt.generic_segment.target_seq;
         } else {
             /* Starting with a parity segment */
             const uint32_t hdr_part = p->pkt.seq % 7;
-            memcpy(&m->p.hdr[4*hdr_part], p->pkt.generic_parity.header_7, 4);
+            memcpy(&m->hdr[4*hdr_part], p->pkt.generic_parity.header_7, 4);
             m->hdr_mask |= 1 << (6 - hdr_part);
             m->target = p->pkt.generic_parity.target_seq;
         }
@@ -422,7 +429,11 @@ int avt_pkt_merge_seg(void *log_ctx, AVTMerger *m, AVTPktd *p)
     } else if (series == 1) {
         /* We got a real header packet which we didn't have */
         m->p.pkt = p->pkt;
-        memcpy(m->p.hdr, p->hdr, sizeof(p->hdr));
+        if (p->hdr.data) {
+            memcpy(m->hdr, p->hdr.data, p->hdr_len);
+            avt_buffer_quick_ref(&m->p.hdr, &p->hdr, 0, p->hdr_len);
+            m->p.hdr_len = p->hdr_len;
+        }
         m->hdr_mask = 0x7F;
         m->p_avail = true;
     }
@@ -498,7 +509,7 @@ int avt_pkt_merge_out(void *log_ctx, AVTMerger *m, AVTPktd *p, int force)
 
 void avt_pkt_merge_done(AVTMerger *m)
 {
-    avt_buffer_quick_unref(&m->p.pl);
+    avt_pktd_unref(&m->p);
     m->active = false;
 }
 
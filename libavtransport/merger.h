@@ -44,6 +44,7 @@ typedef struct AVTMerger {
     /* Phantom header recovery */
     bool p_avail; /* If the header is available */
     uint8_t hdr_mask; /* 1 bit per 32-bits, 7th bit first, 0th bit last */
+    uint8_t hdr[AVT_MAX_HEADER_LEN]; /* Header, as recovered so far */
 
     /* Packet data */
     AVTPktd p;
@@ -65,6 +66,7 @@ typedef struct AVTMerger {
 } AVTMerger;
 
 /* Basic merger function.
+ * The payload of the packet is consumed, while its header gets ref'd.
  * Returns the payload size once an output is possible.
  * Returns AVT_ERROR(EAGAIN) if more segments are needed.
  * Returns AVT_ERROR(EBUSY) if a packet belonging to a different target is
@@ -35,15 +35,28 @@
 
 #include "config.h"
 
+FN_SPARSE_TABLE(avt_send, AVTSender, AVTStream,
+                stream, streams)
+
+static void free_stream(AVTStream *st)
+{
+    free(st->priv);
+}
+
 int avt_send_close(AVTSender **_s)
 {
     AVTSender *s = *_s;
 
+    avt_send_free_streams(s, free_stream);
+    free(s->active_stream_idx);
+    free(s->conn);
+
 #ifdef CONFIG_HAVE_LIBZSTD
     ZSTD_freeCCtx(s->zstd_ctx);
 #endif
 
     XXH3_freeState(s->xxh_state);
+    avt_buffer_pool_free(&s->pool);
 
     free(s);
 
@@ -78,6 +91,11 @@ static inline int alloc_output_context(AVTSender **_s, AVTSenderOptions *opts)
     }
     s->nb_conn_alloc = 1;
 
+    if (avt_buffer_pool_init(&s->pool, 0) < 0) {
+        avt_send_close(&s);
+        return AVT_ERROR(ENOMEM);
+    }
+
     /* Init xxHash state */
     s->xxh_state = XXH3_createState();
     if (!s->xxh_state) {
@@ -141,7 +159,10 @@ AVTStream *avt_send_stream_add(AVTSender *out, uint16_t id)
         return NULL;
     }
 
-    AVTStream *st = &out->streams[id];
+    AVTStream *st = avt_send_alloc_stream(out, id);
+    if (!st)
+        return NULL;
+
     if (st->priv && st->priv->active) {
         avt_log(out, AVT_LOG_ERROR, "Stream 0x%X is already active!\n", id);
         return NULL;
@@ -154,6 +175,17 @@ AVTStream *avt_send_stream_add(AVTSender *out, uint16_t id)
             return NULL;
     }
 
+    if (out->nb_alloc_streams < (out->nb_streams + 1)) {
+        uint16_t *tmp = avt_reallocarray(out->active_stream_idx,
+                                         (out->nb_streams + 1) << 1,
+                                         sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+
+        out->active_stream_idx = tmp;
+        out->nb_alloc_streams = (out->nb_streams + 1) << 1;
+    }
+
     st->priv->active = true;
     st->priv->out = out;
     out->active_stream_idx[out->nb_streams++] = id;
@@ -31,6 +31,7 @@
 
 #include "common.h"
 #include "connection_internal.h"
+#include "mem.h"
 
 #include "config.h"
 
@@ -53,12 +54,17 @@ typedef struct AVTSender {
     uint32_t nb_conn;
     uint32_t nb_conn_alloc;
 
-    AVTStream streams[UINT16_MAX];
-    uint16_t active_stream_idx[UINT16_MAX];
+    /* Allocated on first use */
+    AVTStream **streams[AVT_SPARSE_NB_PAGES];
+    uint16_t *active_stream_idx;
     int nb_streams;
+    int nb_alloc_streams;
 
     uint64_t epoch;
 
+    /* Compressed payloads */
+    AVTBufferPool *pool;
+
     XXH3_state_t *xxh_state;
 #ifdef CONFIG_HAVE_LIBZSTD
     ZSTD_CCtx *zstd_ctx;
@@ -129,7 +129,6 @@ static int payload_process(AVTSender *s, AVTStream *st,
                            AVTPktd *p, AVTBuffer *pl)
 {
     int err = 0;
-    AVTBuffer *zbuf = NULL;
 
     size_t src_len;
     uint8_t *src = avt_buffer_get_data(pl, &src_len);
@@ -174,8 +173,7 @@ static int payload_process(AVTSender *s, AVTStream *st,
     case AVT_DATA_COMPRESSION_ZSTD:
         dst_size = ZSTD_compressBound(src_len);
 
-        /* TODO: use a buffer pool */
-        dst = malloc(dst_size);
+        dst = avt_buffer_pool_quick_alloc(s->pool, &p->pl, dst_size);
         if (!dst)
             return AVT_ERROR(ENOMEM);
 
@@ -183,54 +181,30 @@ static int payload_process(AVTSender *s, AVTStream *st,
         if (!dst_len) {
             avt_log(s, AVT_LOG_ERROR, "Error while compressing with ZSTD!\n");
             err = AVT_ERROR(EINVAL);
-            free(dst);
+            avt_buffer_quick_unref(&p->pl);
             break;
         }
 
-        zbuf = avt_buffer_create(dst, dst_len, NULL, avt_buffer_default_free);
-        if (!zbuf) {
-            free(dst);
-            err = AVT_ERROR(ENOMEM);
-            break;
-        }
-
-        avt_buffer_quick_ref(&p->pl, zbuf, 0, AVT_BUFFER_REF_ALL);
-
-        // TODO: removeme when there's pooling
-        avt_buffer_unref(&zbuf);
+        avt_buffer_resize(&p->pl, dst_len);
         break;
 #endif
 #ifdef CONFIG_HAVE_LIBBROTLIENC
     case AVT_DATA_COMPRESSION_BROTLI:
         dst_size = BrotliEncoderMaxCompressedSize(src_len);
 
-        /* TODO: use a buffer pool */
-        dst = malloc(dst_size);
+        dst = avt_buffer_pool_quick_alloc(s->pool, &p->pl, dst_size);
         if (!dst)
             return AVT_ERROR(ENOMEM);
 
-        /* Brotli has a braindead advanced API that
-         * makes it really hard to use pooling. Since Brotli is mostly
-         * used by text, meh, good enough for now. */
         if (!BrotliEncoderCompress(lvl, BROTLI_DEFAULT_WINDOW, BROTLI_DEFAULT_MODE,
                                    src_len, src, &dst_size, dst)) {
             avt_log(s, AVT_LOG_ERROR, "Error while compressing with Brotli!\n");
             err = AVT_ERROR(EINVAL);
-            free(dst);
+            avt_buffer_quick_unref(&p->pl);
             break;
         }
 
-        zbuf = avt_buffer_create(dst, dst_size, NULL, avt_buffer_default_free);
-        if (!zbuf) {
-            free(dst);
-            err = AVT_ERROR(ENOMEM);
-            break;
-        }
-
-        avt_buffer_quick_ref(&p->pl, zbuf, 0, AVT_BUFFER_REF_ALL);
-
-        // TODO: removeme when there's pooling
-        avt_buffer_unref(&zbuf);
+        avt_buffer_resize(&p->pl, dst_size);
         break;
 #endif
     default:
@@ -30,17 +30,28 @@
 #include <avtransport/packet_data.h>
 #include "buffer.h"
 
-#define AVT_MAX_HEADER_BUF ((1024 - AVT_MAX_HEADER_LEN) + AVT_MAX_HEADER_LEN)
-
-/* Internal packet representation */
+/* Internal packet representation.
+ * The encoded header is kept out of line, usually in a header slab,
+ * and is ref'd and unref'd along with the payload. */
 typedef struct AVTPktd {
-    uint8_t hdr[AVT_MAX_HEADER_BUF];
     union AVTPacketData pkt;
     AVTBuffer pl;
+    AVTBuffer hdr;
     uint8_t pl_hash[16];
     uint16_t hdr_len;
     uint16_t hdr_off;
     bool pl_has_hash;
+
+    /* Time at which the packet should go out, in nanoseconds, on the
+     * scheduler's timeline. Only the difference between packets matters. */
+    int64_t tx_time;
 } AVTPktd;
 
+/* Unref the header and payload of a packet */
+static inline void avt_pktd_unref(AVTPktd *p)
+{
+    avt_buffer_quick_unref(&p->hdr);
+    avt_buffer_quick_unref(&p->pl);
+}
+
 #endif /* AVTRANSPORT_PACKET_COMMON_H */
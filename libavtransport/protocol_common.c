@@ -92,3 +92,75 @@ int avt_index_list_parse(AVTIndexContext *ic, AVTBytestream *bs,
 
     return 0;
 }
+
+int64_t avt_packet_decode_header(void *log_ctx, AVTBytestream *bs,
+                                 uint16_t desc, union AVTPacketData *pkt)
+{
+    switch (desc) {
+    case AVT_PKT_SESSION_START:
+        avt_decode_session_start(bs, &pkt->session_start);
+        return 0;
+    case AVT_PKT_TIME_SYNC & ~(AVT_PKT_FLAG_LSB_BITMASK):
+        avt_decode_time_sync(bs, &pkt->time_sync);
+        return 0;
+    case AVT_PKT_VIDEO_INFO:
+        avt_decode_video_info(bs, &pkt->video_info);
+        return 0;
+    case AVT_PKT_VIDEO_ORIENTATION:
+        avt_decode_video_orientation(bs, &pkt->video_orientation);
+        return 0;
+    case AVT_PKT_STREAM_REGISTRATION:
+        avt_decode_stream_registration(bs, &pkt->stream_registration);
+        return 0;
+    case AVT_PKT_STEREO_VIDEO:
+        avt_decode_stereo_video(bs, &pkt->stereo_video);
+        return 0;
+    case AVT_PKT_STREAM_END:
+        avt_decode_stream_end(bs, &pkt->stream_end);
+        return 0;
+    case AVT_PKT_STREAM_INDEX:
+        avt_decode_stream_index(bs, &pkt->stream_index);
+        return pkt->stream_index.nb_indices * AVT_PKT_INDEX_ENTRY_SIZE;
+    case AVT_PKT_STREAM_DATA & ~(AVT_PKT_FLAG_LSB_BITMASK):
+        avt_decode_stream_data(bs, &pkt->stream_data);
+        return pkt->stream_data.data_length;
+    case AVT_PKT_FEC_GROUPING:
+        avt_decode_fec_grouping(bs, &pkt->fec_grouping);
+        return 0;
+    case AVT_PKT_FEC_GROUP_DATA:
+        avt_decode_fec_group_data(bs, &pkt->fec_group_data);
+        return pkt->fec_group_data.fec_data_length;
+    case AVT_PKT_LUT_ICC:
+        avt_decode_lut_icc(bs, &pkt->lut_icc);
+        return pkt->lut_icc.lut_pl_length;
+    case AVT_PKT_FONT_DATA:
+        avt_decode_font_data(bs, &pkt->font_data);
+        return pkt->font_data.font_pl_length;
+    case AVT_PKT_USER_DATA:
+        avt_decode_user_data(bs, &pkt->user_data);
+        return pkt->user_data.userdata_pl_length;
+    case AVT_PKT_STREAM_CONFIG: [[fallthrough]];
+    case AVT_PKT_METADATA:
+        avt_decode_generic_data(bs, &pkt->generic_data);
+        return pkt->generic_data.payload_length;
+    case AVT_PKT_LUT_ICC_SEGMENT:       [[fallthrough]];
+    case AVT_PKT_FONT_DATA_SEGMENT:     [[fallthrough]];
+    case AVT_PKT_METADATA_SEGMENT:      [[fallthrough]];
+    case AVT_PKT_USER_DATA_SEGMENT:     [[fallthrough]];
+    case AVT_PKT_STREAM_DATA_SEGMENT:   [[fallthrough]];
+    case AVT_PKT_STREAM_CONFIG_SEGMENT:
+        avt_decode_generic_segment(bs, &pkt->generic_segment);
+        return pkt->generic_segment.seg_length;
+    case AVT_PKT_LUT_ICC_PARITY:       [[fallthrough]];
+    case AVT_PKT_FONT_DATA_PARITY:     [[fallthrough]];
+    case AVT_PKT_METADATA_PARITY:      [[fallthrough]];
+    case AVT_PKT_USER_DATA_PARITY:     [[fallthrough]];
+    case AVT_PKT_STREAM_DATA_PARITY:   [[fallthrough]];
+    case AVT_PKT_STREAM_CONFIG_PARITY:
+        avt_decode_generic_parity(bs, &pkt->generic_parity);
+        return pkt->generic_parity.parity_data_length;
+    default:
+        avt_log(log_ctx, AVT_LOG_ERROR, "Unknown descriptor 0x%x received\n", desc);
+        return AVT_ERROR(ENOTSUP);
+    };
+}
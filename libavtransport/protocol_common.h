@@ -93,6 +93,12 @@ typedef struct AVTIndexContext {
     uint64_t nb_index_max;
 } AVTIndexContext;
 
+/* Decode a packet header. Any bitmask bits in desc must be zeroed out.
+ * Returns the number of payload bytes which follow the header, otherwise
+ * negative error. For index packets, this is the size of all entries. */
+int64_t avt_packet_decode_header(void *log_ctx, AVTBytestream *bs,
+                                 uint16_t desc, union AVTPacketData *pkt);
+
 int avt_index_list_config(AVTIndexContext *ic, uint64_t nb_index_max);
 int avt_index_list_parse(AVTIndexContext *ic, AVTBytestream *bs,
                          AVTStreamIndex *pkt);
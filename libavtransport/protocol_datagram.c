@@ -31,16 +31,25 @@
 #include <avtransport/avtransport.h>
 #include "protocol_common.h"
 #include "io_common.h"
+#include "ldpc_decode.h"
+
+/* Maximum number of datagrams read at once */
+#define DATAGRAM_MAX_RECV 64
 
 struct AVTProtocolCtx {
     const AVTIO *io;
     AVTIOCtx *io_ctx;
     AVTProtocolOpts opts;
+
+    AVTIndexContext ic;
+    AVTIODatagram dgram[DATAGRAM_MAX_RECV];
+    uint32_t nb_dropped;
 };
 
 static COLD int datagram_proto_close(AVTProtocolCtx **p)
 {
     AVTProtocolCtx *priv = *p;
+    free(priv->ic.index);
     free(priv);
     *p = NULL;
     return 0;
@@ -49,7 +58,7 @@ static COLD int datagram_proto_close(AVTProtocolCtx **p)
 static COLD int datagram_proto_init(AVTContext *ctx, AVTProtocolCtx **_p, AVTAddress *addr,
                                     const AVTIO *io, AVTIOCtx *io_ctx, AVTProtocolOpts *opts)
 {
-    AVTProtocolCtx *p = malloc(sizeof(*p));
+    AVTProtocolCtx *p = calloc(1, sizeof(*p));
     if (!p)
         return AVT_ERROR(ENOMEM);
 
@@ -88,17 +97,116 @@ static int datagram_proto_send_packet(AVTProtocolCtx *p, AVTPktd *pkt,
 static int datagram_proto_send_seq(AVTProtocolCtx *p, AVTPacketFifo *seq,
                                    int64_t timeout)
 {
-    int64_t ret = p->io->write_vec(p->io_ctx, seq->data, seq->nb, timeout);
-    if (ret < 0)
-        return ret;
+    AVTPktd *span;
+    for (unsigned int i = 0; i < seq->nb;) {
+        unsigned int nb = avt_pkt_fifo_span(seq, i, &span);
+        int64_t ret = p->io->write_vec(p->io_ctx, span, nb, timeout);
+        if (ret < 0)
+            return ret;
+        i += nb;
+    }
+    return 0;
+}
+
+/* Each datagram carries exactly one packet */
+static int datagram_parse(AVTProtocolCtx *s, AVTPacketFifo *fifo,
+                          AVTIODatagram *d)
+{
+    size_t len;
+    uint8_t *data = avt_buffer_get_data(&d->buf, &len);
+    if (len < AVT_MIN_HEADER_LEN)
+        return AVT_ERROR(EINVAL);
+
+    /* Check LDPC codes. Datagrams which cannot be corrected are dropped. */
+    if (avt_ldpc_decode_288_224(data, s->opts.ldpc_iterations) < 0)
+        return AVT_ERROR(EINVAL);
+
+    uint16_t desc = AVT_RB16(&data[0]);
+
+    /* For identification purposes, zero out any bitmask bits */
+    if (((desc & 0xFF00) == (AVT_PKT_TIME_SYNC & 0xFF00)) ||
+        ((desc & 0xFF00) == (AVT_PKT_STREAM_DATA & 0xFF00)))
+        desc &= 0xFF00;
+
+    const int hdr_len = avt_pkt_hdr_size(desc);
+    if (hdr_len < AVT_MIN_HEADER_LEN || len < hdr_len)
+        return AVT_ERROR(EINVAL);
+
+    int err = 0;
+    switch (hdr_len - AVT_MIN_HEADER_LEN) {
+    case 36: err = avt_ldpc_decode_288_224(data + AVT_MIN_HEADER_LEN,
+                                           s->opts.ldpc_iterations);
+        break;
+    case 348: err = avt_ldpc_decode_2784_2016(data + AVT_MIN_HEADER_LEN,
+                                              s->opts.ldpc_iterations);
+        break;
+    default:
+        break;
+    }
+    if (err < 0)
+        return err;
+
+    union AVTPacketData pkt;
+    AVTBytestream bs = avt_bs_init(data, hdr_len);
+    int64_t pl_bytes = avt_packet_decode_header(s, &bs, desc, &pkt);
+    if (pl_bytes < 0)
+        return pl_bytes;
+
+    /* If there's not enough data, we'll try to do what we can with what
+     * we get down the road */
+    pl_bytes = AVT_MIN(pl_bytes, len - hdr_len);
+
+    if (desc == AVT_PKT_STREAM_INDEX) {
+        bs = avt_bs_init(data + hdr_len, pl_bytes);
+        pkt.stream_index.nb_indices = pl_bytes / AVT_PKT_INDEX_ENTRY_SIZE;
+        return avt_index_list_parse(&s->ic, &bs, &pkt.stream_index);
+    }
+
+    /* Header and payload both reference the datagram */
+    AVTPktd *p = avt_pkt_fifo_push_new(fifo, pl_bytes ? &d->buf : NULL,
+                                       hdr_len, pl_bytes);
+    if (!p)
+        return AVT_ERROR(ENOMEM);
+
+    p->pkt = pkt;
+    p->hdr_len = hdr_len;
+    avt_buffer_quick_ref(&p->hdr, &d->buf, 0, hdr_len);
+
     return 0;
 }
 
 static int datagram_proto_receive(AVTProtocolCtx *s, AVTPacketFifo *fifo,
                                   int64_t timeout)
 {
+    if (!s->io->read_vec)
+        return AVT_ERROR(ENOTSUP);
 
-    return 0;
+    int nb = s->io->read_vec(s->io_ctx, s->dgram, DATAGRAM_MAX_RECV, timeout);
+    if (nb < 0)
+        return nb;
+
+    int err = 0;
+    for (int i = 0; i < nb; i++) {
+        AVTIODatagram *d = &s->dgram[i];
+
+        if (d->nb_dropped != s->nb_dropped) {
+            avt_log(s, AVT_LOG_WARN, "%u datagrams dropped by the system\n",
+                    d->nb_dropped - s->nb_dropped);
+            s->nb_dropped = d->nb_dropped;
+        }
+
+        /* A corrupt datagram does not affect any others */
+        int ret = err < 0 ? 0 : datagram_parse(s, fifo, d);
+        if (ret == AVT_ERROR(ENOMEM))
+            err = ret;
+        else if (ret < 0)
+            avt_log(s, AVT_LOG_DEBUG, "Invalid datagram received, %zu bytes\n",
+                    d->buf.len);
+
+        avt_buffer_quick_unref(&d->buf);
+    }
+
+    return err;
 }
 
 static int datagram_proto_max_pkt_len(AVTProtocolCtx *p, size_t *mtu)
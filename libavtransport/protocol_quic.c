@@ -279,7 +279,15 @@ static int quic_proto_send_packet(AVTProtocolCtx *p, AVTPktd *pkt,
 static int quic_proto_send_seq(AVTProtocolCtx *p, AVTPacketFifo *seq,
                                int64_t timeout)
 {
-    return p->io->write_vec(p->io_ctx, seq->data, seq->nb, timeout);
+    AVTPktd *span;
+    for (unsigned int i = 0; i < seq->nb;) {
+        unsigned int nb = avt_pkt_fifo_span(seq, i, &span);
+        int64_t ret = p->io->write_vec(p->io_ctx, span, nb, timeout);
+        if (ret < 0)
+            return ret;
+        i += nb;
+    }
+    return 0;
 }
 
 static int quic_proto_receive(AVTProtocolCtx *p, AVTPacketFifo *fifo,
@@ -26,26 +26,44 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <avtransport/avtransport.h>
-#include "packet_decode.h"
 #include "protocol_common.h"
 #include "io_common.h"
 #include "bytestream.h"
 #include "ldpc_decode.h"
 
+/* Minimum size of each read from the IO */
+#define STREAM_READAHEAD (1024*1024)
+
 struct AVTProtocolCtx {
     const AVTIO *io;
     AVTIOCtx *io_ctx;
     AVTProtocolOpts opts;
 
     AVTIndexContext ic;
+    AVTHeaderSlab hdr_slab;
+    AVTBufferPool *pool;
+
+    /* Read-ahead buffer. Headers are parsed in place,
+     * and payloads are references to it. */
+    AVTBuffer rbuf;
+    size_t rpos;  /* Bytes consumed */
+    size_t rlen;  /* Bytes read */
+    avt_pos roff; /* Input offset of the buffer */
+
+    /* The IO gives out references to its own memory, e.g. a file mapping */
+    bool zerocopy;
 };
 
 static COLD int stream_proto_close(AVTProtocolCtx **_p)
 {
     AVTProtocolCtx *p = *_p;
+    avt_buffer_quick_unref(&p->rbuf);
+    avt_hdr_slab_free(&p->hdr_slab);
+    avt_buffer_pool_free(&p->pool);
     free(p);
     *_p = NULL;
     return 0;
@@ -54,10 +72,16 @@ static COLD int stream_proto_close(AVTProtocolCtx **_p)
 static COLD int stream_init(AVTContext *ctx, AVTProtocolCtx **_p, AVTAddress *addr,
                             const AVTIO *io, AVTIOCtx *io_ctx, AVTProtocolOpts *opts)
 {
-    AVTProtocolCtx *p = malloc(sizeof(*p));
+    AVTProtocolCtx *p = calloc(1, sizeof(*p));
     if (!p)
         return AVT_ERROR(ENOMEM);
 
+    int err = avt_buffer_pool_init(&p->pool, 0);
+    if (err < 0) {
+        free(p);
+        return err;
+    }
+
     p->io = io;
     p->io_ctx = io_ctx;
     p->opts = *opts;
@@ -93,180 +117,235 @@ static int stream_proto_send_packet(AVTProtocolCtx *p, AVTPktd *pkt,
 static int stream_send_seq(AVTProtocolCtx *p,
                            AVTPacketFifo *seq, int64_t timeout)
 {
-    int ret = p->io->write_vec(p->io_ctx, seq->data, seq->nb, timeout);
-    if (ret < 0)
-        return ret;
+    AVTPktd *span;
+    for (unsigned int i = 0; i < seq->nb;) {
+        unsigned int nb = avt_pkt_fifo_span(seq, i, &span);
+        int64_t ret = p->io->write_vec(p->io_ctx, span, nb, timeout);
+        if (ret < 0)
+            return ret;
+        i += nb;
+    }
     return 0;
 }
 
+/* Makes at least len unconsumed bytes available in the read-ahead buffer.
+ * Returns the number of bytes available, which may be lower at the end
+ * of the input, or if the timeout expires. */
+static int64_t stream_fill(AVTProtocolCtx *s, size_t len, int64_t timeout)
+{
+    int64_t err;
+    size_t avail = s->rlen - s->rpos;
+    if (avail >= len)
+        return avail;
+
+    if (s->zerocopy || !avail) {
+        AVTBuffer tmp = { };
+        AVTBufferCtrl *ctrl = NULL;
+        size_t size = AVT_MAX(len, STREAM_READAHEAD);
+
+        if (s->zerocopy) {
+            /* Rather than copying, get a new reference to the IO's memory,
+             * starting at the first unconsumed byte */
+            if (avail) {
+                err = s->io->seek(s->io_ctx, s->roff + s->rpos);
+                if (err < 0)
+                    return err;
+            }
+        } else {
+            /* Nothing is left over, so the IO may replace the buffer */
+            if (!avt_buffer_pool_quick_alloc(s->pool, &tmp, size))
+                return AVT_ERROR(ENOMEM);
+            ctrl = tmp.ctrl;
+        }
+
+        err = s->io->read_input(s->io_ctx, &tmp, size, timeout, 0x0);
+        if (err < 0) {
+            avt_buffer_quick_unref(&tmp);
+            return err;
+        }
+
+        avt_buffer_quick_unref(&s->rbuf);
+        s->rbuf = tmp;
+        s->roff = err;
+        s->rpos = 0;
+        s->rlen = avail = avt_buffer_get_data_len(&tmp);
+        s->zerocopy = tmp.ctrl != ctrl;
+        if (s->zerocopy || avail >= len)
+            return avail;
+    }
+
+    /* Not enough space left, move the remainder into a new buffer.
+     * The old one stays alive for as long as payloads reference it. */
+    if ((s->rpos + len) > (s->rbuf.end_data - s->rbuf.data)) {
+        AVTBuffer tmp = { };
+        if (!avt_buffer_pool_quick_alloc(s->pool, &tmp,
+                                         AVT_MAX(len, STREAM_READAHEAD)))
+            return AVT_ERROR(ENOMEM);
+
+        memcpy(tmp.data, s->rbuf.data + s->rpos, avail);
+
+        avt_buffer_quick_unref(&s->rbuf);
+        s->rbuf = tmp;
+        s->roff += s->rpos;
+        s->rpos = 0;
+        s->rlen = avail;
+    }
+
+    while (avail < len) {
+        /* Read as much as fits, directly after the data we have.
+         * The view is not a reference of its own. */
+        AVTBuffer view = s->rbuf;
+        view.data += s->rlen;
+        view.len = view.end_data - view.data;
+
+        err = s->io->read_input(s->io_ctx, &view, view.len,
+                                timeout, AVT_IO_READ_MUTABLE);
+        if (err < 0)
+            return err;
+        else if (!view.len)
+            break;
+
+        s->rlen += view.len;
+        avail += view.len;
+    }
+
+    return avail;
+}
+
 static int stream_receive(AVTProtocolCtx *s, AVTPacketFifo *fifo,
                           int64_t timeout)
 {
-    int64_t err = 0;
-    AVTPktd *p = avt_pkt_fifo_push_new(fifo, NULL, 0, AVT_BUFFER_REF_ALL);
-    if (!p)
-        return AVT_ERROR(ENOMEM);
-
-    AVTBuffer buf = {
-        .base_data = p->hdr,
-        .data = p->hdr,
-        .end_data = &p->hdr[sizeof(p->hdr)],
-        .len = sizeof(p->hdr),
-    };
+    int64_t err;
+    AVTBuffer hbuf = { };
 
     /* Get the minimum header size */
-    err = s->io->read_input(s->io_ctx, &buf, AVT_MIN_HEADER_LEN,
-                            timeout, AVT_IO_READ_MUTABLE);
+    err = stream_fill(s, AVT_MIN_HEADER_LEN, timeout);
     if (err < 0)
         return err;
+    else if (err < AVT_MIN_HEADER_LEN)
+        return AVT_ERROR(EAGAIN);
+
+    /* Headers in read-only memory, such as a file mapping,
+     * are corrected and parsed in a copy */
+    bool copy_hdr = avt_buffer_read_only(&s->rbuf);
+    uint8_t *hdr = s->rbuf.data + s->rpos;
+    if (copy_hdr) {
+        err = avt_hdr_slab_get(&s->hdr_slab, &hbuf);
+        if (err < 0)
+            return err;
+        memcpy(hbuf.data, hdr, AVT_MIN_HEADER_LEN);
+        hdr = hbuf.data;
+    }
 
-    /* Check LDPC codes */
-    avt_ldpc_decode_288_224(buf.data, s->opts.ldpc_iterations);
+    /* Check LDPC codes. With the header beyond repair, the length of
+     * the packet is unknown, so only the header can be skipped. */
+    if (avt_ldpc_decode_288_224(hdr, s->opts.ldpc_iterations) < 0) {
+        avt_log(s, AVT_LOG_WARN, "Uncorrectable packet header, skipping\n");
+        s->rpos += AVT_MIN_HEADER_LEN;
+        err = AVT_ERROR(EINVAL);
+        goto fail;
+    }
 
-    uint16_t desc = AVT_RB16(&buf.data[0]);
+    uint16_t desc = AVT_RB16(&hdr[0]);
 
     /* For identification purposes, zero out any bitmask bits */
-    if ((desc == (AVT_PKT_TIME_SYNC & 0xFF00)) ||
-        (desc == (AVT_PKT_STREAM_DATA & 0xFF00)))
+    if (((desc & 0xFF00) == (AVT_PKT_TIME_SYNC & 0xFF00)) ||
+        ((desc & 0xFF00) == (AVT_PKT_STREAM_DATA & 0xFF00)))
         desc &= 0xFF00;
 
     /* Get the rest of the header */
-    const int left_size = avt_pkt_hdr_size(desc) - AVT_MIN_HEADER_LEN;
-    if (left_size > 0) {
-        buf.data += AVT_MIN_HEADER_LEN;
-        buf.len -= AVT_MIN_HEADER_LEN;
-
-        err = s->io->read_input(s->io_ctx, &buf, left_size,
-                                timeout, AVT_IO_READ_MUTABLE);
+    size_t hdr_len = AVT_MAX(avt_pkt_hdr_size(desc), AVT_MIN_HEADER_LEN);
+    if (hdr_len > AVT_MIN_HEADER_LEN) {
+        err = stream_fill(s, hdr_len, timeout);
         if (err < 0)
-            return err;
+            goto fail;
+        else if (err < hdr_len) {
+            err = AVT_ERROR(EAGAIN);
+            goto fail;
+        }
+
+        hdr = s->rbuf.data + s->rpos;
+        if (copy_hdr) {
+            memcpy(hbuf.data + AVT_MIN_HEADER_LEN, hdr + AVT_MIN_HEADER_LEN,
+                   hdr_len - AVT_MIN_HEADER_LEN);
+            hdr = hbuf.data;
+        }
 
         /* Check LDPC codes */
-        switch (left_size) {
-        case 36: avt_ldpc_decode_288_224(buf.data, s->opts.ldpc_iterations);
+        switch (hdr_len - AVT_MIN_HEADER_LEN) {
+        case 36: err = avt_ldpc_decode_288_224(hdr + AVT_MIN_HEADER_LEN,
+                                               s->opts.ldpc_iterations);
             break;
-        case 384: avt_ldpc_decode_2784_2016(buf.data, s->opts.ldpc_iterations);
+        case 348: err = avt_ldpc_decode_2784_2016(hdr + AVT_MIN_HEADER_LEN,
+                                                  s->opts.ldpc_iterations);
             break;
         default:
+            err = 0;
             break;
         }
-
-        buf.data += AVT_MIN_HEADER_LEN;
-        buf.len -= AVT_MIN_HEADER_LEN;
+        if (err < 0) {
+            avt_log(s, AVT_LOG_WARN, "Uncorrectable packet header, skipping\n");
+            s->rpos += hdr_len;
+            err = AVT_ERROR(EINVAL);
+            goto fail;
+        }
     }
 
-    p->hdr_len = buf.data - buf.base_data;
-
-    size_t pl_bytes = 0;
-    AVTBytestream bs = avt_bs_init(p->hdr, sizeof(p->hdr));
-
-    switch (desc) {
-    case AVT_PKT_SESSION_START:
-        avt_decode_session_start(&bs, &p->pkt.session_start);
-        return 0;
-    case AVT_PKT_TIME_SYNC & ~(AVT_PKT_FLAG_LSB_BITMASK):
-        avt_decode_time_sync(&bs, &p->pkt.time_sync);
-        return 0;
-    case AVT_PKT_VIDEO_INFO:
-        avt_decode_video_info(&bs, &p->pkt.video_info);
-        return 0;
-    case AVT_PKT_VIDEO_ORIENTATION:
-        avt_decode_video_orientation(&bs, &p->pkt.video_orientation);
-        return 0;
-    case AVT_PKT_STREAM_REGISTRATION:
-        avt_decode_stream_registration(&bs, &p->pkt.stream_registration);
-        return 0;
-    case AVT_PKT_STEREO_VIDEO:
-        avt_decode_stereo_video(&bs, &p->pkt.stereo_video);
-        return 0;
-    case AVT_PKT_STREAM_END:
-        avt_decode_stream_end(&bs, &p->pkt.stream_end);
-        return 0;
-    case AVT_PKT_STREAM_INDEX:
-        avt_decode_stream_index(&bs, &p->pkt.stream_index);
-        pl_bytes = p->pkt.stream_index.nb_indices * AVT_PKT_INDEX_ENTRY_SIZE;
-
-        // TODO: store buffer in state
-        AVTBuffer *tmp = avt_buffer_alloc(pl_bytes);
-        if (!tmp)
-            return AVT_ERROR(ENOMEM);
+    union AVTPacketData pkt;
+    AVTBytestream bs = avt_bs_init(hdr, hdr_len);
+    int64_t pl_bytes = avt_packet_decode_header(s, &bs, desc, &pkt);
+    if (pl_bytes < 0) {
+        err = pl_bytes;
+        goto fail;
+    }
 
-        /* Read index entries */
-        err = s->io->read_input(s->io_ctx, tmp, pl_bytes,
-                                timeout, 0x0);
+    /* Wait until the entire packet has been read */
+    if (pl_bytes) {
+        err = stream_fill(s, hdr_len + pl_bytes, timeout);
         if (err < 0)
-            return err;
+            goto fail;
+        else if (err < (hdr_len + pl_bytes)) {
+            err = AVT_ERROR(EAGAIN);
+            goto fail;
+        }
+    }
 
-        size_t index_size;
-        uint8_t *index_data = avt_buffer_get_data(tmp, &index_size);
+    size_t pkt_pos = s->rpos;
+    s->rpos += hdr_len + pl_bytes;
 
-        bs = avt_bs_init(index_data, index_size);
+    if (desc == AVT_PKT_STREAM_INDEX) {
+        avt_buffer_quick_unref(&hbuf);
 
-        /* Parse */
-        err = avt_index_list_parse(&s->ic, &bs, &p->pkt.stream_index);
-        avt_buffer_unref(&tmp);
+        /* Parse index entries in place */
+        bs = avt_bs_init(s->rbuf.data + pkt_pos + hdr_len, pl_bytes);
+        err = avt_index_list_parse(&s->ic, &bs, &pkt.stream_index);
         if (err < 0)
             return err;
 
         /* Bypass reordering */
         return AVT_ERROR(EAGAIN);
-    case AVT_PKT_STREAM_DATA & ~(AVT_PKT_FLAG_LSB_BITMASK):
-        avt_decode_stream_data(&bs, &p->pkt.stream_data);
-        pl_bytes = p->pkt.stream_data.data_length;
-        break;
-    case AVT_PKT_FEC_GROUPING:
-        avt_decode_fec_grouping(&bs, &p->pkt.fec_grouping);
-        break;
-    case AVT_PKT_FEC_GROUP_DATA:
-        avt_decode_fec_group_data(&bs, &p->pkt.fec_group_data);
-        pl_bytes = p->pkt.fec_group_data.fec_data_length;
-        break;
-    case AVT_PKT_LUT_ICC:
-        avt_decode_lut_icc(&bs, &p->pkt.lut_icc);
-    case AVT_PKT_FONT_DATA:
-        avt_decode_font_data(&bs, &p->pkt.font_data);
-    case AVT_PKT_USER_DATA:
-        avt_decode_user_data(&bs, &p->pkt.user_data);
-    case AVT_PKT_STREAM_CONFIG: [[fallthrough]];
-    case AVT_PKT_METADATA:
-        avt_decode_generic_data(&bs, &p->pkt.generic_data);
-        pl_bytes = p->pkt.generic_data.payload_length;
-        break;
-    case AVT_PKT_LUT_ICC_SEGMENT:       [[fallthrough]];
-    case AVT_PKT_FONT_DATA_SEGMENT:     [[fallthrough]];
-    case AVT_PKT_METADATA_SEGMENT:      [[fallthrough]];
-    case AVT_PKT_USER_DATA_SEGMENT:     [[fallthrough]];
-    case AVT_PKT_STREAM_DATA_SEGMENT:   [[fallthrough]];
-    case AVT_PKT_STREAM_CONFIG_SEGMENT:
-        avt_decode_generic_segment(&bs, &p->pkt.generic_segment);
-        pl_bytes = p->pkt.generic_segment.seg_length;
-        break;
-    case AVT_PKT_LUT_ICC_PARITY:       [[fallthrough]];
-    case AVT_PKT_FONT_DATA_PARITY:     [[fallthrough]];
-    case AVT_PKT_METADATA_PARITY:      [[fallthrough]];
-    case AVT_PKT_USER_DATA_PARITY:     [[fallthrough]];
-    case AVT_PKT_STREAM_DATA_PARITY:   [[fallthrough]];
-    case AVT_PKT_STREAM_CONFIG_PARITY:
-        avt_decode_generic_parity(&bs, &p->pkt.generic_parity);
-        pl_bytes = p->pkt.generic_parity.parity_data_length;
-        break;
-    default:
-        avt_log(p, AVT_LOG_ERROR, "Unknown descriptor 0x%x received\n", desc);
-        return AVT_ERROR(ENOTSUP);
-    };
-
-    // TODO: pool buffer
-    if (!avt_buffer_quick_alloc(&p->pl, pl_bytes))
-        return AVT_ERROR(ENOMEM);
+    }
 
-    err = s->io->read_input(s->io_ctx, &p->pl, pl_bytes, timeout, 0x0);
-    if (err < 0)
-        return err;
+    AVTPktd *p = avt_pkt_fifo_push_new(fifo, NULL, 0, AVT_BUFFER_REF_ALL);
+    if (!p) {
+        err = AVT_ERROR(ENOMEM);
+        goto fail;
+    }
 
-    /* If there's not enough data, we'll try to do what we can with what
-     * we get down the road */
+    p->pkt = pkt;
+    p->hdr_len = hdr_len;
+    if (copy_hdr)
+        p->hdr = hbuf;
+    else
+        avt_buffer_quick_ref(&p->hdr, &s->rbuf, pkt_pos, hdr_len);
+    if (pl_bytes)
+        avt_buffer_quick_ref(&p->pl, &s->rbuf, pkt_pos + hdr_len, pl_bytes);
 
     return 0;
+
+fail:
+    avt_buffer_quick_unref(&hbuf);
+    return err;
 }
 
 static int stream_proto_max_pkt_len(AVTProtocolCtx *p, size_t *mtu)
@@ -281,6 +360,11 @@ static int stream_proto_seek(AVTProtocolCtx *p,
     if (!p->io->seek)
         return AVT_ERROR(ENOTSUP);
 
+    /* Drop anything read ahead */
+    avt_buffer_quick_unref(&p->rbuf);
+    p->rpos = p->rlen = 0;
+    p->roff = off;
+
     /* TODO: verify there's a packet there, use the indices in ts/seq mode */
     p->io->seek(p->io_ctx, off);
     /* Patch out the index if we succeed with the returned value */
@@ -28,6 +28,11 @@
 
 #include "reorder.h"
 
+FN_SPARSE_TABLE(avt_reorder, AVTReorder, AVTReorderStream,
+                stream, st)
+FN_SPARSE_TABLE(avt_reorder, AVTReorder, AVTReorderStream,
+                fec_group, fg)
+
 int avt_reorder_init(AVTContext *ctx, AVTReorder *r, size_t max_size)
 {
     return 0;
@@ -38,9 +43,11 @@ int avt_reorder_push(AVTReorder *r, AVTPacketFifo *in)
     int ret;
 
     for (auto i = 0; i < in->nb; i++) {
-        AVTPktd *p = &in->data[i];
+        AVTPktd *p = avt_pkt_fifo_get(in, i);
         uint32_t pkt_target = 0;
-        AVTReorderStream *rs = &r->st[p->pkt.stream_id];
+        AVTReorderStream *rs = avt_reorder_alloc_stream(r, p->pkt.stream_id);
+        if (!rs)
+            return AVT_ERROR(ENOMEM);
 
         int group_idx = 0;
         do {
@@ -94,7 +101,21 @@ int avt_reorder_done(AVTPacketFifo *out)
     return 0;
 }
 
+static void free_reorder_stream(AVTReorderStream *rs)
+{
+    for (auto i = 0; i < AVT_REORDER_GROUP_NB; i++)
+        avt_pkt_merge_free(&rs->m[i]);
+}
+
 int avt_reorder_free(AVTReorder *r)
 {
+    avt_reorder_free_st(r, free_reorder_stream);
+    avt_reorder_free_fg(r, free_reorder_stream);
+
+    free(r->active_stream_indices);
+    r->active_stream_indices = NULL;
+    r->nb_active_stream_indices = 0;
+    r->nb_alloc_active_stream_indices = 0;
+
     return 0;
 }
@@ -29,6 +29,7 @@
 
 #include "merger.h"
 #include "utils_internal.h"
+#include "mem.h"
 
 /* Maximum number of rejections for a single stream ID */
 #define AVT_REORDER_GROUP_NB 8
@@ -41,18 +42,19 @@ typedef struct AVTReorderStream {
 typedef struct AVTReorder {
     AVTContext *ctx;
 
-    /* One context per stream */
-    AVTReorderStream st[UINT16_MAX];
+    /* One context per stream, allocated on first use */
+    AVTReorderStream **st[AVT_SPARSE_NB_PAGES];
 
-    /* One context per FEC group */
-    AVTReorderStream fg[UINT16_MAX];
+    /* One context per FEC group, allocated on first use */
+    AVTReorderStream **fg[AVT_SPARSE_NB_PAGES];
 
     AVTPacketFifo *staging; /* Staging bucket, next for output */
 
     /* If a stream has no outstanding packets, it is considered inactive.
      * State is managed by an upper layer */
-    uint16_t active_stream_indices[UINT16_MAX];
-    uint16_t nb_active_stream_indices;
+    uint16_t *active_stream_indices;
+    uint32_t nb_active_stream_indices;
+    uint32_t nb_alloc_active_stream_indices;
 
     /* Available output buckets */
     AVTPacketFifo **avail_buckets;
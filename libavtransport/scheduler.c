@@ -36,6 +36,9 @@
 FN_CREATING(avt_scheduler, AVTScheduler, AVTPacketFifo,
             bucket, buckets, nb_buckets)
 
+FN_SPARSE_TABLE(avt_scheduler, AVTScheduler, AVTSchedulerStream,
+                stream, streams)
+
 int avt_scheduler_init(AVTScheduler *s,
                        size_t max_pkt_size, int64_t bandwidth)
 {
@@ -46,7 +49,9 @@ int avt_scheduler_init(AVTScheduler *s,
     /* AVTransport packets simply don't support bigger sizes */
     s->max_pkt_size = AVT_MIN(max_pkt_size, UINT32_MAX);
 
-    return 0;
+    /* Bandwidth is accounted for over a period of a second, in nanoseconds */
+    return avt_sliding_win_init(&s->sw, AVT_SCHEDULER_WINDOW_ENTRIES,
+                                1000000000);
 }
 
 static inline uint64_t get_seq(AVTScheduler *s)
@@ -54,14 +59,21 @@ static inline uint64_t get_seq(AVTScheduler *s)
     return s->seq++;
 }
 
-static inline void update_sw(AVTScheduler *s, size_t size)
+/* How many nanoseconds would take to transmit this number of bits */
+static inline int64_t tx_duration(AVTScheduler *s, int64_t bits)
+{
+    if (s->bandwidth <= 0)
+        return 0;
+    return avt_rescale(bits, 1000000000, s->bandwidth);
+}
+
+/* Account for an output packet, and give it its time on the wire */
+static inline void update_sw(AVTScheduler *s, AVTPktd *p, size_t size)
 {
     size *= 8;
 
-    static const AVTRational target_tb = (AVTRational){ 1, 1000000000 };
-    int64_t duration = avt_rescale(size, s->bandwidth, target_tb.den);
-    int64_t sum = avt_sliding_win(&s->sw, size, s->time, target_tb,
-                                  target_tb.den, 0);
+    int64_t duration = tx_duration(s, size);
+    int64_t sum = avt_sliding_win(&s->sw, size, s->time, 0);
 
     s->avail = s->bandwidth - sum;
     avt_log(s, AVT_LOG_TRACE, "Updating bw: %" PRIi64 " bits in, "
@@ -69,9 +81,29 @@ static inline void update_sw(AVTScheduler *s, size_t size)
                               "%" PRIi64 " bps, %" PRIi64 " avail\n",
             size, s->time, duration, sum, s->avail);
 
+    p->tx_time = s->time;
     s->time += duration;
 }
 
+/* Reserve a new packet in the output bucket, with storage for its header */
+static inline AVTPktd *push_new_pkt(AVTScheduler *s, AVTPacketFifo *dst,
+                                    AVTBuffer *pl, ptrdiff_t offset, size_t len)
+{
+    AVTBuffer hdr = { };
+    if (avt_hdr_slab_get(&s->hdr_slab, &hdr) < 0)
+        return NULL;
+
+    AVTPktd *p = avt_pkt_fifo_push_new(dst, pl, offset, len);
+    if (!p) {
+        avt_buffer_quick_unref(&hdr);
+        return NULL;
+    }
+
+    p->hdr = hdr;
+
+    return p;
+}
+
 static inline int64_t scheduler_push_internal(AVTScheduler *s,
                                               AVTSchedulerPacketContext *state,
                                               AVTPacketFifo *dst,
@@ -98,14 +130,14 @@ static inline int64_t scheduler_push_internal(AVTScheduler *s,
         return AVT_ERROR(EAGAIN);
 
     if (!pl_size) {
-        p = avt_pkt_fifo_push_new(dst, NULL, 0, 0);
+        p = push_new_pkt(s, dst, NULL, 0, 0);
         if (!p)
             return AVT_ERROR(ENOMEM);
 
         p->pkt = state->p.pkt;
-        avt_packet_encode_header(p);
+        avt_packet_encode_header_batch(p, &s->ldpc);
         out_acc += hdr_size;
-        update_sw(s, hdr_size);
+        update_sw(s, p, hdr_size);
         state->seg_offset = 0;
         state->present = 0;
 
@@ -114,7 +146,7 @@ static inline int64_t scheduler_push_internal(AVTScheduler *s,
 
     /* Reserve new packet in the output bucket FIFO */
     seg_pl_size = AVT_MIN(lim - hdr_size, pl_size);
-    p = avt_pkt_fifo_push_new(dst, &state->p.pl, 0, seg_pl_size);
+    p = push_new_pkt(s, dst, &state->p.pl, 0, seg_pl_size);
     if (!p)
         return AVT_ERROR(ENOMEM);
 
@@ -122,18 +154,19 @@ static inline int64_t scheduler_push_internal(AVTScheduler *s,
     avt_packet_change_size(state->p.pkt, 0, seg_pl_size, pl_size);
     state->p.pkt.seq = get_seq(s);
 
-    /* Encode packet */
-    avt_packet_encode_header(&state->p);
+    /* Encode packet directly into the FIFO */
+    p->pkt = state->p.pkt;
+    avt_packet_encode_header_batch(p, &s->ldpc);
 
     /* Update accumulated output */
-    acc = avt_pkt_hdr_size(state->p.pkt.desc) + seg_pl_size;
+    acc = avt_pkt_hdr_size(p->pkt.desc) + seg_pl_size;
     out_acc += acc;
-    update_sw(s, acc);
+    update_sw(s, p, acc);
 
-    /* Update packet in FIFO */
-    p->pkt = state->p.pkt;
-    p->hdr_len = state->p.hdr_len;
-    memcpy(p->hdr, state->p.hdr, state->p.hdr_len);
+    /* Segments carry parts of the header, so keep a reference to it */
+    avt_buffer_quick_ref(&state->p.hdr, &p->hdr, 0, p->hdr_len);
+    state->p.hdr_len = p->hdr_len;
+    state->p.hdr_off = p->hdr_off;
 
     /* Setup segmentation context */
     state->seg_offset = seg_pl_size;
@@ -154,7 +187,7 @@ resume:
         if (out_limit < acc)
             return AVT_ERROR(EAGAIN);
 
-        p = avt_pkt_fifo_push_new(dst, NULL, 0, 0);
+        p = push_new_pkt(s, dst, NULL, 0, 0);
         if (!p)
             return AVT_ERROR(ENOMEM);
 
@@ -165,11 +198,11 @@ resume:
         );
         memcpy(p->pkt.hash_data.hash_data, state->p.pl_hash, 16);
 
-        avt_packet_encode_header(p);
+        avt_packet_encode_header_batch(p, &s->ldpc);
 
         /* Enqueue packet */
         out_acc += acc;
-        update_sw(s, acc);
+        update_sw(s, p, acc);
 
         state->hash_sent = true;
     }
@@ -183,7 +216,7 @@ resume:
     while (state->pl_left) {
         seg_pl_size = AVT_MIN(lim - hdr_size, state->pl_left);
 
-        p = avt_pkt_fifo_push_new(dst, &state->p.pl, state->seg_offset, seg_pl_size);
+        p = push_new_pkt(s, dst, &state->p.pl, state->seg_offset, seg_pl_size);
         if (!p)
             return AVT_ERROR(ENOMEM);
 
@@ -191,12 +224,12 @@ resume:
                                            state->seg_offset, seg_pl_size, pl_size);
 
         /* Encode packet */
-        avt_packet_encode_header(p);
+        avt_packet_encode_header_batch(p, &s->ldpc);
 
         /* Enqueue packet */
         acc = avt_pkt_hdr_size(p->pkt.desc) + seg_pl_size;
         out_acc += acc;
-        update_sw(s, acc);
+        update_sw(s, p, acc);
 
         state->seg_offset += seg_pl_size;
         state->pl_left -= seg_pl_size;
@@ -228,8 +261,7 @@ static inline void update_stream_ctx(AVTScheduler *s, AVTSchedulerStream *pctx)
 
     int64_t duration = avt_packet_get_duration(&pctx->cur.p.pkt);
     if (duration == INT64_MIN) {
-        /* How many nanoseconds would take to transmit this number of bits */
-        duration = avt_rescale(size, s->bandwidth, target_tb.den);
+        duration = tx_duration(s, size);
     } else {
         duration = avt_rescale_rational(duration, s_tb, target_tb);
     }
@@ -244,6 +276,140 @@ static inline void update_stream_ctx(AVTScheduler *s, AVTSchedulerStream *pctx)
     pctx->cur.size = size;
 }
 
+static inline int64_t heap_key(enum AVTSchedulerHeapType t,
+                               const AVTSchedulerStream *st)
+{
+    if (t == AVT_SCHEDULER_HEAP_START)
+        return st->cur.pts;
+    return st->cur.pts + st->cur.duration;
+}
+
+/* Ties are broken by stream ID, to keep scheduling deterministic */
+static inline bool heap_less(enum AVTSchedulerHeapType t,
+                             const AVTSchedulerStream *a,
+                             const AVTSchedulerStream *b)
+{
+    const int64_t ka = heap_key(t, a);
+    const int64_t kb = heap_key(t, b);
+    return (ka < kb) || ((ka == kb) && (a->id < b->id));
+}
+
+static inline void heap_set(AVTSchedulerHeap *h, enum AVTSchedulerHeapType t,
+                            uint32_t pos, AVTSchedulerStream *st)
+{
+    h->st[pos] = st;
+    st->heap_pos[t] = pos;
+}
+
+static void heap_sift_up(AVTScheduler *s, enum AVTSchedulerHeapType t,
+                         uint32_t pos)
+{
+    AVTSchedulerHeap *h = &s->heap[t];
+    AVTSchedulerStream *st = h->st[pos];
+
+    while (pos) {
+        const uint32_t parent = (pos - 1) >> 1;
+        if (!heap_less(t, st, h->st[parent]))
+            break;
+        heap_set(h, t, pos, h->st[parent]);
+        pos = parent;
+    }
+
+    heap_set(h, t, pos, st);
+}
+
+static void heap_sift_down(AVTScheduler *s, enum AVTSchedulerHeapType t,
+                           uint32_t pos)
+{
+    AVTSchedulerHeap *h = &s->heap[t];
+    AVTSchedulerStream *st = h->st[pos];
+
+    while (1) {
+        uint32_t c = (pos << 1) + 1;
+        if (c >= h->nb)
+            break;
+        if (((c + 1) < h->nb) && heap_less(t, h->st[c + 1], h->st[c]))
+            c++;
+        if (!heap_less(t, h->st[c], st))
+            break;
+        heap_set(h, t, pos, h->st[c]);
+        pos = c;
+    }
+
+    heap_set(h, t, pos, st);
+}
+
+/* All heaps and temporary lists hold at most one entry per active stream */
+static int grow_active(AVTScheduler *s)
+{
+    const uint32_t nb_alloc = AVT_MAX(s->nb_alloc_active << 1, 16);
+
+    for (int t = 0; t < AVT_SCHEDULER_HEAP_NB; t++) {
+        AVTSchedulerStream **st = avt_reallocarray(s->heap[t].st, nb_alloc,
+                                                   sizeof(*st));
+        if (!st)
+            return AVT_ERROR(ENOMEM);
+        s->heap[t].st = st;
+    }
+
+    AVTSchedulerStream **overlap = avt_reallocarray(s->tmp.overlap, nb_alloc,
+                                                    sizeof(*overlap));
+    if (!overlap)
+        return AVT_ERROR(ENOMEM);
+    s->tmp.overlap = overlap;
+
+    uint32_t *cand = avt_reallocarray(s->tmp.cand, nb_alloc, sizeof(*cand));
+    if (!cand)
+        return AVT_ERROR(ENOMEM);
+    s->tmp.cand = cand;
+
+    s->nb_alloc_active = nb_alloc;
+
+    return 0;
+}
+
+static int activate_stream(AVTScheduler *s, AVTSchedulerStream *st)
+{
+    if (s->heap[AVT_SCHEDULER_HEAP_END].nb == s->nb_alloc_active) {
+        int ret = grow_active(s);
+        if (ret < 0)
+            return ret;
+    }
+
+    st->active = true;
+    for (int t = 0; t < AVT_SCHEDULER_HEAP_NB; t++) {
+        const uint32_t pos = s->heap[t].nb++;
+        s->heap[t].st[pos] = st;
+        heap_sift_up(s, t, pos);
+    }
+
+    return 0;
+}
+
+/* Must be called after the timestamps of an active stream change */
+static void update_stream_pos(AVTScheduler *s, AVTSchedulerStream *st)
+{
+    for (int t = 0; t < AVT_SCHEDULER_HEAP_NB; t++) {
+        heap_sift_up(s, t, st->heap_pos[t]);
+        heap_sift_down(s, t, st->heap_pos[t]);
+    }
+}
+
+static void remove_stream(AVTScheduler *s, AVTSchedulerStream *st)
+{
+    st->active = false;
+    for (int t = 0; t < AVT_SCHEDULER_HEAP_NB; t++) {
+        AVTSchedulerHeap *h = &s->heap[t];
+        const uint32_t pos = st->heap_pos[t];
+        AVTSchedulerStream *last = h->st[--h->nb];
+        if (pos == h->nb)
+            continue;
+        heap_set(h, t, pos, last);
+        heap_sift_up(s, t, pos);
+        heap_sift_down(s, t, last->heap_pos[t]);
+    }
+}
+
 static inline int preload_pkt(AVTScheduler *s, AVTSchedulerStream *pctx)
 {
     if (pctx->cur.present)
@@ -254,48 +420,30 @@ static inline int preload_pkt(AVTScheduler *s, AVTSchedulerStream *pctx)
         return ret;
 
     update_stream_ctx(s, pctx);
+    update_stream_pos(s, pctx);
 
     return ret;
 }
 
-static void remove_stream(AVTScheduler *s, int active_id, int overlap_id)
-{
-    if (overlap_id >= 0) {
-        memcpy(&s->tmp.overlap[overlap_id], &s->tmp.overlap[overlap_id + 1],
-               (s->tmp.nb_overlap - overlap_id)*sizeof(*s->tmp.overlap));
-        s->tmp.nb_overlap--;
-    }
-
-    if (active_id >= 0) {
-        s->streams[s->active_stream_indices[active_id]].active = false;
-        memcpy(&s->active_stream_indices[active_id],
-               &s->active_stream_indices[active_id + 1],
-               (s->nb_active_stream_indices - active_id) *
-               sizeof(*s->active_stream_indices));
-        s->nb_active_stream_indices--;
-    }
-}
-
-static int direct_push(AVTScheduler *s, uint16_t id)
+static int direct_push(AVTScheduler *s, AVTSchedulerStream *pctx)
 {
     int ret;
-    AVTSchedulerStream *pctx = &s->streams[id];
     avt_log(s, AVT_LOG_TRACE, "Pushing stream 0x%X: 0x%X pkt, "
                               "%" PRIi64 " avail bits\n",
-            id, pctx->cur.p.pkt.desc, s->avail);
+            pctx->id, pctx->cur.p.pkt.desc, s->avail);
     do {
         ret = scheduler_push_internal(s, &pctx->cur, s->staging,
                                       s->max_pkt_size, s->avail >> 3);
     } while (ret > 0);
 
     if (ret < 0) {
-        avt_buffer_quick_unref(&pctx->cur.p.pl);
+        avt_pktd_unref(&pctx->cur.p);
         return ret;
     } else if (!ret) {
-        avt_buffer_quick_unref(&pctx->cur.p.pl);
-        ret = preload_pkt(s, &s->streams[id]);
+        avt_pktd_unref(&pctx->cur.p);
+        ret = preload_pkt(s, pctx);
         if (ret == AVT_ERROR(ENOENT)) {
-            remove_stream(s, 0, -1);
+            remove_stream(s, pctx);
             ret = 0;
         } else if (ret < 0) {
             return ret;
@@ -305,65 +453,104 @@ static int direct_push(AVTScheduler *s, uint16_t id)
     return ret;
 }
 
+static inline bool cand_less(AVTScheduler *s, uint32_t a, uint32_t b)
+{
+    const AVTSchedulerHeap *h = &s->heap[AVT_SCHEDULER_HEAP_START];
+    return heap_less(AVT_SCHEDULER_HEAP_START, h->st[a], h->st[b]);
+}
+
+static inline void cand_push(AVTScheduler *s, uint32_t *nb_cand, uint32_t pos)
+{
+    uint32_t *cand = s->tmp.cand;
+    uint32_t i = (*nb_cand)++;
+
+    cand[i] = pos;
+    while (i && cand_less(s, cand[i], cand[(i - 1) >> 1])) {
+        AVT_SWAP(cand[i], cand[(i - 1) >> 1]);
+        i = (i - 1) >> 1;
+    }
+}
+
+static inline uint32_t cand_pop(AVTScheduler *s, uint32_t *nb_cand)
+{
+    uint32_t *cand = s->tmp.cand;
+    const uint32_t top = cand[0];
+    const uint32_t nb = --(*nb_cand);
+    uint32_t i = 0;
+
+    cand[0] = cand[nb];
+    while (1) {
+        uint32_t c = (i << 1) + 1;
+        if (c >= nb)
+            break;
+        if (((c + 1) < nb) && cand_less(s, cand[c + 1], cand[c]))
+            c++;
+        if (!cand_less(s, cand[c], cand[i]))
+            break;
+        AVT_SWAP(cand[c], cand[i]);
+        i = c;
+    }
+
+    return top;
+}
+
+/* Collect all streams starting before min_end into tmp.overlap, sorted by
+ * start time. These form a subtree at the root of the start heap, which is
+ * walked best-first, so this is O(k log k) for k overlapping streams. */
+static void get_overlaps(AVTScheduler *s, int64_t min_end)
+{
+    const AVTSchedulerHeap *h = &s->heap[AVT_SCHEDULER_HEAP_START];
+    uint32_t nb_cand = 0;
+
+    s->tmp.nb_overlap = 0;
+    if (h->nb && (h->st[0]->cur.pts < min_end))
+        cand_push(s, &nb_cand, 0);
+
+    while (nb_cand) {
+        const uint32_t pos = cand_pop(s, &nb_cand);
+        s->tmp.overlap[s->tmp.nb_overlap++] = h->st[pos];
+
+        for (uint32_t c = (pos << 1) + 1; c <= ((pos << 1) + 2); c++)
+            if ((c < h->nb) && (h->st[c]->cur.pts < min_end))
+                cand_push(s, &nb_cand, c);
+    }
+}
+
 static int scheduler_process(AVTScheduler *s)
 {
     int ret;
     AVTSchedulerStream *pctx;
-
-    for (auto i = 0; i < s->nb_active_stream_indices; i++) {
-        const uint16_t id = s->active_stream_indices[i];
-        ret = preload_pkt(s, &s->streams[id]);
-        if (ret < 0)
-            return ret;
-    }
+    const AVTSchedulerHeap *end_heap = &s->heap[AVT_SCHEDULER_HEAP_END];
 
  repeat:
-    if (!s->nb_active_stream_indices)
+    if (!end_heap->nb)
         return 0;
-    else if (s->nb_active_stream_indices == 1)
-        return direct_push(s, s->active_stream_indices[0]);
+    else if (end_heap->nb == 1)
+        return direct_push(s, end_heap->st[0]);
 
     /* Get the first (time-wise) ending timestamp of a packet */
-    int64_t min_end = INT64_MAX;
-    uint16_t min_end_id = 0;
-    for (int i = 0; i < s->nb_active_stream_indices; i++) {
-        const uint16_t id = s->active_stream_indices[i];
-        pctx = &s->streams[id];
-        if ((pctx->cur.pts + pctx->cur.duration) < min_end) {
-            min_end = (pctx->cur.pts + pctx->cur.duration);
-            min_end_id = id;
-        }
-    }
+    AVTSchedulerStream *min_end_st = end_heap->st[0];
+    const int64_t min_end = heap_key(AVT_SCHEDULER_HEAP_END, min_end_st);
 
-    /* Get a list of packets whose start time overlaps with the first end */
-    s->tmp.nb_overlap = 0;
-    s->tmp.overlap[s->tmp.nb_overlap++] = min_end_id;
-    size_t overlap_size = s->streams[min_end_id].cur.size;
-    size_t min_overlap_size = AVT_MIN(s->streams[min_end_id].cur.size,
-                                      s->max_pkt_size);
-    for (int i = 0; i < s->nb_active_stream_indices; i++) {
-        const uint16_t id = s->active_stream_indices[i];
-        if (id == min_end_id)
-            continue;
-        pctx = &s->streams[id];
-        if (pctx->cur.pts < min_end) {
-            if (pctx->cur.size < min_overlap_size)
-                min_overlap_size = pctx->cur.size;
-            overlap_size += pctx->cur.size;
-            s->tmp.overlap[s->tmp.nb_overlap++] = id;
-        }
-    }
+    /* Get a list of packets whose start time overlaps with the first end.
+     * A zero-duration packet does not overlap with itself, but it starts
+     * after all the others, so it goes last. */
+    get_overlaps(s, min_end);
+    if (min_end_st->cur.pts >= min_end)
+        s->tmp.overlap[s->tmp.nb_overlap++] = min_end_st;
+
+    size_t overlap_size = 0;
+    for (uint32_t i = 0; i < s->tmp.nb_overlap; i++)
+        overlap_size += s->tmp.overlap[i]->cur.size;
 
     /* No overlaps, nothing to schedule */
     if (s->tmp.nb_overlap == 1) {
-        ret = direct_push(s, s->active_stream_indices[0]);
+        ret = direct_push(s, min_end_st);
         if (ret < 0)
             return ret;
         goto repeat;
     }
 
-    /* TODO: We should really sort overlaps by start time here */
-
     /* We need to do a while loop for each time we call
      * scheduler_push_internal, as it needs a flush.
      *
@@ -376,24 +563,23 @@ static int scheduler_process(AVTScheduler *s)
      * This essentially interleaves segments of all streams, giving
      * some amount of resilience towards packet drops, which happen in
      * bursts. */
-    avt_log(s, AVT_LOG_DEBUG, "Interleaving: %" PRIu16 " streams, "
-                              "%" PRIu16 " overlaps, %" PRIi64 " end ts, "
+    avt_log(s, AVT_LOG_DEBUG, "Interleaving: %" PRIu32 " streams, "
+                              "%" PRIu32 " overlaps, %" PRIi64 " end ts, "
                               "%" PRIi64 "/%" PRIi64 " left/avail bits\n",
-            s->nb_active_stream_indices, s->tmp.nb_overlap, min_end,
+            end_heap->nb, s->tmp.nb_overlap, min_end,
             overlap_size, s->avail);
 
     /* Per-stream limit */
     size_t local_limit = (s->avail / overlap_size) * s->max_pkt_size;
-    unsigned int idx = 0;
+    uint32_t i = 0, nb_kept = 0;
     do {
-        const int i = (idx++) % s->tmp.nb_overlap;
-        const uint16_t id = s->tmp.overlap[i];
-        pctx = &s->streams[id];
+        pctx = s->tmp.overlap[i];
+        bool keep = true;
 
         avt_log(s, AVT_LOG_TRACE, "Pushing stream 0x%X: 0x%X pkt, "
                                   "%" PRIi64 " limit, "
                                   "%" PRIi64 "/%" PRIi64 " left/avail bits\n",
-                id, pctx->cur.p.pkt.desc, local_limit, overlap_size, s->avail);
+                pctx->id, pctx->cur.p.pkt.desc, local_limit, overlap_size, s->avail);
 
         ret = scheduler_push_internal(s, &pctx->cur, s->staging,
                                       s->max_pkt_size, local_limit);
@@ -401,13 +587,13 @@ static int scheduler_process(AVTScheduler *s)
             /* No bits left at all. Just return. */
             return 0;
         } else if (ret < 0) {
-            avt_buffer_quick_unref(&pctx->cur.p.pl);
+            avt_pktd_unref(&pctx->cur.p);
             return ret;
         } else if (ret > 0) {
             s->avail -= ret;
             overlap_size -= ret;
         } else if (ret == 0) {
-            avt_buffer_quick_unref(&pctx->cur.p.pl);
+            avt_pktd_unref(&pctx->cur.p);
             /* Preload next */
             ret = preload_pkt(s, pctx);
             if (ret == 0) {
@@ -415,15 +601,25 @@ static int scheduler_process(AVTScheduler *s)
                  * it into, or if it doesn't overlap */
                 if (((overlap_size + pctx->cur.size) < s->avail) ||
                     (pctx->cur.pts >= min_end))
-                    remove_stream(s, -1, i);
+                    keep = false;
                 else
                     overlap_size += pctx->cur.size;
             } else if (ret == AVT_ERROR(ENOENT)) {
-                remove_stream(s, pctx->active_id, i);
+                remove_stream(s, pctx);
+                keep = false;
             } else if (ret < 0) {
                 return ret;
             }
         }
+
+        /* Compact the list in place, rather than shifting it on each
+         * removal, and start over once all streams have had a go */
+        if (keep)
+            s->tmp.overlap[nb_kept++] = pctx;
+        if (++i == s->tmp.nb_overlap) {
+            s->tmp.nb_overlap = nb_kept;
+            i = nb_kept = 0;
+        }
     } while ((overlap_size < s->avail) && s->tmp.nb_overlap);
 
     goto repeat;
@@ -431,7 +627,7 @@ static int scheduler_process(AVTScheduler *s)
     return 0;
 }
 
-int avt_scheduler_push(AVTScheduler *s, AVTPktd *p)
+static int scheduler_push(AVTScheduler *s, AVTPktd *p)
 {
     int ret;
 
@@ -447,32 +643,40 @@ int avt_scheduler_push(AVTScheduler *s, AVTPktd *p)
         AVTSchedulerPacketContext state = {
             .p = *p,
         };
-        return scheduler_push_internal(s, &state, s->staging,
-                                       s->max_pkt_size, INT64_MAX);
+        state.p.hdr = (AVTBuffer){ };
+        ret = scheduler_push_internal(s, &state, s->staging,
+                                      s->max_pkt_size, INT64_MAX);
+        avt_buffer_quick_unref(&state.p.hdr);
+        return ret;
     }
 
-    /* Keep track of timebases for all streams */
-    if (p->pkt.desc == AVT_PKT_STREAM_REGISTRATION)
-        s->streams[p->pkt.stream_id].reg = p->pkt;
-
     uint16_t sid = p->pkt.stream_id;
     if (p->pkt.desc == AVT_PKT_SESSION_START || p->pkt.desc == AVT_PKT_TIME_SYNC)
         sid = 0xFFFF;
 
-    /* Keep track of active streams */
-    if (!s->streams[sid].active) {
-        s->streams[sid].active = true;
-        s->streams[sid].active_id = s->nb_active_stream_indices;
-        s->active_stream_indices[s->nb_active_stream_indices++] = sid;
-    }
+    AVTSchedulerStream *st = avt_scheduler_alloc_stream(s, sid);
+    if (!st)
+        return AVT_ERROR(ENOMEM);
+    st->id = sid;
 
-    if (!s->streams[sid].cur.present && !s->streams[sid].fifo.nb) {
-        s->streams[sid].cur.p.pkt = p->pkt;
-        avt_buffer_quick_ref(&s->streams[sid].cur.p.pl, &p->pl, 0, AVT_BUFFER_REF_ALL);
-        update_stream_ctx(s, &s->streams[sid]);
+    /* Keep track of timebases for all streams */
+    if (p->pkt.desc == AVT_PKT_STREAM_REGISTRATION)
+        st->reg = p->pkt;
+
+    if (!st->cur.present && !st->fifo.nb) {
+        st->cur.p.pkt = p->pkt;
+        avt_buffer_quick_ref(&st->cur.p.pl, &p->pl, 0, AVT_BUFFER_REF_ALL);
+        update_stream_ctx(s, st);
     } else {
         /* Add packet to stream FIFO */
-        ret = avt_pkt_fifo_push(&s->streams[sid].fifo, p);
+        ret = avt_pkt_fifo_push(&st->fifo, p);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* Keep track of active streams */
+    if (!st->active) {
+        ret = activate_stream(s, st);
         if (ret < 0)
             return ret;
     }
@@ -480,6 +684,16 @@ int avt_scheduler_push(AVTScheduler *s, AVTPktd *p)
     return scheduler_process(s);
 }
 
+int avt_scheduler_push(AVTScheduler *s, AVTPktd *p)
+{
+    int ret = scheduler_push(s, p);
+
+    /* Compute the parity of all headers written at once */
+    avt_ldpc_encode_batch(&s->ldpc);
+
+    return ret;
+}
+
 int avt_scheduler_pop(AVTScheduler *s, AVTPacketFifo **seq)
 {
     if (!s->staging || (!s->staging->nb))
@@ -525,6 +739,12 @@ int avt_scheduler_done(AVTScheduler *s, AVTPacketFifo *seq)
     return 0;
 }
 
+static void free_stream(AVTSchedulerStream *st)
+{
+    avt_pktd_unref(&st->cur.p);
+    avt_pkt_fifo_free(&st->fifo);
+}
+
 void avt_scheduler_free(AVTScheduler *s)
 {
     s->staging = NULL;
@@ -534,16 +754,27 @@ void avt_scheduler_free(AVTScheduler *s)
     s->nb_alloc_avail_buckets = 0;
     s->nb_avail_buckets = 0;
 
-    for (auto i = 0; i < s->nb_buckets; i++)
+    for (auto i = 0; i < s->nb_buckets; i++) {
         avt_pkt_fifo_free(s->buckets[i]);
+        free(s->buckets[i]);
+    }
     free(s->buckets);
     s->buckets = NULL;
     s->nb_buckets = 0;
 
-    for (auto i = 0; i < s->nb_active_stream_indices; i++) {
-        AVTSchedulerStream *st = &s->streams[s->active_stream_indices[i]];
-        avt_buffer_quick_unref(&st->cur.p.pl);
-        avt_pkt_fifo_free(&st->fifo);
+    avt_scheduler_free_streams(s, free_stream);
+
+    for (auto t = 0; t < AVT_SCHEDULER_HEAP_NB; t++) {
+        free(s->heap[t].st);
+        s->heap[t].st = NULL;
+        s->heap[t].nb = 0;
     }
-    s->nb_active_stream_indices = 0;
+    free(s->tmp.overlap);
+    s->tmp.overlap = NULL;
+    free(s->tmp.cand);
+    s->tmp.cand = NULL;
+    s->nb_alloc_active = 0;
+
+    avt_sliding_win_free(&s->sw);
+    avt_hdr_slab_free(&s->hdr_slab);
 }
@@ -29,6 +29,8 @@
 
 #include <avtransport/rational.h>
 #include "utils_internal.h"
+#include "ldpc_encode.h"
+#include "mem.h"
 
 typedef struct AVTSchedulerPacketContext {
     /* Unlike with a normal packet, this is state,
@@ -46,7 +48,18 @@ typedef struct AVTSchedulerPacketContext {
     size_t    size;
 } AVTSchedulerPacketContext;
 
+/* Capacity of the bandwidth accounting window */
+#define AVT_SCHEDULER_WINDOW_ENTRIES (1 << 14)
+
+enum AVTSchedulerHeapType {
+    AVT_SCHEDULER_HEAP_END = 0, /* Keyed on cur.pts + cur.duration */
+    AVT_SCHEDULER_HEAP_START,   /* Keyed on cur.pts */
+    AVT_SCHEDULER_HEAP_NB,
+};
+
 typedef struct AVTSchedulerStream {
+    uint16_t id;
+
     /* For timebase keeping */
     union AVTPacketData reg;
 
@@ -57,9 +70,16 @@ typedef struct AVTSchedulerStream {
 
     /* Stream has had packets without a closure */
     bool active;
-    uint16_t active_id;
+    /* Position of the stream in each of the scheduler's heaps */
+    uint32_t heap_pos[AVT_SCHEDULER_HEAP_NB];
 } AVTSchedulerStream;
 
+/* Binary min-heap of active streams */
+typedef struct AVTSchedulerHeap {
+    AVTSchedulerStream **st;
+    uint32_t nb;
+} AVTSchedulerHeap;
+
 typedef struct AVTScheduler {
     /* Settings */
     size_t max_pkt_size;
@@ -70,16 +90,23 @@ typedef struct AVTScheduler {
     uint64_t seq;           /* Next packet seq */
     AVTPacketFifo *staging; /* Staging bucket, next for output */
     AVTSlidingWinCtx sw;    /* Sliding window state */
+    AVTHeaderSlab hdr_slab; /* Storage for encoded headers */
+    AVTLDPCBatch ldpc;      /* Parity of headers encoded in a push */
     int64_t avail;
     int64_t time;
 
-    /* Streams state */
-    AVTSchedulerStream streams[UINT16_MAX];
-    uint16_t active_stream_indices[UINT16_MAX];
-    uint16_t nb_active_stream_indices;
+    /* Streams state, allocated on first use.
+     * Stream 0xFFFF is used for session-level packets. */
+    AVTSchedulerStream **streams[AVT_SPARSE_NB_PAGES];
+
+    /* Active streams, ordered by end and start time */
+    AVTSchedulerHeap heap[AVT_SCHEDULER_HEAP_NB];
+    uint32_t nb_alloc_active; /* Allocated size of the heaps and tmp lists */
+
     struct {
-        uint16_t overlap[UINT16_MAX];
-        uint16_t nb_overlap;
+        AVTSchedulerStream **overlap;
+        uint32_t nb_overlap;
+        uint32_t *cand; /* Start heap positions to visit */
     } tmp;
 
     /* Available output buckets */
@@ -0,0 +1,334 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#include "buffer.h"
+
+#define NB_THREADS 8
+#define NB_THREAD_ITER 4096
+
+static void noop_free(void *opaque, void *base_data, size_t len)
+{
+}
+
+#ifdef COUNT_ALLOCS
+/* Linked with --wrap=malloc */
+void *__real_malloc(size_t size);
+void *__wrap_malloc(size_t size);
+
+static atomic_int nb_allocs;
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&nb_allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+static int check_allocs(int start, int expected, const char *what)
+{
+    int nb = atomic_load(&nb_allocs) - start;
+    if (nb != expected) {
+        fprintf(stderr, "%s took %i allocations, expected %i\n",
+                what, nb, expected);
+        return AVT_ERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+static int test_alloc_count(AVTBufferPool *pool)
+{
+    int ret;
+    AVTBuffer buf = { };
+    AVTBuffer ref = { };
+    AVTBuffer *pbuf = NULL;
+    AVTBuffer *pref = NULL;
+    uint8_t data[16];
+
+    int start = atomic_load(&nb_allocs);
+    if (!avt_buffer_quick_alloc(&buf, 1024))
+        return AVT_ERROR(ENOMEM);
+    avt_buffer_quick_ref(&ref, &buf, 16, 32);
+    ret = check_allocs(start, 1, "Allocation and reference");
+    avt_buffer_quick_unref(&ref);
+    avt_buffer_quick_unref(&buf);
+    if (ret < 0)
+        return ret;
+
+    start = atomic_load(&nb_allocs);
+    pbuf = avt_buffer_alloc(1024);
+    if (!pbuf)
+        return AVT_ERROR(ENOMEM);
+    pref = avt_buffer_ref(pbuf, 0, AVT_BUFFER_REF_ALL);
+    ret = check_allocs(start, 3, "Public allocation and reference");
+    avt_buffer_unref(&pref);
+    avt_buffer_unref(&pbuf);
+    if (ret < 0)
+        return ret;
+
+    start = atomic_load(&nb_allocs);
+    pbuf = avt_buffer_create(data, sizeof(data), NULL, noop_free);
+    ret = check_allocs(start, 2, "Wrapping external memory");
+    avt_buffer_unref(&pbuf);
+    if (ret < 0)
+        return ret;
+
+    /* Returned memory must be reused with no allocations at all */
+    if (!avt_buffer_pool_quick_alloc(pool, &buf, 1024))
+        return AVT_ERROR(ENOMEM);
+    avt_buffer_quick_unref(&buf);
+    start = atomic_load(&nb_allocs);
+    if (!avt_buffer_pool_quick_alloc(pool, &buf, 1024))
+        return AVT_ERROR(ENOMEM);
+    ret = check_allocs(start, 0, "Pooled allocation");
+    avt_buffer_quick_unref(&buf);
+
+    return ret;
+}
+#endif
+
+static int check_stats(AVTBufferPool *pool, uint64_t hits, uint64_t misses,
+                       uint64_t oversized)
+{
+    AVTBufferPoolStats stats;
+    avt_buffer_pool_get_stats(pool, &stats);
+
+    if ((stats.hits != hits) || (stats.misses != misses) ||
+        (stats.oversized != oversized)) {
+        fprintf(stderr, "Got %lu hits, %lu misses, %lu oversized, "
+                        "expected %lu, %lu, %lu\n",
+                (unsigned long)stats.hits, (unsigned long)stats.misses,
+                (unsigned long)stats.oversized, (unsigned long)hits,
+                (unsigned long)misses, (unsigned long)oversized);
+        return AVT_ERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+static int thread_fn(void *arg)
+{
+    AVTBufferPool *pool = arg;
+    AVTBuffer buf[4] = { };
+
+    for (int i = 0; i < NB_THREAD_ITER; i++) {
+        AVTBuffer *b = &buf[i & 3];
+        avt_buffer_quick_unref(b);
+
+        size_t len = 1 + (i*37 % 8192);
+        uint8_t *data = avt_buffer_pool_quick_alloc(pool, b, len);
+        if (!data)
+            return AVT_ERROR(ENOMEM);
+        memset(data, i, len);
+    }
+
+    for (int i = 0; i < 4; i++)
+        avt_buffer_quick_unref(&buf[i]);
+
+    return 0;
+}
+
+int main(void)
+{
+    int ret;
+    AVTBufferPool *pool = NULL;
+    AVTBuffer buf = { };
+    AVTBuffer ref = { };
+
+    ret = avt_buffer_pool_init(&pool, 65536);
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    {
+        fprintf(stderr, "Testing reuse...\n");
+        uint8_t *data = avt_buffer_pool_quick_alloc(pool, &buf, 1000);
+        if (!data || (avt_buffer_get_data_len(&buf) != 1000)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        avt_buffer_quick_unref(&buf);
+
+        /* Same size class, so the memory must be reused */
+        uint8_t *data2 = avt_buffer_pool_quick_alloc(pool, &buf, 600);
+        if (data2 != data) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+
+        /* The memory is only returned once all references are gone */
+        avt_buffer_quick_ref(&ref, &buf, 0, AVT_BUFFER_REF_ALL);
+        avt_buffer_quick_unref(&buf);
+        data = avt_buffer_pool_quick_alloc(pool, &buf, 600);
+        if (data == data2) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+        avt_buffer_quick_unref(&buf);
+        avt_buffer_quick_unref(&ref);
+
+        ret = check_stats(pool, 1, 2, 0);
+        if (ret < 0)
+            goto end;
+    }
+
+    {
+        fprintf(stderr, "Testing oversized allocations...\n");
+        if (!avt_buffer_pool_quick_alloc(pool, &buf, 65537)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        avt_buffer_quick_unref(&buf);
+
+        ret = check_stats(pool, 1, 2, 1);
+        if (ret < 0)
+            goto end;
+    }
+
+    {
+        fprintf(stderr, "Testing wrapping pool memory...\n");
+        uint8_t *data = avt_buffer_pool_get(pool, 1000);
+        if (!data) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        ret = avt_buffer_quick_create(&buf, data, 1000, pool,
+                                      avt_buffer_pool_release, 0);
+        if (ret < 0) {
+            avt_buffer_pool_release(pool, data, 1000);
+            goto end;
+        }
+        avt_buffer_quick_unref(&buf);
+
+        /* The memory must have gone back to the pool */
+        uint8_t *data2 = avt_buffer_pool_quick_alloc(pool, &buf, 1000);
+        if (data2 != data) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+        avt_buffer_quick_unref(&buf);
+
+        ret = check_stats(pool, 3, 2, 1);
+        if (ret < 0)
+            goto end;
+    }
+
+    {
+        fprintf(stderr, "Testing resizing...\n");
+        uint8_t *data = avt_buffer_pool_quick_alloc(pool, &buf, 100);
+        if (!data) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(data, 0xAA, 100);
+
+        /* Grows past the size class, so the data gets moved out */
+        ret = avt_buffer_resize(&buf, 1000);
+        if (ret < 0)
+            goto end;
+
+        data = avt_buffer_get_data(&buf, NULL);
+        for (int i = 0; i < 100; i++) {
+            if (data[i] != 0xAA) {
+                ret = AVT_ERROR(EINVAL);
+                goto end;
+            }
+        }
+        avt_buffer_quick_unref(&buf);
+    }
+
+    {
+        fprintf(stderr, "Testing multithreaded use...\n");
+        thrd_t threads[NB_THREADS];
+        int nb_threads = 0;
+        for (; nb_threads < NB_THREADS; nb_threads++) {
+            if (thrd_create(&threads[nb_threads], thread_fn, pool) != thrd_success) {
+                ret = AVT_ERROR(ENOMEM);
+                break;
+            }
+        }
+        for (int i = 0; i < nb_threads; i++) {
+            int t_ret;
+            thrd_join(threads[i], &t_ret);
+            if (t_ret < 0)
+                ret = t_ret;
+        }
+        if (ret < 0)
+            goto end;
+    }
+
+    {
+        fprintf(stderr, "Testing alignment and headroom...\n");
+        AVTBuffer *abuf = avt_buffer_alloc_aligned(100, 256, 32);
+        if (!abuf) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+
+        uint8_t *data = avt_buffer_get_data(abuf, NULL);
+        if (((uintptr_t)data & 255) ||
+            (avt_buffer_offset(abuf, -33) >= 0) ||
+            (avt_buffer_offset(abuf, -32) < 0) ||
+            (avt_buffer_get_data(abuf, NULL) != data - 32) ||
+            (avt_buffer_get_data_len(abuf) != 132)) {
+            avt_buffer_unref(&abuf);
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+        avt_buffer_unref(&abuf);
+    }
+
+#ifdef COUNT_ALLOCS
+    {
+        fprintf(stderr, "Testing allocation counts...\n");
+        ret = test_alloc_count(pool);
+        if (ret < 0)
+            goto end;
+    }
+#endif
+
+    {
+        fprintf(stderr, "Testing freeing the pool before its buffers...\n");
+        if (!avt_buffer_pool_quick_alloc(pool, &buf, 4096)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        avt_buffer_pool_free(&pool);
+
+        memset(avt_buffer_get_data(&buf, NULL), 0, 4096);
+        avt_buffer_quick_unref(&buf);
+    }
+
+end:
+    avt_buffer_quick_unref(&buf);
+    avt_buffer_quick_unref(&ref);
+    avt_buffer_pool_free(&pool);
+    if (ret < 0)
+        fprintf(stderr, "Error: %i\n", ret);
+    return AVT_ERROR(ret);
+}
@@ -0,0 +1,371 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TIMER_UNIT "cycles"
+#else
+#define TIMER_UNIT "ns"
+#endif
+
+#include "ldpc.h"
+#include "cpu.h"
+#include "utils_internal.h"
+
+/* Checks every dispatchable kernel against its C version, at each level
+ * the CPU supports. Run with --bench to time them, --seed=N to repeat
+ * a failed run, and --test=name to only check functions with that prefix. */
+
+#define FUZZ_ITER 64
+#define MAX_MSG 256
+#define MAX_BLOCKS 12
+#define MAX_PKT (MAX_MSG + MAX_BLOCKS*8)
+#define GUARD 64
+#define BENCH_RUNS 16
+#define BENCH_CALLS 256
+
+static const struct {
+    const char *name;
+    unsigned flags;
+} cpu_levels[] = {
+    { "c", 0 },
+    { "sse4", AVT_CPU_FLAG_SSE4 },
+    { "avx2", AVT_CPU_FLAG_SSE4 | AVT_CPU_FLAG_AVX2 },
+    { "avx512", AVT_CPU_FLAG_SSE4 | AVT_CPU_FLAG_AVX2 | AVT_CPU_FLAG_AVX512 },
+    { "neon", AVT_CPU_FLAG_NEON },
+};
+
+/* Sizes of the header codes, which get benchmarked */
+static const struct {
+    const char *name;
+    int msg, blocks;
+} codes[] = {
+    { "288_224", 224/8, 64/64 },
+    { "2784_2016", 2016/8, 768/64 },
+};
+
+static struct {
+    bool bench;
+    const char *filter;
+    uint64_t seed;
+    uint64_t rng;
+    int nb_checked;
+    int nb_failed;
+    uint64_t *H;
+} state;
+
+static uint64_t rng(void)
+{
+    state.rng ^= state.rng << 13;
+    state.rng ^= state.rng >> 7;
+    state.rng ^= state.rng << 17;
+    return state.rng;
+}
+
+static void rand_fill(void *dst, size_t len)
+{
+    uint8_t *d = dst;
+    for (size_t i = 0; i < len; i++)
+        d[i] = rng();
+}
+
+static void rand_sizes(int iter, int *msg, int *blocks)
+{
+    if (iter < AVT_ARRAY_ELEMS(codes)) {
+        *msg = codes[iter].msg;
+        *blocks = codes[iter].blocks;
+    } else {
+        *msg = 1 + rng() % MAX_MSG;
+        *blocks = 1 + rng() % MAX_BLOCKS;
+    }
+
+    rand_fill(state.H, (*msg*8 + *blocks*64) * *blocks * sizeof(*state.H));
+}
+
+static uint64_t timer(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void report(const char *fn, const char *level, bool ok)
+{
+    state.nb_checked++;
+    if (!ok)
+        state.nb_failed++;
+    printf("%-16s %-8s %s\n", fn, level, ok ? "OK" : "FAILED");
+}
+
+/* Lowest of several runs, to filter out interruptions */
+#define BENCH(fn, level, code, call)                                      \
+    do {                                                                  \
+        uint64_t best = UINT64_MAX;                                       \
+        for (int r = 0; r < BENCH_RUNS; r++) {                            \
+            uint64_t t0 = timer();                                        \
+            for (int c = 0; c < BENCH_CALLS; c++)                         \
+                call;                                                     \
+            uint64_t t = timer() - t0;                                    \
+            best = AVT_MIN(best, t);                                      \
+        }                                                                 \
+        printf("  %s_%s_%s: %.1f " TIMER_UNIT "/call\n", fn, code, level, \
+               (double)best / BENCH_CALLS);                               \
+    } while (0)
+
+static bool check_encode(const AVTLDPCDSP *ref, const AVTLDPCDSP *dsp)
+{
+    alignas(64) uint8_t src[MAX_PKT + GUARD];
+    alignas(64) uint8_t a[MAX_PKT + GUARD];
+    alignas(64) uint8_t b[MAX_PKT + GUARD];
+
+    for (int i = 0; i < FUZZ_ITER; i++) {
+        int msg, blocks;
+        rand_sizes(i, &msg, &blocks);
+        rand_fill(src, sizeof(src));
+
+        /* The parity and anything past it must be overwritten, or kept */
+        memcpy(a, src, sizeof(a));
+        memcpy(b, src, sizeof(b));
+        ref->encode(a, state.H, msg, blocks);
+        dsp->encode(b, state.H, msg, blocks);
+        if (memcmp(a, b, sizeof(a))) {
+            fprintf(stderr, "encode: mismatch for %i bytes, %i blocks\n",
+                    msg, blocks);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool check_encode_x4(const AVTLDPCDSP *ref, const AVTLDPCDSP *dsp)
+{
+    alignas(64) uint8_t a[4][MAX_PKT + GUARD];
+    alignas(64) uint8_t b[4][MAX_PKT + GUARD];
+    uint8_t *dst[4] = { b[0], b[1], b[2], b[3] };
+
+    for (int i = 0; i < FUZZ_ITER; i++) {
+        int msg, blocks;
+        rand_sizes(i, &msg, &blocks);
+        rand_fill(a, sizeof(a));
+        memcpy(b, a, sizeof(b));
+
+        for (int k = 0; k < 4; k++)
+            ref->encode(a[k], state.H, msg, blocks);
+        dsp->encode_x4(dst, state.H, msg, blocks);
+        if (memcmp(a, b, sizeof(a))) {
+            fprintf(stderr, "encode_x4: mismatch for %i bytes, %i blocks\n",
+                    msg, blocks);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool check_syndrome(const AVTLDPCDSP *ref, const AVTLDPCDSP *dsp)
+{
+    alignas(64) uint8_t pkt[MAX_PKT];
+    uint64_t a[MAX_BLOCKS + 1];
+    uint64_t b[MAX_BLOCKS + 1];
+
+    for (int i = 0; i < FUZZ_ITER; i++) {
+        int msg, blocks;
+        rand_sizes(i, &msg, &blocks);
+        rand_fill(pkt, sizeof(pkt));
+
+        /* Every other packet is a valid codeword, with 0 or 1 bit flipped */
+        if (i & 1) {
+            ref->encode(pkt, state.H, msg, blocks);
+            if (i & 2) {
+                int bit = rng() % ((msg + blocks*8)*8);
+                pkt[bit >> 3] ^= 1 << (bit & 7);
+            }
+        }
+
+        rand_fill(a, sizeof(a));
+        memcpy(b, a, sizeof(b));
+        int ret_a = ref->syndrome(a, pkt, state.H, msg, blocks);
+        int ret_b = dsp->syndrome(b, pkt, state.H, msg, blocks);
+        if (!ret_a != !ret_b || memcmp(a, b, sizeof(a))) {
+            fprintf(stderr, "syndrome: mismatch for %i bytes, %i blocks\n",
+                    msg, blocks);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void bench_ldpc(const char *level, const AVTLDPCDSP *dsp,
+                       const void *fn)
+{
+    alignas(64) uint8_t pkt[4][MAX_PKT];
+    uint8_t *dst[4] = { pkt[0], pkt[1], pkt[2], pkt[3] };
+    uint64_t syn[MAX_BLOCKS];
+    rand_fill(pkt, sizeof(pkt));
+
+    for (int i = 0; i < AVT_ARRAY_ELEMS(codes); i++) {
+        int msg = codes[i].msg, blocks = codes[i].blocks;
+        rand_fill(state.H, (msg*8 + blocks*64) * blocks * sizeof(*state.H));
+
+        if (fn == dsp->encode)
+            BENCH("ldpc_encode", level, codes[i].name,
+                  dsp->encode(pkt[0], state.H, msg, blocks));
+        else if (fn == dsp->encode_x4)
+            BENCH("ldpc_encode_x4", level, codes[i].name,
+                  dsp->encode_x4(dst, state.H, msg, blocks));
+        else if (fn == dsp->syndrome)
+            BENCH("ldpc_syndrome", level, codes[i].name,
+                  dsp->syndrome(syn, pkt[0], state.H, msg, blocks));
+    }
+}
+
+/* Dispatchable functions, in the order of their DSP structure */
+static const struct {
+    const char *name;
+    size_t offset;
+    bool (*check)(const AVTLDPCDSP *ref, const AVTLDPCDSP *dsp);
+} ldpc_funcs[] = {
+    { "ldpc_encode", offsetof(AVTLDPCDSP, encode), check_encode },
+    { "ldpc_encode_x4", offsetof(AVTLDPCDSP, encode_x4), check_encode_x4 },
+    { "ldpc_syndrome", offsetof(AVTLDPCDSP, syndrome), check_syndrome },
+};
+
+static const void *dsp_func(const AVTLDPCDSP *dsp, int idx)
+{
+    const void *fn;
+    memcpy(&fn, (const uint8_t *)dsp + ldpc_funcs[idx].offset, sizeof(fn));
+    return fn;
+}
+
+static void check_ldpc(void)
+{
+    AVTLDPCDSP ref, dsp;
+    avt_ldpc_dsp_init(&ref, 0);
+
+    for (int f = 0; f < AVT_ARRAY_ELEMS(ldpc_funcs); f++) {
+        const char *name = ldpc_funcs[f].name;
+        if (state.filter && strncmp(name, state.filter, strlen(state.filter)))
+            continue;
+
+        /* A level may keep the kernel of the one below it */
+        const void *prev = NULL;
+        for (int l = 0; l < AVT_ARRAY_ELEMS(cpu_levels); l++) {
+            unsigned flags = cpu_levels[l].flags;
+            if ((avt_cpu_detect() & flags) != flags)
+                continue;
+
+            avt_ldpc_dsp_init(&dsp, flags);
+            const void *fn = dsp_func(&dsp, f);
+            if (!fn || fn == prev)
+                continue;
+            prev = fn;
+
+            if (fn != dsp_func(&ref, f)) {
+                state.rng = state.seed;
+                report(name, cpu_levels[l].name,
+                       ldpc_funcs[f].check(&ref, &dsp));
+            }
+
+            if (state.bench)
+                bench_ldpc(cpu_levels[l].name, &dsp, fn);
+        }
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*check)(void);
+} groups[] = {
+    { "ldpc", check_ldpc },
+};
+
+int main(int argc, char **argv)
+{
+    state.seed = time(NULL);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--bench")) {
+            state.bench = true;
+        } else if (!strncmp(argv[i], "--seed=", 7)) {
+            state.seed = strtoull(argv[i] + 7, NULL, 0);
+        } else if (!strncmp(argv[i], "--test=", 7)) {
+            state.filter = argv[i] + 7;
+        } else {
+            fprintf(stderr, "Usage: %s [--bench] [--seed=N] [--test=name]\n",
+                    argv[0]);
+            return AVT_ERROR(EINVAL);
+        }
+    }
+
+    /* Xorshift has no zero state */
+    state.seed |= 1;
+
+    state.H = aligned_alloc(64, (MAX_MSG*8 + MAX_BLOCKS*64) * MAX_BLOCKS *
+                                sizeof(*state.H));
+    if (!state.H)
+        return AVT_ERROR(ENOMEM);
+
+    printf("CPU flags: 0x%x, seed: %llu\n", avt_cpu_detect(),
+           (unsigned long long)state.seed);
+
+    for (int i = 0; i < AVT_ARRAY_ELEMS(groups); i++)
+        groups[i].check();
+
+    free(state.H);
+
+    if (state.nb_failed) {
+        printf("%i of %i tests failed, rerun with --seed=%llu\n",
+               state.nb_failed, state.nb_checked,
+               (unsigned long long)state.seed);
+        return 1;
+    }
+
+    /* Nothing was compared, which must not pass as a success */
+    if (!state.nb_checked && !state.bench) {
+        printf("No kernels differ from C, skipping\n");
+        return 77;
+    }
+
+    printf("All %i tests passed\n", state.nb_checked);
+    return 0;
+}
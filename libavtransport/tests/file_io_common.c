@@ -26,6 +26,7 @@
 
 #include <string.h>
 #include <inttypes.h>
+#include <unistd.h>
 
 #include "file_io_common.h"
 
@@ -55,7 +56,7 @@ static int read_fn(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx,
     }
 
     /* Check data read */
-    if (memcmp(test_buf_data, test_pkt->hdr, test_buf_size)) {
+    if (memcmp(test_buf_data, test_pkt->hdr.data, test_buf_size)) {
         avt_log(avt, AVT_LOG_ERROR, "Mismatch between read and written data!\n");
         avt_buffer_unref(&buf);
         return AVT_ERROR(EINVAL);
@@ -73,10 +74,17 @@ int file_io_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
     int64_t sum = 0;
     AVTPktd test_pkt[16] = { };
     for (int i = 0; i < AVT_ARRAY_ELEMS(test_pkt); i++) {
-        test_pkt[i].hdr_len = sizeof(test_pkt[i].hdr);
+        uint8_t *hdr = avt_buffer_quick_alloc(&test_pkt[i].hdr,
+                                              AVT_MAX_HEADER_LEN);
+        if (!hdr) {
+            ret = AVT_ERROR(ENOMEM);
+            goto fail;
+        }
+
+        test_pkt[i].hdr_len = AVT_MAX_HEADER_LEN;
         sum += test_pkt[i].hdr_len;
         for (int j = 0; j < test_pkt[i].hdr_len; j++)
-            test_pkt[i].hdr[j] = (i + j) & 0xFF;
+            hdr[j] = (i + j) & 0xFF;
     }
 
     ret = io->write_vec(io_ctx, test_pkt, AVT_ARRAY_ELEMS(test_pkt),
@@ -121,7 +129,7 @@ int file_io_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
 
         size_t test_buf_size;
         uint8_t *test_buf_data = avt_buffer_get_data(buf, &test_buf_size);
-        if (memcmp(test_buf_data, test_pkt[i].hdr, test_buf_size)) {
+        if (memcmp(test_buf_data, test_pkt[i].hdr.data, test_buf_size)) {
             avt_log(avt, AVT_LOG_ERROR,"Mismatch between read and written data!\n");
             avt_buffer_unref(&buf);
             goto fail;
@@ -147,7 +155,7 @@ int file_io_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
 
     /* Rewrite test */
     for (int i = 0; i < test_pkt[0].hdr_len; i++)
-        test_pkt[0].hdr[i] = ~test_pkt[0].hdr[i];
+        test_pkt[0].hdr.data[i] = ~test_pkt[0].hdr.data[i];
 
     ret = io->rewrite(io_ctx, &test_pkt[0], 0,
                       INT64_MAX);
@@ -162,5 +170,75 @@ int file_io_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
     ret = 0;
 
 fail:
+    for (int i = 0; i < AVT_ARRAY_ELEMS(test_pkt); i++)
+        avt_buffer_quick_unref(&test_pkt[i].hdr);
+    return ret;
+}
+
+#define SYNC_PKT_SIZE (16*1024)
+#define SYNC_NB_PKTS 64
+#define SYNC_BYTES (SYNC_PKT_SIZE*16)
+
+int file_sync_test(AVTContext *avt, const AVTIO *io, const char *path)
+{
+    int64_t ret;
+    AVTIOCtx *io_ctx;
+    AVTIOStats stats;
+    AVTAddress addr = { .path = (char *)path };
+    addr.opts.sync_bytes = SYNC_BYTES;
+
+    unlink(path);
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret < 0)
+        return ret;
+
+    AVTPktd p = { };
+    if (!avt_buffer_quick_alloc(&p.hdr, SYNC_PKT_SIZE)) {
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+    p.hdr_len = SYNC_PKT_SIZE;
+
+    for (int i = 0; i < SYNC_NB_PKTS; i++) {
+        memset(p.hdr.data, i, SYNC_PKT_SIZE);
+        ret = io->write_pkt(io_ctx, &p, INT64_MAX);
+        if (ret < 0)
+            goto end;
+    }
+
+    /* All packets are synced in groups of SYNC_BYTES */
+    io->get_stats(io_ctx, &stats);
+    if ((stats.nb_syncs != (SYNC_NB_PKTS*SYNC_PKT_SIZE / SYNC_BYTES)) ||
+        (stats.sync_bytes != SYNC_NB_PKTS*SYNC_PKT_SIZE) ||
+        (stats.sync_time < stats.sync_time_max)) {
+        avt_log(avt, AVT_LOG_ERROR, "Unexpected sync stats: %" PRIu64 " syncs, "
+                "%" PRIu64 " bytes\n", stats.nb_syncs, stats.sync_bytes);
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    /* Rewrites count towards the next sync, which a flush forces */
+    ret = io->rewrite(io_ctx, &p, 0, INT64_MAX);
+    if (ret >= 0)
+        ret = io->flush(io_ctx, INT64_MAX);
+    if (ret < 0)
+        goto end;
+
+    io->get_stats(io_ctx, &stats);
+    if (stats.sync_bytes != (SYNC_NB_PKTS + 1)*SYNC_PKT_SIZE) {
+        avt_log(avt, AVT_LOG_ERROR, "Rewrite not synced on flush\n");
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    avt_buffer_quick_unref(&p.hdr);
+    if (ret < 0)
+        io->close(&io_ctx);
+    else
+        ret = io->close(&io_ctx);
+    unlink(path);
     return ret;
 }
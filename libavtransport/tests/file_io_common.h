@@ -31,4 +31,7 @@
 
 int file_io_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx);
 
+/* Opens its own context at path, with a durability policy */
+int file_sync_test(AVTContext *avt, const AVTIO *io, const char *path);
+
 #endif /* TEST_FILE_IO_COMMON_H */
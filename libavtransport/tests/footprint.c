@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "reorder.h"
+#include "output_internal.h"
+
+/* Upper bound for any per-connection or per-sender object, before
+ * any stream is used */
+#define FOOTPRINT_MAX (64*1024)
+
+/* Upper bound for a packet, which gets copied around in FIFOs,
+ * not including its out of line header */
+#define PKTD_MAX 512
+
+static int report(const char *name, size_t size, size_t stream_size)
+{
+    /* The first stream in a page also allocates the page */
+    const size_t page_size = AVT_SPARSE_PAGE_SIZE*sizeof(void *);
+
+    fprintf(stderr, "    %s: %zu bytes, +%zu bytes per stream "
+                    "(+%zu bytes per page of %i streams)\n",
+            name, size, stream_size, page_size, AVT_SPARSE_PAGE_SIZE);
+
+    if (size > FOOTPRINT_MAX) {
+        fprintf(stderr, "    %s is larger than %i bytes!\n",
+                name, FOOTPRINT_MAX);
+        return AVT_ERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    int ret;
+
+    {
+        fprintf(stderr, "Testing per-object footprint...\n");
+        ret = report("AVTScheduler", sizeof(AVTScheduler),
+                     sizeof(AVTSchedulerStream));
+        if (ret < 0)
+            goto end;
+
+        fprintf(stderr, "    AVTScheduler bandwidth window: %zu bytes\n",
+                AVT_SCHEDULER_WINDOW_ENTRIES*sizeof(struct AVTSlidingWinEntry));
+
+        fprintf(stderr, "    AVTPktd: %zu bytes, +%i bytes per header\n",
+                sizeof(AVTPktd), AVT_MAX_HEADER_LEN);
+        if (sizeof(AVTPktd) > PKTD_MAX) {
+            fprintf(stderr, "    AVTPktd is larger than %i bytes!\n", PKTD_MAX);
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+
+        ret = report("AVTReorder", sizeof(AVTReorder),
+                     sizeof(AVTReorderStream));
+        if (ret < 0)
+            goto end;
+
+        ret = report("AVTSender", sizeof(AVTSender),
+                     sizeof(AVTStream) + sizeof(AVTStreamPriv));
+        if (ret < 0)
+            goto end;
+    }
+
+    {
+        fprintf(stderr, "Testing sparse stream allocation...\n");
+        AVTSender *s = NULL;
+        AVTSenderOptions opts = { };
+
+        ret = avt_send_open(NULL, &s, NULL, &opts);
+        if (ret < 0)
+            goto end;
+
+        const uint16_t ids[] = { 0, 1, 0x1234, 0xFFFE };
+        for (int i = 0; i < sizeof(ids)/sizeof(*ids); i++) {
+            AVTStream *st = avt_send_stream_add(s, ids[i]);
+            if (!st || (st->id != ids[i])) {
+                ret = AVT_ERROR(EINVAL);
+                break;
+            }
+        }
+
+        /* Already active */
+        if (!ret && avt_send_stream_add(s, 0x1234))
+            ret = AVT_ERROR(EINVAL);
+
+        avt_send_close(&s);
+    }
+
+end:
+    return AVT_ERROR(ret);
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avtransport/avtransport.h>
+#include "io_common.h"
+#include "utils_internal.h"
+
+#include "file_io_common.h"
+
+extern const AVTIO avt_io_direct_path;
+extern const AVTIO avt_io_fd_path;
+
+#define RMW_PKT_SIZE 3000
+#define RMW_NB_PKTS 1024
+
+static int check_pkt(const AVTIO *io, AVTIOCtx *io_ctx, avt_pos off, uint8_t val)
+{
+    AVTBuffer buf = { };
+    if (!avt_buffer_quick_alloc(&buf, RMW_PKT_SIZE))
+        return AVT_ERROR(ENOMEM);
+
+    int64_t ret = io->seek(io_ctx, off);
+    if (ret >= 0)
+        ret = io->read_input(io_ctx, &buf, RMW_PKT_SIZE, INT64_MAX, 0x0);
+    if (ret < 0)
+        goto end;
+
+    size_t len;
+    uint8_t *data = avt_buffer_get_data(&buf, &len);
+    ret = len != RMW_PKT_SIZE ? AVT_ERROR(EINVAL) : 0;
+    for (int i = 0; !ret && i < len; i++)
+        if (data[i] != val)
+            ret = AVT_ERROR(EINVAL);
+
+end:
+    avt_buffer_quick_unref(&buf);
+    return ret;
+}
+
+/* Write across several blocks, with unaligned packets, then rewrite
+ * packets already on disk, and in the block still being filled */
+static int rmw_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
+{
+    int64_t ret;
+    avt_pos first = 0, last = 0;
+    AVTPktd p = { };
+
+    if (!avt_buffer_quick_alloc(&p.hdr, RMW_PKT_SIZE))
+        return AVT_ERROR(ENOMEM);
+    p.hdr_len = RMW_PKT_SIZE;
+
+    for (int i = 0; i < RMW_NB_PKTS; i++) {
+        memset(p.hdr.data, i & 0xFF, RMW_PKT_SIZE);
+        ret = io->write_pkt(io_ctx, &p, INT64_MAX);
+        if (ret < 0)
+            goto end;
+        else if (!i)
+            first = ret;
+        last = ret;
+    }
+
+    memset(p.hdr.data, 0xAA, RMW_PKT_SIZE);
+    ret = io->rewrite(io_ctx, &p, first, INT64_MAX);
+    if (ret >= 0)
+        ret = io->rewrite(io_ctx, &p, last, INT64_MAX);
+    if (ret < 0)
+        goto end;
+
+    ret = io->flush(io_ctx, INT64_MAX);
+    if (ret >= 0)
+        ret = check_pkt(io, io_ctx, first, 0xAA);
+    if (ret >= 0)
+        ret = check_pkt(io, io_ctx, first + RMW_PKT_SIZE, 1);
+    if (ret >= 0)
+        ret = check_pkt(io, io_ctx, last, 0xAA);
+    if (ret >= 0)
+        ret = check_pkt(io, io_ctx, last - RMW_PKT_SIZE, (RMW_NB_PKTS - 2) & 0xFF);
+    if (ret < 0)
+        avt_log(avt, AVT_LOG_ERROR, "Mismatch after rewriting!\n");
+
+end:
+    avt_buffer_quick_unref(&p.hdr);
+    return ret;
+}
+
+/* Write a large file, and compare wall clock and CPU time */
+static int bench_write(AVTContext *avt, const AVTIO *io, size_t pl_size)
+{
+    int64_t ret;
+    const size_t total = 256 << 20;
+    const int nb_pkt = 64;
+    AVTPktd pkt[64] = { };
+    AVTIOCtx *io_ctx;
+    AVTAddress addr = { .path = "io_direct_bench.avt" };
+    addr.opts.direct_io = true;
+
+    unlink(addr.path);
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret < 0) {
+        printf("Unable to create bench file with %s\n", io->name);
+        return ret;
+    }
+
+    AVTBuffer pl = { };
+    if (!avt_buffer_quick_alloc(&pl, pl_size)) {
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+    memset(pl.data, 0xAA, pl_size);
+
+    for (int i = 0; i < nb_pkt; i++) {
+        uint8_t *hdr = avt_buffer_quick_alloc(&pkt[i].hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(hdr, i, AVT_MAX_HEADER_LEN);
+        pkt[i].hdr_len = 64;
+        avt_buffer_quick_ref(&pkt[i].pl, &pl, 0, AVT_BUFFER_REF_ALL);
+    }
+
+    const size_t batch = nb_pkt*(64 + pl_size);
+    clock_t c = clock();
+    int64_t t = avt_get_time_ns();
+    for (size_t done = 0; done < total; done += batch) {
+        ret = io->write_vec(io_ctx, pkt, nb_pkt, INT64_MAX);
+        if (ret < 0)
+            goto end;
+    }
+    ret = io->flush(io_ctx, INT64_MAX);
+    if (ret < 0)
+        goto end;
+    t = avt_get_time_ns() - t;
+    c = clock() - c;
+
+    printf("    %-12s %6zu byte payloads: %8.1f MiB/s, %6.1f ms CPU\n",
+           io->name, pl_size, ((double)total / (1 << 20)) / (t / 1000000000.0),
+           1000.0*c / CLOCKS_PER_SEC);
+
+end:
+    for (int i = 0; i < nb_pkt; i++) {
+        avt_buffer_quick_unref(&pkt[i].hdr);
+        avt_buffer_quick_unref(&pkt[i].pl);
+    }
+    avt_buffer_quick_unref(&pl);
+    io->close(&io_ctx);
+    unlink(addr.path);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t ret;
+
+    /* Open context */
+    AVTContext *avt;
+    ret = avt_init(&avt, NULL);
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    if ((argc > 1) && !strcmp(argv[1], "bench")) {
+        const AVTIO *list[] = { &avt_io_direct_path, &avt_io_fd_path };
+        const size_t pl_sizes[] = { 1024, 65536 };
+
+        printf("Benchmarking direct I/O writing...\n");
+        for (int i = 0; i < AVT_ARRAY_ELEMS(pl_sizes); i++) {
+            for (int j = 0; j < AVT_ARRAY_ELEMS(list); j++) {
+                ret = bench_write(avt, list[j], pl_sizes[i]);
+                if (ret < 0)
+                    break;
+            }
+        }
+
+        avt_close(&avt);
+        return AVT_ERROR(ret);
+    }
+
+    /* Open io context */
+    const AVTIO *io = &avt_io_direct_path;
+    AVTIOCtx *io_ctx;
+    AVTAddress addr = { .path = "io_direct_test.avt" };
+    addr.opts.direct_io = true;
+
+    unlink(addr.path);
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret == AVT_ERROR(ENOMEM)) {
+        avt_close(&avt);
+        return AVT_ERROR(ret);
+    } else if (ret < 0) {
+        /* Not all filesystems support direct I/O */
+        printf("Direct I/O unavailable, skipping\n");
+        avt_close(&avt);
+        return 77;
+    }
+
+    ret = file_io_test(avt, io, io_ctx);
+    if (!ret)
+        ret = rmw_test(avt, io, io_ctx);
+
+    if (ret)
+        io->close(&io_ctx);
+    else
+        ret = io->close(&io_ctx);
+    avt_close(&avt);
+    return AVT_ERROR(ret);
+}
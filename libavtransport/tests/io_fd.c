@@ -25,14 +25,125 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
 
 #include <avtransport/avtransport.h>
 #include "io_common.h"
 
 #include "file_io_common.h"
 
+extern const AVTIO avt_io_fd;
 extern const AVTIO avt_io_fd_path;
 
+#define PIPE_NB_PKTS 16
+
+/* Pipes have no offsets, so writes must go in order */
+static int pipe_test(AVTContext *avt)
+{
+    int64_t ret;
+    int p[2];
+    AVTPktd pkt[PIPE_NB_PKTS] = { };
+    uint8_t out[PIPE_NB_PKTS*(8 + 256)];
+    size_t size = 0;
+
+    if (pipe(p) < 0)
+        return AVT_ERROR(errno);
+
+    const AVTIO *io = &avt_io_fd;
+    AVTIOCtx *io_ctx;
+    AVTAddress addr = { .fd = p[1] };
+
+    ret = io->init(avt, &io_ctx, &addr);
+    close(p[1]);
+    if (ret < 0) {
+        close(p[0]);
+        return ret;
+    }
+
+    for (int i = 0; i < PIPE_NB_PKTS; i++) {
+        size_t pl_len = (i & 1) ? 0 : 256 - i;
+        if (!avt_buffer_quick_alloc(&pkt[i].hdr, 8) ||
+            (pl_len && !avt_buffer_quick_alloc(&pkt[i].pl, pl_len))) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        pkt[i].hdr_len = 8;
+        memset(pkt[i].hdr.data, i, 8);
+        memcpy(&out[size], pkt[i].hdr.data, 8);
+        size += 8;
+
+        if (pl_len) {
+            memset(pkt[i].pl.data, ~i, pl_len);
+            memcpy(&out[size], pkt[i].pl.data, pl_len);
+            size += pl_len;
+        }
+    }
+
+    ret = io->write_vec(io_ctx, pkt, PIPE_NB_PKTS, INT64_MAX);
+    if (ret != 0) {
+        printf("Wrong offset returned: %" PRIi64 "\n", ret);
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    ret = io->write_pkt(io_ctx, &pkt[0], INT64_MAX);
+    if (ret != size) {
+        printf("Wrong offset returned: %" PRIi64 "\n", ret);
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    /* Must fail, rather than append the packet again */
+    ret = io->rewrite(io_ctx, &pkt[0], 0, INT64_MAX);
+    if (ret != AVT_ERROR(ESPIPE)) {
+        printf("Rewriting a pipe did not fail: %" PRIi64 "\n", ret);
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    /* Nothing to sync, but flushing must still work */
+    ret = io->flush(io_ctx, INT64_MAX);
+    if (ret < 0) {
+        printf("Flushing a pipe failed: %" PRIi64 "\n", ret);
+        goto end;
+    }
+
+    AVTIOStats stats;
+    io->get_stats(io_ctx, &stats);
+    if (stats.nb_syncs) {
+        printf("Flushing a pipe counted a sync\n");
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    uint8_t in[sizeof(out) + 8 + 256];
+    size_t in_size = 0;
+    while (in_size < (size + 8 + 256)) {
+        ssize_t r = read(p[0], &in[in_size], sizeof(in) - in_size);
+        if (r <= 0)
+            break;
+        in_size += r;
+    }
+
+    if ((in_size != (size + 8 + 256)) || memcmp(in, out, size) ||
+        memcmp(&in[size], out, 8 + 256)) {
+        printf("Mismatch between written and read data\n");
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    for (int i = 0; i < PIPE_NB_PKTS; i++)
+        avt_pktd_unref(&pkt[i]);
+    io->close(&io_ctx);
+    close(p[0]);
+    return ret;
+}
+
 int main(void)
 {
     int64_t ret;
@@ -56,6 +167,10 @@ int main(void)
     }
 
     ret = file_io_test(avt, io, io_ctx);
+    if (ret >= 0)
+        ret = pipe_test(avt);
+    if (!ret)
+        ret = file_sync_test(avt, &avt_io_fd_path, "io_fd_sync.avt");
 
     if (ret)
         io->close(&io_ctx);
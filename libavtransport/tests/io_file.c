@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include <avtransport/avtransport.h>
 #include "io_common.h"
@@ -34,6 +35,95 @@
 /* Always available, on all platforms */
 extern const AVTIO avt_io_file;
 
+/* Mixed small and large payloads, written with coalescing enabled */
+static int coalesce_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
+{
+    int64_t ret;
+    size_t total = 0;
+    AVTPktd pkt[32] = { };
+
+    for (int i = 0; i < AVT_ARRAY_ELEMS(pkt); i++) {
+        size_t pl_len = (i % 4) == 3 ? 8192 : i*7;
+        uint8_t *hdr = avt_buffer_quick_alloc(&pkt[i].hdr, AVT_MAX_HEADER_LEN);
+        uint8_t *pl = pl_len ? avt_buffer_quick_alloc(&pkt[i].pl, pl_len) : NULL;
+        if (!hdr || (pl_len && !pl)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto fail;
+        }
+
+        pkt[i].hdr_len = 36 + (i & 1)*(AVT_MAX_HEADER_LEN - 36);
+        for (int j = 0; j < pkt[i].hdr_len; j++)
+            hdr[j] = (i*3 + j) & 0xFF;
+        for (int j = 0; j < pl_len; j++)
+            pl[j] = (i*5 + j) & 0xFF;
+
+        total += pkt[i].hdr_len + pl_len;
+    }
+
+    /* Send half as single packets, to cover both paths */
+    avt_pos start = io->write_vec(io_ctx, pkt, AVT_ARRAY_ELEMS(pkt)/2, INT64_MAX);
+    if (start < 0) {
+        ret = start;
+        goto fail;
+    }
+    for (int i = AVT_ARRAY_ELEMS(pkt)/2; i < AVT_ARRAY_ELEMS(pkt); i++) {
+        ret = io->write_pkt(io_ctx, &pkt[i], INT64_MAX);
+        if (ret < 0)
+            goto fail;
+    }
+
+    ret = io->flush(io_ctx, INT64_MAX);
+    if (ret < 0)
+        goto fail;
+
+    ret = io->seek(io_ctx, start);
+    if (ret < 0)
+        goto fail;
+
+    AVTBuffer *buf = avt_buffer_alloc(total);
+    if (!buf) {
+        ret = AVT_ERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = io->read_input(io_ctx, buf, total, INT64_MAX, 0x0);
+    if (ret < 0) {
+        avt_buffer_unref(&buf);
+        goto fail;
+    }
+
+    size_t len;
+    uint8_t *data = avt_buffer_get_data(buf, &len);
+    if (len != total) {
+        avt_log(avt, AVT_LOG_ERROR, "Short read: got %zu; wanted %zu\n",
+                len, total);
+        avt_buffer_unref(&buf);
+        ret = AVT_ERROR(EINVAL);
+        goto fail;
+    }
+
+    for (int i = 0; i < AVT_ARRAY_ELEMS(pkt); i++) {
+        size_t pl_len;
+        uint8_t *pl = avt_buffer_get_data(&pkt[i].pl, &pl_len);
+        if (memcmp(data, pkt[i].hdr.data, pkt[i].hdr_len) ||
+            (pl_len && memcmp(data + pkt[i].hdr_len, pl, pl_len))) {
+            avt_log(avt, AVT_LOG_ERROR, "Mismatch in packet %i!\n", i);
+            avt_buffer_unref(&buf);
+            ret = AVT_ERROR(EINVAL);
+            goto fail;
+        }
+        data += pkt[i].hdr_len + pl_len;
+    }
+
+    avt_buffer_unref(&buf);
+    ret = 0;
+
+fail:
+    for (int i = 0; i < AVT_ARRAY_ELEMS(pkt); i++)
+        avt_pktd_unref(&pkt[i]);
+    return ret;
+}
+
 int main(void)
 {
     int64_t ret;
@@ -49,19 +139,33 @@ int main(void)
     AVTIOCtx *io_ctx;
     AVTAddress addr = { .path = "io_file_test.avt" };
 
-    ret = io->init(avt, &io_ctx, &addr);
-    if (ret < 0) {
-        printf("Unable to create test file: %s\n", addr.path);
-        avt_close(&avt);
-        return AVT_ERROR(ret);
-    }
+    for (int i = 0; i < 2; i++) {
+        /* Second run coalesces writes */
+        addr.opts.coalesce = i ? 4096 : 0;
 
-    ret = file_io_test(avt, io, io_ctx);
+        ret = io->init(avt, &io_ctx, &addr);
+        if (ret < 0) {
+            printf("Unable to create test file: %s\n", addr.path);
+            avt_close(&avt);
+            return AVT_ERROR(ret);
+        }
 
-    if (ret)
-        io->close(&io_ctx);
-    else
+        ret = file_io_test(avt, io, io_ctx);
+        if (!ret && i)
+            ret = coalesce_test(avt, io, io_ctx);
+
+        if (ret) {
+            io->close(&io_ctx);
+            break;
+        }
         ret = io->close(&io_ctx);
+        if (ret)
+            break;
+    }
+
+    if (!ret)
+        ret = file_sync_test(avt, io, "io_file_sync.avt");
+
     avt_close(&avt);
     return AVT_ERROR(ret);
 }
@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include <avtransport/avtransport.h>
 #include "io_common.h"
@@ -33,6 +34,68 @@
 
 extern const AVTIO avt_io_mmap_path;
 
+#define GROW_PKT_SIZE (32*1024)
+#define GROW_NB_PKTS 2048
+
+static int check_pkt(const AVTIO *io, AVTIOCtx *io_ctx, avt_pos off, uint8_t val)
+{
+    AVTBuffer buf = { };
+    int64_t ret = io->seek(io_ctx, off);
+    if (ret < 0)
+        return ret;
+
+    ret = io->read_input(io_ctx, &buf, GROW_PKT_SIZE, INT64_MAX, 0x0);
+    if (ret < 0)
+        return ret;
+
+    size_t len;
+    uint8_t *data = avt_buffer_get_data(&buf, &len);
+    ret = len != GROW_PKT_SIZE ? AVT_ERROR(EINVAL) : 0;
+    for (int i = 0; !ret && i < len; i++)
+        if (data[i] != val)
+            ret = AVT_ERROR(EINVAL);
+
+    avt_buffer_quick_unref(&buf);
+    return ret;
+}
+
+/* Grow the file well past its initial allocation, then rewrite the start */
+static int grow_test(AVTContext *avt, const AVTIO *io, AVTIOCtx *io_ctx)
+{
+    int64_t ret;
+    avt_pos start = 0;
+    AVTPktd p = { };
+
+    if (!avt_buffer_quick_alloc(&p.hdr, GROW_PKT_SIZE))
+        return AVT_ERROR(ENOMEM);
+    p.hdr_len = GROW_PKT_SIZE;
+
+    for (int i = 0; i < GROW_NB_PKTS; i++) {
+        memset(p.hdr.data, i & 0xFF, GROW_PKT_SIZE);
+        ret = io->write_pkt(io_ctx, &p, INT64_MAX);
+        if (ret < 0)
+            goto end;
+        else if (!i)
+            start = ret;
+    }
+
+    memset(p.hdr.data, 0xAA, GROW_PKT_SIZE);
+    ret = io->rewrite(io_ctx, &p, start, INT64_MAX);
+    if (ret < 0)
+        goto end;
+
+    ret = check_pkt(io, io_ctx, start, 0xAA);
+    if (ret >= 0)
+        ret = check_pkt(io, io_ctx, start + (GROW_NB_PKTS - 1)*GROW_PKT_SIZE,
+                        (GROW_NB_PKTS - 1) & 0xFF);
+    if (ret < 0)
+        avt_log(avt, AVT_LOG_ERROR, "Mismatch after growing!\n");
+
+end:
+    avt_buffer_quick_unref(&p.hdr);
+    return ret;
+}
+
 int main(void)
 {
     int64_t ret;
@@ -56,6 +119,10 @@ int main(void)
     }
 
     ret = file_io_test(avt, io, io_ctx);
+    if (!ret)
+        ret = grow_test(avt, io, io_ctx);
+    if (!ret)
+        ret = file_sync_test(avt, io, "io_mmap_sync.avt");
 
     if (ret)
         io->close(&io_ctx);
@@ -24,19 +24,393 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <sys/resource.h>
+
 #include "net_io_common.h"
+#include "utils_internal.h"
 
 extern const AVTIO avt_io_udp;
+#ifdef CONFIG_HAVE_LIBURING
+extern const AVTIO avt_io_udp_uring;
+#endif
+
+#define BENCH_NB_PKTS (1 << 18)
+#define BENCH_BATCH 64
+#define BENCH_PKT_LEN 1200
+#define BENCH_HDR_LEN 32
+
+static int64_t get_cpu_time_ns(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)*INT64_C(1000000000) +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)*INT64_C(1000);
+}
 
-int main(void)
+/* Send packets of equal size, as the scheduler would output them
+ * when segmenting large payloads. Nothing reads them. */
+static int bench_send(const AVTIO *io, const char *url)
 {
+    int ret;
     NetTestContext ntc;
-    int ret = net_io_init(&ntc, &avt_io_udp, "udp://[::1]");
+    AVTBuffer hdr = { };
+    AVTBuffer pl = { };
+    AVTPktd pkt[BENCH_BATCH] = { };
+
+    ret = net_io_init(&ntc, io, url);
     if (ret < 0)
-        return AVT_ERROR(ret);
+        return ret;
+
+    if (!avt_buffer_quick_alloc(&hdr, BENCH_HDR_LEN) ||
+        !avt_buffer_quick_alloc(&pl, BENCH_PKT_LEN - BENCH_HDR_LEN)) {
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+    memset(hdr.data, 0, BENCH_HDR_LEN);
+    memset(pl.data, 0, BENCH_PKT_LEN - BENCH_HDR_LEN);
+
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        avt_buffer_quick_ref(&pkt[i].hdr, &hdr, 0, AVT_BUFFER_REF_ALL);
+        avt_buffer_quick_ref(&pkt[i].pl, &pl, 0, AVT_BUFFER_REF_ALL);
+        pkt[i].hdr_len = BENCH_HDR_LEN;
+    }
+
+    int64_t t = avt_get_time_ns();
+    int64_t cpu = get_cpu_time_ns();
+    for (int i = 0; i < (BENCH_NB_PKTS / BENCH_BATCH); i++) {
+        ret = io->write_vec(ntc.ioctx_sender, pkt, BENCH_BATCH, 1);
+        if (ret < 0)
+            goto end;
+    }
+    if (io->flush)
+        io->flush(ntc.ioctx_sender, INT64_MAX);
+    cpu = get_cpu_time_ns() - cpu;
+    t = avt_get_time_ns() - t;
+
+    fprintf(stderr, "    %-9s %-24s %7.0f kpps, %6.1f ns CPU per packet\n",
+            io->name, url,
+            (double)BENCH_NB_PKTS*1000000.0 / t,
+            (double)cpu / BENCH_NB_PKTS);
+    ret = 0;
+
+end:
+    for (int i = 0; i < BENCH_BATCH; i++)
+        avt_pktd_unref(&pkt[i]);
+    avt_buffer_quick_unref(&hdr);
+    avt_buffer_quick_unref(&pl);
+    net_io_free(&ntc);
+    return ret;
+}
+
+#define VEC_NB_PKTS 32
+#define VEC_PKT_LEN 384
+#define VEC_BIG_LEN 20000
+
+/* Send a run of packets of equal size, and one large packet,
+ * and read them back in small batches */
+static int test_read_vec(NetTestContext *ntc)
+{
+    int ret;
+    AVTPktd pkt[VEC_NB_PKTS + 1] = { };
+    AVTIODatagram dgram[5];
+
+    for (int i = 0; i <= VEC_NB_PKTS; i++) {
+        size_t len = i == VEC_NB_PKTS ? VEC_BIG_LEN : VEC_PKT_LEN;
+        if (!avt_buffer_quick_alloc(&pkt[i].hdr, 4) ||
+            !avt_buffer_quick_alloc(&pkt[i].pl, len - 4)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(pkt[i].hdr.data, i, 4);
+        memset(pkt[i].pl.data, i, len - 4);
+        pkt[i].hdr_len = 4;
+    }
+
+    ret = ntc->io->write_vec(ntc->ioctx_sender, pkt, VEC_NB_PKTS + 1, 1);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i <= VEC_NB_PKTS;) {
+        ret = ntc->io->read_vec(ntc->ioctx_listener, dgram,
+                                AVT_ARRAY_ELEMS(dgram), 1);
+        if (ret < 0)
+            goto end;
+
+        for (int j = 0; j < ret; j++) {
+            size_t len = i == VEC_NB_PKTS ? VEC_BIG_LEN : VEC_PKT_LEN;
+            uint8_t *data = dgram[j].buf.data;
+            if (dgram[j].buf.len != len ||
+                data[0] != (i & 0xFF) || data[len - 1] != (i & 0xFF)) {
+                fprintf(stderr, "Datagram %i mismatch, %zu bytes\n",
+                        i, dgram[j].buf.len);
+                ret = AVT_ERROR(EINVAL);
+            }
+            avt_buffer_quick_unref(&dgram[j].buf);
+            i++;
+        }
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = 0;
+
+end:
+    for (int i = 0; i <= VEC_NB_PKTS; i++)
+        avt_pktd_unref(&pkt[i]);
+    return ret;
+}
+
+#define ZC_NB_PKTS 16
+#define ZC_PKT_LEN 1200
+
+/* Send a run of packets large enough to go out without a copy, and check
+ * their buffers are held until the kernel is done with them */
+static int test_zerocopy(const char *url)
+{
+    int ret;
+    NetTestContext ntc;
+    AVTBuffer pl = { };
+    AVTPktd pkt[ZC_NB_PKTS] = { };
+    AVTIODatagram dgram[ZC_NB_PKTS];
+    AVTIOStats stats;
+
+    ret = net_io_init(&ntc, &avt_io_udp, url);
+    if (ret < 0)
+        return ret;
+
+    if (!avt_buffer_quick_alloc(&pl, ZC_PKT_LEN - 4)) {
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+    memset(pl.data, 0xAA, ZC_PKT_LEN - 4);
+
+    for (int i = 0; i < ZC_NB_PKTS; i++) {
+        if (!avt_buffer_quick_alloc(&pkt[i].hdr, 4)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(pkt[i].hdr.data, i, 4);
+        pkt[i].hdr_len = 4;
+        avt_buffer_quick_ref(&pkt[i].pl, &pl, 0, AVT_BUFFER_REF_ALL);
+    }
+
+    ret = avt_io_udp.write_vec(ntc.ioctx_sender, pkt, ZC_NB_PKTS, 1);
+    if (ret < 0)
+        goto end;
+
+    /* Drop our references, the IO must keep its own */
+    for (int i = 0; i < ZC_NB_PKTS; i++)
+        avt_pktd_unref(&pkt[i]);
+
+    ret = avt_io_udp.flush(ntc.ioctx_sender, INT64_C(1000000000));
+    if (ret < 0) {
+        fprintf(stderr, "Zero-copy completions not received\n");
+        goto end;
+    }
+
+    if (avt_buffer_get_refcount(&pl) != 1) {
+        fprintf(stderr, "Payload still referenced after completion: %i\n",
+                avt_buffer_get_refcount(&pl));
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    avt_io_udp.get_stats(ntc.ioctx_sender, &stats);
+    fprintf(stderr, "    %" PRIu64 " messages copied, %" PRIu64 " zero-copy\n",
+            stats.nb_copied, stats.nb_zerocopy);
+    if (!(stats.nb_copied + stats.nb_zerocopy)) {
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    for (int i = 0; i < ZC_NB_PKTS;) {
+        ret = avt_io_udp.read_vec(ntc.ioctx_listener, dgram, ZC_NB_PKTS - i, 1);
+        if (ret < 0)
+            goto end;
+
+        for (int j = 0; j < ret; j++) {
+            uint8_t *data = dgram[j].buf.data;
+            if (dgram[j].buf.len != ZC_PKT_LEN || data[0] != i ||
+                data[ZC_PKT_LEN - 1] != 0xAA) {
+                fprintf(stderr, "Datagram %i mismatch\n", i);
+                ret = AVT_ERROR(EINVAL);
+            }
+            avt_buffer_quick_unref(&dgram[j].buf);
+            i++;
+        }
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = 0;
+
+end:
+    for (int i = 0; i < ZC_NB_PKTS; i++)
+        avt_pktd_unref(&pkt[i]);
+    avt_buffer_quick_unref(&pl);
+    net_io_free(&ntc);
+    return ret;
+}
+
+#define PACE_NB_PKTS 32
+#define PACE_PKT_LEN 1200
+#define PACE_GAP INT64_C(200000)
+
+/* Send packets spaced out by the scheduler, and measure the gaps between
+ * them as they arrive. Launch times are only honoured with qdiscs like fq
+ * and etf, which loopback does not have by default, so strict is only set
+ * for userspace pacing. Without blocking, packets not yet due are held back
+ * until flushed. */
+static int test_pacing(const char *url, bool blocking, bool strict)
+{
+    int ret;
+    NetTestContext ntc;
+    AVTPktd pkt[PACE_NB_PKTS] = { };
+    AVTIODatagram dgram[PACE_NB_PKTS];
+    int64_t first = INT64_MIN, last = INT64_MIN, min_gap = INT64_MAX;
+
+    ret = net_io_init(&ntc, &avt_io_udp, url);
+    if (ret < 0)
+        return ret;
+
+    for (int i = 0; i < PACE_NB_PKTS; i++) {
+        if (!avt_buffer_quick_alloc(&pkt[i].hdr, PACE_PKT_LEN)) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(pkt[i].hdr.data, i, PACE_PKT_LEN);
+        pkt[i].hdr_len = PACE_PKT_LEN;
+        pkt[i].tx_time = i*PACE_GAP;
+    }
+
+    ret = avt_io_udp.write_vec(ntc.ioctx_sender, pkt, PACE_NB_PKTS, blocking);
+    if (ret < 0)
+        goto end;
+
+    do {
+        ret = avt_io_udp.flush(ntc.ioctx_sender, blocking);
+    } while (ret == AVT_ERROR(EAGAIN));
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < PACE_NB_PKTS;) {
+        ret = avt_io_udp.read_vec(ntc.ioctx_listener, dgram, PACE_NB_PKTS - i, 1);
+        if (ret < 0)
+            goto end;
+
+        for (int j = 0; j < ret; j++) {
+            int64_t ts = dgram[j].ts;
+            if (ts != INT64_MIN) {
+                if (last != INT64_MIN)
+                    min_gap = AVT_MIN(min_gap, ts - last);
+                else
+                    first = ts;
+                last = ts;
+            }
+            avt_buffer_quick_unref(&dgram[j].buf);
+            i++;
+        }
+    }
+
+    ret = 0;
+    if (first == INT64_MIN) {
+        fprintf(stderr, "    %-30s no receive timestamps\n", url);
+        goto end;
+    }
+
+    int64_t span = last - first;
+    int64_t expected = (PACE_NB_PKTS - 1)*PACE_GAP;
+    fprintf(stderr, "    %-30s %" PRIi64 " us span (%" PRIi64 " us expected), "
+            "%" PRIi64 " us min gap\n", url, span / 1000, expected / 1000,
+            min_gap / 1000);
+
+    /* Be lenient, as the machine may be busy */
+    if (strict && (span < (expected*3/4))) {
+        fprintf(stderr, "Packets not paced!\n");
+        ret = AVT_ERROR(EINVAL);
+    }
+
+end:
+    for (int i = 0; i < PACE_NB_PKTS; i++)
+        avt_pktd_unref(&pkt[i]);
+    net_io_free(&ntc);
+    return ret;
+}
+
+static int run_test(const AVTIO *io, const char *url)
+{
+    NetTestContext ntc;
+    int ret = net_io_init(&ntc, io, url);
+    if (ret < 0)
+        return ret;
 
     ret = net_io_test(&ntc);
+    if (ret >= 0)
+        ret = test_read_vec(&ntc);
 
     net_io_free(&ntc);
+    return ret;
+}
+
+int main(int argc, const char **argv)
+{
+    int ret;
+
+    if ((argc > 1) && !strcmp(argv[1], "bench")) {
+        fprintf(stderr, "Benchmarking UDP sending...\n");
+        ret = bench_send(&avt_io_udp, "udp://[::1]");
+        if (ret >= 0)
+            ret = bench_send(&avt_io_udp, "udp://[::1]/#gso=1");
+#ifdef CONFIG_HAVE_LIBURING
+        if (ret >= 0)
+            ret = bench_send(&avt_io_udp_uring, "udp://[::1]");
+#endif
+        return AVT_ERROR(ret);
+    }
+
+    ret = run_test(&avt_io_udp, "udp://[::1]");
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+#ifdef CONFIG_HAVE_LIBURING
+    /* Asynchronous sending, if io_uring is available */
+    NetTestContext ntc;
+    if (net_io_init(&ntc, &avt_io_udp_uring, "udp://[::1]") >= 0) {
+        net_io_free(&ntc);
+        ret = run_test(&avt_io_udp_uring, "udp://[::1]");
+        if (ret < 0)
+            return AVT_ERROR(ret);
+    }
+#endif
+
+    /* Segmentation offload. Falls back if unsupported. */
+    ret = run_test(&avt_io_udp, "udp://[::1]/#gso=1");
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    /* Segmentation and receive offload, coalesced datagrams get split */
+    ret = run_test(&avt_io_udp, "udp://[::1]/#gso=1&gro=1");
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    /* Zero-copy sending. The kernel copies anyway on loopback. */
+    ret = test_zerocopy("udp://[::1]/#gso=1&zerocopy=1");
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    /* Pacing */
+    ret = test_pacing("udp://[::1]/#pacing=user", true, true);
+    if (ret >= 0)
+        ret = test_pacing("udp://[::1]/#pacing=user", false, true);
+    if (ret >= 0)
+        ret = test_pacing("udp://[::1]/#pacing=txtime&gso=1", true, false);
+    if (ret >= 0)
+        ret = test_pacing("udp://[::1]/#pacing=txtime&pacing_clock=tai", true, false);
+
     return AVT_ERROR(ret);
 }
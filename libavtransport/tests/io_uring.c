@@ -0,0 +1,245 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <avtransport/avtransport.h>
+#include "io_common.h"
+#include "utils_internal.h"
+
+#include "file_io_common.h"
+
+extern const AVTIO avt_io_uring_path;
+extern const AVTIO avt_io_fd_path;
+extern const AVTIO avt_io_mmap_path;
+
+/* Write a large file in batches of packets, and flush it */
+static int bench_write(AVTContext *avt, const AVTIO *io, size_t pl_size)
+{
+    int64_t ret;
+    const size_t total = 256 << 20;
+    const int nb_pkt = 64;
+    AVTPktd pkt[64] = { };
+    AVTIOCtx *io_ctx;
+    AVTAddress addr = { .path = "io_uring_bench.avt" };
+
+    unlink(addr.path);
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret < 0) {
+        printf("Unable to create bench file with %s\n", io->name);
+        return ret;
+    }
+
+    AVTBuffer pl = { };
+    if (!avt_buffer_quick_alloc(&pl, pl_size)) {
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+    memset(pl.data, 0xAA, pl_size);
+
+    for (int i = 0; i < nb_pkt; i++) {
+        uint8_t *hdr = avt_buffer_quick_alloc(&pkt[i].hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(hdr, i, AVT_MAX_HEADER_LEN);
+        pkt[i].hdr_len = 64;
+        avt_buffer_quick_ref(&pkt[i].pl, &pl, 0, AVT_BUFFER_REF_ALL);
+    }
+
+    const size_t batch = nb_pkt*(64 + pl_size);
+    int64_t t = avt_get_time_ns();
+    for (size_t done = 0; done < total; done += batch) {
+        ret = io->write_vec(io_ctx, pkt, nb_pkt, INT64_MAX);
+        if (ret < 0)
+            goto end;
+    }
+    ret = io->flush(io_ctx, INT64_MAX);
+    if (ret < 0)
+        goto end;
+    t = avt_get_time_ns() - t;
+
+    printf("    %-14s %6zu byte payloads: %8.1f MiB/s\n", io->name, pl_size,
+           ((double)total / (1 << 20)) / (t / 1000000000.0));
+
+end:
+    for (int i = 0; i < nb_pkt; i++) {
+        avt_buffer_quick_unref(&pkt[i].hdr);
+        avt_buffer_quick_unref(&pkt[i].pl);
+    }
+    avt_buffer_quick_unref(&pl);
+    io->close(&io_ctx);
+    unlink(addr.path);
+    return ret;
+}
+
+/* Write more than the ring can hold at once, without waiting */
+static int test_full_ring(AVTContext *avt, const AVTIO *io)
+{
+    int64_t ret;
+    const int nb_pkt = 1024;
+    const size_t pl_size = 16000;
+    AVTPktd *pkt = calloc(nb_pkt, sizeof(*pkt));
+    AVTIOCtx *io_ctx = NULL;
+    AVTBuffer pl = { };
+    uint8_t *data = NULL;
+    AVTAddress addr = { .path = "io_uring_full.avt" };
+
+    if (!pkt)
+        return AVT_ERROR(ENOMEM);
+
+    unlink(addr.path);
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret < 0)
+        goto end;
+
+    uint8_t *pl_data = avt_buffer_quick_alloc(&pl, nb_pkt*pl_size);
+    if (!pl_data) {
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i < nb_pkt; i++) {
+        uint8_t *hdr = avt_buffer_quick_alloc(&pkt[i].hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr) {
+            ret = AVT_ERROR(ENOMEM);
+            goto end;
+        }
+        memset(hdr, i, AVT_MAX_HEADER_LEN);
+        pkt[i].hdr_len = 64;
+        memset(pl_data + i*pl_size, ~i, pl_size);
+        avt_buffer_quick_ref(&pkt[i].pl, &pl, i*pl_size, pl_size);
+    }
+
+    ret = io->write_vec(io_ctx, pkt, nb_pkt, 0);
+    if (ret != 0) {
+        printf("Writing with a full ring returned %" PRIi64 "\n", ret);
+        ret = AVT_ERROR(EINVAL);
+        goto end;
+    }
+
+    ret = io->flush(io_ctx, INT64_MAX);
+    if (ret < 0)
+        goto end;
+
+    /* Every packet must have made it to the file */
+    const size_t len = nb_pkt*(64 + pl_size);
+    data = malloc(len);
+    FILE *f = fopen(addr.path, "rb");
+    if (!data || !f) {
+        if (f)
+            fclose(f);
+        ret = AVT_ERROR(ENOMEM);
+        goto end;
+    }
+    size_t got = fread(data, 1, len + 1, f);
+    fclose(f);
+
+    ret = got != len ? AVT_ERROR(EINVAL) : 0;
+    for (int i = 0; !ret && (i < nb_pkt); i++) {
+        const uint8_t *p = data + i*(64 + pl_size);
+        for (int j = 0; j < (64 + pl_size); j++) {
+            if (p[j] != (uint8_t)(j < 64 ? i : ~i)) {
+                printf("Mismatch in packet %i\n", i);
+                ret = AVT_ERROR(EINVAL);
+                break;
+            }
+        }
+    }
+
+end:
+    for (int i = 0; i < nb_pkt; i++) {
+        avt_buffer_quick_unref(&pkt[i].hdr);
+        avt_buffer_quick_unref(&pkt[i].pl);
+    }
+    avt_buffer_quick_unref(&pl);
+    free(pkt);
+    free(data);
+    if (io_ctx)
+        io->close(&io_ctx);
+    unlink(addr.path);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t ret;
+
+    /* Open context */
+    AVTContext *avt;
+    ret = avt_init(&avt, NULL);
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    if ((argc > 1) && !strcmp(argv[1], "bench")) {
+        const AVTIO *list[] = { &avt_io_uring_path, &avt_io_fd_path,
+                                &avt_io_mmap_path };
+        const size_t pl_sizes[] = { 1024, 65536 };
+
+        printf("Benchmarking file writing...\n");
+        for (int i = 0; i < AVT_ARRAY_ELEMS(pl_sizes); i++) {
+            for (int j = 0; j < AVT_ARRAY_ELEMS(list); j++) {
+                ret = bench_write(avt, list[j], pl_sizes[i]);
+                if (ret < 0)
+                    break;
+            }
+        }
+
+        avt_close(&avt);
+        return AVT_ERROR(ret);
+    }
+
+    /* Open io context */
+    const AVTIO *io = &avt_io_uring_path;
+    AVTIOCtx *io_ctx;
+    AVTAddress addr = { .path = "io_uring_test.avt" };
+
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret == AVT_ERROR(ENOMEM)) {
+        avt_close(&avt);
+        return AVT_ERROR(ret);
+    } else if (ret < 0) {
+        /* io_uring may be disabled in the kernel, or by a sandbox */
+        printf("io_uring unavailable, skipping\n");
+        avt_close(&avt);
+        return 77;
+    }
+
+    ret = file_io_test(avt, io, io_ctx);
+    if (!ret)
+        ret = test_full_ring(avt, io);
+
+    if (ret)
+        io->close(&io_ctx);
+    else
+        ret = io->close(&io_ctx);
+    avt_close(&avt);
+    return AVT_ERROR(ret);
+}
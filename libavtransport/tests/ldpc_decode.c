@@ -0,0 +1,237 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ldpc_tables.h"
+#include "ldpc_encode.h"
+#include "ldpc_decode.h"
+#include "utils_internal.h"
+
+#define MAX_BITS 2784
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    rng_state = rng_state*1664525 + 1013904223;
+    return rng_state >> 8;
+}
+
+/* Makes an H-matrix with message_bits columns of the given weight,
+ * all different, followed by the identity matrix */
+static uint64_t *make_matrix(int message_bits, int parity_bits, int weight)
+{
+    const int n = message_bits + parity_bits;
+    const int nb_blocks = parity_bits / 64;
+    uint64_t *H = aligned_alloc(64, n*nb_blocks*sizeof(*H));
+    if (!H)
+        return NULL;
+    memset(H, 0, n*nb_blocks*sizeof(*H));
+
+    for (int c = 0; c < message_bits; c++) {
+        int rows[16];
+        bool dup;
+        do {
+            for (int w = 0; w < weight; w++) {
+                int r;
+                bool taken;
+                do {
+                    r = rng() % parity_bits;
+                    taken = false;
+                    for (int k = 0; k < w; k++)
+                        taken |= rows[k] == r;
+                } while (taken);
+                rows[w] = r;
+            }
+
+            for (int w = 0; w < weight; w++)
+                H[(rows[w] >> 6)*n + c] |= 1ULL << (63 - (rows[w] & 63));
+
+            dup = false;
+            for (int p = 0; p < c && !dup; p++) {
+                bool same = true;
+                for (int i = 0; i < nb_blocks; i++)
+                    same &= H[i*n + c] == H[i*n + p];
+                dup = same;
+            }
+            if (dup)
+                for (int i = 0; i < nb_blocks; i++)
+                    H[i*n + c] = 0;
+        } while (dup);
+    }
+
+    for (int r = 0; r < parity_bits; r++)
+        H[(r >> 6)*n + message_bits + r] = 1ULL << (63 - (r & 63));
+
+    return H;
+}
+
+static void random_codeword(uint8_t *data, const uint64_t *H,
+                            int message_bits, int parity_bits)
+{
+    for (int i = 0; i < message_bits / 8; i++)
+        data[i] = rng();
+    ldpc_encode(data, H, message_bits, parity_bits);
+}
+
+static int test_code(const uint64_t *H, int message_bits, int parity_bits)
+{
+    const int n = message_bits + parity_bits;
+    uint8_t ref[MAX_BITS / 8], data[MAX_BITS / 8];
+    int ret;
+
+    random_codeword(ref, H, message_bits, parity_bits);
+
+    /* Clean data */
+    memcpy(data, ref, n / 8);
+    ret = avt_ldpc_decode(data, H, message_bits, parity_bits, 0);
+    if (ret || memcmp(data, ref, n / 8)) {
+        printf("LDPC(%i, %i): clean data altered: %i\n", n, message_bits, ret);
+        return 1;
+    }
+
+    /* Any single bit error must be corrected */
+    for (int b = 0; b < n; b++) {
+        memcpy(data, ref, n / 8);
+        data[b >> 3] ^= 0x80 >> (b & 7);
+        ret = avt_ldpc_decode(data, H, message_bits, parity_bits, 0);
+        if (ret != 1 || memcmp(data, ref, n / 8)) {
+            printf("LDPC(%i, %i): error in bit %i not corrected: %i\n",
+                   n, message_bits, b, ret);
+            return 1;
+        }
+    }
+
+    /* With more errors, either a valid codeword must be found,
+     * or the data must be left as it was */
+    int nb_corrected = 0;
+    for (int i = 0; i < 256; i++) {
+        uint8_t in[MAX_BITS / 8], chk[MAX_BITS / 8];
+        random_codeword(ref, H, message_bits, parity_bits);
+        memcpy(in, ref, n / 8);
+
+        int nb_err = 2 + (i & 3);
+        for (int e = 0; e < nb_err; e++) {
+            int b = rng() % n;
+            in[b >> 3] ^= 0x80 >> (b & 7);
+        }
+
+        memcpy(data, in, n / 8);
+        ret = avt_ldpc_decode(data, H, message_bits, parity_bits, 0);
+        if (ret < 0) {
+            if (memcmp(data, in, n / 8)) {
+                printf("LDPC(%i, %i): data altered on failure\n", n, message_bits);
+                return 1;
+            }
+            continue;
+        }
+
+        memcpy(chk, data, n / 8);
+        ldpc_encode(chk, H, message_bits, parity_bits);
+        if (memcmp(chk, data, n / 8)) {
+            printf("LDPC(%i, %i): invalid codeword returned\n", n, message_bits);
+            return 1;
+        }
+        nb_corrected += !memcmp(data, ref, n / 8);
+    }
+
+    printf("LDPC(%i, %i): %i/256 multi-bit errors corrected\n",
+           n, message_bits, nb_corrected);
+
+    return 0;
+}
+
+static void bench_code(const char *name, const uint64_t *H,
+                       int message_bits, int parity_bits, int nb_err)
+{
+    const int n = message_bits + parity_bits;
+    const int nb = (1 << 22) / n;
+    uint8_t ref[MAX_BITS / 8], data[MAX_BITS / 8];
+
+    random_codeword(ref, H, message_bits, parity_bits);
+    for (int e = 0; e < nb_err; e++)
+        ref[e*7] ^= 0x10;
+
+    int64_t t = avt_get_time_ns();
+    for (int i = 0; i < nb; i++) {
+        memcpy(data, ref, n / 8);
+        avt_ldpc_decode(data, H, message_bits, parity_bits, 0);
+    }
+    t = avt_get_time_ns() - t;
+
+    printf("    %-24s %i bit errors: %10.0f headers/s\n", name, nb_err,
+           nb / (t / 1000000000.0));
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    uint64_t *h_288 = make_matrix(224, 64, 3);
+    uint64_t *h_2784 = make_matrix(2016, 768, 3);
+    if (!h_288 || !h_2784) {
+        ret = 1;
+        goto end;
+    }
+
+    if ((argc > 1) && !strcmp(argv[1], "bench")) {
+        printf("Benchmarking LDPC decoding...\n");
+        bench_code("LDPC(288, 224)", ldpc_h_matrix_288_224, 224, 64, 0);
+        bench_code("LDPC(2784, 2016)", ldpc_h_matrix_2784_2016, 2016, 768, 0);
+        bench_code("LDPC(288, 224), test H", h_288, 224, 64, 1);
+        bench_code("LDPC(2784, 2016), test H", h_2784, 2016, 768, 1);
+        bench_code("LDPC(2784, 2016), test H", h_2784, 2016, 768, 4);
+        goto end;
+    }
+
+    /* The codes from the specification */
+    uint8_t hdr[MAX_BITS / 8];
+    for (int i = 0; i < 252; i++)
+        hdr[i] = rng();
+    avt_ldpc_encode_288_224(hdr);
+    if (avt_ldpc_decode_288_224(hdr, 0)) {
+        printf("LDPC(288, 224): encoded data failed checks\n");
+        ret = 1;
+        goto end;
+    }
+    avt_ldpc_encode_2784_2016(hdr);
+    if (avt_ldpc_decode_2784_2016(hdr, 0)) {
+        printf("LDPC(2784, 2016): encoded data failed checks\n");
+        ret = 1;
+        goto end;
+    }
+
+    ret = test_code(h_288, 224, 64);
+    if (!ret)
+        ret = test_code(h_2784, 2016, 768);
+
+end:
+    free(h_288);
+    free(h_2784);
+    return ret;
+}
@@ -26,14 +26,222 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "ldpc.h"
 #include "ldpc_tables.h"
+#include "ldpc_encode.h"
+#include "cpu.h"
 
 #define DATA_LEN 1024
 #define PARITY_LEN 1024
 
-int main(void)
+static const struct {
+    const char *name;
+    unsigned flags;
+} cpu_levels[] = {
+    { "c", 0 },
+    { "sse4", AVT_CPU_FLAG_SSE4 },
+    { "avx2", AVT_CPU_FLAG_SSE4 | AVT_CPU_FLAG_AVX2 },
+    { "avx512", AVT_CPU_FLAG_SSE4 | AVT_CPU_FLAG_AVX2 | AVT_CPU_FLAG_AVX512 },
+    { "neon", AVT_CPU_FLAG_NEON },
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int level_supported(int idx)
+{
+    unsigned flags = cpu_levels[idx].flags;
+    return (avt_cpu_detect() & flags) == flags;
+}
+
+/* Checks the kernels of every supported level against the C encoder,
+ * with random data and random matrices, at the sizes of both header codes */
+static int bitexact_test(void)
+{
+    static const int codes[][2] = { { 224, 64 }, { 2016, 768 }, { 64, 128 } };
+    AVTLDPCDSP ref_dsp, dsp;
+    avt_ldpc_dsp_init(&ref_dsp, 0);
+
+    for (int c = 0; c < AVT_ARRAY_ELEMS(codes); c++) {
+        int msg = codes[c][0] >> 3;
+        int blocks = codes[c][1] >> 6;
+        int n = codes[c][0] + codes[c][1];
+
+        uint64_t *H = aligned_alloc(64, n*blocks*sizeof(*H));
+        uint8_t ref[(2016 + 768) / 8];
+        uint8_t out[(2016 + 768) / 8];
+        if (!H)
+            return 1;
+
+        for (int iter = 0; iter < 32; iter++) {
+            for (int i = 0; i < n*blocks; i++)
+                H[i] = rng();
+            for (int i = 0; i < msg; i++)
+                ref[i] = rng();
+
+            memcpy(out, ref, msg);
+            ref_dsp.encode(ref, H, msg, blocks);
+
+            for (int j = 1; j < AVT_ARRAY_ELEMS(cpu_levels); j++) {
+                if (!level_supported(j))
+                    continue;
+
+                avt_ldpc_dsp_init(&dsp, cpu_levels[j].flags);
+                memset(out + msg, 0xAA, blocks*8);
+                dsp.encode(out, H, msg, blocks);
+                if (memcmp(out, ref, msg + blocks*8)) {
+                    printf("%s mismatch for %i/%i\n", cpu_levels[j].name,
+                           n, codes[c][0]);
+                    free(H);
+                    return 1;
+                }
+
+                if (!dsp.encode_x4)
+                    continue;
+
+                /* Different messages in each slot */
+                uint8_t x4_ref[4][(2016 + 768) / 8];
+                uint8_t x4_out[4][(2016 + 768) / 8];
+                uint8_t *x4_dst[4];
+                for (int k = 0; k < 4; k++) {
+                    for (int i = 0; i < msg; i++)
+                        x4_ref[k][i] = rng();
+                    memcpy(x4_out[k], x4_ref[k], msg);
+                    memset(x4_out[k] + msg, 0xAA, blocks*8);
+                    ref_dsp.encode(x4_ref[k], H, msg, blocks);
+                    x4_dst[k] = x4_out[k];
+                }
+
+                dsp.encode_x4(x4_dst, H, msg, blocks);
+                for (int k = 0; k < 4; k++) {
+                    if (memcmp(x4_out[k], x4_ref[k], msg + blocks*8)) {
+                        printf("%s x4 mismatch for %i/%i, slot %i\n",
+                               cpu_levels[j].name, n, codes[c][0], k);
+                        free(H);
+                        return 1;
+                    }
+                }
+            }
+        }
+
+        free(H);
+    }
+
+    /* Public entry points, with the spec's matrices, at every level */
+    uint8_t ref[(2016 + 768) / 8];
+    uint8_t out[(2016 + 768) / 8];
+    for (int i = 0; i < sizeof(ref); i++)
+        ref[i] = rng();
+
+    for (int j = 0; j < AVT_ARRAY_ELEMS(cpu_levels); j++) {
+        if (!level_supported(j))
+            continue;
+        avt_cpu_set_flags(cpu_levels[j].flags);
+
+        memcpy(out, ref, sizeof(ref));
+        ldpc_encode(ref, ldpc_h_matrix_288_224, 224, 64);
+        avt_ldpc_encode_288_224(out);
+        if (memcmp(out, ref, 288 / 8)) {
+            printf("%s: 288/224 mismatch\n", cpu_levels[j].name);
+            return 1;
+        }
+
+        memcpy(out, ref, sizeof(ref));
+        ldpc_encode(ref, ldpc_h_matrix_2784_2016, 2016, 768);
+        avt_ldpc_encode_2784_2016(out);
+        if (memcmp(out, ref, 2784 / 8)) {
+            printf("%s: 2784/2016 mismatch\n", cpu_levels[j].name);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Queued sequences must come out the same as encoding each directly */
+static int batch_test(void)
+{
+    enum { NB = AVT_LDPC_BATCH_MAX + 7 };
+    static uint8_t ref[NB][288 / 8];
+    static uint8_t out[NB][288 / 8];
+    static uint8_t ref_l[3][2784 / 8];
+    static uint8_t out_l[3][2784 / 8];
+    AVTLDPCBatch b = { };
+
+    for (int i = 0; i < NB; i++) {
+        for (int j = 0; j < 224 / 8; j++)
+            ref[i][j] = rng();
+        memcpy(out[i], ref[i], 224 / 8);
+        memset(out[i] + 224 / 8, 0xAA, 64 / 8);
+        avt_ldpc_encode_288_224(ref[i]);
+        avt_ldpc_queue_288_224(&b, out[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 2016 / 8; j++)
+            ref_l[i][j] = rng();
+        memcpy(out_l[i], ref_l[i], 2016 / 8);
+        memset(out_l[i] + 2016 / 8, 0xAA, 768 / 8);
+        avt_ldpc_encode_2784_2016(ref_l[i]);
+        avt_ldpc_queue_2784_2016(&b, out_l[i]);
+    }
+
+    /* Full batches get encoded as soon as they fill up */
+    if (b.nb_288_224 != NB - AVT_LDPC_BATCH_MAX || b.nb_2784_2016 != 3) {
+        printf("Unexpected batch state: %i, %i\n", b.nb_288_224, b.nb_2784_2016);
+        return 1;
+    }
+
+    avt_ldpc_encode_batch(&b);
+    if (b.nb_288_224 || b.nb_2784_2016 ||
+        memcmp(out, ref, sizeof(ref)) || memcmp(out_l, ref_l, sizeof(ref_l))) {
+        printf("Batch mismatch\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void bench_level(int idx)
+{
+    static const struct {
+        const char *name;
+        const uint64_t *H;
+        int msg, blocks, nb;
+    } codes[] = {
+        { "288/224", ldpc_h_matrix_288_224, 224/8, 64/64, 1 << 20 },
+        { "2784/2016", ldpc_h_matrix_2784_2016, 2016/8, 768/64, 1 << 14 },
+    };
+    uint8_t data[2784 / 8];
+    for (int i = 0; i < sizeof(data); i++)
+        data[i] = rng();
+
+    AVTLDPCDSP dsp;
+    avt_ldpc_dsp_init(&dsp, cpu_levels[idx].flags);
+
+    for (int c = 0; c < AVT_ARRAY_ELEMS(codes); c++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int i = 0; i < codes[c].nb; i++)
+            dsp.encode(data, codes[c].H, codes[c].msg, codes[c].blocks);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        double t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        printf("%-8s %-10s %10.0f headers/s\n", cpu_levels[idx].name,
+               codes[c].name, codes[c].nb / t);
+    }
+}
+
+static int parity_test(void)
 {
     uint8_t data[DATA_LEN + PARITY_LEN];
 
@@ -75,3 +283,23 @@ int main(void)
 
     return 0;
 }
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        for (int j = 0; j < AVT_ARRAY_ELEMS(cpu_levels); j++)
+            if (level_supported(j))
+                bench_level(j);
+        return 0;
+    }
+
+    int ret = parity_test();
+    if (ret)
+        return ret;
+
+    ret = bitexact_test();
+    if (ret)
+        return ret;
+
+    return batch_test();
+}
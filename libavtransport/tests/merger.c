@@ -53,6 +53,11 @@ int main(void)
             ),
         };
 
+        hdr_data = avt_buffer_quick_alloc(&hdr.hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr_data)
+            return ENOMEM;
+        memset(hdr_data, 0, AVT_MAX_HEADER_LEN);
+
         hdr_data = avt_buffer_quick_alloc(&hdr.pl, 64);
         if (!hdr_data)
             return ENOMEM;
@@ -70,7 +75,8 @@ int main(void)
             goto end;
 
         /* Output generated, have to free it */
-        avt_buffer_quick_unref(&out.pl);
+        avt_pktd_unref(&out);
+        avt_buffer_quick_unref(&hdr.hdr);
         ret = 0;
     }
 
@@ -88,6 +94,11 @@ int main(void)
             ),
         };
 
+        hdr_data = avt_buffer_quick_alloc(&hdr.hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr_data)
+            return ENOMEM;
+        memset(hdr_data, 0, AVT_MAX_HEADER_LEN);
+
         /* Start packet */
         hdr_data = avt_buffer_quick_alloc(&hdr.pl, 64);
         if (!hdr_data)
@@ -111,7 +122,8 @@ int main(void)
         ret = avt_pkt_merge_out(NULL, &s, &out, 0);
         if (ret != 128)
             goto end;
-        avt_buffer_quick_unref(&out.pl);
+        avt_pktd_unref(&out);
+        avt_buffer_quick_unref(&hdr.hdr);
         ret = 0;
     }
 
@@ -129,6 +141,11 @@ int main(void)
             ),
         };
 
+        hdr_data = avt_buffer_quick_alloc(&hdr.hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr_data)
+            return ENOMEM;
+        memset(hdr_data, 0, AVT_MAX_HEADER_LEN);
+
         /* Start packet */
         hdr_data = avt_buffer_quick_alloc(&hdr.pl, 64);
         if (!hdr_data)
@@ -161,7 +178,8 @@ int main(void)
         ret = avt_pkt_merge_out(NULL, &s, &out, 0);
         if (ret != 192)
             goto end;
-        avt_buffer_quick_unref(&out.pl);
+        avt_pktd_unref(&out);
+        avt_buffer_quick_unref(&hdr.hdr);
         ret = 0;
     }
 
@@ -179,6 +197,11 @@ int main(void)
             ),
         };
 
+        hdr_data = avt_buffer_quick_alloc(&hdr.hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr_data)
+            return ENOMEM;
+        memset(hdr_data, 0, AVT_MAX_HEADER_LEN);
+
         /* Segment */
         seg.pkt = avt_packet_create_segment(&hdr, 2, 128, 64, 192);
         hdr_data = avt_buffer_quick_alloc(&seg.pl, 64);
@@ -211,7 +234,8 @@ int main(void)
         ret = avt_pkt_merge_out(NULL, &s, &out, 0);
         if (ret != 192)
             goto end;
-        avt_buffer_quick_unref(&out.pl);
+        avt_pktd_unref(&out);
+        avt_buffer_quick_unref(&hdr.hdr);
         ret = 0;
     }
 
@@ -228,6 +252,11 @@ int main(void)
                 .duration = 1,
             ),
         };
+
+        hdr_data = avt_buffer_quick_alloc(&hdr.hdr, AVT_MAX_HEADER_LEN);
+        if (!hdr_data)
+            return ENOMEM;
+        memset(hdr_data, 0, AVT_MAX_HEADER_LEN);
         avt_packet_encode_header(&hdr);
 
         /* Segment */
@@ -245,11 +274,13 @@ int main(void)
         ret = avt_pkt_merge_out(NULL, &s, &out, 1);
         if (ret != 192)
             goto end;
-        avt_buffer_quick_unref(&out.pl);
+        avt_pktd_unref(&out);
+        avt_buffer_quick_unref(&hdr.hdr);
         ret = 0;
     }
 
 end:
+    avt_buffer_quick_unref(&hdr.hdr);
     avt_pkt_merge_free(&s);
     return AVT_ERROR(ret);
 }
@@ -82,6 +82,7 @@ int net_io_test(NetTestContext *ntc)
     int64_t ret = 0;
     int t_err = thrd_success, t_res = 0;
     thrd_t listener_thread = 0;
+    AVTPktd test_pkt[16] = { };
     NetListenerContext listener_ctx = {
         .avt = ntc->avt,
         .io = ntc->io,
@@ -102,12 +103,18 @@ int net_io_test(NetTestContext *ntc)
 
     /* Random packet data */
     int64_t sum = 0;
-    AVTPktd test_pkt[16] = { };
     for (int i = 0; i < AVT_ARRAY_ELEMS(test_pkt); i++) {
-        test_pkt[i].hdr_len = AVT_MIN(mtu, sizeof(test_pkt[i].hdr));
+        uint8_t *hdr = avt_buffer_quick_alloc(&test_pkt[i].hdr,
+                                              AVT_MAX_HEADER_LEN);
+        if (!hdr) {
+            ret = AVT_ERROR(ENOMEM);
+            goto fail;
+        }
+
+        test_pkt[i].hdr_len = AVT_MIN((size_t)mtu, AVT_MAX_HEADER_LEN);
         sum += test_pkt[i].hdr_len;
         for (int j = 0; j < test_pkt[i].hdr_len; j++)
-            test_pkt[i].hdr[j] = (rand() & 0xFF);
+            hdr[j] = (rand() & 0xFF);
     }
 
     listener_ctx.pkt_len = test_pkt[0].hdr_len;
@@ -133,7 +140,7 @@ int net_io_test(NetTestContext *ntc)
     for (int i = 0; i < listener_ctx.nb_pkts; i++) {
         bool found = false;
         for (int j = (listener_ctx.nb_pkts - 1); j >= 0; j--) {
-            if (!memcmp(buf_data, test_pkt[j].hdr, test_pkt[j].hdr_len)) {
+            if (!memcmp(buf_data, test_pkt[j].hdr.data, test_pkt[j].hdr_len)) {
                 found = true;
                 break;
             }
@@ -164,14 +171,16 @@ int net_io_test(NetTestContext *ntc)
         goto fail;
 
     buf_data = avt_buffer_get_data(listener_ctx.output, &buf_size);
-    if (memcmp(buf_data, test_pkt[0].hdr, test_pkt[0].hdr_len)) {
+    if (memcmp(buf_data, test_pkt[0].hdr.data, test_pkt[0].hdr_len)) {
        avt_log(ntc->avt, AVT_LOG_ERROR,"Data written and read does not match\n");
        ret = AVT_ERROR(EINVAL);
        goto fail;
     }
 
+    ret = 0;
+
 fail:
-    if (ret >= 0 && t_res)
+    if (ret >= 0 && t_res < 0)
         ret = t_res;
 
     if (ret >= 0 && (t_err != thrd_success)) {
@@ -184,6 +193,8 @@ fail:
         thrd_join(listener_thread, NULL);
 
     avt_buffer_unref(&listener_ctx.output);
+    for (int i = 0; i < AVT_ARRAY_ELEMS(test_pkt); i++)
+        avt_buffer_quick_unref(&test_pkt[i].hdr);
 
     return ret;
 }
@@ -232,10 +243,12 @@ fail:
 
 int net_io_free(NetTestContext *ntc)
 {
-    int err = ntc->io->close(&ntc->ioctx_sender);
-    if (err)
+    int err = 0;
+    if (ntc->ioctx_sender)
+        err = ntc->io->close(&ntc->ioctx_sender);
+    if (ntc->ioctx_listener && err)
         ntc->io->close(&ntc->ioctx_listener);
-    else
+    else if (ntc->ioctx_listener)
         err = ntc->io->close(&ntc->ioctx_listener);
     avt_close(&ntc->avt);
     return err;
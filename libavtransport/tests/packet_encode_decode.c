@@ -38,17 +38,21 @@ int main(void)
     size_t buf_size;
     AVTBuffer *buf = avt_buffer_alloc(AVT_MAX_HEADER_LEN);
     uint8_t *buf_data = avt_buffer_get_data(buf, &buf_size);
+    uint8_t *hdr_data = avt_buffer_quick_alloc(&in.hdr, AVT_MAX_HEADER_LEN);
+    if (!hdr_data)
+        return ENOMEM;
+    memset(hdr_data, 0, AVT_MAX_HEADER_LEN);
 
     {
         in.hdr_off = 0;
         in.pkt = AVT_SESSION_START_HDR();
         avt_packet_encode_header(&in);
-        memcpy(buf_data, in.hdr, in.hdr_len);
+        memcpy(buf_data, in.hdr.data, in.hdr_len);
 
         AVTBytestream bs = avt_bs_init(buf_data, buf_size);
         avt_decode_session_start(&bs, &out.pkt.session_start);
 
-        if (memcmp(&in.pkt, &out.pkt, in.hdr_len))
+        if (memcmp(&in.pkt.session_start, &out.pkt.session_start, sizeof(in.pkt.session_start)))
             return EINVAL;
     }
 
@@ -56,12 +60,12 @@ int main(void)
         in.hdr_off = 0;
         in.pkt = AVT_STREAM_REGISTRATION_HDR();
         avt_packet_encode_header(&in);
-        memcpy(buf_data, in.hdr, in.hdr_len);
+        memcpy(buf_data, in.hdr.data, in.hdr_len);
 
         AVTBytestream bs = avt_bs_init(buf_data, buf_size);
         avt_decode_stream_registration(&bs, &out.pkt.stream_registration);
 
-        if (memcmp(&in.pkt, &out.pkt, in.hdr_len))
+        if (memcmp(&in.pkt.stream_registration, &out.pkt.stream_registration, sizeof(in.pkt.stream_registration)))
             return EINVAL;
     }
 
@@ -69,15 +73,16 @@ int main(void)
         in.hdr_off = 0;
         in.pkt = AVT_VIDEO_INFO_HDR();
         avt_packet_encode_header(&in);
-        memcpy(buf_data, in.hdr, in.hdr_len);
+        memcpy(buf_data, in.hdr.data, in.hdr_len);
 
         AVTBytestream bs = avt_bs_init(buf_data, buf_size);
         avt_decode_video_info(&bs, &out.pkt.video_info);
 
-        if (memcmp(&in.pkt, &out.pkt, in.hdr_len))
+        if (memcmp(&in.pkt.video_info, &out.pkt.video_info, sizeof(in.pkt.video_info)))
             return EINVAL;
     }
 
+    avt_buffer_quick_unref(&in.hdr);
     avt_buffer_unref(&buf);
 
     return 0;
@@ -0,0 +1,214 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "utils_internal.h"
+
+static int check_order(AVTPacketFifo *fifo, uint64_t first, unsigned int nb)
+{
+    if (fifo->nb != nb) {
+        fprintf(stderr, "FIFO has %u packets, expected %u\n", fifo->nb, nb);
+        return AVT_ERROR(EINVAL);
+    }
+
+    for (unsigned int i = 0; i < nb; i++) {
+        if (avt_pkt_fifo_get(fifo, i)->pkt.seq != (first + i)) {
+            fprintf(stderr, "Packet %u has seq %" PRIu64 ", expected %" PRIu64 "\n",
+                    i, avt_pkt_fifo_get(fifo, i)->pkt.seq, first + i);
+            return AVT_ERROR(EINVAL);
+        }
+    }
+
+    return 0;
+}
+
+static int push_seq(AVTPacketFifo *fifo, AVTBuffer *pl, uint64_t seq)
+{
+    union AVTPacketData pkt = { .seq = seq };
+    return avt_pkt_fifo_push(fifo, pkt, pl);
+}
+
+/* Time a push and a pop on a FIFO holding depth packets */
+static int bench_depth(unsigned int depth)
+{
+    int ret;
+    const int nb_iter = 1 << 20;
+    AVTPacketFifo fifo = { };
+    AVTPktd p = { };
+
+    for (unsigned int i = 0; i < depth; i++) {
+        ret = push_seq(&fifo, NULL, i);
+        if (ret < 0)
+            goto end;
+    }
+
+    int64_t t = avt_get_time_ns();
+    for (int i = 0; i < nb_iter; i++) {
+        ret = push_seq(&fifo, NULL, depth + i);
+        if (ret < 0)
+            goto end;
+        ret = avt_pkt_fifo_pop(&fifo, &p);
+        if (ret < 0)
+            goto end;
+    }
+    t = avt_get_time_ns() - t;
+
+    fprintf(stderr, "    depth %5u: %6.1f ns per push+pop\n",
+            depth, (double)t / nb_iter);
+
+end:
+    avt_pkt_fifo_free(&fifo);
+    return ret;
+}
+
+int main(int argc, const char **argv)
+{
+    int ret;
+    AVTPacketFifo fifo = { };
+    AVTPacketFifo dst = { };
+    AVTPktd p = { };
+    AVTBuffer pl = { };
+
+    if ((argc > 1) && !strcmp(argv[1], "bench")) {
+        fprintf(stderr, "Benchmarking packet FIFO...\n");
+        for (unsigned int depth = 1; depth <= 4096; depth <<= 2) {
+            ret = bench_depth(depth);
+            if (ret < 0)
+                return AVT_ERROR(ret);
+        }
+        return 0;
+    }
+
+    if (!avt_buffer_quick_alloc(&pl, 64))
+        return AVT_ERROR(ENOMEM);
+
+    {
+        fprintf(stderr, "Testing push/pop with wraparound...\n");
+        /* Fill up, then pop half, so that further pushes wrap around */
+        for (int i = 0; i < 16; i++) {
+            ret = push_seq(&fifo, &pl, i);
+            if (ret < 0)
+                goto end;
+        }
+        for (int i = 0; i < 8; i++) {
+            ret = avt_pkt_fifo_pop(&fifo, &p);
+            if (ret < 0)
+                goto end;
+            avt_buffer_quick_unref(&p.pl);
+        }
+        for (int i = 16; i < 20; i++) {
+            ret = push_seq(&fifo, &pl, i);
+            if (ret < 0)
+                goto end;
+        }
+
+        ret = check_order(&fifo, 8, 12);
+        if (ret < 0)
+            goto end;
+
+        /* Grow while wrapped around */
+        for (int i = 20; i < 40; i++) {
+            ret = push_seq(&fifo, &pl, i);
+            if (ret < 0)
+                goto end;
+        }
+
+        ret = check_order(&fifo, 8, 32);
+        if (ret < 0)
+            goto end;
+
+        union AVTPacketData pkt;
+        ret = avt_pkt_fifo_peek(&fifo, &pkt, NULL);
+        if ((ret < 0) || (pkt.seq != 8)) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+    }
+
+    {
+        fprintf(stderr, "Testing copy/move with wraparound...\n");
+        ret = avt_pkt_fifo_copy(&dst, &fifo);
+        if (ret < 0)
+            goto end;
+
+        ret = check_order(&dst, 8, 32);
+        if (ret < 0)
+            goto end;
+
+        /* One for the buffer, and one per packet in each FIFO */
+        if (avt_buffer_get_refcount(&pl) != (1 + 2*32)) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+
+        avt_pkt_fifo_clear(&dst);
+        ret = avt_pkt_fifo_move(&dst, &fifo);
+        if (ret < 0)
+            goto end;
+
+        ret = check_order(&dst, 8, 32);
+        if ((ret < 0) || fifo.nb ||
+            (avt_buffer_get_refcount(&pl) != (1 + 32))) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+    }
+
+    {
+        fprintf(stderr, "Testing drop...\n");
+        ret = avt_pkt_fifo_drop(&dst, 8, 0);
+        if (ret < 0)
+            goto end;
+
+        ret = check_order(&dst, 8, 24);
+        if (ret < 0)
+            goto end;
+
+        /* Keep only as many packets as fit in the ceiling */
+        const size_t entry_size = sizeof(AVTPktd) + 64;
+        ret = avt_pkt_fifo_drop(&dst, 0, entry_size*4);
+        if (ret < 0)
+            goto end;
+
+        ret = check_order(&dst, 8, 4);
+        if (ret < 0)
+            goto end;
+
+        if (avt_buffer_get_refcount(&pl) != (1 + 4)) {
+            ret = AVT_ERROR(EINVAL);
+            goto end;
+        }
+    }
+
+end:
+    avt_pkt_fifo_free(&fifo);
+    avt_pkt_fifo_free(&dst);
+    avt_buffer_quick_unref(&pl);
+    return AVT_ERROR(ret);
+}
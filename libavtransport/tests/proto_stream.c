@@ -0,0 +1,225 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <avtransport/avtransport.h>
+
+#include "address.h"
+#include "protocol_common.h"
+#include "io_common.h"
+#include "utils_packet.h"
+
+extern const AVTIO avt_io_fd_path;
+extern const AVTIO avt_io_mmap_path;
+extern const AVTProtocol avt_protocol_stream;
+
+#define TEST_FILE "proto_stream_test.avt"
+
+static size_t test_pl_len(int i, bool bench)
+{
+    if (bench)
+        return 64;
+    /* Every so often, a payload larger than the read-ahead buffer */
+    return !(i % 37) ? 3*1024*1024 : (i * 61) % 1500;
+}
+
+static int write_pkts(const AVTIO *io, AVTIOCtx *io_ctx, int nb_pkts, bool bench)
+{
+    int64_t ret = 0;
+    AVTPktd p = { };
+
+    if (!avt_buffer_quick_alloc(&p.hdr, AVT_MAX_HEADER_LEN))
+        return AVT_ERROR(ENOMEM);
+
+    for (int i = 0; i < nb_pkts; i++) {
+        size_t pl_len = test_pl_len(i, bench);
+        if (!(i % 16)) {
+            /* Header-only packets of a different size */
+            p.hdr_off = 0;
+            p.pkt = AVT_SESSION_START_HDR();
+            avt_packet_encode_header(&p);
+            ret = io->write_pkt(io_ctx, &p, INT64_MAX);
+            if (ret < 0)
+                break;
+        }
+
+        if (pl_len && !avt_buffer_quick_alloc(&p.pl, pl_len)) {
+            ret = AVT_ERROR(ENOMEM);
+            break;
+        }
+        for (int j = 0; j < pl_len; j++)
+            p.pl.data[j] = (i + j) & 0xFF;
+
+        p.hdr_off = 0;
+        p.pkt = AVT_STREAM_DATA_HDR(
+            .stream_id = i & 0xFFFF,
+            .global_seq = i,
+            .pts = i,
+            .data_length = pl_len,
+        );
+        avt_packet_encode_header(&p);
+
+        ret = io->write_pkt(io_ctx, &p, INT64_MAX);
+        avt_buffer_quick_unref(&p.pl);
+        if (ret < 0)
+            break;
+    }
+
+    avt_pktd_unref(&p);
+    return ret < 0 ? ret : 0;
+}
+
+static int check_pkt(AVTContext *avt, AVTPktd *p, int i, bool bench)
+{
+    size_t pl_len;
+    uint8_t *pl_data = avt_buffer_get_data(&p->pl, &pl_len);
+
+    if ((p->pkt.desc & 0xFF00) != (AVT_PKT_STREAM_DATA & 0xFF00) ||
+        p->pkt.stream_data.global_seq != i ||
+        pl_len != test_pl_len(i, bench)) {
+        avt_log(avt, AVT_LOG_ERROR, "Packet %i mismatch: desc 0x%x, "
+                "seq %" PRIu64 ", %zu bytes\n", i, p->pkt.desc,
+                p->pkt.stream_data.global_seq, pl_len);
+        return AVT_ERROR(EINVAL);
+    }
+
+    for (int j = 0; j < pl_len; j++) {
+        if (pl_data[j] != ((i + j) & 0xFF)) {
+            avt_log(avt, AVT_LOG_ERROR, "Packet %i payload mismatch "
+                    "at byte %i\n", i, j);
+            return AVT_ERROR(EINVAL);
+        }
+    }
+
+    return 0;
+}
+
+static int read_pkts(AVTContext *avt, const AVTProtocol *proto,
+                     AVTProtocolCtx *p_ctx, int nb_pkts, bool bench)
+{
+    int64_t ret = 0;
+    int nb_out = 0, nb_in = 0;
+    AVTPacketFifo fifo = { };
+    AVTPktd p = { };
+
+    /* Session start packets are sent every 16 packets */
+    while (nb_in < (nb_pkts + (nb_pkts + 15)/16)) {
+        ret = proto->receive(p_ctx, &fifo, INT64_MAX);
+        if (ret == AVT_ERROR(EAGAIN)) {
+            avt_log(avt, AVT_LOG_ERROR, "Input ended after %i packets\n", nb_in);
+            ret = AVT_ERROR(EINVAL);
+            break;
+        } else if (ret < 0) {
+            break;
+        }
+        nb_in++;
+
+        ret = avt_pkt_fifo_pop(&fifo, &p);
+        if (ret < 0)
+            break;
+
+        if (p.pkt.desc != AVT_PKT_SESSION_START) {
+            ret = check_pkt(avt, &p, nb_out++, bench);
+            if (ret < 0)
+                break;
+        }
+        avt_pktd_unref(&p);
+    }
+
+    avt_pktd_unref(&p);
+    avt_pkt_fifo_free(&fifo);
+    return ret < 0 ? ret : 0;
+}
+
+static int run_test(AVTContext *avt, const AVTIO *io, int nb_pkts, bool bench)
+{
+    int64_t ret;
+    const AVTProtocol *proto = &avt_protocol_stream;
+    AVTIOCtx *io_ctx;
+    AVTProtocolCtx *p_ctx;
+    AVTProtocolOpts opts = { };
+    AVTAddress addr = { .path = TEST_FILE };
+
+    ret = io->init(avt, &io_ctx, &addr);
+    if (ret < 0)
+        return ret;
+
+    ret = write_pkts(io, io_ctx, nb_pkts, bench);
+    if (ret < 0)
+        goto end;
+
+    ret = io->seek(io_ctx, 0);
+    if (ret < 0)
+        goto end;
+
+    ret = proto->init(avt, &p_ctx, &addr, io, io_ctx, &opts);
+    if (ret < 0)
+        goto end;
+
+    int64_t t_start = avt_get_time_ns();
+    ret = read_pkts(avt, proto, p_ctx, nb_pkts, bench);
+    int64_t t_end = avt_get_time_ns();
+
+    if (!ret && bench) {
+        size_t size = (size_t)nb_pkts*(AVT_PKT_STREAM_DATA_SIZE + test_pl_len(0, true)) +
+                      (size_t)((nb_pkts + 15)/16)*AVT_PKT_SESSION_START_SIZE;
+        double secs = (t_end - t_start) / 1000000000.0;
+        printf("    %-10s %i packets: %.1f MiB/s, %.0f packets/s\n", io->name, nb_pkts,
+               (size / secs) / (1024.0*1024.0), nb_pkts / secs);
+    }
+
+    proto->close(&p_ctx);
+
+end:
+    io->close(&io_ctx);
+    remove(TEST_FILE);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t ret;
+    bool bench = argc > 1 && !strcmp(argv[1], "bench");
+
+    AVTContext *avt;
+    ret = avt_init(&avt, NULL);
+    if (ret < 0)
+        return AVT_ERROR(ret);
+
+    /* Copied reads, and reads which reference a mapping of the file */
+    const AVTIO *io_list[] = { &avt_io_fd_path, &avt_io_mmap_path };
+    for (int i = 0; i < AVT_ARRAY_ELEMS(io_list); i++) {
+        ret = run_test(avt, io_list[i], bench ? 4*1024*1024 : 512, bench);
+        if (ret < 0)
+            break;
+    }
+
+    avt_close(&avt);
+    return AVT_ERROR(ret);
+}
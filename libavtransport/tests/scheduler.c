@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "utils_packet.h"
+
+#define NB_STREAMS 48
+#define NB_PACKETS 16
+
+/* Headers must be complete, parity included, once output */
+static int check_header(AVTPktd *p)
+{
+    AVTPktd ref = { .pkt = p->pkt };
+    if (!avt_buffer_quick_alloc(&ref.hdr, AVT_MAX_HEADER_LEN))
+        return AVT_ERROR(ENOMEM);
+
+    avt_packet_encode_header(&ref);
+
+    int ret = 0;
+    if ((ref.hdr_len != p->hdr_len) ||
+        memcmp(ref.hdr.data, &p->hdr.data[p->hdr_off], p->hdr_len)) {
+        fprintf(stderr, "Header mismatch for packet 0x%x\n", p->pkt.desc);
+        ret = AVT_ERROR(EINVAL);
+    }
+
+    avt_buffer_quick_unref(&ref.hdr);
+    return ret;
+}
+
+static int pop_all(AVTScheduler *s, size_t *pl_bytes, uint64_t *last_seq)
+{
+    AVTPacketFifo *seq;
+
+    while (avt_scheduler_pop(s, &seq) >= 0) {
+        for (int i = 0; i < seq->nb; i++) {
+            AVTPktd *p = avt_pkt_fifo_get(seq, i);
+            uint64_t cur_seq;
+
+            int ret = check_header(p);
+            if (ret < 0)
+                return ret;
+
+            switch (p->pkt.desc) {
+            case AVT_PKT_STREAM_DATA:
+                cur_seq = p->pkt.seq;
+                pl_bytes[p->pkt.stream_id] += avt_buffer_get_data_len(&p->pl);
+                break;
+            case AVT_PKT_STREAM_DATA_SEGMENT:
+                cur_seq = p->pkt.generic_segment.global_seq;
+                pl_bytes[p->pkt.stream_id] += avt_buffer_get_data_len(&p->pl);
+                break;
+            default:
+                continue;
+            }
+
+            /* Sequence numbers must be strictly monotonic */
+            if ((*last_seq != UINT64_MAX) && (cur_seq <= *last_seq)) {
+                fprintf(stderr, "Non-monotonic seq: %lu after %lu\n",
+                        (unsigned long)cur_seq, (unsigned long)*last_seq);
+                return AVT_ERROR(EINVAL);
+            }
+            *last_seq = cur_seq;
+        }
+        avt_pkt_fifo_clear(seq);
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    int ret;
+    size_t pl_bytes[NB_STREAMS] = { };
+    uint64_t last_seq = UINT64_MAX;
+
+    AVTScheduler *s = calloc(1, sizeof(*s));
+    if (!s)
+        return AVT_ERROR(ENOMEM);
+
+    {
+        fprintf(stderr, "Testing interleaving of %i streams...\n", NB_STREAMS);
+        ret = avt_scheduler_init(s, 1280, 1000*1000*1000);
+        if (ret < 0)
+            goto end;
+
+        AVTPktd p = {
+            .pkt = AVT_SESSION_START_HDR(),
+        };
+        ret = avt_scheduler_push(s, &p);
+        if (ret < 0)
+            goto end;
+
+        for (int i = 0; i < NB_STREAMS; i++) {
+            p = (AVTPktd) {
+                .pkt = AVT_STREAM_REGISTRATION_HDR(
+                    .stream_id = i,
+                    .timebase = (AVTRational){ 1, 1000 + i },
+                ),
+            };
+            ret = avt_scheduler_push(s, &p);
+            if (ret < 0)
+                goto end;
+        }
+
+        for (int j = 0; j < NB_PACKETS; j++) {
+            for (int i = 0; i < NB_STREAMS; i++) {
+                const size_t len = 64 + 256*(i % 7) + 17*j;
+                p = (AVTPktd) {
+                    .pkt = AVT_STREAM_DATA_HDR(
+                        .frame_type = AVT_FRAME_TYPE_KEY,
+                        .pkt_compression = AVT_DATA_COMPRESSION_NONE,
+                        .stream_id = i,
+                        .pts = j*(20 + i),
+                        .duration = 20 + i,
+                    ),
+                };
+                if (!avt_buffer_quick_alloc(&p.pl, len)) {
+                    ret = AVT_ERROR(ENOMEM);
+                    goto end;
+                }
+                avt_packet_change_size(&p, 0, len, len);
+
+                ret = avt_scheduler_push(s, &p);
+                avt_buffer_quick_unref(&p.pl);
+                if (ret < 0)
+                    goto end;
+
+                ret = pop_all(s, pl_bytes, &last_seq);
+                if (ret < 0)
+                    goto end;
+            }
+        }
+
+        for (int i = 0; i < NB_STREAMS; i++) {
+            size_t expected = 0;
+            for (int j = 0; j < NB_PACKETS; j++)
+                expected += 64 + 256*(i % 7) + 17*j;
+            if (pl_bytes[i] != expected) {
+                fprintf(stderr, "Stream %i: %zu bytes output, expected %zu\n",
+                        i, pl_bytes[i], expected);
+                ret = AVT_ERROR(EINVAL);
+                goto end;
+            }
+        }
+    }
+
+end:
+    avt_scheduler_free(s);
+    free(s);
+    return AVT_ERROR(ret);
+}
@@ -88,7 +88,7 @@ bsw = {
     "int":  "avt_bsw_",
     "fstr": "avt_bsw_fstr",
     "len":  "avt_bs_offs",
-    "ldpc": "avt_ldpc_encode_",
+    "ldpc": "avt_ldpc_queue_",
     "skip": "avt_bs_skip",
 }
 
@@ -617,7 +617,7 @@ if f_packet_encode != None:
         newline_carryover = False;
         bitfield_bit = 0
         indent = "    "
-        file_encode.write("\nstatic void inline " + fn_prefix + "encode_" + orig_desc_names[struct] + "(" + data_prefix + "Bytestream *bs, const " + struct + " p)" + "\n{\n")
+        file_encode.write("\nstatic void inline " + fn_prefix + "encode_" + orig_desc_names[struct] + "_batch(" + data_prefix + "Bytestream *bs, const " + struct + " p, " + data_prefix + "LDPCBatch *ldpc)" + "\n{\n")
         def wsym(indent, sym, name, field):
             # Start
             if field["struct"] != None:
@@ -637,7 +637,7 @@ if f_packet_encode != None:
                 file_encode.write(" ")
 
             if sym == bsw["ldpc"]:
-                file_encode.write("(" + bsw["skip"] + "(bs, " + str((field["ldpc"][0] - field["ldpc"][1]) >> 3) + ") - " + str(field["ldpc"][1] >> 3))
+                file_encode.write("(ldpc, " + bsw["skip"] + "(bs, " + str((field["ldpc"][0] - field["ldpc"][1]) >> 3) + ") - " + str(field["ldpc"][1] >> 3))
             else:
                 file_encode.write("(bs")
 
@@ -740,6 +740,11 @@ if f_packet_encode != None:
                 file_encode.write(indent + bsw["int"] + "u" + str(MAX_BITFIELD_LEN - bitfield_bit - 1) + "b (bs, bitfield);\n")
                 bitfield = False
         file_encode.write("}\n")
+
+        # Without a batch, the parity is written immediately
+        file_encode.write("\nstatic void inline " + fn_prefix + "encode_" + orig_desc_names[struct] + "(" + data_prefix + "Bytestream *bs, const " + struct + " p)" + "\n{\n")
+        file_encode.write("    " + fn_prefix + "encode_" + orig_desc_names[struct] + "_batch(bs, p, NULL);\n")
+        file_encode.write("}\n")
     file_encode.write("\n#endif /* AVTRANSPORT_ENCODE_H */\n")
     file_encode.close()
 
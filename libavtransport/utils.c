@@ -49,9 +49,10 @@ int64_t avt_get_time_ns(void)
 void avt_pkt_fifo_clear(AVTPacketFifo *fifo)
 {
     for (int i = 0; i < fifo->nb; i++) {
-        AVTPktd *data = &fifo->data[i];
-        avt_buffer_quick_unref(&data->pl);
+        AVTPktd *data = avt_pkt_fifo_get(fifo, i);
+        avt_pktd_unref(data);
     }
+    fifo->head = 0;
     fifo->nb = 0;
 }
 
@@ -64,7 +65,10 @@ void avt_pkt_fifo_free(AVTPacketFifo *fifo)
 
 static int fifo_resize(AVTPacketFifo *fifo, unsigned int alloc_new)
 {
-    alloc_new = AVT_MAX(alloc_new, 1);
+    const unsigned int alloc_old = fifo->alloc;
+    alloc_new = stdc_bit_ceil(AVT_MAX(alloc_new, 1));
+    if (alloc_new <= alloc_old)
+        return 0;
 
     AVTPktd *alloc_pkt = avt_reallocarray(fifo->data, alloc_new,
                                           sizeof(*fifo->data));
@@ -72,26 +76,46 @@ static int fifo_resize(AVTPacketFifo *fifo, unsigned int alloc_new)
         return AVT_ERROR(ENOMEM);
     fifo->data = alloc_pkt;
 
+    /* Unwrap the part which wrapped around to the start */
+    if ((fifo->head + fifo->nb) > alloc_old) {
+        const unsigned int wrapped = fifo->head + fifo->nb - alloc_old;
+        memcpy(&fifo->data[alloc_old], fifo->data,
+               wrapped*sizeof(*fifo->data));
+    }
+
     fifo->alloc = alloc_new;
 
     return 0;
 }
 
-AVTPktd *avt_pkt_fifo_push_new(AVTPacketFifo *fifo, AVTBuffer *pl,
-                               ptrdiff_t offset, size_t len)
+/* Reserve the next entry at the tail, without initializing it */
+static inline AVTPktd *fifo_push_slot(AVTPacketFifo *fifo)
 {
-    if ((fifo->nb + 1) >= fifo->alloc) {
+    if (fifo->nb == fifo->alloc) {
         /* Ptwo allocations */
         if (fifo_resize(fifo, fifo->alloc << 1))
             return NULL;
     }
 
-    AVTPktd *data = &fifo->data[fifo->nb];
+    return &fifo->data[(fifo->head + fifo->nb++) & (fifo->alloc - 1)];
+}
+
+AVTPktd *avt_pkt_fifo_push_new(AVTPacketFifo *fifo, AVTBuffer *pl,
+                               ptrdiff_t offset, size_t len)
+{
+    AVTPktd *data = fifo_push_slot(fifo);
+    if (!data)
+        return NULL;
+
+    data->hdr_len = 0;
+    data->hdr_off = 0;
+    data->pl_has_hash = false;
+    data->tx_time = 0;
+    data->hdr = (AVTBuffer){ };
+    data->pl = (AVTBuffer){ };
     if (pl)
         avt_buffer_quick_ref(&data->pl, pl, offset, len);
 
-    fifo->nb++;
-
     return data;
 }
 
@@ -103,6 +127,9 @@ int avt_pkt_fifo_push_d(AVTPacketFifo *fifo, AVTPktd *p)
     AVTBuffer tmp = pdst->pl;
     memcpy(pdst, p, sizeof(*p));
     pdst->pl = tmp;
+    pdst->hdr = (AVTBuffer){ };
+    avt_buffer_quick_ref(&pdst->hdr, &p->hdr, 0,
+                         avt_buffer_get_data_len(&p->hdr));
     return 0;
 }
 
@@ -118,15 +145,14 @@ int avt_pkt_fifo_push_p(AVTPacketFifo *fifo,
 
 int avt_pkt_fifo_push_refd_d(AVTPacketFifo *fifo, AVTPktd *p)
 {
-    if ((fifo->nb + 1) >= fifo->alloc) {
-        /* Ptwo allocations */
-        if (fifo_resize(fifo, fifo->alloc << 1))
-            return AVT_ERROR(ENOMEM);
-    }
+    AVTPktd *data = fifo_push_slot(fifo);
+    if (!data)
+        return AVT_ERROR(ENOMEM);
 
-    fifo->data[fifo->nb++] = *p;
+    *data = *p;
 
     /* Zero to prevent leaks */
+    p->hdr = (AVTBuffer){ };
     p->pl = (AVTBuffer){ };
 
     return 0;
@@ -135,14 +161,17 @@ int avt_pkt_fifo_push_refd_d(AVTPacketFifo *fifo, AVTPktd *p)
 int avt_pkt_fifo_push_refd_p(AVTPacketFifo *fifo,
                              union AVTPacketData pkt, AVTBuffer *pl)
 {
-    if ((fifo->nb + 1) >= fifo->alloc) {
-        /* Ptwo allocations */
-        if (fifo_resize(fifo, fifo->alloc << 1))
-            return AVT_ERROR(ENOMEM);
-    }
+    AVTPktd *data = fifo_push_slot(fifo);
+    if (!data)
+        return AVT_ERROR(ENOMEM);
 
-    AVTPktd *data = &fifo->data[fifo->nb++];
     data->pkt = pkt;
+    data->hdr_len = 0;
+    data->hdr_off = 0;
+    data->pl_has_hash = false;
+    data->tx_time = 0;
+    data->hdr = (AVTBuffer){ };
+    data->pl = (AVTBuffer){ };
     if (pl) {
         data->pl = *pl;
         /* Zero to prevent leaks */
@@ -154,16 +183,21 @@ int avt_pkt_fifo_push_refd_p(AVTPacketFifo *fifo,
 
 int avt_pkt_fifo_copy(AVTPacketFifo *dst, const AVTPacketFifo *src)
 {
-    if ((dst->nb + src->nb) >= dst->alloc) {
-        if (fifo_resize(dst, dst->alloc + src->nb))
+    if ((dst->nb + src->nb) > dst->alloc) {
+        if (fifo_resize(dst, dst->nb + src->nb))
             return AVT_ERROR(ENOMEM);
     }
 
     for (int i = 0; i < src->nb; i++) {
-        AVTPktd *pdst = &dst->data[dst->nb + i];
-        AVTPktd *psrc = &src->data[i];
-        *psrc = *pdst;
-        avt_buffer_quick_ref(&pdst->pl, &psrc->pl, 0, 0);
+        AVTPktd *pdst = avt_pkt_fifo_get(dst, dst->nb + i);
+        AVTPktd *psrc = avt_pkt_fifo_get(src, i);
+        *pdst = *psrc;
+        pdst->hdr = (AVTBuffer){ };
+        pdst->pl = (AVTBuffer){ };
+        avt_buffer_quick_ref(&pdst->hdr, &psrc->hdr, 0,
+                             avt_buffer_get_data_len(&psrc->hdr));
+        avt_buffer_quick_ref(&pdst->pl, &psrc->pl, 0,
+                             avt_buffer_get_data_len(&psrc->pl));
     }
 
     dst->nb += src->nb;
@@ -173,14 +207,18 @@ int avt_pkt_fifo_copy(AVTPacketFifo *dst, const AVTPacketFifo *src)
 
 int avt_pkt_fifo_move(AVTPacketFifo *dst, AVTPacketFifo *src)
 {
-    if ((dst->nb + src->nb) >= dst->alloc) {
-        if (fifo_resize(dst, dst->alloc + src->nb))
+    if ((dst->nb + src->nb) > dst->alloc) {
+        if (fifo_resize(dst, dst->nb + src->nb))
             return AVT_ERROR(ENOMEM);
     }
 
-    memcpy(&dst->data[dst->nb], src->data, src->nb*sizeof(*dst->data));
+    for (int i = 0; i < src->nb; i++)
+        *avt_pkt_fifo_get(dst, dst->nb + i) = *avt_pkt_fifo_get(src, i);
     dst->nb += src->nb;
-    avt_pkt_fifo_clear(src);
+
+    /* Payloads were moved, rather than ref'd */
+    src->head = 0;
+    src->nb = 0;
 
     return 0;
 }
@@ -191,7 +229,7 @@ int avt_pkt_fifo_peek(const AVTPacketFifo *fifo,
     if (!fifo->nb)
         return AVT_ERROR(ENOENT);
 
-    AVTPktd *data = &fifo->data[0];
+    AVTPktd *data = avt_pkt_fifo_get(fifo, 0);
 
     *pkt = data->pkt;
     if (pl)
@@ -200,19 +238,25 @@ int avt_pkt_fifo_peek(const AVTPacketFifo *fifo,
     return 0;
 }
 
+static inline void fifo_pop_head(AVTPacketFifo *fifo)
+{
+    fifo->head = (fifo->head + 1) & (fifo->alloc - 1);
+    if (!(--fifo->nb))
+        fifo->head = 0;
+}
+
 int avt_pkt_fifo_pop_d(AVTPacketFifo *fifo, AVTPktd *p)
 {
     if (!fifo->nb)
         return AVT_ERROR(ENOENT);
 
-    AVTPktd *data = &fifo->data[0];
+    AVTPktd *data = avt_pkt_fifo_get(fifo, 0);
     if (p)
         *p = *data;
     else
-        avt_buffer_quick_unref(&data->pl);
+        avt_pktd_unref(data);
 
-    fifo->nb--;
-    memmove(fifo->data, fifo->data + 1, fifo->nb*sizeof(*fifo->data));
+    fifo_pop_head(fifo);
 
     return 0;
 }
@@ -223,7 +267,7 @@ int avt_pkt_fifo_pop_p(AVTPacketFifo *fifo,
     if (!fifo->nb)
         return AVT_ERROR(ENOENT);
 
-    AVTPktd *data = &fifo->data[0];
+    AVTPktd *data = avt_pkt_fifo_get(fifo, 0);
     if (pkt)
         *pkt = data->pkt;
 
@@ -231,9 +275,9 @@ int avt_pkt_fifo_pop_p(AVTPacketFifo *fifo,
         *pl = data->pl;
     else
         avt_buffer_quick_unref(&data->pl);
+    avt_buffer_quick_unref(&data->hdr);
 
-    fifo->nb--;
-    memmove(fifo->data, fifo->data + 1, fifo->nb*sizeof(*fifo->data));
+    fifo_pop_head(fifo);
 
     return 0;
 }
@@ -249,8 +293,9 @@ int avt_pkt_fifo_drop(AVTPacketFifo *fifo, unsigned int nb_pkts, size_t ceiling)
 
     if (!nb_pkts) {
         size_t acc = 0;
+        idx = fifo->nb;
         for (int i = 0; i < fifo->nb; i++) {
-            acc += avt_pkt_fifo_get_entry_size(&fifo->data[i]);
+            acc += avt_pkt_fifo_get_entry_size(avt_pkt_fifo_get(fifo, i));
             if (acc > ceiling) {
                 idx = i;
                 break;
@@ -261,12 +306,14 @@ int avt_pkt_fifo_drop(AVTPacketFifo *fifo, unsigned int nb_pkts, size_t ceiling)
             return AVT_ERROR(EINVAL);
     }
 
-    for (; idx < fifo->nb; idx++) {
-        AVTPktd *data = &fifo->data[idx];
-        avt_buffer_quick_unref(&data->pl);
+    for (unsigned int i = idx; i < fifo->nb; i++) {
+        AVTPktd *data = avt_pkt_fifo_get(fifo, i);
+        avt_pktd_unref(data);
     }
 
     fifo->nb = idx;
+    if (!fifo->nb)
+        fifo->head = 0;
 
     return 0;
 }
@@ -276,45 +323,97 @@ size_t avt_pkt_fifo_size(AVTPacketFifo *fifo)
     size_t acc = fifo->nb * sizeof(*fifo->data);
 
     for (int i = 0; i < fifo->nb; i++)
-        acc += avt_buffer_get_data_len(&fifo->data[i].pl);
+        acc += avt_buffer_get_data_len(&avt_pkt_fifo_get(fifo, i)->pl);
 
     return acc;
 }
 
+int avt_hdr_slab_get(AVTHeaderSlab *slab, AVTBuffer *hdr)
+{
+    if (!slab->buf.ctrl || (slab->next == AVT_HDR_SLAB_NB)) {
+        avt_buffer_quick_unref(&slab->buf);
+        uint8_t *data = avt_buffer_quick_alloc(&slab->buf,
+                                               AVT_HDR_SLAB_NB*AVT_MAX_HEADER_LEN);
+        if (!data)
+            return AVT_ERROR(ENOMEM);
+
+        /* Encoders skip over reserved fields */
+        memset(data, 0, AVT_HDR_SLAB_NB*AVT_MAX_HEADER_LEN);
+        slab->next = 0;
+    }
+
+    avt_buffer_quick_ref(hdr, &slab->buf, slab->next*AVT_MAX_HEADER_LEN,
+                         AVT_MAX_HEADER_LEN);
+    slab->next++;
+
+    return 0;
+}
+
+void avt_hdr_slab_free(AVTHeaderSlab *slab)
+{
+    avt_buffer_quick_unref(&slab->buf);
+    slab->next = 0;
+}
+
+int avt_sliding_win_init(AVTSlidingWinCtx *ctx, uint32_t max_entries,
+                         int64_t period)
+{
+    const uint32_t alloc = stdc_bit_ceil(AVT_MAX(max_entries, 1));
+
+    struct AVTSlidingWinEntry *entries = avt_reallocarray(ctx->entries, alloc,
+                                                          sizeof(*entries));
+    if (!entries)
+        return AVT_ERROR(ENOMEM);
+
+    ctx->entries = entries;
+    ctx->mask = alloc - 1;
+    ctx->head = 0;
+    ctx->nb = 0;
+    ctx->sum = 0;
+    ctx->period = period;
+
+    return 0;
+}
+
 int64_t avt_sliding_win(AVTSlidingWinCtx *ctx, int64_t val, int64_t ts,
-                        AVTRational tb, int64_t period, bool do_avg)
+                        bool do_avg)
 {
-    struct AVTSlidingWinEntry *top, *last;
-    int64_t sum = 0;
-
-    if (!ctx->num_entries)
-        goto add;
-
-    for (int i = 0; i < ctx->num_entries; i++) {
-        last = &ctx->entries[i];
-        int64_t test = avt_add_stable(last->tb, last->ts, tb, period);
-
-        /* If the number of values is about to overread, or the value is
-         * too old to consider, throw it away. */
-        if (((ctx->num_entries + 1) > AVT_SLIDING_WINDOW_MAX_ENTRIES) ||
-            avt_compare_ts(test, last->tb, ts, tb) < 0) {
-            ctx->num_entries--;
-            memmove(last, last + 1, sizeof(*last) * ctx->num_entries);
-        }
+    struct AVTSlidingWinEntry *e;
+
+    /* Expire values which are too old to consider. Each value gets
+     * added and removed once, so this is amortized constant time. */
+    while (ctx->nb) {
+        e = &ctx->entries[ctx->head];
+        if ((e->ts + ctx->period) >= ts)
+            break;
+        ctx->sum -= e->val;
+        ctx->head = (ctx->head + 1) & ctx->mask;
+        ctx->nb--;
+    }
+
+    if (ctx->nb > ctx->mask) {
+        /* Out of space, merge into the most recent entry. Its timestamp
+         * gets moved forward, so the sum is never underestimated. */
+        e = &ctx->entries[(ctx->head + ctx->nb - 1) & ctx->mask];
+        e->val += val;
+        e->ts = ts;
+    } else {
+        e = &ctx->entries[(ctx->head + ctx->nb) & ctx->mask];
+        e->val = val;
+        e->ts = ts;
+        ctx->nb++;
     }
 
-add:
-    top = &ctx->entries[ctx->num_entries++];
-    top->val = val;
-    top->ts = ts;
-    top->tb  = tb;
+    ctx->sum += val;
 
-    /* Calculate the average */
-    for (int i = 0; i < ctx->num_entries; i++)
-        sum += ctx->entries[i].val;
+    if (do_avg)
+        return ctx->sum / ctx->nb;
 
-    if (do_avg && ctx->num_entries)
-        sum /= ctx->num_entries;
+    return ctx->sum;
+}
 
-    return sum;
+void avt_sliding_win_free(AVTSlidingWinCtx *ctx)
+{
+    free(ctx->entries);
+    memset(ctx, 0, sizeof(*ctx));
 }
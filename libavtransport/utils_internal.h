@@ -72,13 +72,33 @@ static inline int avt_ascii_to_int(int c)
 #define avt_hamming_dist(a, b) \
     stdc_count_ones((a) ^ (b))
 
-/* Zero (usually) alloc FIFO. Payload is ref'd, and leaves with a ref. */
+/* Zero (usually) alloc FIFO. Payload is ref'd, and leaves with a ref.
+ * Packets are kept in a power-of-two ring buffer, so they are only
+ * contiguous in memory up to the point the buffer wraps around. */
 typedef struct AVTPacketFifo {
     AVTPktd *data;
+    unsigned int head; /* Index of the oldest packet in data */
     unsigned int nb;
     unsigned int alloc;
 } AVTPacketFifo;
 
+/* Get a packet from the FIFO, 0 being the oldest */
+static inline AVTPktd *avt_pkt_fifo_get(const AVTPacketFifo *fifo,
+                                        unsigned int idx)
+{
+    return &fifo->data[(fifo->head + idx) & (fifo->alloc - 1)];
+}
+
+/* Get a run of packets, starting at idx, which are contiguous in memory.
+ * Returns the number of packets in the run. */
+static inline unsigned int avt_pkt_fifo_span(const AVTPacketFifo *fifo,
+                                             unsigned int idx, AVTPktd **p)
+{
+    const unsigned int start = (fifo->head + idx) & (fifo->alloc - 1);
+    *p = &fifo->data[start];
+    return AVT_MIN(fifo->nb - idx, fifo->alloc - start);
+}
+
 /* Push a packet to the FIFO */
 int avt_pkt_fifo_push_d(AVTPacketFifo *fifo, AVTPktd *p);
 int avt_pkt_fifo_push_p(AVTPacketFifo *fifo,
@@ -139,27 +159,57 @@ void avt_pkt_fifo_clear(AVTPacketFifo *fifo);
 /* Free all resources in/for a fifo */
 void avt_pkt_fifo_free(AVTPacketFifo *fifo);
 
-/* Sliding window */
-#define AVT_SLIDING_WINDOW_MAX_ENTRIES (1024*512)
+/* Number of headers per slab */
+#define AVT_HDR_SLAB_NB 64
+
+/* Encoded packet headers are allocated in slabs, rather than inline in
+ * packets. A slab is freed once no packet references any header in it. */
+typedef struct AVTHeaderSlab {
+    AVTBuffer buf;
+    unsigned int next;
+} AVTHeaderSlab;
 
+/* Get a reference to an unused AVT_MAX_HEADER_LEN sized header */
+int avt_hdr_slab_get(AVTHeaderSlab *slab, AVTBuffer *hdr);
+
+/* Release the slab. Headers given out remain valid until unref'd. */
+void avt_hdr_slab_free(AVTHeaderSlab *slab);
+
+/* Sliding window, as a ring buffer with a running sum */
 typedef struct AVTSlidingWinCtx {
-    int num_entries;
-    PACKED(struct AVTSlidingWinEntry {
+    struct AVTSlidingWinEntry {
         int64_t val;
         int64_t ts;
-        AVTRational tb;
-    }) entries[AVT_SLIDING_WINDOW_MAX_ENTRIES];
+    } *entries;
+    uint32_t mask;   /* Number of allocated entries - 1 */
+    uint32_t head;   /* Oldest entry */
+    uint32_t nb;
+
+    int64_t sum;
+    int64_t period;
 } AVTSlidingWinCtx;
 
+/*
+ * Initialize a sliding window.
+ * max_entries is the capacity, rounded up to a power of two. Once full,
+ *   new values get merged into the most recent entry.
+ * period is the duration over which to average or sum up, in the
+ *   timebase of the timestamps given to avt_sliding_win()
+ */
+int avt_sliding_win_init(AVTSlidingWinCtx *ctx, uint32_t max_entries,
+                         int64_t period);
+
 /*
  * Run a sliding window calculation and produce an output.
  * val is the value for which to average or sum
- * ts is the timestamp for the value
- * tb is the timebase for the timestamp of the value, as well as the period
- * period is the value in tb units over which to average or sum up
+ * ts is the timestamp for the value. All timestamps given to a window must
+ *   share a timebase, and must not decrease.
  * do_avg specifies that instead of summing, an average is to be performed
  */
 int64_t avt_sliding_win(AVTSlidingWinCtx *ctx, int64_t val, int64_t ts,
-                        AVTRational tb, int64_t period, bool do_avg);
+                        bool do_avg);
+
+/* Free all resources of a sliding window */
+void avt_sliding_win_free(AVTSlidingWinCtx *ctx);
 
 #endif /* AVTRANSPORT_UTILS_INTERNAL_H */
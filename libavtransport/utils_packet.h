@@ -40,7 +40,7 @@ static inline union AVTPacketData avt_packet_create_segment(AVTPktd *p,
 {
     switch (p->pkt.desc) {
     case AVT_PKT_STREAM_DATA:
-        uint8_t *os = &p->hdr[p->hdr_off + (seq % 7)*4];
+        uint8_t *os = &p->hdr.data[p->hdr_off + (seq % 7)*4];
         return AVT_GENERIC_SEGMENT_HDR(AVT_PKT_STREAM_DATA_SEGMENT,
             .global_seq = seq,
             .stream_id = p->pkt.stream_id,
@@ -56,40 +56,42 @@ static inline union AVTPacketData avt_packet_create_segment(AVTPktd *p,
     }
 }
 
-static inline void avt_packet_encode_header(AVTPktd *p)
+/* Encode a packet's header. With a batch given, the LDPC parity is only
+ * computed once the batch is encoded. */
+static inline void avt_packet_encode_header_batch(AVTPktd *p, AVTLDPCBatch *ldpc)
 {
-    AVTBytestream bs = avt_bs_init(&p->hdr[p->hdr_off], (AVT_MAX_HEADER_LEN - p->hdr_off));
+    AVTBytestream bs = avt_bs_init(&p->hdr.data[p->hdr_off], (AVT_MAX_HEADER_LEN - p->hdr_off));
 
     switch (p->pkt.desc) {
     case AVT_PKT_SESSION_START:
-        avt_encode_session_start(&bs, p->pkt.session_start);
+        avt_encode_session_start_batch(&bs, p->pkt.session_start, ldpc);
         break;
     case AVT_PKT_STREAM_REGISTRATION:
-        avt_encode_stream_registration(&bs, p->pkt.stream_registration);
+        avt_encode_stream_registration_batch(&bs, p->pkt.stream_registration, ldpc);
         break;
     case AVT_PKT_VIDEO_INFO:
-        avt_encode_video_info(&bs, p->pkt.video_info);
+        avt_encode_video_info_batch(&bs, p->pkt.video_info, ldpc);
         break;
     case AVT_PKT_LUT_ICC:
-        avt_encode_lut_icc(&bs, p->pkt.lut_icc);
+        avt_encode_lut_icc_batch(&bs, p->pkt.lut_icc, ldpc);
         break;
     case AVT_PKT_FONT_DATA:
-        avt_encode_font_data(&bs, p->pkt.font_data);
+        avt_encode_font_data_batch(&bs, p->pkt.font_data, ldpc);
         break;
     case AVT_PKT_STREAM_DATA:
-        avt_encode_stream_data(&bs, p->pkt.stream_data);
+        avt_encode_stream_data_batch(&bs, p->pkt.stream_data, ldpc);
         break;
     case AVT_PKT_USER_DATA:
-        avt_encode_user_data(&bs, p->pkt.user_data);
+        avt_encode_user_data_batch(&bs, p->pkt.user_data, ldpc);
         break;
     case AVT_PKT_STREAM_INDEX:
-        avt_encode_stream_index(&bs, p->pkt.stream_index);
+        avt_encode_stream_index_batch(&bs, p->pkt.stream_index, ldpc);
         break;
     case AVT_PKT_METADATA_SEGMENT:    [[fallthrough]];
     case AVT_PKT_FONT_DATA_SEGMENT:   [[fallthrough]];
     case AVT_PKT_STREAM_DATA_SEGMENT: [[fallthrough]];
     case AVT_PKT_USER_DATA_SEGMENT:
-        avt_encode_generic_segment(&bs, p->pkt.generic_segment);
+        avt_encode_generic_segment_batch(&bs, p->pkt.generic_segment, ldpc);
         break;
     default:
         avt_assert1(0);
@@ -99,6 +101,11 @@ static inline void avt_packet_encode_header(AVTPktd *p)
     p->hdr_len = avt_bs_offs(&bs);
 }
 
+static inline void avt_packet_encode_header(AVTPktd *p)
+{
+    avt_packet_encode_header_batch(p, NULL);
+}
+
 #define RENAME(x) x ## _d
 #define GET(x) p->pkt.x
 #define TYPE AVTPktd *
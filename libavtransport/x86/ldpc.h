@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2024, Lynne
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AVTRANSPORT_X86_LDPC_H
+#define AVTRANSPORT_X86_LDPC_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#if defined(CONFIG_HAVE_X86_ASM) && (defined(__x86_64__) || defined(_M_X64))
+#define LDPC_X86
+
+void avt_ldpc_encode_sse4(uint8_t *pkt, const uint64_t *H,
+                          int message_bytes, int nb_blocks);
+void avt_ldpc_encode_avx2(uint8_t *pkt, const uint64_t *H,
+                          int message_bytes, int nb_blocks);
+void avt_ldpc_encode_avx512(uint8_t *pkt, const uint64_t *H,
+                            int message_bytes, int nb_blocks);
+void avt_ldpc_encode_x4_avx512(uint8_t *const *pkt, const uint64_t *H,
+                               int message_bytes, int nb_blocks);
+
+int avt_ldpc_syndrome_sse4(uint64_t *syn, const uint8_t *pkt,
+                           const uint64_t *H, int message_bytes,
+                           int nb_blocks);
+int avt_ldpc_syndrome_avx2(uint64_t *syn, const uint8_t *pkt,
+                           const uint64_t *H, int message_bytes,
+                           int nb_blocks);
+#endif
+
+#endif /* AVTRANSPORT_X86_LDPC_H */
@@ -0,0 +1,135 @@
+;*********************************************************************************
+;* Copyright © 2024, Lynne
+;* All rights reserved.
+;*
+;* Redistribution and use in source and binary forms, with or without
+;* modification, are permitted provided that the following conditions are met:
+;*
+;* 1. Redistributions of source code must retain the above copyright notice, this
+;*    list of conditions and the following disclaimer.
+;*
+;* 2. Redistributions in binary form must reproduce the above copyright notice,
+;*    this list of conditions and the following disclaimer in the documentation
+;*    and/or other materials provided with the distribution.
+;*
+;* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+;* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+;* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+;* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+;* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+;* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+;* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+;* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+;* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+;* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+;*********************************************************************************
+
+%include "x86/config.asm"
+%include "x86/x86inc.asm"
+
+SECTION_RODATA 32
+
+; Bits of a byte, first to last, one per quadword
+bit_masks: dq 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01
+
+SECTION .text
+
+%if ARCH_X86_64
+
+;-----------------------------------------------------------------------------
+; int ldpc_syndrome(uint64_t *syn, const uint8_t *pkt, const uint64_t *H,
+;                   int message_bytes, int nb_blocks)
+;
+; Computes the syndrome for each block of 64 checks. Each message bit
+; is expanded into a mask, which selects its column of the H-matrix.
+; Returns non-zero if any check failed. The H-matrix must be 16-byte aligned.
+;-----------------------------------------------------------------------------
+%macro LDPC_SYNDROME_FN 0
+cglobal ldpc_syndrome, 5, 10, 8, syn, pkt, H, msg, blocks, cur, end, par, err, tmp
+    movsxdifnidn msgq, msgd
+    movsxdifnidn blocksq, blocksd
+    lea endq, [pktq + msgq]
+    mov parq, endq
+    mov msgq, blocksq
+    shl msgq, 9 ; Size of the identity columns to skip
+    xor errd, errd
+
+    mova m4, [bit_masks + 0*mmsize]
+    mova m5, [bit_masks + 1*mmsize]
+%if mmsize == 16
+    mova m6, [bit_masks + 2*mmsize]
+    mova m7, [bit_masks + 3*mmsize]
+%endif
+
+.block:
+    pxor m0, m0
+    mov curq, pktq
+
+.byte:
+    movzx tmpd, byte [curq]
+    movd xm1, tmpd
+%if cpuflag(avx2)
+    vpbroadcastq m1, xm1
+%else
+    punpcklqdq m1, m1
+%endif
+
+    pand m2, m1, m4
+    pand m3, m1, m5
+    pcmpeqq m2, m4
+    pcmpeqq m3, m5
+    pand m2, [Hq + 0*mmsize]
+    pand m3, [Hq + 1*mmsize]
+    pxor m0, m2
+    pxor m0, m3
+%if mmsize == 16
+    pand m2, m1, m6
+    pand m3, m1, m7
+    pcmpeqq m2, m6
+    pcmpeqq m3, m7
+    pand m2, [Hq + 2*mmsize]
+    pand m3, [Hq + 3*mmsize]
+    pxor m0, m2
+    pxor m0, m3
+%endif
+
+    add Hq, 64
+    inc curq
+    cmp curq, endq
+    jl .byte
+
+    ; Sum up the partial parities
+%if mmsize == 32
+    vextracti128 xm1, m0, 1
+    pxor xm0, xm1
+%endif
+    pshufd xm1, xm0, 0x4E
+    pxor xm0, xm1
+    movq tmpq, xm0
+
+    ; Check against the received parity
+    mov curq, [parq]
+    bswap curq
+    xor tmpq, curq
+    mov [synq], tmpq
+    or errq, tmpq
+
+    add Hq, msgq
+    add synq, 8
+    add parq, 8
+    dec blocksq
+    jg .block
+
+    xor eax, eax
+    test errq, errq
+    setnz al
+    RET
+%endmacro
+
+INIT_XMM sse4
+LDPC_SYNDROME_FN
+
+INIT_YMM avx2
+LDPC_SYNDROME_FN
+
+%endif ; ARCH_X86_64
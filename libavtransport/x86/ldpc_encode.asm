@@ -27,6 +27,195 @@
 %include "x86/config.asm"
 %include "x86/x86inc.asm"
 
-SECTION_RODATA
+SECTION_RODATA 64
+
+; Bits of a byte, first to last, one per quadword
+bit_masks: dq 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01
+
+; Bytes with their bits reversed, giving a mask register of the columns
+bit_rev:
+%assign i 0
+%rep 256
+    db ((i & 0x01) << 7) | ((i & 0x02) << 5) | ((i & 0x04) << 3) | ((i & 0x08) << 1) | \
+       ((i & 0x10) >> 1) | ((i & 0x20) >> 3) | ((i & 0x40) >> 5) | ((i & 0x80) >> 7)
+%assign i i+1
+%endrep
 
 SECTION .text
+
+%if ARCH_X86_64
+
+;-----------------------------------------------------------------------------
+; void ldpc_encode(uint8_t *pkt, const uint64_t *H,
+;                  int message_bytes, int nb_blocks)
+;
+; Computes 64 parity bits at a time, and writes them after the message.
+; Each message bit is expanded into a mask, which selects its column of
+; the H-matrix. The H-matrix must be aligned to the vector size.
+;-----------------------------------------------------------------------------
+%macro LDPC_ENCODE_FN 0
+cglobal ldpc_encode, 4, 9, 8, pkt, H, msg, blocks, cur, end, dst, tmp, rev
+    movsxdifnidn msgq, msgd
+    movsxdifnidn blocksq, blocksd
+    lea endq, [pktq + msgq]
+    mov dstq, endq
+    mov msgq, blocksq
+    shl msgq, 9 ; Size of the identity columns to skip
+
+%if mmsize == 64
+    lea revq, [bit_rev]
+%else
+    mova m4, [bit_masks + 0*mmsize]
+    mova m5, [bit_masks + 1*mmsize]
+%endif
+%if mmsize == 16
+    mova m6, [bit_masks + 2*mmsize]
+    mova m7, [bit_masks + 3*mmsize]
+%endif
+
+.block:
+    pxor m0, m0
+    mov curq, pktq
+
+.byte:
+    movzx tmpd, byte [curq]
+%if mmsize == 64
+    ; One mask bit per column, XOR the selected ones in directly
+    movzx tmpd, byte [revq + tmpq]
+    kmovb k1, tmpd
+    vpxorq m0{k1}, m0, [Hq]
+%else
+    movd xm1, tmpd
+%if cpuflag(avx2)
+    vpbroadcastq m1, xm1
+%else
+    punpcklqdq m1, m1
+%endif
+
+    pand m2, m1, m4
+    pand m3, m1, m5
+    pcmpeqq m2, m4
+    pcmpeqq m3, m5
+    pand m2, [Hq + 0*mmsize]
+    pand m3, [Hq + 1*mmsize]
+    pxor m0, m2
+    pxor m0, m3
+%if mmsize == 16
+    pand m2, m1, m6
+    pand m3, m1, m7
+    pcmpeqq m2, m6
+    pcmpeqq m3, m7
+    pand m2, [Hq + 2*mmsize]
+    pand m3, [Hq + 3*mmsize]
+    pxor m0, m2
+    pxor m0, m3
+%endif
+%endif
+
+    add Hq, 64
+    inc curq
+    cmp curq, endq
+    jl .byte
+
+    ; Sum up the partial parities
+%if mmsize == 64
+    vextracti64x4 ym1, m0, 1
+    pxor ym0, ym1
+%endif
+%if mmsize >= 32
+    vextracti128 xm1, ym0, 1
+    pxor xm0, xm1
+%endif
+    pshufd xm1, xm0, 0x4E
+    pxor xm0, xm1
+    movq tmpq, xm0
+
+    ; Write out, in bytestream order
+    bswap tmpq
+    mov [dstq], tmpq
+
+    add Hq, msgq
+    add dstq, 8
+    dec blocksq
+    jg .block
+    RET
+%endmacro
+
+INIT_XMM sse4
+LDPC_ENCODE_FN
+
+INIT_YMM avx2
+LDPC_ENCODE_FN
+
+INIT_ZMM avx512
+LDPC_ENCODE_FN
+
+;-----------------------------------------------------------------------------
+; void ldpc_encode_x4(uint8_t *const *pkt, const uint64_t *H,
+;                     int message_bytes, int nb_blocks)
+;
+; Encodes 4 messages at once, loading each column of the H-matrix once.
+;-----------------------------------------------------------------------------
+%macro LDPC_X4_BYTE 3 ; accumulator, message pointer, mask register
+    movzx tmpd, byte [%2 + offq]
+    movzx tmpd, byte [revq + tmpq]
+    kmovb %3, tmpd
+    vpxorq m%1{%3}, m%1, m4
+%endmacro
+
+%macro LDPC_X4_STORE 2 ; accumulator, message pointer
+    vextracti64x4 ym5, m%1, 1
+    pxor ym5, ym%1
+    vextracti128 xm6, ym5, 1
+    pxor xm5, xm6
+    pshufd xm6, xm5, 0x4E
+    pxor xm5, xm6
+    movq tmpq, xm5
+    bswap tmpq
+    mov [%2 + dstq], tmpq
+%endmacro
+
+INIT_ZMM avx512
+cglobal ldpc_encode_x4, 4, 12, 8, pkts, H, msg, blocks, p0, p1, p2, p3, dst, off, tmp, rev
+    movsxdifnidn msgq, msgd
+    movsxdifnidn blocksq, blocksd
+    mov p0q, [pktsq + 0*8]
+    mov p1q, [pktsq + 1*8]
+    mov p2q, [pktsq + 2*8]
+    mov p3q, [pktsq + 3*8]
+    lea revq, [bit_rev]
+    mov dstq, msgq
+    mov pktsq, blocksq
+    shl pktsq, 9 ; Size of the identity columns to skip
+
+.block:
+    pxor m0, m0
+    pxor m1, m1
+    pxor m2, m2
+    pxor m3, m3
+    xor offq, offq
+
+.byte:
+    mova m4, [Hq]
+    LDPC_X4_BYTE 0, p0q, k1
+    LDPC_X4_BYTE 1, p1q, k2
+    LDPC_X4_BYTE 2, p2q, k3
+    LDPC_X4_BYTE 3, p3q, k4
+
+    add Hq, 64
+    inc offq
+    cmp offq, msgq
+    jl .byte
+
+    LDPC_X4_STORE 0, p0q
+    LDPC_X4_STORE 1, p1q
+    LDPC_X4_STORE 2, p2q
+    LDPC_X4_STORE 3, p3q
+
+    add Hq, pktsq
+    add dstq, 8
+    dec blocksq
+    jg .block
+    RET
+
+%endif ; ARCH_X86_64